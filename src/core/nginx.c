@@ -1244,6 +1244,7 @@ ngx_core_module_create_conf(ngx_cycle_t *cycle)
      *     ccf->oldpid = NULL;
      *     ccf->priority = 0;
      *     ccf->cpu_affinity_auto = 0;
+     *     ccf->cpu_affinity_numa = 0;
      *     ccf->cpu_affinity_n = 0;
      *     ccf->cpu_affinity = NULL;
      */
@@ -1288,6 +1289,7 @@ ngx_core_module_init_conf(ngx_cycle_t *cycle, void *conf)
 #if (NGX_HAVE_CPU_AFFINITY)
 
     if (!ccf->cpu_affinity_auto
+        && !ccf->cpu_affinity_numa
         && ccf->cpu_affinity_n
         && ccf->cpu_affinity_n != 1
         && ccf->cpu_affinity_n != (ngx_uint_t) ccf->worker_processes)
@@ -1555,6 +1557,49 @@ ngx_set_cpu_affinity(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         return "is duplicate";
     }
 
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "numa") == 0) {
+
+        if (cf->args->nelts > 2) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "invalid number of arguments in "
+                               "\"worker_cpu_affinity\" directive");
+            return NGX_CONF_ERROR;
+        }
+
+#if (NGX_HAVE_NUMA)
+
+        if (ngx_numa_nodes == 0) {
+            ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                               "NUMA topology is not available, "
+                               "\"worker_cpu_affinity numa\" ignored");
+            return NGX_CONF_OK;
+        }
+
+        mask = ngx_palloc(cf->pool, ngx_numa_nodes * sizeof(ngx_cpuset_t));
+        if (mask == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        for (i = 0; i < ngx_numa_nodes; i++) {
+            mask[i] = *ngx_numa_cpus(i);
+        }
+
+        ccf->cpu_affinity_numa = 1;
+        ccf->cpu_affinity_n = ngx_numa_nodes;
+        ccf->cpu_affinity = mask;
+
+#else
+
+        ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                           "\"worker_cpu_affinity numa\" is not supported "
+                           "on this platform, ignored");
+#endif
+
+        return NGX_CONF_OK;
+    }
+
     mask = ngx_palloc(cf->pool, (cf->args->nelts - 1) * sizeof(ngx_cpuset_t));
     if (mask == NULL) {
         return NGX_CONF_ERROR;
@@ -1563,8 +1608,6 @@ ngx_set_cpu_affinity(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     ccf->cpu_affinity_n = cf->args->nelts - 1;
     ccf->cpu_affinity = mask;
 
-    value = cf->args->elts;
-
     if (ngx_strcmp(value[1].data, "auto") == 0) {
 
         if (cf->args->nelts > 3) {
@@ -1639,7 +1682,7 @@ ngx_set_cpu_affinity(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 
 
 ngx_cpuset_t *
-ngx_get_cpu_affinity(ngx_uint_t n)
+ngx_get_cpu_affinity(ngx_cycle_t *cycle, ngx_uint_t n)
 {
 #if (NGX_HAVE_CPU_AFFINITY)
     ngx_uint_t        i, j;
@@ -1648,8 +1691,7 @@ ngx_get_cpu_affinity(ngx_uint_t n)
 
     static ngx_cpuset_t  result;
 
-    ccf = (ngx_core_conf_t *) ngx_get_conf(ngx_cycle->conf_ctx,
-                                           ngx_core_module);
+    ccf = (ngx_core_conf_t *) ngx_get_conf(cycle->conf_ctx, ngx_core_module);
 
     if (ccf->cpu_affinity == NULL) {
         return NULL;
@@ -1678,6 +1720,11 @@ ngx_get_cpu_affinity(ngx_uint_t n)
         return &result;
     }
 
+    if (ccf->cpu_affinity_numa) {
+        /* workers are spread over nodes in turn */
+        return &ccf->cpu_affinity[n % ccf->cpu_affinity_n];
+    }
+
     if (ccf->cpu_affinity_n > n) {
         return &ccf->cpu_affinity[n];
     }
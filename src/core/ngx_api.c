@@ -38,6 +38,17 @@ static ngx_int_t ngx_api_angie_config_files_handler(ngx_api_entry_data_t data,
 static ngx_int_t ngx_api_angie_config_files_iter(ngx_api_iter_ctx_t *ictx,
     ngx_api_ctx_t *actx);
 
+#if (NGX_HAVE_NUMA && NGX_HAVE_CPU_AFFINITY)
+static ngx_int_t ngx_api_angie_numa_handler(ngx_api_entry_data_t data,
+    ngx_api_ctx_t *actx, void *ctx);
+static ngx_int_t ngx_api_angie_numa_nodes_handler(ngx_api_entry_data_t data,
+    ngx_api_ctx_t *actx, void *ctx);
+static ngx_int_t ngx_api_angie_numa_workers_handler(ngx_api_entry_data_t data,
+    ngx_api_ctx_t *actx, void *ctx);
+static ngx_int_t ngx_api_angie_numa_workers_iter(ngx_api_iter_ctx_t *ictx,
+    ngx_api_ctx_t *actx);
+#endif
+
 static ngx_int_t ngx_api_connections_dropped_handler(ngx_api_entry_data_t data,
     ngx_api_ctx_t *actx, void *ctx);
 static ngx_int_t ngx_api_connections_active_handler(ngx_api_entry_data_t data,
@@ -69,6 +80,26 @@ static ngx_str_t  ngx_api_angie_build = ngx_string(NGX_BUILD);
 #endif
 
 
+#if (NGX_HAVE_NUMA && NGX_HAVE_CPU_AFFINITY)
+
+static ngx_api_entry_t  ngx_api_angie_numa_entries[] = {
+
+    {
+        .name      = ngx_string("nodes"),
+        .handler   = ngx_api_angie_numa_nodes_handler,
+    },
+
+    {
+        .name      = ngx_string("workers"),
+        .handler   = ngx_api_angie_numa_workers_handler,
+    },
+
+    ngx_api_null_entry
+};
+
+#endif
+
+
 static ngx_api_entry_t  ngx_api_angie_entries[] = {
 
     {
@@ -111,6 +142,32 @@ static ngx_api_entry_t  ngx_api_angie_entries[] = {
         .handler   = ngx_api_angie_config_files_handler,
     },
 
+#if (NGX_HAVE_NUMA && NGX_HAVE_CPU_AFFINITY)
+    {
+        .name      = ngx_string("numa"),
+        .handler   = ngx_api_angie_numa_handler,
+        .data.ents = ngx_api_angie_numa_entries
+    },
+#endif
+
+    ngx_api_null_entry
+};
+
+
+static ngx_api_entry_t  ngx_api_connections_udp_entries[] = {
+
+    {
+        .name      = ngx_string("batches"),
+        .handler   = ngx_api_atomic_pp_handler,
+        .data.atpp = &ngx_stat_udp_batches
+    },
+
+    {
+        .name      = ngx_string("datagrams"),
+        .handler   = ngx_api_atomic_pp_handler,
+        .data.atpp = &ngx_stat_udp_datagrams
+    },
+
     ngx_api_null_entry
 };
 
@@ -139,6 +196,18 @@ static ngx_api_entry_t  ngx_api_connections_entries[] = {
         .data.atpp = &ngx_stat_waiting
     },
 
+    {
+        .name      = ngx_string("idle_memory"),
+        .handler   = ngx_api_atomic_pp_handler,
+        .data.atpp = &ngx_stat_idle_memory
+    },
+
+    {
+        .name      = ngx_string("udp"),
+        .handler   = ngx_api_object_handler,
+        .data.ents = ngx_api_connections_udp_entries
+    },
+
     ngx_api_null_entry
 };
 
@@ -521,6 +590,99 @@ ngx_api_angie_config_files_iter(ngx_api_iter_ctx_t *ictx, ngx_api_ctx_t *actx)
 }
 
 
+#if (NGX_HAVE_NUMA && NGX_HAVE_CPU_AFFINITY)
+
+static ngx_int_t
+ngx_api_angie_numa_handler(ngx_api_entry_data_t data, ngx_api_ctx_t *actx,
+    void *ctx)
+{
+    if (ngx_numa_nodes == 0) {
+        return NGX_DECLINED;
+    }
+
+    return ngx_api_object_handler(data, actx, ctx);
+}
+
+
+static ngx_int_t
+ngx_api_angie_numa_nodes_handler(ngx_api_entry_data_t data,
+    ngx_api_ctx_t *actx, void *ctx)
+{
+    data.num = ngx_numa_nodes;
+
+    return ngx_api_number_handler(data, actx, ctx);
+}
+
+
+static ngx_int_t
+ngx_api_angie_numa_workers_handler(ngx_api_entry_data_t data,
+    ngx_api_ctx_t *actx, void *ctx)
+{
+    ngx_uint_t          n;
+    ngx_api_iter_ctx_t  ictx;
+
+    n = 0;
+
+    ictx.entry.handler = ngx_api_number_handler;
+    ictx.ctx = NULL;
+    ictx.elts = &n;
+
+    return ngx_api_object_iterate(ngx_api_angie_numa_workers_iter, &ictx,
+                                  actx);
+}
+
+
+static ngx_int_t
+ngx_api_angie_numa_workers_iter(ngx_api_iter_ctx_t *ictx, ngx_api_ctx_t *actx)
+{
+    ngx_int_t         node;
+    ngx_str_t        *name;
+    ngx_uint_t       *n;
+    ngx_cpuset_t     *mask;
+    ngx_core_conf_t  *ccf;
+
+    n = ictx->elts;
+
+    ccf = (ngx_core_conf_t *) ngx_get_conf(ngx_cycle->conf_ctx,
+                                           ngx_core_module);
+
+    /* only workers confined to a single node are listed */
+
+    for ( ;; ) {
+        if (*n >= (ngx_uint_t) ccf->worker_processes) {
+            return NGX_DECLINED;
+        }
+
+        mask = ngx_get_cpu_affinity((ngx_cycle_t *) ngx_cycle, (*n)++);
+
+        if (mask == NULL) {
+            return NGX_DECLINED;
+        }
+
+        node = ngx_numa_cpuset_node(mask);
+
+        if (node != NGX_DECLINED) {
+            break;
+        }
+    }
+
+    name = &ictx->entry.name;
+
+    name->data = ngx_pnalloc(actx->pool, NGX_INT_T_LEN);
+    if (name->data == NULL) {
+        return NGX_ERROR;
+    }
+
+    name->len = ngx_sprintf(name->data, "%ui", *n - 1) - name->data;
+
+    ictx->entry.data.num = node;
+
+    return NGX_OK;
+}
+
+#endif
+
+
 static ngx_int_t
 ngx_api_connections_dropped_handler(ngx_api_entry_data_t data,
     ngx_api_ctx_t *actx, void *ctx)
@@ -12,6 +12,8 @@
 #define NGX_CONF_BUFFER  4096
 
 static ngx_int_t ngx_conf_add_dump(ngx_conf_t *cf, ngx_str_t *filename);
+static ngx_int_t ngx_conf_parse_zone_numa(ngx_conf_t *cf,
+    ngx_shm_zone_params_t *zp, ngx_str_t *value);
 static ngx_int_t ngx_conf_handler(ngx_conf_t *cf, ngx_int_t last);
 static ngx_int_t ngx_conf_read_token(ngx_conf_t *cf);
 static void ngx_conf_flush_files(ngx_cycle_t *cycle);
@@ -1595,6 +1597,21 @@ ngx_conf_parse_zone_spec(ngx_conf_t *cf, ngx_shm_zone_params_t *zp,
             continue;
         }
 
+        if (ngx_strncmp(param.data, "numa=", 5) == 0) {
+
+            if (!zp->numa_aware) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "this zone cannot have a NUMA policy");
+                return NGX_ERROR;
+            }
+
+            if (ngx_conf_parse_zone_numa(cf, zp, &param) != NGX_OK) {
+                return NGX_ERROR;
+            }
+
+            continue;
+        }
+
     bad_param:
 
         ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
@@ -1616,3 +1633,57 @@ ngx_conf_parse_zone_spec(ngx_conf_t *cf, ngx_shm_zone_params_t *zp,
 
     return NGX_OK;
 }
+
+
+static ngx_int_t
+ngx_conf_parse_zone_numa(ngx_conf_t *cf, ngx_shm_zone_params_t *zp,
+    ngx_str_t *value)
+{
+#if (NGX_HAVE_NUMA)
+    ngx_int_t  node;
+
+    value->data += 5;
+    value->len -= 5;
+
+    if (value->len == 10
+        && ngx_strncmp(value->data, "interleave", 10) == 0)
+    {
+        zp->numa = NGX_NUMA_INTERLEAVE;
+        return NGX_OK;
+    }
+
+    node = ngx_atoi(value->data, value->len);
+
+    if (node == NGX_ERROR) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid zone numa policy \"%V\"", value);
+        return NGX_ERROR;
+    }
+
+    if (node >= NGX_NUMA_MAX_NODES) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "NUMA node must be less than %d",
+                           NGX_NUMA_MAX_NODES);
+        return NGX_ERROR;
+    }
+
+    if (ngx_numa_nodes && !ngx_numa_node_exists(node)) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "NUMA node %i does not exist", node);
+        return NGX_ERROR;
+    }
+
+    zp->numa = NGX_NUMA_BIND;
+    zp->numa_node = node;
+
+    return NGX_OK;
+
+#else
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "zone numa policies are not supported "
+                       "on this platform");
+    return NGX_ERROR;
+
+#endif
+}
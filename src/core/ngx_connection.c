@@ -14,6 +14,9 @@ ngx_os_io_t  ngx_io;
 
 
 static void ngx_drain_connections(ngx_cycle_t *cycle);
+#if (NGX_STAT_STUB)
+static size_t ngx_connection_idle_memory(ngx_connection_t *c);
+#endif
 
 
 ngx_listening_t *
@@ -1350,6 +1353,9 @@ ngx_reusable_connection(ngx_connection_t *c, ngx_uint_t reusable)
 
 #if (NGX_STAT_STUB)
         (void) ngx_atomic_fetch_add(ngx_stat_waiting, -1);
+        (void) ngx_atomic_fetch_add(ngx_stat_idle_memory,
+                                    -(ngx_atomic_int_t)
+                                     ngx_connection_idle_memory(c));
 #endif
     }
 
@@ -1364,11 +1370,38 @@ ngx_reusable_connection(ngx_connection_t *c, ngx_uint_t reusable)
 
 #if (NGX_STAT_STUB)
         (void) ngx_atomic_fetch_add(ngx_stat_waiting, 1);
+        (void) ngx_atomic_fetch_add(ngx_stat_idle_memory,
+                                    ngx_connection_idle_memory(c));
 #endif
     }
 }
 
 
+#if (NGX_STAT_STUB)
+
+static size_t
+ngx_connection_idle_memory(ngx_connection_t *c)
+{
+    size_t  size;
+
+    /*
+     * the memory an idle connection is expected to hold: its descriptor
+     * and the first block of its pool; buffers are freed by the modules
+     * before a connection is made reusable
+     */
+
+    size = sizeof(ngx_connection_t) + 2 * sizeof(ngx_event_t);
+
+    if (c->pool) {
+        size += c->pool->d.end - (u_char *) c->pool;
+    }
+
+    return size;
+}
+
+#endif
+
+
 static void
 ngx_drain_connections(ngx_cycle_t *cycle)
 {
@@ -33,6 +33,9 @@ struct ngx_listening_s {
     int                 keepintvl;
     int                 keepcnt;
 #endif
+#if (NGX_HAVE_MMSG)
+    int                 batch;      /* datagrams per recvmmsg() */
+#endif
 
     /* handler of accepted connection */
     ngx_connection_handler_pt   handler;
@@ -16,8 +16,8 @@ static ngx_int_t ngx_init_zone_pool(ngx_cycle_t *cycle,
     ngx_shm_zone_t *shm_zone);
 static ngx_int_t ngx_pidfile_changed(ngx_str_t *name1, ngx_str_t *name2,
     ngx_log_t *log);
-static ngx_int_t ngx_shared_memory_find(ngx_conf_t *cf, ngx_str_t *name,
-    size_t size, void *tag, ngx_shm_zone_t **out);
+static ngx_int_t ngx_shared_memory_find(ngx_conf_t *cf,
+    ngx_shm_zone_params_t *zp, ngx_shm_zone_t **out);
 static ngx_inline ngx_int_t ngx_fn_extend(ngx_pool_t *pool, ngx_str_t *fn,
     ngx_str_t *base, const char *ext);
 static ngx_int_t ngx_test_lockfile(u_char *file, ngx_log_t *log);
@@ -502,7 +502,9 @@ ngx_init_cycle(ngx_cycle_t *old_cycle)
                 break;
             }
 
-            if (shm_zone[i].shm.size == oshm_zone[n].shm.size) {
+            if (shm_zone[i].shm.size == oshm_zone[n].shm.size
+                && ngx_shm_same_policy(&shm_zone[i].shm, &oshm_zone[n].shm))
+            {
                 shm_zone[i].shm.addr = oshm_zone[n].shm.addr;
 #if (NGX_WIN32)
                 shm_zone[i].shm.handle = oshm_zone[n].shm.handle;
@@ -949,6 +951,7 @@ failed:
 
             if (shm_zone[i].tag == oshm_zone[n].tag
                 && shm_zone[i].shm.size == oshm_zone[n].shm.size
+                && ngx_shm_same_policy(&shm_zone[i].shm, &oshm_zone[n].shm)
                 && !shm_zone[i].noreuse)
             {
                 goto old_shm_zone_found;
@@ -1433,10 +1436,17 @@ ngx_reopen_files(ngx_cycle_t *cycle, ngx_uid_t user)
 ngx_shm_zone_t *
 ngx_shared_memory_add(ngx_conf_t *cf, ngx_str_t *name, size_t size, void *tag)
 {
-    ngx_int_t         rc;
-    ngx_shm_zone_t   *shm_zone;
+    ngx_int_t               rc;
+    ngx_shm_zone_t         *shm_zone;
+    ngx_shm_zone_params_t   zp;
+
+    ngx_memzero(&zp, sizeof(ngx_shm_zone_params_t));
+
+    zp.name = *name;
+    zp.size = size;
+    zp.tag = tag;
 
-    rc = ngx_shared_memory_find(cf, name, size, tag, &shm_zone);
+    rc = ngx_shared_memory_find(cf, &zp, &shm_zone);
     if (rc == NGX_OK) {
         return shm_zone;
     }
@@ -1477,7 +1487,7 @@ ngx_shared_memory_add_ext(ngx_conf_t *cf, ngx_shm_zone_params_t *zp)
     zstate = NULL;
     sign = NULL;
 
-    rc = ngx_shared_memory_find(cf, &zp->name, zp->size, zp->tag, &shm_zone);
+    rc = ngx_shared_memory_find(cf, zp, &shm_zone);
     if (rc == NGX_OK) {
         return shm_zone;
     }
@@ -1603,6 +1613,10 @@ done:
     shm_zone->shm.addr = addr;
     shm_zone->shm.size = zp->size;
     shm_zone->shm.name = zp->name;
+#if (NGX_HAVE_NUMA)
+    shm_zone->shm.numa = zp->numa;
+    shm_zone->shm.numa_node = zp->numa_node;
+#endif
     shm_zone->tag = zp->tag;
     shm_zone->state = zstate;
     shm_zone->signature = sign;
@@ -1614,13 +1628,18 @@ done:
 
 
 static ngx_int_t
-ngx_shared_memory_find(ngx_conf_t *cf, ngx_str_t *name, size_t size, void *tag,
+ngx_shared_memory_find(ngx_conf_t *cf, ngx_shm_zone_params_t *zp,
     ngx_shm_zone_t **out)
 {
+    size_t            size;
+    ngx_str_t        *name;
     ngx_uint_t        i;
     ngx_shm_zone_t   *shm_zone;
     ngx_list_part_t  *part;
 
+    name = &zp->name;
+    size = zp->size;
+
     part = &cf->cycle->shared_memory.part;
     shm_zone = part->elts;
 
@@ -1645,7 +1664,7 @@ ngx_shared_memory_find(ngx_conf_t *cf, ngx_str_t *name, size_t size, void *tag,
             continue;
         }
 
-        if (tag != shm_zone[i].tag) {
+        if (zp->tag != shm_zone[i].tag) {
             ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
                             "the shared memory zone \"%V\" is "
                             "already declared for a different use",
@@ -1655,6 +1674,10 @@ ngx_shared_memory_find(ngx_conf_t *cf, ngx_str_t *name, size_t size, void *tag,
 
         if (shm_zone[i].shm.size == 0) {
             shm_zone[i].shm.size = size;
+#if (NGX_HAVE_NUMA)
+            shm_zone[i].shm.numa = zp->numa;
+            shm_zone[i].shm.numa_node = zp->numa_node;
+#endif
         }
 
         if (size && size != shm_zone[i].shm.size) {
@@ -1665,6 +1688,19 @@ ngx_shared_memory_find(ngx_conf_t *cf, ngx_str_t *name, size_t size, void *tag,
             return NGX_DECLINED;
         }
 
+#if (NGX_HAVE_NUMA)
+        if (size
+            && (zp->numa != shm_zone[i].shm.numa
+                || zp->numa_node != shm_zone[i].shm.numa_node))
+        {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                            "the NUMA policy of shared memory zone \"%V\" "
+                            "conflicts with already declared policy",
+                            &shm_zone[i].shm.name);
+            return NGX_DECLINED;
+        }
+#endif
+
         *out = &shm_zone[i];
         return NGX_OK;
     }
@@ -31,8 +31,13 @@ typedef struct {
     ngx_str_t                 signature;
 
     size_t                    min_size;
+#if (NGX_HAVE_NUMA)
+    ngx_uint_t                numa;
+    ngx_uint_t                numa_node;
+#endif
     unsigned                  is_count:1;
     unsigned                  restorable:1;
+    unsigned                  numa_aware:1;
 } ngx_shm_zone_params_t;
 
 
@@ -133,6 +138,7 @@ typedef struct {
     int                       priority;
 
     ngx_uint_t                cpu_affinity_auto;
+    ngx_uint_t                cpu_affinity_numa;
     ngx_uint_t                cpu_affinity_n;
     ngx_cpuset_t             *cpu_affinity;
 
@@ -163,7 +169,7 @@ ngx_int_t ngx_signal_process(ngx_cycle_t *cycle, char *sig);
 void ngx_reopen_files(ngx_cycle_t *cycle, ngx_uid_t user);
 char **ngx_set_environment(ngx_cycle_t *cycle, ngx_uint_t *last);
 ngx_pid_t ngx_exec_new_binary(ngx_cycle_t *cycle, char *const *argv);
-ngx_cpuset_t *ngx_get_cpu_affinity(ngx_uint_t n);
+ngx_cpuset_t *ngx_get_cpu_affinity(ngx_cycle_t *cycle, ngx_uint_t n);
 ngx_shm_zone_t *ngx_shared_memory_add(ngx_conf_t *cf, ngx_str_t *name,
     size_t size, void *tag);
 ngx_shm_zone_t *ngx_shared_memory_add_ext(ngx_conf_t *cf,
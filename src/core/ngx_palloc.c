@@ -9,10 +9,38 @@
 #include <ngx_core.h>
 
 
+typedef struct ngx_pool_stats_large_s  ngx_pool_stats_large_t;
+
+struct ngx_pool_stats_large_s {
+    ngx_pool_stats_large_t  *next;
+    void                    *alloc;
+    size_t                   size;
+};
+
+
+/*
+ * the statistics are kept aside of the pool, in the data of a cleanup
+ * handler, so pools without them do not pay for the accounting
+ */
+
+typedef struct {
+    ngx_pool_stats_t         stats;
+    ngx_pool_stats_large_t  *large;
+} ngx_pool_stats_ctx_t;
+
+
 static ngx_inline void *ngx_palloc_small(ngx_pool_t *pool, size_t size,
     ngx_uint_t align);
 static void *ngx_palloc_block(ngx_pool_t *pool, size_t size);
 static void *ngx_palloc_large(ngx_pool_t *pool, size_t size);
+static ngx_pool_stats_ctx_t *ngx_pool_stats_ctx(ngx_pool_t *pool);
+static void ngx_pool_stats_large(ngx_pool_t *pool, void *p, size_t size);
+static void ngx_pool_stats_free(ngx_pool_t *pool, void *p);
+static void ngx_pool_stats_account(ngx_pool_stats_t *stats, ssize_t size);
+static void ngx_pool_stats_cleanup(void *data);
+
+
+static ngx_uint_t  ngx_pool_stats_used;
 
 
 ngx_pool_t *
@@ -177,9 +205,10 @@ ngx_palloc_small(ngx_pool_t *pool, size_t size, ngx_uint_t align)
 static void *
 ngx_palloc_block(ngx_pool_t *pool, size_t size)
 {
-    u_char      *m;
-    size_t       psize;
-    ngx_pool_t  *p, *new;
+    u_char                *m;
+    size_t                 psize;
+    ngx_pool_t            *p, *new;
+    ngx_pool_stats_ctx_t  *ctx;
 
     psize = (size_t) (pool->d.end - (u_char *) pool);
 
@@ -206,6 +235,15 @@ ngx_palloc_block(ngx_pool_t *pool, size_t size)
 
     p->d.next = new;
 
+    if (ngx_pool_stats_used) {
+        ctx = ngx_pool_stats_ctx(pool);
+
+        if (ctx) {
+            ctx->stats.blocks++;
+            ngx_pool_stats_account(&ctx->stats, psize);
+        }
+    }
+
     return m;
 }
 
@@ -213,21 +251,35 @@ ngx_palloc_block(ngx_pool_t *pool, size_t size)
 static void *
 ngx_palloc_large(ngx_pool_t *pool, size_t size)
 {
-    void              *p;
-    ngx_uint_t         n;
-    ngx_pool_large_t  *large;
+    void  *p;
 
     p = ngx_alloc(size, pool->log);
     if (p == NULL) {
         return NULL;
     }
 
+    if (ngx_pattach(pool, p, size) != NGX_OK) {
+        ngx_free(p);
+        return NULL;
+    }
+
+    return p;
+}
+
+
+ngx_int_t
+ngx_pattach(ngx_pool_t *pool, void *p, size_t size)
+{
+    ngx_uint_t         n;
+    ngx_pool_large_t  *large;
+
+    /* p is freed along with the pool */
+
     n = 0;
 
     for (large = pool->large; large; large = large->next) {
         if (large->alloc == NULL) {
-            large->alloc = p;
-            return p;
+            goto found;
         }
 
         if (n++ > 3) {
@@ -237,15 +289,21 @@ ngx_palloc_large(ngx_pool_t *pool, size_t size)
 
     large = ngx_palloc_small(pool, sizeof(ngx_pool_large_t), 1);
     if (large == NULL) {
-        ngx_free(p);
-        return NULL;
+        return NGX_ERROR;
     }
 
-    large->alloc = p;
     large->next = pool->large;
     pool->large = large;
 
-    return p;
+found:
+
+    large->alloc = p;
+
+    if (ngx_pool_stats_used) {
+        ngx_pool_stats_large(pool, p, size);
+    }
+
+    return NGX_OK;
 }
 
 
@@ -270,6 +328,10 @@ ngx_pmemalign(ngx_pool_t *pool, size_t size, size_t alignment)
     large->next = pool->large;
     pool->large = large;
 
+    if (ngx_pool_stats_used) {
+        ngx_pool_stats_large(pool, p, size);
+    }
+
     return p;
 }
 
@@ -283,6 +345,11 @@ ngx_pfree(ngx_pool_t *pool, void *p)
         if (p == l->alloc) {
             ngx_log_debug1(NGX_LOG_DEBUG_ALLOC, pool->log, 0,
                            "free: %p", l->alloc);
+
+            if (ngx_pool_stats_used) {
+                ngx_pool_stats_free(pool, p);
+            }
+
             ngx_free(l->alloc);
             l->alloc = NULL;
 
@@ -294,6 +361,195 @@ ngx_pfree(ngx_pool_t *pool, void *p)
 }
 
 
+ngx_int_t
+ngx_pdetach(ngx_pool_t *pool, void *p)
+{
+    ngx_pool_large_t  *l;
+
+    /* the caller becomes responsible for freeing p */
+
+    for (l = pool->large; l; l = l->next) {
+        if (p == l->alloc) {
+            ngx_log_debug1(NGX_LOG_DEBUG_ALLOC, pool->log, 0,
+                           "detach: %p", l->alloc);
+            l->alloc = NULL;
+
+            if (ngx_pool_stats_used) {
+                ngx_pool_stats_free(pool, p);
+            }
+
+            return NGX_OK;
+        }
+    }
+
+    return NGX_DECLINED;
+}
+
+
+ngx_int_t
+ngx_pool_enable_stats(ngx_pool_t *pool)
+{
+    size_t                 psize;
+    ngx_pool_t            *p;
+    ngx_pool_large_t      *l;
+    ngx_pool_cleanup_t    *cln;
+    ngx_pool_stats_ctx_t  *ctx;
+
+    if (ngx_pool_stats_ctx(pool)) {
+        return NGX_OK;
+    }
+
+    cln = ngx_pool_cleanup_add(pool, sizeof(ngx_pool_stats_ctx_t));
+    if (cln == NULL) {
+        return NGX_ERROR;
+    }
+
+    ctx = cln->data;
+    ngx_memzero(ctx, sizeof(ngx_pool_stats_ctx_t));
+
+    /*
+     * the memory already allocated is accounted too,
+     * except for the sizes of large allocations which are not known
+     */
+
+    psize = (size_t) (pool->d.end - (u_char *) pool);
+
+    for (p = pool; p; p = p->d.next) {
+        ctx->stats.blocks++;
+        ctx->stats.size += psize;
+    }
+
+    for (l = pool->large; l; l = l->next) {
+        if (l->alloc) {
+            ctx->stats.large++;
+        }
+    }
+
+    ctx->stats.peak = ctx->stats.size;
+
+    cln->handler = ngx_pool_stats_cleanup;
+
+    ngx_pool_stats_used = 1;
+
+    return NGX_OK;
+}
+
+
+ngx_pool_stats_t *
+ngx_pool_get_stats(ngx_pool_t *pool)
+{
+    ngx_pool_stats_ctx_t  *ctx;
+
+    ctx = ngx_pool_stats_ctx(pool);
+
+    return ctx ? &ctx->stats : NULL;
+}
+
+
+static ngx_pool_stats_ctx_t *
+ngx_pool_stats_ctx(ngx_pool_t *pool)
+{
+    ngx_pool_cleanup_t  *c;
+
+    if (!ngx_pool_stats_used) {
+        return NULL;
+    }
+
+    for (c = pool->cleanup; c; c = c->next) {
+        if (c->handler == ngx_pool_stats_cleanup) {
+            return c->data;
+        }
+    }
+
+    return NULL;
+}
+
+
+static void
+ngx_pool_stats_large(ngx_pool_t *pool, void *p, size_t size)
+{
+    ngx_uint_t               n;
+    ngx_pool_stats_ctx_t    *ctx;
+    ngx_pool_stats_large_t  *large;
+
+    ctx = ngx_pool_stats_ctx(pool);
+
+    if (ctx == NULL) {
+        return;
+    }
+
+    ctx->stats.large++;
+    ngx_pool_stats_account(&ctx->stats, size);
+
+    /* sizes are remembered to account ngx_pfree() and ngx_pdetach() */
+
+    n = 0;
+
+    for (large = ctx->large; large; large = large->next) {
+        if (large->alloc == NULL) {
+            goto found;
+        }
+
+        if (n++ > 3) {
+            break;
+        }
+    }
+
+    large = ngx_palloc_small(pool, sizeof(ngx_pool_stats_large_t), 1);
+    if (large == NULL) {
+        return;
+    }
+
+    large->next = ctx->large;
+    ctx->large = large;
+
+found:
+
+    large->alloc = p;
+    large->size = size;
+}
+
+
+static void
+ngx_pool_stats_free(ngx_pool_t *pool, void *p)
+{
+    ngx_pool_stats_ctx_t    *ctx;
+    ngx_pool_stats_large_t  *large;
+
+    ctx = ngx_pool_stats_ctx(pool);
+
+    if (ctx == NULL) {
+        return;
+    }
+
+    for (large = ctx->large; large; large = large->next) {
+        if (large->alloc == p) {
+            large->alloc = NULL;
+            ngx_pool_stats_account(&ctx->stats, -(ssize_t) large->size);
+            return;
+        }
+    }
+}
+
+
+static void
+ngx_pool_stats_account(ngx_pool_stats_t *stats, ssize_t size)
+{
+    stats->size += size;
+
+    if (stats->size > stats->peak) {
+        stats->peak = stats->size;
+    }
+}
+
+
+static void
+ngx_pool_stats_cleanup(void *data)
+{
+    /* the statistics are freed along with the pool */
+}
+
+
 void *
 ngx_pcalloc(ngx_pool_t *pool, size_t size)
 {
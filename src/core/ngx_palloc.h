@@ -46,6 +46,14 @@ struct ngx_pool_large_s {
 };
 
 
+typedef struct {
+    size_t                size;     /* blocks and large allocations */
+    size_t                peak;
+    ngx_uint_t            blocks;
+    ngx_uint_t            large;    /* number of large allocations made */
+} ngx_pool_stats_t;
+
+
 typedef struct {
     u_char               *last;
     u_char               *end;
@@ -75,12 +83,16 @@ typedef struct {
 ngx_pool_t *ngx_create_pool(size_t size, ngx_log_t *log);
 void ngx_destroy_pool(ngx_pool_t *pool);
 void ngx_reset_pool(ngx_pool_t *pool);
+ngx_int_t ngx_pool_enable_stats(ngx_pool_t *pool);
+ngx_pool_stats_t *ngx_pool_get_stats(ngx_pool_t *pool);
 
 void *ngx_palloc(ngx_pool_t *pool, size_t size);
 void *ngx_pnalloc(ngx_pool_t *pool, size_t size);
 void *ngx_pcalloc(ngx_pool_t *pool, size_t size);
 void *ngx_pmemalign(ngx_pool_t *pool, size_t size, size_t alignment);
 ngx_int_t ngx_pfree(ngx_pool_t *pool, void *p);
+ngx_int_t ngx_pattach(ngx_pool_t *pool, void *p, size_t size);
+ngx_int_t ngx_pdetach(ngx_pool_t *pool, void *p);
 
 
 ngx_pool_cleanup_t *ngx_pool_cleanup_add(ngx_pool_t *p, size_t size);
@@ -124,6 +124,14 @@ static ngx_int_t ngx_api_slab_slots_iter(ngx_api_iter_ctx_t *ictx,
     ngx_api_ctx_t *actx);
 static ngx_int_t ngx_api_slab_slot_free_handler(ngx_api_entry_data_t data,
     ngx_api_ctx_t *actx, void *ctx);
+#if (NGX_HAVE_NUMA)
+static ngx_int_t ngx_api_slab_numa_handler(ngx_api_entry_data_t data,
+    ngx_api_ctx_t *actx, void *ctx);
+static ngx_int_t ngx_api_slab_numa_policy_handler(ngx_api_entry_data_t data,
+    ngx_api_ctx_t *actx, void *ctx);
+static ngx_int_t ngx_api_slab_numa_node_handler(ngx_api_entry_data_t data,
+    ngx_api_ctx_t *actx, void *ctx);
+#endif
 
 
 static ngx_api_entry_t  ngx_api_slab_pages_entries[] = {
@@ -172,6 +180,26 @@ static ngx_api_entry_t  ngx_api_slab_slot_entries[] = {
 };
 
 
+#if (NGX_HAVE_NUMA)
+
+static ngx_api_entry_t  ngx_api_slab_numa_entries[] = {
+
+    {
+        .name      = ngx_string("policy"),
+        .handler   = ngx_api_slab_numa_policy_handler,
+    },
+
+    {
+        .name      = ngx_string("node"),
+        .handler   = ngx_api_slab_numa_node_handler,
+    },
+
+    ngx_api_null_entry
+};
+
+#endif
+
+
 static ngx_api_entry_t  ngx_api_slab_entries[] = {
 
     {
@@ -185,6 +213,14 @@ static ngx_api_entry_t  ngx_api_slab_entries[] = {
         .handler   = ngx_api_slab_slots_handler,
     },
 
+#if (NGX_HAVE_NUMA)
+    {
+        .name      = ngx_string("numa"),
+        .handler   = ngx_api_slab_numa_handler,
+        .data.ents = ngx_api_slab_numa_entries
+    },
+#endif
+
     ngx_api_null_entry
 };
 
@@ -1076,6 +1112,64 @@ ngx_api_slab_slot_free_handler(ngx_api_entry_data_t data, ngx_api_ctx_t *actx,
     return ngx_api_number_handler(data, actx, ctx);
 }
 
+
+#if (NGX_HAVE_NUMA)
+
+static ngx_int_t
+ngx_api_slab_numa_handler(ngx_api_entry_data_t data, ngx_api_ctx_t *actx,
+    void *ctx)
+{
+    ngx_uint_t  policy, node;
+
+    if (ngx_numa_nodes == 0
+        || ngx_numa_get_policy(ctx, &policy, &node) != NGX_OK)
+    {
+        return NGX_DECLINED;
+    }
+
+    return ngx_api_object_handler(data, actx, ctx);
+}
+
+
+static ngx_int_t
+ngx_api_slab_numa_policy_handler(ngx_api_entry_data_t data,
+    ngx_api_ctx_t *actx, void *ctx)
+{
+    ngx_uint_t  policy, node;
+
+    static ngx_str_t  policies[] = {
+        ngx_string("default"),
+        ngx_string("bind"),
+        ngx_string("interleave")
+    };
+
+    if (ngx_numa_get_policy(ctx, &policy, &node) != NGX_OK) {
+        return NGX_DECLINED;
+    }
+
+    data.str = &policies[policy];
+
+    return ngx_api_string_handler(data, actx, ctx);
+}
+
+
+static ngx_int_t
+ngx_api_slab_numa_node_handler(ngx_api_entry_data_t data, ngx_api_ctx_t *actx,
+    void *ctx)
+{
+    ngx_uint_t  policy, node;
+
+    if (ngx_numa_get_policy(ctx, &policy, &node) != NGX_OK) {
+        return NGX_DECLINED;
+    }
+
+    data.num = node;
+
+    return ngx_api_number_handler(data, actx, ctx);
+}
+
+#endif
+
 #endif
 
 
@@ -26,11 +26,37 @@ typedef struct {
     (q)->last = &(q)->first
 
 
-struct ngx_thread_pool_s {
+#if (NGX_API)
+
+typedef struct {
+    ngx_atomic_t              threads;
+    ngx_atomic_t              queue;
+    ngx_atomic_t              tasks;
+    ngx_atomic_t              stolen;
+    ngx_atomic_t              notifications;
+    ngx_atomic_t              wait_time;        /* microseconds */
+    ngx_atomic_t              run_time;         /* microseconds */
+} ngx_thread_pool_stats_t;
+
+#endif
+
+
+/* a thread with its own queues, one per task priority */
+
+typedef struct {
     ngx_thread_mutex_t        mtx;
-    ngx_thread_pool_queue_t   queue;
-    ngx_int_t                 waiting;
     ngx_thread_cond_t         cond;
+    ngx_thread_pool_queue_t   queue[NGX_THREAD_TASK_HIGH + 1];
+    ngx_atomic_t              queued;
+    ngx_atomic_t              idle;
+    ngx_thread_pool_t        *pool;
+} ngx_thread_pool_thread_t;
+
+
+struct ngx_thread_pool_s {
+    ngx_thread_pool_thread_t *thread;
+    ngx_atomic_t              waiting;
+    ngx_uint_t                next;
 
     ngx_log_t                *log;
 
@@ -38,6 +64,10 @@ struct ngx_thread_pool_s {
     ngx_uint_t                threads;
     ngx_int_t                 max_queue;
 
+#if (NGX_API)
+    ngx_thread_pool_stats_t  *stats;
+#endif
+
     u_char                   *file;
     ngx_uint_t                line;
 };
@@ -48,7 +78,14 @@ static ngx_int_t ngx_thread_pool_init(ngx_thread_pool_t *tp, ngx_log_t *log,
 static void ngx_thread_pool_destroy(ngx_thread_pool_t *tp);
 static void ngx_thread_pool_exit_handler(void *data, ngx_log_t *log);
 
+static void ngx_thread_pool_wakeup(ngx_thread_pool_t *tp,
+    ngx_thread_pool_thread_t *busy);
 static void *ngx_thread_pool_cycle(void *data);
+static ngx_thread_task_t *ngx_thread_pool_get_task(
+    ngx_thread_pool_thread_t *thr);
+static ngx_thread_task_t *ngx_thread_pool_steal_task(
+    ngx_thread_pool_thread_t *thr);
+static ngx_int_t ngx_thread_pool_wait(ngx_thread_pool_thread_t *thr);
 static void ngx_thread_pool_handler(ngx_event_t *ev);
 
 static char *ngx_thread_pool(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
@@ -59,6 +96,77 @@ static char *ngx_thread_pool_init_conf(ngx_cycle_t *cycle, void *conf);
 static ngx_int_t ngx_thread_pool_init_worker(ngx_cycle_t *cycle);
 static void ngx_thread_pool_exit_worker(ngx_cycle_t *cycle);
 
+#if (NGX_API)
+
+static uint64_t ngx_thread_pool_time(void);
+static ngx_int_t ngx_thread_pool_add_zone(ngx_conf_t *cf,
+    ngx_thread_pool_t *tp);
+static ngx_int_t ngx_thread_pool_init_zone(ngx_shm_zone_t *shm_zone,
+    void *data);
+
+static ngx_int_t ngx_api_thread_pools_handler(ngx_api_entry_data_t data,
+    ngx_api_ctx_t *actx, void *ctx);
+static ngx_int_t ngx_api_thread_pools_iter(ngx_api_iter_ctx_t *ictx,
+    ngx_api_ctx_t *actx);
+static ngx_int_t ngx_api_thread_pool_time_handler(ngx_api_entry_data_t data,
+    ngx_api_ctx_t *actx, void *ctx);
+
+
+static ngx_api_entry_t  ngx_api_thread_pool_entries[] = {
+
+    {
+        .name      = ngx_string("threads"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_thread_pool_stats_t, threads)
+    },
+
+    {
+        .name      = ngx_string("queue"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_thread_pool_stats_t, queue)
+    },
+
+    {
+        .name      = ngx_string("tasks"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_thread_pool_stats_t, tasks)
+    },
+
+    {
+        .name      = ngx_string("stolen"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_thread_pool_stats_t, stolen)
+    },
+
+    {
+        .name      = ngx_string("notifications"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_thread_pool_stats_t, notifications)
+    },
+
+    {
+        .name      = ngx_string("wait_time"),
+        .handler   = ngx_api_thread_pool_time_handler,
+        .data.off  = offsetof(ngx_thread_pool_stats_t, wait_time)
+    },
+
+    {
+        .name      = ngx_string("run_time"),
+        .handler   = ngx_api_thread_pool_time_handler,
+        .data.off  = offsetof(ngx_thread_pool_stats_t, run_time)
+    },
+
+    ngx_api_null_entry
+};
+
+
+static ngx_api_entry_t  ngx_api_thread_pools_entry = {
+    .name      = ngx_string("thread_pools"),
+    .handler   = ngx_api_thread_pools_handler,
+};
+
+#endif
+
 
 static ngx_command_t  ngx_thread_pool_commands[] = {
 
@@ -106,10 +214,11 @@ static ngx_thread_pool_queue_t  ngx_thread_pool_done;
 static ngx_int_t
 ngx_thread_pool_init(ngx_thread_pool_t *tp, ngx_log_t *log, ngx_pool_t *pool)
 {
-    int             err;
-    pthread_t       tid;
-    ngx_uint_t      n;
-    pthread_attr_t  attr;
+    int                        err;
+    pthread_t                  tid;
+    ngx_uint_t                 n, i;
+    pthread_attr_t             attr;
+    ngx_thread_pool_thread_t  *thr;
 
     if (ngx_notify == NULL) {
         ngx_log_error(NGX_LOG_ALERT, log, 0,
@@ -117,15 +226,29 @@ ngx_thread_pool_init(ngx_thread_pool_t *tp, ngx_log_t *log, ngx_pool_t *pool)
         return NGX_ERROR;
     }
 
-    ngx_thread_pool_queue_init(&tp->queue);
-
-    if (ngx_thread_mutex_create(&tp->mtx, log) != NGX_OK) {
+    tp->thread = ngx_pcalloc(pool,
+                             tp->threads * sizeof(ngx_thread_pool_thread_t));
+    if (tp->thread == NULL) {
         return NGX_ERROR;
     }
 
-    if (ngx_thread_cond_create(&tp->cond, log) != NGX_OK) {
-        (void) ngx_thread_mutex_destroy(&tp->mtx, log);
-        return NGX_ERROR;
+    for (n = 0; n < tp->threads; n++) {
+        thr = &tp->thread[n];
+
+        thr->pool = tp;
+
+        for (i = 0; i <= NGX_THREAD_TASK_HIGH; i++) {
+            ngx_thread_pool_queue_init(&thr->queue[i]);
+        }
+
+        if (ngx_thread_mutex_create(&thr->mtx, log) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        if (ngx_thread_cond_create(&thr->cond, log) != NGX_OK) {
+            (void) ngx_thread_mutex_destroy(&thr->mtx, log);
+            return NGX_ERROR;
+        }
     }
 
     tp->log = log;
@@ -154,7 +277,8 @@ ngx_thread_pool_init(ngx_thread_pool_t *tp, ngx_log_t *log, ngx_pool_t *pool)
 #endif
 
     for (n = 0; n < tp->threads; n++) {
-        err = pthread_create(&tid, &attr, ngx_thread_pool_cycle, tp);
+        err = pthread_create(&tid, &attr, ngx_thread_pool_cycle,
+                             &tp->thread[n]);
         if (err) {
             ngx_log_error(NGX_LOG_ALERT, log, err,
                           "pthread_create() failed");
@@ -194,9 +318,10 @@ ngx_thread_pool_destroy(ngx_thread_pool_t *tp)
         task.event.active = 0;
     }
 
-    (void) ngx_thread_cond_destroy(&tp->cond, tp->log);
-
-    (void) ngx_thread_mutex_destroy(&tp->mtx, tp->log);
+    for (n = 0; n < tp->threads; n++) {
+        (void) ngx_thread_cond_destroy(&tp->thread[n].cond, tp->log);
+        (void) ngx_thread_mutex_destroy(&tp->thread[n].mtx, tp->log);
+    }
 }
 
 
@@ -230,22 +355,39 @@ ngx_thread_task_alloc(ngx_pool_t *pool, size_t size)
 ngx_int_t
 ngx_thread_task_post(ngx_thread_pool_t *tp, ngx_thread_task_t *task)
 {
+    ngx_uint_t                 i, idle;
+    ngx_thread_pool_queue_t   *queue;
+    ngx_thread_pool_thread_t  *thr;
+
     if (task->event.active) {
         ngx_log_error(NGX_LOG_ALERT, tp->log, 0,
                       "task #%ui already active", task->id);
         return NGX_ERROR;
     }
 
-    if (ngx_thread_mutex_lock(&tp->mtx, tp->log) != NGX_OK) {
+    if ((ngx_atomic_int_t) tp->waiting >= tp->max_queue) {
+        ngx_log_error(NGX_LOG_ERR, tp->log, 0,
+                      "thread pool \"%V\" queue overflow: %i tasks waiting",
+                      &tp->name, (ngx_int_t) tp->waiting);
         return NGX_ERROR;
     }
 
-    if (tp->waiting >= tp->max_queue) {
-        (void) ngx_thread_mutex_unlock(&tp->mtx, tp->log);
+    /* an idle thread is preferred, otherwise the threads are taken in turn */
 
-        ngx_log_error(NGX_LOG_ERR, tp->log, 0,
-                      "thread pool \"%V\" queue overflow: %i tasks waiting",
-                      &tp->name, tp->waiting);
+    thr = NULL;
+
+    for (i = 0; i < tp->threads; i++) {
+        if (tp->thread[i].idle) {
+            thr = &tp->thread[i];
+            break;
+        }
+    }
+
+    if (thr == NULL) {
+        thr = &tp->thread[tp->next++ % tp->threads];
+    }
+
+    if (ngx_thread_mutex_lock(&thr->mtx, tp->log) != NGX_OK) {
         return NGX_ERROR;
     }
 
@@ -254,34 +396,97 @@ ngx_thread_task_post(ngx_thread_pool_t *tp, ngx_thread_task_t *task)
     task->id = ngx_thread_pool_task_id++;
     task->next = NULL;
 
-    if (ngx_thread_cond_signal(&tp->cond, tp->log) != NGX_OK) {
-        (void) ngx_thread_mutex_unlock(&tp->mtx, tp->log);
+#if (NGX_API)
+    task->posted = ngx_thread_pool_time();
+#endif
+
+    queue = &thr->queue[task->priority ? NGX_THREAD_TASK_HIGH
+                                       : NGX_THREAD_TASK_NORMAL];
+
+    *queue->last = task;
+    queue->last = &task->next;
+
+    (void) ngx_atomic_fetch_add(&thr->queued, 1);
+    (void) ngx_atomic_fetch_add(&tp->waiting, 1);
+
+    idle = ngx_atomic_cmp_set(&thr->idle, 1, 0);
+
+    if (idle && ngx_thread_cond_signal(&thr->cond, tp->log) != NGX_OK) {
+        (void) ngx_thread_mutex_unlock(&thr->mtx, tp->log);
         return NGX_ERROR;
     }
 
-    *tp->queue.last = task;
-    tp->queue.last = &task->next;
+    (void) ngx_thread_mutex_unlock(&thr->mtx, tp->log);
 
-    tp->waiting++;
+#if (NGX_API)
+    if (tp->stats) {
+        (void) ngx_atomic_fetch_add(&tp->stats->queue, 1);
+    }
+#endif
 
-    (void) ngx_thread_mutex_unlock(&tp->mtx, tp->log);
+    if (!idle) {
+        /* the task is to be stolen by an idle thread, if any */
+        ngx_thread_pool_wakeup(tp, thr);
+    }
 
-    ngx_log_debug2(NGX_LOG_DEBUG_CORE, tp->log, 0,
-                   "task #%ui added to thread pool \"%V\"",
-                   task->id, &tp->name);
+    ngx_log_debug3(NGX_LOG_DEBUG_CORE, tp->log, 0,
+                   "task #%ui added to thread pool \"%V\", priority %ui",
+                   task->id, &tp->name, task->priority);
 
     return NGX_OK;
 }
 
 
+static void
+ngx_thread_pool_wakeup(ngx_thread_pool_t *tp, ngx_thread_pool_thread_t *busy)
+{
+    ngx_uint_t                 i;
+    ngx_thread_pool_thread_t  *thr;
+
+    /*
+     * the queued counter is updated with a full barrier before the idle
+     * flags are checked, while a thread sets its idle flag before checking
+     * the counters in ngx_thread_pool_wait(), so either the thread sees
+     * the task, or the flag is seen here
+     */
+
+    for (i = 0; i < tp->threads; i++) {
+        thr = &tp->thread[i];
+
+        if (thr == busy || !thr->idle) {
+            continue;
+        }
+
+        if (ngx_thread_mutex_lock(&thr->mtx, tp->log) != NGX_OK) {
+            return;
+        }
+
+        if (ngx_atomic_cmp_set(&thr->idle, 1, 0)) {
+            (void) ngx_thread_cond_signal(&thr->cond, tp->log);
+            (void) ngx_thread_mutex_unlock(&thr->mtx, tp->log);
+            return;
+        }
+
+        (void) ngx_thread_mutex_unlock(&thr->mtx, tp->log);
+    }
+}
+
+
 static void *
 ngx_thread_pool_cycle(void *data)
 {
-    ngx_thread_pool_t *tp = data;
+    ngx_thread_pool_thread_t *thr = data;
 
     int                 err;
     sigset_t            set;
+    ngx_uint_t          notify;
+    ngx_thread_pool_t  *tp;
     ngx_thread_task_t  *task;
+#if (NGX_API)
+    uint64_t            start;
+#endif
+
+    tp = thr->pool;
 
 #if 0
     ngx_time_update();
@@ -304,32 +509,32 @@ ngx_thread_pool_cycle(void *data)
     }
 
     for ( ;; ) {
-        if (ngx_thread_mutex_lock(&tp->mtx, tp->log) != NGX_OK) {
-            return NULL;
-        }
 
-        /* the number may become negative */
-        tp->waiting--;
+        task = ngx_thread_pool_get_task(thr);
+
+        if (task == NULL) {
+            task = ngx_thread_pool_steal_task(thr);
+        }
 
-        while (tp->queue.first == NULL) {
-            if (ngx_thread_cond_wait(&tp->cond, &tp->mtx, tp->log)
-                != NGX_OK)
-            {
-                (void) ngx_thread_mutex_unlock(&tp->mtx, tp->log);
+        if (task == NULL) {
+            if (ngx_thread_pool_wait(thr) != NGX_OK) {
                 return NULL;
             }
+
+            continue;
         }
 
-        task = tp->queue.first;
-        tp->queue.first = task->next;
+        (void) ngx_atomic_fetch_add(&tp->waiting, -1);
 
-        if (tp->queue.first == NULL) {
-            tp->queue.last = &tp->queue.first;
-        }
+#if (NGX_API)
+        start = ngx_thread_pool_time();
 
-        if (ngx_thread_mutex_unlock(&tp->mtx, tp->log) != NGX_OK) {
-            return NULL;
+        if (tp->stats) {
+            (void) ngx_atomic_fetch_add(&tp->stats->queue, -1);
+            (void) ngx_atomic_fetch_add(&tp->stats->wait_time,
+                                        start - task->posted);
         }
+#endif
 
 #if 0
         ngx_time_update();
@@ -345,10 +550,25 @@ ngx_thread_pool_cycle(void *data)
                        "complete task #%ui in thread pool \"%V\"",
                        task->id, &tp->name);
 
+#if (NGX_API)
+        if (tp->stats) {
+            (void) ngx_atomic_fetch_add(&tp->stats->tasks, 1);
+            (void) ngx_atomic_fetch_add(&tp->stats->run_time,
+                                        ngx_thread_pool_time() - start);
+        }
+#endif
+
         task->next = NULL;
 
         ngx_spinlock(&ngx_thread_pool_done_lock, 1, 2048);
 
+        /*
+         * the completion handler takes all the tasks done at once,
+         * so it is only notified when the first one is added
+         */
+
+        notify = (ngx_thread_pool_done.first == NULL);
+
         *ngx_thread_pool_done.last = task;
         ngx_thread_pool_done.last = &task->next;
 
@@ -356,8 +576,132 @@ ngx_thread_pool_cycle(void *data)
 
         ngx_unlock(&ngx_thread_pool_done_lock);
 
-        (void) ngx_notify(ngx_thread_pool_handler);
+        if (notify) {
+            (void) ngx_notify(ngx_thread_pool_handler);
+
+#if (NGX_API)
+            if (tp->stats) {
+                (void) ngx_atomic_fetch_add(&tp->stats->notifications, 1);
+            }
+#endif
+        }
+    }
+}
+
+
+static ngx_thread_task_t *
+ngx_thread_pool_get_task(ngx_thread_pool_thread_t *thr)
+{
+    ngx_uint_t                i;
+    ngx_thread_task_t        *task;
+    ngx_thread_pool_queue_t  *queue;
+
+    if (thr->queued == 0) {
+        return NULL;
+    }
+
+    if (ngx_thread_mutex_lock(&thr->mtx, thr->pool->log) != NGX_OK) {
+        return NULL;
+    }
+
+    task = NULL;
+
+    /* tasks of higher priorities first */
+
+    for (i = NGX_THREAD_TASK_HIGH + 1; i-- > 0; /* void */) {
+        queue = &thr->queue[i];
+
+        if (queue->first == NULL) {
+            continue;
+        }
+
+        task = queue->first;
+        queue->first = task->next;
+
+        if (queue->first == NULL) {
+            queue->last = &queue->first;
+        }
+
+        (void) ngx_atomic_fetch_add(&thr->queued, -1);
+
+        break;
+    }
+
+    (void) ngx_thread_mutex_unlock(&thr->mtx, thr->pool->log);
+
+    return task;
+}
+
+
+static ngx_thread_task_t *
+ngx_thread_pool_steal_task(ngx_thread_pool_thread_t *thr)
+{
+    ngx_uint_t          i, n;
+    ngx_thread_pool_t  *tp;
+    ngx_thread_task_t  *task;
+
+    tp = thr->pool;
+    n = thr - tp->thread;
+
+    for (i = 1; i < tp->threads; i++) {
+
+        task = ngx_thread_pool_get_task(&tp->thread[(n + i) % tp->threads]);
+
+        if (task) {
+            ngx_log_debug2(NGX_LOG_DEBUG_CORE, tp->log, 0,
+                           "task #%ui stolen in thread pool \"%V\"",
+                           task->id, &tp->name);
+
+#if (NGX_API)
+            if (tp->stats) {
+                (void) ngx_atomic_fetch_add(&tp->stats->stolen, 1);
+            }
+#endif
+
+            return task;
+        }
+    }
+
+    return NULL;
+}
+
+
+static ngx_int_t
+ngx_thread_pool_wait(ngx_thread_pool_thread_t *thr)
+{
+    ngx_uint_t          i;
+    ngx_thread_pool_t  *tp;
+
+    tp = thr->pool;
+
+    if (ngx_thread_mutex_lock(&thr->mtx, tp->log) != NGX_OK) {
+        return NGX_ERROR;
     }
+
+    for ( ;; ) {
+        (void) ngx_atomic_cmp_set(&thr->idle, 0, 1);
+
+        for (i = 0; i < tp->threads; i++) {
+            if (tp->thread[i].queued) {
+                goto done;
+            }
+        }
+
+        if (ngx_thread_cond_wait(&thr->cond, &thr->mtx, tp->log) != NGX_OK) {
+            (void) ngx_thread_mutex_unlock(&thr->mtx, tp->log);
+            return NGX_ERROR;
+        }
+    }
+
+done:
+
+    thr->idle = 0;
+
+    if (ngx_thread_mutex_unlock(&thr->mtx, tp->log) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
 }
 
 
@@ -448,6 +792,12 @@ ngx_thread_pool_init_conf(ngx_cycle_t *cycle, void *conf)
         return NGX_CONF_ERROR;
     }
 
+#if (NGX_API)
+    if (ngx_api_add(cycle, "/status", &ngx_api_thread_pools_entry) != NGX_OK) {
+        return NGX_CONF_ERROR;
+    }
+#endif
+
     return NGX_CONF_OK;
 }
 
@@ -540,6 +890,12 @@ ngx_thread_pool_add(ngx_conf_t *cf, ngx_str_t *name)
     tp->file = cf->conf_file->file.name.data;
     tp->line = cf->conf_file->line;
 
+#if (NGX_API)
+    if (ngx_thread_pool_add_zone(cf, tp) != NGX_OK) {
+        return NULL;
+    }
+#endif
+
     tcf = (ngx_thread_pool_conf_t *) ngx_get_conf(cf->cycle->conf_ctx,
                                                   ngx_thread_pool_module);
 
@@ -639,3 +995,130 @@ ngx_thread_pool_exit_worker(ngx_cycle_t *cycle)
         ngx_thread_pool_destroy(tpp[i]);
     }
 }
+
+
+#if (NGX_API)
+
+static uint64_t
+ngx_thread_pool_time(void)
+{
+#if (NGX_HAVE_CLOCK_MONOTONIC)
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    struct timeval   tv;
+
+    ngx_gettimeofday(&tv);
+
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+
+static ngx_int_t
+ngx_thread_pool_add_zone(ngx_conf_t *cf, ngx_thread_pool_t *tp)
+{
+    ngx_str_t        name;
+    ngx_shm_zone_t  *shm_zone;
+
+    name.len = sizeof("angie_thread_pool_") - 1 + tp->name.len;
+    name.data = ngx_pnalloc(cf->pool, name.len);
+    if (name.data == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_sprintf(name.data, "angie_thread_pool_%V", &tp->name);
+
+    shm_zone = ngx_shared_memory_add(cf, &name,
+                                     sizeof(ngx_thread_pool_stats_t),
+                                     &ngx_thread_pool_module);
+    if (shm_zone == NULL) {
+        return NGX_ERROR;
+    }
+
+    shm_zone->init = ngx_thread_pool_init_zone;
+    shm_zone->data = tp;
+    shm_zone->noslab = 1;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_thread_pool_init_zone(ngx_shm_zone_t *shm_zone, void *data)
+{
+    ngx_thread_pool_t  *otp = data;
+
+    ngx_thread_pool_t  *tp;
+
+    tp = shm_zone->data;
+
+    if (otp) {
+        tp->stats = otp->stats;
+
+    } else {
+        tp->stats = (ngx_thread_pool_stats_t *) shm_zone->shm.addr;
+    }
+
+    tp->stats->threads = tp->threads;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_api_thread_pools_handler(ngx_api_entry_data_t data, ngx_api_ctx_t *actx,
+    void *ctx)
+{
+    ngx_api_iter_ctx_t       ictx;
+    ngx_thread_pool_conf_t  *tcf;
+
+    tcf = (ngx_thread_pool_conf_t *) ngx_get_conf(ngx_cycle->conf_ctx,
+                                                  ngx_thread_pool_module);
+
+    ictx.entry.handler = ngx_api_object_handler;
+    ictx.entry.data.ents = ngx_api_thread_pool_entries;
+    ictx.elts = tcf->pools.elts;
+
+    return ngx_api_object_iterate(ngx_api_thread_pools_iter, &ictx, actx);
+}
+
+
+static ngx_int_t
+ngx_api_thread_pools_iter(ngx_api_iter_ctx_t *ictx, ngx_api_ctx_t *actx)
+{
+    ngx_thread_pool_t       **tpp;
+    ngx_thread_pool_conf_t   *tcf;
+
+    tcf = (ngx_thread_pool_conf_t *) ngx_get_conf(ngx_cycle->conf_ctx,
+                                                  ngx_thread_pool_module);
+
+    tpp = ictx->elts;
+
+    if (tpp == (ngx_thread_pool_t **) tcf->pools.elts + tcf->pools.nelts) {
+        return NGX_DECLINED;
+    }
+
+    ictx->entry.name = (*tpp)->name;
+    ictx->ctx = (*tpp)->stats;
+    ictx->elts = tpp + 1;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_api_thread_pool_time_handler(ngx_api_entry_data_t data,
+    ngx_api_ctx_t *actx, void *ctx)
+{
+    /* milliseconds */
+
+    data.num = *(ngx_atomic_uint_t *) ((u_char *) ctx + data.off) / 1000;
+
+    return ngx_api_number_handler(data, actx, ctx);
+}
+
+#endif
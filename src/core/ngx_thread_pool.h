@@ -14,9 +14,17 @@
 #include <ngx_event.h>
 
 
+#define NGX_THREAD_TASK_NORMAL  0
+#define NGX_THREAD_TASK_HIGH    1
+
+#define NGX_THREAD_READ_HIGH_SIZE  16384
+
+
 struct ngx_thread_task_s {
     ngx_thread_task_t   *next;
     ngx_uint_t           id;
+    ngx_uint_t           priority;
+    uint64_t             posted;
     void                *ctx;
     void               (*handler)(void *data, ngx_log_t *log);
     ngx_event_t          event;
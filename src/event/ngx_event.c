@@ -75,6 +75,12 @@ static ngx_atomic_t   ngx_stat_writing0;
 ngx_atomic_t         *ngx_stat_writing = &ngx_stat_writing0;
 static ngx_atomic_t   ngx_stat_waiting0;
 ngx_atomic_t         *ngx_stat_waiting = &ngx_stat_waiting0;
+static ngx_atomic_t   ngx_stat_udp_batches0;
+ngx_atomic_t         *ngx_stat_udp_batches = &ngx_stat_udp_batches0;
+static ngx_atomic_t   ngx_stat_udp_datagrams0;
+ngx_atomic_t         *ngx_stat_udp_datagrams = &ngx_stat_udp_datagrams0;
+static ngx_atomic_t   ngx_stat_idle_memory0;
+ngx_atomic_t         *ngx_stat_idle_memory = &ngx_stat_idle_memory0;
 
 #endif
 
@@ -564,7 +570,10 @@ ngx_event_module_init(ngx_cycle_t *cycle)
            + cl          /* ngx_stat_active */
            + cl          /* ngx_stat_reading */
            + cl          /* ngx_stat_writing */
-           + cl;         /* ngx_stat_waiting */
+           + cl          /* ngx_stat_waiting */
+           + cl          /* ngx_stat_udp_batches */
+           + cl          /* ngx_stat_udp_datagrams */
+           + cl;         /* ngx_stat_idle_memory */
 
 #endif
 
@@ -613,6 +622,9 @@ ngx_event_module_init(ngx_cycle_t *cycle)
     ngx_stat_reading = (ngx_atomic_t *) (shared + 7 * cl);
     ngx_stat_writing = (ngx_atomic_t *) (shared + 8 * cl);
     ngx_stat_waiting = (ngx_atomic_t *) (shared + 9 * cl);
+    ngx_stat_udp_batches = (ngx_atomic_t *) (shared + 10 * cl);
+    ngx_stat_udp_datagrams = (ngx_atomic_t *) (shared + 11 * cl);
+    ngx_stat_idle_memory = (ngx_atomic_t *) (shared + 12 * cl);
 
 #endif
 
@@ -27,6 +27,14 @@ typedef struct {
 #endif
 
 
+typedef struct {
+    ngx_msec_t       key;
+    ngx_msec_t       armed;    /* the key the timer is placed by */
+    ngx_uint_t       slot;
+    ngx_queue_t      queue;
+} ngx_event_timer_t;
+
+
 struct ngx_event_s {
     void            *data;
 
@@ -111,7 +119,7 @@ struct ngx_event_s {
 
     ngx_log_t       *log;
 
-    ngx_rbtree_node_t   timer;
+    ngx_event_timer_t   timer;
 
     /* the posted queue */
     ngx_queue_t      queue;
@@ -474,6 +482,9 @@ extern ngx_atomic_t  *ngx_stat_active;
 extern ngx_atomic_t  *ngx_stat_reading;
 extern ngx_atomic_t  *ngx_stat_writing;
 extern ngx_atomic_t  *ngx_stat_waiting;
+extern ngx_atomic_t  *ngx_stat_udp_batches;
+extern ngx_atomic_t  *ngx_stat_udp_datagrams;
+extern ngx_atomic_t  *ngx_stat_idle_memory;
 
 #endif
 
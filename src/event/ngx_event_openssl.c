@@ -9,6 +9,9 @@
 #include <ngx_config.h>
 #include <ngx_core.h>
 #include <ngx_event.h>
+#if (NGX_THREADS)
+#include <ngx_thread_pool.h>
+#endif
 
 
 #define NGX_SSL_PASSWORD_BUFFER_SIZE  4096
@@ -27,6 +30,24 @@ typedef struct {
 } ngx_openssl_conf_t;
 
 
+#if (NGX_SSL_ASYNC_KEYS)
+
+struct ngx_ssl_async_s {
+    ngx_connection_t           *connection;
+    RSA                        *rsa;
+    int                         flen;
+    int                         padding;
+    int                         ret;
+    unsigned                    dec:1;
+    unsigned                    done:1;
+    unsigned                    cancelled:1;
+    u_char                     *from;
+    u_char                     *to;
+};
+
+#endif
+
+
 #if (NGX_HAVE_NTLS)
 static ngx_uint_t ngx_ssl_ntls_type(ngx_str_t *s);
 #endif
@@ -43,6 +64,22 @@ static int ngx_ssl_new_client_session(ngx_ssl_conn_t *ssl_conn,
 static ngx_int_t ngx_ssl_try_early_data(ngx_connection_t *c);
 #endif
 static void ngx_ssl_handshake_handler(ngx_event_t *ev);
+static ssize_t ngx_ssl_dyn_rec_size(ngx_connection_t *c, ssize_t size);
+#if (NGX_SSL_ASYNC_KEYS)
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
+static ngx_int_t ngx_ssl_async_disable_rsa_kx(ngx_conf_t *cf, ngx_ssl_t *ssl);
+#endif
+static ngx_int_t ngx_ssl_async_handshake(ngx_connection_t *c);
+static int ngx_ssl_async_rsa_priv_enc(int flen, const unsigned char *from,
+    unsigned char *to, RSA *rsa, int padding);
+static int ngx_ssl_async_rsa_priv_dec(int flen, const unsigned char *from,
+    unsigned char *to, RSA *rsa, int padding);
+static int ngx_ssl_async_rsa_op(int flen, const unsigned char *from,
+    unsigned char *to, RSA *rsa, int padding, ngx_uint_t dec);
+static void ngx_ssl_async_thread_handler(void *data, ngx_log_t *log);
+static void ngx_ssl_async_event_handler(ngx_event_t *ev);
+static void ngx_ssl_async_cleanup(ngx_connection_t *c);
+#endif
 #ifdef SSL_READ_EARLY_DATA_SUCCESS
 static ssize_t ngx_ssl_recv_early(ngx_connection_t *c, u_char *buf,
     size_t size);
@@ -71,16 +108,32 @@ static ngx_ssl_session_t *ngx_ssl_get_cached_session(ngx_ssl_conn_t *ssl_conn,
 #endif
     u_char *id, int len, int *copy);
 static void ngx_ssl_remove_session(SSL_CTX *ssl, ngx_ssl_session_t *sess);
-static void ngx_ssl_expire_sessions(ngx_ssl_session_cache_t *cache,
-    ngx_slab_pool_t *shpool, ngx_uint_t n);
+static void ngx_ssl_session_lock(ngx_ssl_session_stripe_t *stripe);
+static ngx_ssl_sess_id_t *ngx_ssl_session_lookup(
+    ngx_ssl_session_stripe_t *stripe, u_char *id, size_t len, uint32_t hash);
+static void ngx_ssl_free_session_slots(ngx_ssl_session_stripe_t *stripe,
+    ngx_ssl_sess_id_t *sess_id);
+static void ngx_ssl_expire_sessions(ngx_ssl_session_stripe_t *stripe,
+    ngx_uint_t n);
 static void ngx_ssl_session_rbtree_insert_value(ngx_rbtree_node_t *temp,
     ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel);
 
+#if (NGX_API)
+static ngx_int_t ngx_api_ssl_session_caches_handler(ngx_api_entry_data_t data,
+    ngx_api_ctx_t *actx, void *ctx);
+static ngx_int_t ngx_api_ssl_session_caches_iter(ngx_api_iter_ctx_t *ictx,
+    ngx_api_ctx_t *actx);
+static ngx_int_t ngx_api_ssl_session_cache_handler(ngx_api_entry_data_t data,
+    ngx_api_ctx_t *actx, void *ctx);
+#endif
+
 #ifdef SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB
 static int ngx_ssl_ticket_key_callback(ngx_ssl_conn_t *ssl_conn,
     unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *ectx,
     HMAC_CTX *hctx, int enc);
 static ngx_int_t ngx_ssl_rotate_ticket_keys(SSL_CTX *ssl_ctx, ngx_log_t *log);
+static ngx_int_t ngx_ssl_generate_ticket_key(ngx_ssl_ticket_key_t *key,
+    ngx_log_t *log);
 static void ngx_ssl_ticket_keys_cleanup(void *data);
 #endif
 
@@ -95,6 +148,7 @@ static time_t ngx_ssl_parse_time(
     ASN1_TIME *asn1time, ngx_log_t *log);
 
 static void *ngx_openssl_create_conf(ngx_cycle_t *cycle);
+static char *ngx_openssl_init_conf(ngx_cycle_t *cycle, void *conf);
 static char *ngx_openssl_engine(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
 static void ngx_openssl_exit(ngx_cycle_t *cycle);
 
@@ -115,7 +169,7 @@ static ngx_command_t  ngx_openssl_commands[] = {
 static ngx_core_module_t  ngx_openssl_module_ctx = {
     ngx_string("openssl"),
     ngx_openssl_create_conf,
-    NULL
+    ngx_openssl_init_conf
 };
 
 
@@ -135,6 +189,108 @@ ngx_module_t  ngx_openssl_module = {
 };
 
 
+#if (NGX_API)
+
+typedef struct {
+    ngx_uint_t                  stripes;
+    ngx_uint_t                  slots;
+    ngx_uint_t                  free;
+    ngx_uint_t                  sessions;
+    ngx_uint_t                  hits;
+    ngx_uint_t                  misses;
+    ngx_uint_t                  stored;
+    ngx_uint_t                  expired;
+    ngx_uint_t                  evicted;
+    ngx_uint_t                  lock_waits;
+} ngx_ssl_session_cache_stats_t;
+
+
+static ngx_api_entry_t  ngx_api_ssl_session_cache_slots_entries[] = {
+
+    {
+        .name      = ngx_string("total"),
+        .handler   = ngx_api_struct_int_handler,
+        .data.off  = offsetof(ngx_ssl_session_cache_stats_t, slots)
+    },
+
+    {
+        .name      = ngx_string("free"),
+        .handler   = ngx_api_struct_int_handler,
+        .data.off  = offsetof(ngx_ssl_session_cache_stats_t, free)
+    },
+
+    ngx_api_null_entry
+};
+
+
+static ngx_api_entry_t  ngx_api_ssl_session_cache_entries[] = {
+
+    {
+        .name      = ngx_string("stripes"),
+        .handler   = ngx_api_struct_int_handler,
+        .data.off  = offsetof(ngx_ssl_session_cache_stats_t, stripes)
+    },
+
+    {
+        .name      = ngx_string("slots"),
+        .handler   = ngx_api_object_handler,
+        .data.ents = ngx_api_ssl_session_cache_slots_entries
+    },
+
+    {
+        .name      = ngx_string("sessions"),
+        .handler   = ngx_api_struct_int_handler,
+        .data.off  = offsetof(ngx_ssl_session_cache_stats_t, sessions)
+    },
+
+    {
+        .name      = ngx_string("hits"),
+        .handler   = ngx_api_struct_int_handler,
+        .data.off  = offsetof(ngx_ssl_session_cache_stats_t, hits)
+    },
+
+    {
+        .name      = ngx_string("misses"),
+        .handler   = ngx_api_struct_int_handler,
+        .data.off  = offsetof(ngx_ssl_session_cache_stats_t, misses)
+    },
+
+    {
+        .name      = ngx_string("stored"),
+        .handler   = ngx_api_struct_int_handler,
+        .data.off  = offsetof(ngx_ssl_session_cache_stats_t, stored)
+    },
+
+    {
+        .name      = ngx_string("expired"),
+        .handler   = ngx_api_struct_int_handler,
+        .data.off  = offsetof(ngx_ssl_session_cache_stats_t, expired)
+    },
+
+    {
+        .name      = ngx_string("evicted"),
+        .handler   = ngx_api_struct_int_handler,
+        .data.off  = offsetof(ngx_ssl_session_cache_stats_t, evicted)
+    },
+
+    {
+        .name      = ngx_string("lock_waits"),
+        .handler   = ngx_api_struct_int_handler,
+        .data.off  = offsetof(ngx_ssl_session_cache_stats_t, lock_waits)
+    },
+
+    ngx_api_null_entry
+};
+
+
+static ngx_api_entry_t  ngx_api_ssl_session_caches_entry = {
+    .name      = ngx_string("ssl_session_caches"),
+    .handler   = ngx_api_ssl_session_caches_handler,
+};
+
+#endif
+
+
 int  ngx_ssl_connection_index;
 int  ngx_ssl_server_conf_index;
 int  ngx_ssl_session_cache_index;
@@ -143,6 +299,14 @@ int  ngx_ssl_ocsp_index;
 int  ngx_ssl_index;
 int  ngx_ssl_certificate_name_index;
 
+#if (NGX_SSL_ASYNC_KEYS)
+
+static int                ngx_ssl_async_index;
+static RSA_METHOD        *ngx_ssl_async_rsa_method;
+static ngx_connection_t  *ngx_ssl_async_connection;
+
+#endif
+
 
 ngx_int_t
 ngx_ssl_init(ngx_log_t *log)
@@ -273,6 +437,17 @@ ngx_ssl_init(ngx_log_t *log)
         return NGX_ERROR;
     }
 
+#if (NGX_SSL_ASYNC_KEYS)
+
+    ngx_ssl_async_index = RSA_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+
+    if (ngx_ssl_async_index == -1) {
+        ngx_ssl_error(NGX_LOG_ALERT, log, 0, "RSA_get_ex_new_index() failed");
+        return NGX_ERROR;
+    }
+
+#endif
+
     ngx_ssl_certificate_name_index = X509_get_ex_new_index(0, NULL, NULL, NULL,
                                                            NULL);
 
@@ -1661,6 +1836,108 @@ ngx_ssl_early_data(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_uint_t enable)
 }
 
 
+ngx_int_t
+ngx_ssl_ktls(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_uint_t enable)
+{
+    if (!enable) {
+        return NGX_OK;
+    }
+
+#if (defined SSL_OP_ENABLE_KTLS && !defined OPENSSL_NO_KTLS && !NGX_WIN32)
+
+    /*
+     * kernel TLS is enabled by OpenSSL after the handshake if supported
+     * by the kernel for the negotiated cipher; otherwise, the connection
+     * silently falls back to userspace encryption
+     */
+
+    SSL_CTX_set_options(ssl->ctx, SSL_OP_ENABLE_KTLS);
+
+#else
+    ngx_log_error(NGX_LOG_WARN, ssl->log, 0,
+                  "\"ssl_ktls\" is not supported on this platform, ignored");
+#endif
+
+    return NGX_OK;
+}
+
+
+ngx_int_t
+ngx_ssl_certificate_compression(ngx_conf_t *cf, ngx_ssl_t *ssl,
+    ngx_array_t *algorithms)
+{
+#ifdef TLSEXT_comp_cert_none
+
+    int          algs[3];
+    ngx_str_t   *name;
+    ngx_uint_t   i, n;
+
+    if (algorithms == NULL) {
+        return NGX_OK;
+    }
+
+    if (algorithms->nelts > 3) {
+        ngx_log_error(NGX_LOG_EMERG, ssl->log, 0,
+                      "too many certificate compression algorithms");
+        return NGX_ERROR;
+    }
+
+    name = algorithms->elts;
+    n = 0;
+
+    for (i = 0; i < algorithms->nelts; i++) {
+
+        if (ngx_strcmp(name[i].data, "zlib") == 0) {
+            algs[n++] = TLSEXT_comp_cert_zlib;
+
+        } else if (ngx_strcmp(name[i].data, "brotli") == 0) {
+            algs[n++] = TLSEXT_comp_cert_brotli;
+
+        } else if (ngx_strcmp(name[i].data, "zstd") == 0) {
+            algs[n++] = TLSEXT_comp_cert_zstd;
+
+        } else {
+            ngx_log_error(NGX_LOG_EMERG, ssl->log, 0,
+                          "unknown certificate compression algorithm \"%V\"",
+                          &name[i]);
+            return NGX_ERROR;
+        }
+    }
+
+    if (SSL_CTX_set1_cert_comp_preference(ssl->ctx, algs, n) == 0) {
+        ngx_ssl_error(NGX_LOG_EMERG, ssl->log, 0,
+                      "SSL_CTX_set1_cert_comp_preference() failed, "
+                      "algorithms might be not supported by the SSL library");
+        return NGX_ERROR;
+    }
+
+    /*
+     * certificates loaded from files are compressed once here,
+     * certificates loaded with variables are compressed on the fly
+     */
+
+    if (ssl->certs.nelts && SSL_CTX_compress_certs(ssl->ctx, 0) == 0) {
+        ngx_ssl_error(NGX_LOG_WARN, ssl->log, 0,
+                      "SSL_CTX_compress_certs() failed");
+        ERR_clear_error();
+    }
+
+#else
+
+    if (algorithms == NULL) {
+        return NGX_OK;
+    }
+
+    ngx_log_error(NGX_LOG_WARN, ssl->log, 0,
+                  "\"ssl_certificate_compression\" is not supported "
+                  "on this platform, ignored");
+
+#endif
+
+    return NGX_OK;
+}
+
+
 ngx_int_t
 ngx_ssl_conf_commands(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_array_t *commands)
 {
@@ -1782,6 +2059,10 @@ ngx_ssl_create_connection(ngx_ssl_t *ssl, ngx_connection_t *c, ngx_uint_t flags)
     sc->buffer = ((flags & NGX_SSL_BUFFER) != 0);
     sc->buffer_size = ssl->buffer_size;
 
+    if (ssl->dyn_rec.size) {
+        sc->dyn_rec = &ssl->dyn_rec;
+    }
+
     sc->session_ctx = ssl->ctx;
 
 #ifdef SSL_READ_EARLY_DATA_SUCCESS
@@ -1866,9 +2147,29 @@ ngx_ssl_set_session(ngx_connection_t *c, ngx_ssl_session_t *session)
 ngx_int_t
 ngx_ssl_handshake(ngx_connection_t *c)
 {
-    int        n, sslerr;
-    ngx_err_t  err;
-    ngx_int_t  rc;
+    int          n, sslerr;
+    ngx_err_t    err;
+    ngx_int_t    rc;
+#if (NGX_SSL_ASYNC_KEYS)
+    ngx_ssl_t   *ssl;
+#endif
+
+#if (NGX_SSL_ASYNC_KEYS)
+
+    if (c->ssl->async && !c->ssl->async->done) {
+        return NGX_AGAIN;
+    }
+
+    if (SSL_is_server(c->ssl->connection)) {
+        ssl = SSL_CTX_get_ex_data(SSL_get_SSL_CTX(c->ssl->connection),
+                                  ngx_ssl_index);
+
+        if (ssl && ssl->async_keys) {
+            SSL_set_mode(c->ssl->connection, SSL_MODE_ASYNC);
+        }
+    }
+
+#endif
 
 #ifdef SSL_READ_EARLY_DATA_SUCCESS
     if (c->ssl->try_early_data) {
@@ -1882,12 +2183,24 @@ ngx_ssl_handshake(ngx_connection_t *c)
 
     ngx_ssl_clear_error(c->log);
 
+#if (NGX_SSL_ASYNC_KEYS)
+    ngx_ssl_async_connection = c;
+#endif
+
     n = SSL_do_handshake(c->ssl->connection);
 
+#if (NGX_SSL_ASYNC_KEYS)
+    ngx_ssl_async_connection = NULL;
+#endif
+
     ngx_log_debug1(NGX_LOG_DEBUG_EVENT, c->log, 0, "SSL_do_handshake: %d", n);
 
     if (n == 1) {
 
+#if (NGX_SSL_ASYNC_KEYS)
+        SSL_clear_mode(c->ssl->connection, SSL_MODE_ASYNC);
+#endif
+
         if (ngx_handle_read_event(c->read, 0) != NGX_OK) {
             return NGX_ERROR;
         }
@@ -1928,6 +2241,16 @@ ngx_ssl_handshake(ngx_connection_t *c)
             c->ssl->sendfile = 1;
         }
 
+#endif
+
+#if (defined BIO_get_ktls_recv && !NGX_WIN32)
+
+        if (BIO_get_ktls_recv(SSL_get_rbio(c->ssl->connection)) == 1) {
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                           "BIO_get_ktls_recv(): 1");
+            c->ssl->ktls_recv = 1;
+        }
+
 #endif
 
         rc = ngx_ssl_ocsp_validate(c);
@@ -1983,6 +2306,12 @@ ngx_ssl_handshake(ngx_connection_t *c)
         return NGX_AGAIN;
     }
 
+#if (NGX_SSL_ASYNC_KEYS)
+    if (sslerr == SSL_ERROR_WANT_ASYNC) {
+        return ngx_ssl_async_handshake(c);
+    }
+#endif
+
     err = (sslerr == SSL_ERROR_SYSCALL) ? ngx_errno : 0;
 
     c->ssl->no_wait_shutdown = 1;
@@ -2026,8 +2355,16 @@ ngx_ssl_try_early_data(ngx_connection_t *c)
 
     readbytes = 0;
 
+#if (NGX_SSL_ASYNC_KEYS)
+    ngx_ssl_async_connection = c;
+#endif
+
     n = SSL_read_early_data(c->ssl->connection, &buf, 1, &readbytes);
 
+#if (NGX_SSL_ASYNC_KEYS)
+    ngx_ssl_async_connection = NULL;
+#endif
+
     ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
                    "SSL_read_early_data: %d, %uz", n, readbytes);
 
@@ -2038,6 +2375,10 @@ ngx_ssl_try_early_data(ngx_connection_t *c)
 
     if (n == SSL_READ_EARLY_DATA_SUCCESS) {
 
+#if (NGX_SSL_ASYNC_KEYS)
+        SSL_clear_mode(c->ssl->connection, SSL_MODE_ASYNC);
+#endif
+
         if (ngx_handle_read_event(c->read, 0) != NGX_OK) {
             return NGX_ERROR;
         }
@@ -2073,6 +2414,16 @@ ngx_ssl_try_early_data(ngx_connection_t *c)
             c->ssl->sendfile = 1;
         }
 
+#endif
+
+#if (defined BIO_get_ktls_recv && !NGX_WIN32)
+
+        if (BIO_get_ktls_recv(SSL_get_rbio(c->ssl->connection)) == 1) {
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                           "BIO_get_ktls_recv(): 1");
+            c->ssl->ktls_recv = 1;
+        }
+
 #endif
 
         rc = ngx_ssl_ocsp_validate(c);
@@ -2130,6 +2481,12 @@ ngx_ssl_try_early_data(ngx_connection_t *c)
         return NGX_AGAIN;
     }
 
+#if (NGX_SSL_ASYNC_KEYS)
+    if (sslerr == SSL_ERROR_WANT_ASYNC) {
+        return ngx_ssl_async_handshake(c);
+    }
+#endif
+
     err = (sslerr == SSL_ERROR_SYSCALL) ? ngx_errno : 0;
 
     c->ssl->no_wait_shutdown = 1;
@@ -2232,81 +2589,541 @@ ngx_ssl_handshake_handler(ngx_event_t *ev)
 }
 
 
-ssize_t
-ngx_ssl_recv_chain(ngx_connection_t *c, ngx_chain_t *cl, off_t limit)
+#if (NGX_SSL_ASYNC_KEYS)
+
+ngx_int_t
+ngx_ssl_async_keys(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_str_t *pool)
 {
-    u_char     *last;
-    ssize_t     n, bytes, size;
-    ngx_buf_t  *b;
+    int                 rc;
+    RSA                *rsa, *key;
+    EVP_PKEY           *pkey;
+    ngx_uint_t          n;
+    ngx_thread_pool_t  *tp;
+
+    tp = ngx_thread_pool_add(cf, pool->len ? pool : NULL);
+    if (tp == NULL) {
+        return NGX_ERROR;
+    }
 
-    bytes = 0;
+    if (ngx_ssl_async_rsa_method == NULL) {
 
-    b = cl->buf;
-    last = b->last;
+        ngx_ssl_async_rsa_method = RSA_meth_dup(RSA_PKCS1_OpenSSL());
+        if (ngx_ssl_async_rsa_method == NULL) {
+            ngx_ssl_error(NGX_LOG_EMERG, ssl->log, 0, "RSA_meth_dup() failed");
+            return NGX_ERROR;
+        }
 
-    for ( ;; ) {
-        size = b->end - last;
+        RSA_meth_set_priv_enc(ngx_ssl_async_rsa_method,
+                              ngx_ssl_async_rsa_priv_enc);
+        RSA_meth_set_priv_dec(ngx_ssl_async_rsa_method,
+                              ngx_ssl_async_rsa_priv_dec);
+    }
 
-        if (limit) {
-            if (bytes >= limit) {
-                return bytes;
-            }
+    /*
+     * RSA private keys are replaced with copies that use a method
+     * passing private key operations to the thread pool; such keys
+     * are treated by OpenSSL as foreign and handled by legacy code
+     */
 
-            if (bytes + size > limit) {
-                size = (ssize_t) (limit - bytes);
-            }
-        }
+    n = 0;
 
-        n = ngx_ssl_recv(c, last, size);
+    for (rc = SSL_CTX_set_current_cert(ssl->ctx, SSL_CERT_SET_FIRST);
+         rc;
+         rc = SSL_CTX_set_current_cert(ssl->ctx, SSL_CERT_SET_NEXT))
+    {
+        pkey = SSL_CTX_get0_privatekey(ssl->ctx);
 
-        if (n > 0) {
-            last += n;
-            bytes += n;
+        if (pkey == NULL || EVP_PKEY_base_id(pkey) != EVP_PKEY_RSA) {
+            continue;
+        }
 
-            if (!c->read->ready) {
-                return bytes;
-            }
+        rsa = EVP_PKEY_get1_RSA(pkey);
+        if (rsa == NULL) {
+            ngx_ssl_error(NGX_LOG_EMERG, ssl->log, 0,
+                          "EVP_PKEY_get1_RSA() failed");
+            return NGX_ERROR;
+        }
 
-            if (last == b->end) {
-                cl = cl->next;
+        key = RSAPrivateKey_dup(rsa);
 
-                if (cl == NULL) {
-                    return bytes;
-                }
+        RSA_free(rsa);
 
-                b = cl->buf;
-                last = b->last;
-            }
+        if (key == NULL) {
+            ngx_ssl_error(NGX_LOG_EMERG, ssl->log, 0,
+                          "RSAPrivateKey_dup() failed");
+            return NGX_ERROR;
+        }
 
-            continue;
+        if (RSA_set_method(key, ngx_ssl_async_rsa_method) == 0
+            || RSA_set_ex_data(key, ngx_ssl_async_index, tp) == 0)
+        {
+            ngx_ssl_error(NGX_LOG_EMERG, ssl->log, 0,
+                          "RSA_set_method() failed");
+            RSA_free(key);
+            return NGX_ERROR;
         }
 
-        if (bytes) {
+        pkey = EVP_PKEY_new();
+        if (pkey == NULL) {
+            ngx_ssl_error(NGX_LOG_EMERG, ssl->log, 0, "EVP_PKEY_new() failed");
+            RSA_free(key);
+            return NGX_ERROR;
+        }
 
-            if (n == 0 || n == NGX_ERROR) {
-                c->read->ready = 1;
-            }
+        if (EVP_PKEY_assign_RSA(pkey, key) == 0) {
+            ngx_ssl_error(NGX_LOG_EMERG, ssl->log, 0,
+                          "EVP_PKEY_assign_RSA() failed");
+            EVP_PKEY_free(pkey);
+            RSA_free(key);
+            return NGX_ERROR;
+        }
 
-            return bytes;
+        if (SSL_CTX_use_PrivateKey(ssl->ctx, pkey) == 0) {
+            ngx_ssl_error(NGX_LOG_EMERG, ssl->log, 0,
+                          "SSL_CTX_use_PrivateKey() failed");
+            EVP_PKEY_free(pkey);
+            return NGX_ERROR;
         }
 
-        return n;
+        EVP_PKEY_free(pkey);
+
+        n++;
     }
-}
 
+    if (n == 0) {
+        ngx_log_error(NGX_LOG_WARN, ssl->log, 0,
+                      "\"ssl_async_keys\" ignored, no RSA keys loaded");
+        return NGX_OK;
+    }
 
-ssize_t
-ngx_ssl_recv(ngx_connection_t *c, u_char *buf, size_t size)
-{
-    int  n, bytes;
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
 
-#ifdef SSL_READ_EARLY_DATA_SUCCESS
-    if (c->ssl->in_early) {
-        return ngx_ssl_recv_early(c, buf, size);
+    if (ngx_ssl_async_disable_rsa_kx(cf, ssl) != NGX_OK) {
+        return NGX_ERROR;
     }
+
 #endif
 
-    if (c->ssl->last == NGX_ERROR) {
+    ssl->async_keys = 1;
+
+    return NGX_OK;
+}
+
+
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
+
+static ngx_int_t
+ngx_ssl_async_disable_rsa_kx(ngx_conf_t *cf, ngx_ssl_t *ssl)
+{
+    int                    i, n, kx;
+    u_char                *p, *list;
+    size_t                 len;
+    const char            *name;
+    ngx_uint_t             disabled;
+    const SSL_CIPHER      *cipher;
+    STACK_OF(SSL_CIPHER)  *ciphers;
+
+    /*
+     * OpenSSL 3.0 does not support the TLS padding check used
+     * in RSA key exchange with keys of a custom RSA_METHOD,
+     * so such ciphers are removed from the list
+     */
+
+    ciphers = SSL_CTX_get_ciphers(ssl->ctx);
+    if (ciphers == NULL) {
+        return NGX_OK;
+    }
+
+    n = sk_SSL_CIPHER_num(ciphers);
+
+    len = 0;
+    disabled = 0;
+
+    for (i = 0; i < n; i++) {
+        cipher = sk_SSL_CIPHER_value(ciphers, i);
+        len += ngx_strlen(SSL_CIPHER_get_name(cipher)) + 1;
+    }
+
+    list = ngx_pnalloc(cf->temp_pool, len + 1);
+    if (list == NULL) {
+        return NGX_ERROR;
+    }
+
+    p = list;
+
+    for (i = 0; i < n; i++) {
+        cipher = sk_SSL_CIPHER_value(ciphers, i);
+
+        kx = SSL_CIPHER_get_kx_nid(cipher);
+
+        if (kx == NID_kx_any) {
+            /* TLSv1.3 */
+            continue;
+        }
+
+        if (kx == NID_kx_rsa) {
+            disabled++;
+            continue;
+        }
+
+        name = SSL_CIPHER_get_name(cipher);
+
+        if (p != list) {
+            *p++ = ':';
+        }
+
+        p = ngx_cpymem(p, name, ngx_strlen(name));
+    }
+
+    *p = '\0';
+
+    if (disabled == 0) {
+        return NGX_OK;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, ssl->log, 0,
+                   "ssl async keys disabled %ui RSA key exchange ciphers",
+                   disabled);
+
+    if (p == list || SSL_CTX_set_cipher_list(ssl->ctx, (char *) list) == 0) {
+        ngx_log_error(NGX_LOG_EMERG, ssl->log, 0,
+                      "\"ssl_async_keys\" is incompatible "
+                      "with RSA key exchange ciphers only");
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+#endif
+
+
+static ngx_int_t
+ngx_ssl_async_handshake(ngx_connection_t *c)
+{
+    ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, 0, "SSL handshake paused");
+
+    c->read->handler = ngx_ssl_handshake_handler;
+    c->write->handler = ngx_ssl_handshake_handler;
+
+    /*
+     * the handshake is resumed by the thread task completion handler;
+     * with level-triggered notifications, read events are disabled
+     * till then to avoid busy looping
+     */
+
+    if (!(ngx_event_flags & NGX_USE_CLEAR_EVENT) && c->read->active) {
+        if (ngx_del_event(c->read, NGX_READ_EVENT, 0) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+
+    return NGX_AGAIN;
+}
+
+
+static int
+ngx_ssl_async_rsa_priv_enc(int flen, const unsigned char *from,
+    unsigned char *to, RSA *rsa, int padding)
+{
+    return ngx_ssl_async_rsa_op(flen, from, to, rsa, padding, 0);
+}
+
+
+static int
+ngx_ssl_async_rsa_priv_dec(int flen, const unsigned char *from,
+    unsigned char *to, RSA *rsa, int padding)
+{
+    return ngx_ssl_async_rsa_op(flen, from, to, rsa, padding, 1);
+}
+
+
+static int
+ngx_ssl_async_rsa_op(int flen, const unsigned char *from, unsigned char *to,
+    RSA *rsa, int padding, ngx_uint_t dec)
+{
+    int                 ret;
+    size_t              size;
+    ngx_connection_t   *c;
+    ngx_ssl_async_t    *async;
+    ngx_thread_pool_t  *tp;
+    ngx_thread_task_t  *task;
+
+    c = ngx_ssl_async_connection;
+    tp = RSA_get_ex_data(rsa, ngx_ssl_async_index);
+
+    /*
+     * the operation is performed inline unless called from
+     * an asynchronous job started by a server handshake
+     */
+
+    if (c == NULL || tp == NULL || ASYNC_get_current_job() == NULL) {
+        goto local;
+    }
+
+    /*
+     * the task is allocated from the heap: if the connection is closed,
+     * the task may outlive it, and is freed by the completion handler
+     */
+
+    size = sizeof(ngx_thread_task_t) + sizeof(ngx_ssl_async_t)
+           + flen + RSA_size(rsa);
+
+    task = ngx_alloc(size, c->log);
+    if (task == NULL) {
+        goto local;
+    }
+
+    ngx_memzero(task, sizeof(ngx_thread_task_t) + sizeof(ngx_ssl_async_t));
+
+    async = (ngx_ssl_async_t *) (task + 1);
+
+    async->connection = c;
+    async->rsa = rsa;
+    async->flen = flen;
+    async->padding = padding;
+    async->dec = dec;
+
+    async->from = (u_char *) (async + 1);
+    async->to = async->from + flen;
+
+    ngx_memcpy(async->from, from, flen);
+
+    task->ctx = async;
+    task->handler = ngx_ssl_async_thread_handler;
+    task->priority = NGX_THREAD_TASK_HIGH;
+    task->event.data = task;
+    task->event.handler = ngx_ssl_async_event_handler;
+    task->event.log = ngx_cycle->log;
+
+    RSA_up_ref(rsa);
+
+    if (ngx_thread_task_post(tp, task) != NGX_OK) {
+        RSA_free(rsa);
+        ngx_free(task);
+        goto local;
+    }
+
+    c->ssl->async = async;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "ssl async %s posted", dec ? "decrypt" : "sign");
+
+    while (!async->done && !async->cancelled) {
+
+        if (ASYNC_pause_job() == 0) {
+            ngx_log_error(NGX_LOG_ALERT, c->log, 0, "ASYNC_pause_job() failed");
+            async->cancelled = 1;
+            c->ssl->async = NULL;
+            return -1;
+        }
+    }
+
+    if (async->cancelled) {
+        /* the connection is closed, the task will be freed on completion */
+        return -1;
+    }
+
+    c = async->connection;
+    c->ssl->async = NULL;
+
+    ret = async->ret;
+
+    if (ret > 0) {
+        ngx_memcpy(to, async->to, ret);
+    }
+
+    RSA_free(async->rsa);
+    ngx_free(task);
+
+    return ret;
+
+local:
+
+    if (dec) {
+        return RSA_meth_get_priv_dec(RSA_PKCS1_OpenSSL())(flen, from, to, rsa,
+                                                          padding);
+    }
+
+    return RSA_meth_get_priv_enc(RSA_PKCS1_OpenSSL())(flen, from, to, rsa,
+                                                      padding);
+}
+
+
+static void
+ngx_ssl_async_thread_handler(void *data, ngx_log_t *log)
+{
+    ngx_ssl_async_t *async = data;
+
+    const RSA_METHOD  *meth;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_CORE, log, 0, "ssl async thread handler");
+
+    meth = RSA_PKCS1_OpenSSL();
+
+    if (async->dec) {
+        async->ret = RSA_meth_get_priv_dec(meth)(async->flen, async->from,
+                                                 async->to, async->rsa,
+                                                 async->padding);
+
+    } else {
+        async->ret = RSA_meth_get_priv_enc(meth)(async->flen, async->from,
+                                                 async->to, async->rsa,
+                                                 async->padding);
+    }
+
+    /* the error queue is thread local, errors are reported by return code */
+
+    ERR_clear_error();
+}
+
+
+static void
+ngx_ssl_async_event_handler(ngx_event_t *ev)
+{
+    ngx_connection_t   *c;
+    ngx_ssl_async_t    *async;
+    ngx_thread_task_t  *task;
+
+    task = ev->data;
+    async = task->ctx;
+
+    if (async->cancelled) {
+        RSA_free(async->rsa);
+        ngx_free(task);
+        return;
+    }
+
+    c = async->connection;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "ssl async done: %d", async->ret);
+
+    async->done = 1;
+
+    ngx_post_event(c->read, &ngx_posted_events);
+}
+
+
+static void
+ngx_ssl_async_cleanup(ngx_connection_t *c)
+{
+    ngx_ssl_async_t  *async;
+
+    async = c->ssl->async;
+
+    if (async == NULL) {
+        return;
+    }
+
+    if (!async->done) {
+        async->cancelled = 1;
+    }
+
+    /*
+     * the paused job is resumed to let it complete, or fail if the
+     * operation is still in progress; otherwise it is never released
+     */
+
+    ngx_ssl_clear_error(c->log);
+
+    (void) SSL_do_handshake(c->ssl->connection);
+
+    ERR_clear_error();
+
+    c->ssl->async = NULL;
+}
+
+#else
+
+ngx_int_t
+ngx_ssl_async_keys(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_str_t *pool)
+{
+    ngx_log_error(NGX_LOG_EMERG, ssl->log, 0,
+                  "\"ssl_async_keys\" is not supported "
+                  "by the SSL library or platform");
+
+    return NGX_ERROR;
+}
+
+#endif
+
+
+ssize_t
+ngx_ssl_recv_chain(ngx_connection_t *c, ngx_chain_t *cl, off_t limit)
+{
+    u_char     *last;
+    ssize_t     n, bytes, size;
+    ngx_buf_t  *b;
+
+    bytes = 0;
+
+    b = cl->buf;
+    last = b->last;
+
+    for ( ;; ) {
+        size = b->end - last;
+
+        if (limit) {
+            if (bytes >= limit) {
+                return bytes;
+            }
+
+            if (bytes + size > limit) {
+                size = (ssize_t) (limit - bytes);
+            }
+        }
+
+        n = ngx_ssl_recv(c, last, size);
+
+        if (n > 0) {
+            last += n;
+            bytes += n;
+
+            if (!c->read->ready) {
+                return bytes;
+            }
+
+            if (last == b->end) {
+                cl = cl->next;
+
+                if (cl == NULL) {
+                    return bytes;
+                }
+
+                b = cl->buf;
+                last = b->last;
+            }
+
+            continue;
+        }
+
+        if (bytes) {
+
+            if (n == 0 || n == NGX_ERROR) {
+                c->read->ready = 1;
+            }
+
+            return bytes;
+        }
+
+        return n;
+    }
+}
+
+
+ssize_t
+ngx_ssl_recv(ngx_connection_t *c, u_char *buf, size_t size)
+{
+    int  n, bytes;
+
+#ifdef SSL_READ_EARLY_DATA_SUCCESS
+    if (c->ssl->in_early) {
+        return ngx_ssl_recv_early(c, buf, size);
+    }
+#endif
+
+    if (c->ssl->last == NGX_ERROR) {
         c->read->ready = 0;
         c->read->error = 1;
         return NGX_ERROR;
@@ -2698,7 +3515,13 @@ ngx_ssl_send_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
                 continue;
             }
 
-            n = ngx_ssl_write(c, in->buf->pos, in->buf->last - in->buf->pos);
+            size = in->buf->last - in->buf->pos;
+
+            if (c->ssl->dyn_rec) {
+                size = ngx_ssl_dyn_rec_size(c, size);
+            }
+
+            n = ngx_ssl_write(c, in->buf->pos, size);
 
             if (n == NGX_ERROR) {
                 return NGX_CHAIN_ERROR;
@@ -2708,6 +3531,8 @@ ngx_ssl_send_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
                 return in;
             }
 
+            c->ssl->dyn_rec_sent += n;
+
             in->buf->pos += n;
 
             if (in->buf->pos == in->buf->last) {
@@ -2830,6 +3655,10 @@ ngx_ssl_send_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
             return in;
         }
 
+        if (c->ssl->dyn_rec) {
+            size = ngx_ssl_dyn_rec_size(c, size);
+        }
+
         n = ngx_ssl_write(c, buf->pos, size);
 
         if (n == NGX_ERROR) {
@@ -2840,12 +3669,19 @@ ngx_ssl_send_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
             break;
         }
 
+        c->ssl->dyn_rec_sent += n;
+
         buf->pos += n;
 
         if (n < size) {
             break;
         }
 
+        if (buf->pos < buf->last) {
+            /* the rest of the buffer goes to the next record */
+            continue;
+        }
+
         flush = 0;
 
         buf->pos = buf->start;
@@ -3097,6 +3933,40 @@ ngx_ssl_write_early(ngx_connection_t *c, u_char *data, size_t size)
 #endif
 
 
+static ssize_t
+ngx_ssl_dyn_rec_size(ngx_connection_t *c, ssize_t size)
+{
+    ngx_ssl_dyn_rec_t  *dyn_rec;
+
+    /*
+     * small records are sent on a new connection, or after an idle
+     * period, to let the client decrypt data as soon as the first
+     * TCP segment arrives; full-sized records are used once enough
+     * data has been sent to grow the congestion window
+     */
+
+    dyn_rec = c->ssl->dyn_rec;
+
+    if (ngx_current_msec - c->ssl->dyn_rec_last > dyn_rec->timeout) {
+        c->ssl->dyn_rec_sent = 0;
+    }
+
+    c->ssl->dyn_rec_last = ngx_current_msec;
+
+    if (c->ssl->dyn_rec_sent < dyn_rec->threshold
+        && size > (ssize_t) dyn_rec->size)
+    {
+        size = dyn_rec->size;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "SSL record size: %z, sent: %uz",
+                   size, c->ssl->dyn_rec_sent);
+
+    return size;
+}
+
+
 static ssize_t
 ngx_ssl_sendfile(ngx_connection_t *c, ngx_buf_t *file, size_t size)
 {
@@ -3317,6 +4187,10 @@ ngx_ssl_shutdown(ngx_connection_t *c)
 
     ngx_ssl_ocsp_cleanup(c);
 
+#if (NGX_SSL_ASYNC_KEYS)
+    ngx_ssl_async_cleanup(c);
+#endif
+
     if (SSL_in_init(c->ssl->connection)) {
         /*
          * OpenSSL 1.0.2f complains if SSL_shutdown() is called during
@@ -3968,12 +4842,60 @@ failed:
 }
 
 
+ngx_shm_zone_t *
+ngx_ssl_session_cache_zone(ngx_conf_t *cf, ngx_str_t *spec, void *tag)
+{
+    ngx_str_t               s;
+    ngx_shm_zone_t         *shm_zone;
+    ngx_shm_zone_params_t   zp;
+
+    ngx_memzero(&zp, sizeof(ngx_shm_zone_params_t));
+
+    zp.min_size = 8 * ngx_pagesize;
+    zp.size = NGX_CONF_UNSET;
+    zp.restorable = 1;
+    zp.numa_aware = 1;
+    zp.tag = tag;
+
+    s.len = sizeof(NGX_SSL_SESSION_CACHE_SIGNATURE) + NGX_INT64_LEN * 2 + 3;
+
+    s.data = ngx_pnalloc(cf->pool, s.len);
+    if (s.data == NULL) {
+        return NULL;
+    }
+
+    s.len = ngx_sprintf(s.data, "%s:%z:%z;", NGX_SSL_SESSION_CACHE_SIGNATURE,
+                        sizeof(ngx_ssl_session_cache_t),
+                        sizeof(ngx_ssl_session_stripe_t))
+            - s.data;
+
+    zp.signature = s;
+
+    if (ngx_conf_parse_zone_spec(cf, &zp, spec) != NGX_OK) {
+        return NULL;
+    }
+
+    shm_zone = ngx_shared_memory_add_ext(cf, &zp);
+    if (shm_zone == NULL) {
+        return NULL;
+    }
+
+    shm_zone->init = ngx_ssl_session_cache_init;
+
+    return shm_zone;
+}
+
+
 ngx_int_t
 ngx_ssl_session_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 {
-    size_t                    len;
-    ngx_slab_pool_t          *shpool;
-    ngx_ssl_session_cache_t  *cache;
+    u_char                    *p, *file;
+    size_t                     len;
+    ngx_uint_t                 i, k, n, slots;
+    ngx_slab_pool_t           *shpool;
+    ngx_ssl_sess_slot_t       *slot;
+    ngx_ssl_session_cache_t   *cache;
+    ngx_ssl_session_stripe_t  *stripe;
 
     if (data) {
         shm_zone->data = data;
@@ -3982,12 +4904,46 @@ ngx_ssl_session_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 
     shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
 
+#if (NGX_HAVE_ATOMIC_OPS)
+    file = NULL;
+#else
+    file = shpool->mutex.name;
+#endif
+
     if (shm_zone->shm.exists) {
-        shm_zone->data = shpool->data;
+        cache = shpool->data;
+        shm_zone->data = cache;
+
+        if (!shm_zone->restore) {
+            return NGX_OK;
+        }
+
+        /*
+         * the zone was restored from a file: stripe locks are recreated,
+         * and rbtree insert handlers may point to the previous binary
+         */
+
+        for (i = 0; i < cache->nstripes; i++) {
+            stripe = cache->stripes[i];
+
+            ngx_memzero(&stripe->lock, sizeof(ngx_shmtx_sh_t));
+            ngx_memzero(&stripe->mutex, sizeof(ngx_shmtx_t));
+
+            if (ngx_shmtx_create(&stripe->mutex, &stripe->lock, file)
+                != NGX_OK)
+            {
+                return NGX_ERROR;
+            }
+
+            stripe->session_rbtree.insert = ngx_ssl_session_rbtree_insert_value;
+        }
+
+        shpool->log_nomem = 0;
+
         return NGX_OK;
     }
 
-    cache = ngx_slab_alloc(shpool, sizeof(ngx_ssl_session_cache_t));
+    cache = ngx_slab_calloc(shpool, sizeof(ngx_ssl_session_cache_t));
     if (cache == NULL) {
         return NGX_ERROR;
     }
@@ -3995,17 +4951,6 @@ ngx_ssl_session_cache_init(ngx_shm_zone_t *shm_zone, void *data)
     shpool->data = cache;
     shm_zone->data = cache;
 
-    ngx_rbtree_init(&cache->session_rbtree, &cache->sentinel,
-                    ngx_ssl_session_rbtree_insert_value);
-
-    ngx_queue_init(&cache->expire_queue);
-
-    cache->ticket_keys[0].expire = 0;
-    cache->ticket_keys[1].expire = 0;
-    cache->ticket_keys[2].expire = 0;
-
-    cache->fail_time = 0;
-
     len = sizeof(" in SSL session shared cache \"\"") + shm_zone->shm.name.len;
 
     shpool->log_ctx = ngx_slab_alloc(shpool, len);
@@ -4018,6 +4963,88 @@ ngx_ssl_session_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 
     shpool->log_nomem = 0;
 
+    /*
+     * the cache is split into stripes, each with its own lock, rbtree,
+     * expiration queue and preallocated fixed-size slots; there are
+     * at least as many stripes as CPUs, as long as each stripe is able
+     * to hold at least 128 sessions
+     */
+
+    n = NGX_SSL_SESSION_STRIPES;
+
+    while (n < (ngx_uint_t) ngx_ncpu) {
+        n *= 2;
+    }
+
+    slots = shpool->pfree * (ngx_pagesize / NGX_SSL_SESSION_SLOT_SIZE);
+
+    while (n > 1 && slots / n < 128) {
+        n /= 2;
+    }
+
+    cache->nstripes = n;
+
+    cache->stripes = ngx_slab_alloc(shpool,
+                                    n * sizeof(ngx_ssl_session_stripe_t *));
+    if (cache->stripes == NULL) {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < n; i++) {
+
+        /*
+         * stripes are allocated separately: slab allocations are aligned
+         * to their size, so the locks of different stripes do not share
+         * cache lines
+         */
+
+        stripe = ngx_slab_calloc(shpool, sizeof(ngx_ssl_session_stripe_t));
+        if (stripe == NULL) {
+            return NGX_ERROR;
+        }
+
+        if (ngx_shmtx_create(&stripe->mutex, &stripe->lock, file) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        ngx_rbtree_init(&stripe->session_rbtree, &stripe->sentinel,
+                        ngx_ssl_session_rbtree_insert_value);
+
+        ngx_queue_init(&stripe->expire_queue);
+
+        cache->stripes[i] = stripe;
+    }
+
+    /* the rest of the zone is divided into session slots */
+
+    for (i = 0; /* void */ ; i++) {
+
+        p = ngx_slab_alloc(shpool, ngx_pagesize);
+        if (p == NULL) {
+            break;
+        }
+
+        stripe = cache->stripes[i % n];
+
+        for (k = 0; k + NGX_SSL_SESSION_SLOT_SIZE <= ngx_pagesize;
+             k += NGX_SSL_SESSION_SLOT_SIZE)
+        {
+            slot = (ngx_ssl_sess_slot_t *) (p + k);
+
+            slot->next = stripe->free;
+            stripe->free = slot;
+
+            stripe->nfree++;
+            stripe->nslots++;
+        }
+    }
+
+    if (cache->stripes[0]->nslots == 0) {
+        ngx_log_error(NGX_LOG_EMERG, shm_zone->shm.log, 0,
+                      "no memory for sessions%s", shpool->log_ctx);
+        return NGX_ERROR;
+    }
+
     return NGX_OK;
 }
 
@@ -4028,32 +5055,45 @@ ngx_ssl_session_cache_init(ngx_shm_zone_t *shm_zone, void *data)
  * Typical length of the external ASN1 representation of a session
  * is about 150 bytes plus SNI server name.
  *
- * On 32-bit platforms we allocate an rbtree node, a session id, and
- * an ASN1 representation in a single allocation, it typically takes
- * 256 bytes.
- *
- * On 64-bit platforms we allocate separately an rbtree node + session_id,
- * and an ASN1 representation, they take accordingly 128 and 256 bytes.
+ * A session is stored in a chain of fixed-size slots taken from the
+ * free list of the stripe selected by the session id hash: the first
+ * slot holds an rbtree node, a session id, and the beginning of the ASN1
+ * representation, the rest of it is kept in continuation slots.
+ * Slots are never returned to the slab allocator, so the zone does
+ * not fragment, and typical sessions fit into a single slot.
  *
  * OpenSSL's i2d_SSL_SESSION() and d2i_SSL_SESSION are slow,
- * so they are outside the code locked by shared pool mutex
+ * so they are outside the code locked by stripe mutex
  */
 
+#define ngx_ssl_session_first_size                                            \
+    (NGX_SSL_SESSION_SLOT_SIZE - offsetof(ngx_ssl_sess_id_t, session))
+
+#define ngx_ssl_session_next_size                                             \
+    (NGX_SSL_SESSION_SLOT_SIZE - offsetof(ngx_ssl_sess_slot_t, data))
+
+#define ngx_ssl_session_stripe(cache, hash)                                   \
+    (cache)->stripes[(hash) & ((cache)->nstripes - 1)]
+
+
 static int
 ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn, ngx_ssl_session_t *sess)
 {
-    int                       len;
-    u_char                   *p, *session_id;
-    size_t                    n;
-    uint32_t                  hash;
-    SSL_CTX                  *ssl_ctx;
-    unsigned int              session_id_length;
-    ngx_shm_zone_t           *shm_zone;
-    ngx_connection_t         *c;
-    ngx_slab_pool_t          *shpool;
-    ngx_ssl_sess_id_t        *sess_id;
-    ngx_ssl_session_cache_t  *cache;
-    u_char                    buf[NGX_SSL_MAX_SESSION_SIZE];
+    int                        len;
+    u_char                    *p, *session_id;
+    size_t                     size;
+    uint32_t                   hash;
+    SSL_CTX                   *ssl_ctx;
+    ngx_uint_t                 n;
+    unsigned int               session_id_length;
+    ngx_shm_zone_t            *shm_zone;
+    ngx_connection_t          *c;
+    ngx_slab_pool_t           *shpool;
+    ngx_ssl_sess_id_t         *sess_id;
+    ngx_ssl_sess_slot_t       *slot, **next;
+    ngx_ssl_session_cache_t   *cache;
+    ngx_ssl_session_stripe_t  *stripe;
+    u_char                     buf[NGX_SSL_MAX_SESSION_SIZE];
 
 #ifdef TLS1_3_VERSION
 
@@ -4099,56 +5139,59 @@ ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn, ngx_ssl_session_t *sess)
     cache = shm_zone->data;
     shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
 
-    ngx_shmtx_lock(&shpool->mutex);
+    hash = ngx_crc32_short(session_id, session_id_length);
+
+    n = 1;
 
-    /* drop one or two expired sessions */
-    ngx_ssl_expire_sessions(cache, shpool, 1);
+    if ((size_t) len > ngx_ssl_session_first_size) {
+        n += (len - ngx_ssl_session_first_size + ngx_ssl_session_next_size - 1)
+             / ngx_ssl_session_next_size;
+    }
 
-#if (NGX_PTR_SIZE == 8)
-    n = sizeof(ngx_ssl_sess_id_t);
-#else
-    n = offsetof(ngx_ssl_sess_id_t, session) + len;
-#endif
+    stripe = ngx_ssl_session_stripe(cache, hash);
 
-    sess_id = ngx_slab_alloc_locked(shpool, n);
+    if (n > stripe->nslots) {
+        goto failed;
+    }
 
-    if (sess_id == NULL) {
+    ngx_ssl_session_lock(stripe);
 
-        /* drop the oldest non-expired session and try once more */
+    /* drop one or two expired sessions */
+    ngx_ssl_expire_sessions(stripe, 1);
 
-        ngx_ssl_expire_sessions(cache, shpool, 0);
+    while (stripe->nfree < n) {
 
-        sess_id = ngx_slab_alloc_locked(shpool, n);
+        /* drop the oldest non-expired sessions until there is enough room */
 
-        if (sess_id == NULL) {
-            goto failed;
-        }
+        ngx_ssl_expire_sessions(stripe, 0);
     }
 
-#if (NGX_PTR_SIZE == 8)
+    stripe->nfree -= n;
 
-    sess_id->session = ngx_slab_alloc_locked(shpool, len);
+    sess_id = (ngx_ssl_sess_id_t *) stripe->free;
+    slot = stripe->free->next;
 
-    if (sess_id->session == NULL) {
+    size = ngx_min((size_t) len, ngx_ssl_session_first_size);
+    ngx_memcpy(sess_id->session, buf, size);
+    p = buf + size;
 
-        /* drop the oldest non-expired session and try once more */
+    next = &sess_id->next;
 
-        ngx_ssl_expire_sessions(cache, shpool, 0);
+    while (--n) {
+        size = ngx_min((size_t) (buf + len - p), ngx_ssl_session_next_size);
+        ngx_memcpy(slot->data, p, size);
+        p += size;
 
-        sess_id->session = ngx_slab_alloc_locked(shpool, len);
-
-        if (sess_id->session == NULL) {
-            goto failed;
-        }
+        *next = slot;
+        next = &slot->next;
+        slot = slot->next;
     }
 
-#endif
+    *next = NULL;
+    stripe->free = slot;
 
-    ngx_memcpy(sess_id->session, buf, len);
     ngx_memcpy(sess_id->id, session_id, session_id_length);
 
-    hash = ngx_crc32_short(session_id, session_id_length);
-
     ngx_log_debug3(NGX_LOG_DEBUG_EVENT, c->log, 0,
                    "ssl new session: %08XD:%ud:%d",
                    hash, session_id_length, len);
@@ -4159,22 +5202,19 @@ ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn, ngx_ssl_session_t *sess)
 
     sess_id->expire = ngx_time() + SSL_CTX_get_timeout(ssl_ctx);
 
-    ngx_queue_insert_head(&cache->expire_queue, &sess_id->queue);
+    ngx_queue_insert_head(&stripe->expire_queue, &sess_id->queue);
 
-    ngx_rbtree_insert(&cache->session_rbtree, &sess_id->node);
+    ngx_rbtree_insert(&stripe->session_rbtree, &sess_id->node);
 
-    ngx_shmtx_unlock(&shpool->mutex);
+    stripe->nsessions++;
+    stripe->stored++;
+
+    ngx_shmtx_unlock(&stripe->mutex);
 
     return 0;
 
 failed:
 
-    if (sess_id) {
-        ngx_slab_free_locked(shpool, sess_id);
-    }
-
-    ngx_shmtx_unlock(&shpool->mutex);
-
     if (cache->fail_time != ngx_time()) {
         cache->fail_time = ngx_time();
         ngx_log_error(NGX_LOG_WARN, c->log, 0,
@@ -4192,18 +5232,18 @@ ngx_ssl_get_cached_session(ngx_ssl_conn_t *ssl_conn,
 #endif
     u_char *id, int len, int *copy)
 {
-    size_t                    slen;
-    uint32_t                  hash;
-    ngx_int_t                 rc;
-    const u_char             *p;
-    ngx_shm_zone_t           *shm_zone;
-    ngx_slab_pool_t          *shpool;
-    ngx_rbtree_node_t        *node, *sentinel;
-    ngx_ssl_session_t        *sess;
-    ngx_ssl_sess_id_t        *sess_id;
-    ngx_ssl_session_cache_t  *cache;
-    u_char                    buf[NGX_SSL_MAX_SESSION_SIZE];
-    ngx_connection_t         *c;
+    size_t                     slen, size;
+    u_char                    *p;
+    uint32_t                   hash;
+    const u_char              *q;
+    ngx_shm_zone_t            *shm_zone;
+    ngx_connection_t          *c;
+    ngx_ssl_session_t         *sess;
+    ngx_ssl_sess_id_t         *sess_id;
+    ngx_ssl_sess_slot_t       *slot;
+    ngx_ssl_session_cache_t   *cache;
+    ngx_ssl_session_stripe_t  *stripe;
+    u_char                     buf[NGX_SSL_MAX_SESSION_SIZE];
 
     hash = ngx_crc32_short((u_char *) (uintptr_t) id, (size_t) len);
     *copy = 0;
@@ -4218,71 +5258,45 @@ ngx_ssl_get_cached_session(ngx_ssl_conn_t *ssl_conn,
 
     cache = shm_zone->data;
 
-    sess = NULL;
-
-    shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
-
-    ngx_shmtx_lock(&shpool->mutex);
-
-    node = cache->session_rbtree.root;
-    sentinel = cache->session_rbtree.sentinel;
-
-    while (node != sentinel) {
-
-        if (hash < node->key) {
-            node = node->left;
-            continue;
-        }
-
-        if (hash > node->key) {
-            node = node->right;
-            continue;
-        }
-
-        /* hash == node->key */
-
-        sess_id = (ngx_ssl_sess_id_t *) node;
-
-        rc = ngx_memn2cmp((u_char *) (uintptr_t) id, sess_id->id,
-                          (size_t) len, (size_t) node->data);
-
-        if (rc == 0) {
+    stripe = ngx_ssl_session_stripe(cache, hash);
 
-            if (sess_id->expire > ngx_time()) {
-                slen = sess_id->len;
+    ngx_ssl_session_lock(stripe);
 
-                ngx_memcpy(buf, sess_id->session, slen);
-
-                ngx_shmtx_unlock(&shpool->mutex);
-
-                p = buf;
-                sess = d2i_SSL_SESSION(NULL, &p, slen);
-
-                return sess;
-            }
+    sess_id = ngx_ssl_session_lookup(stripe, (u_char *) (uintptr_t) id,
+                                     (size_t) len, hash);
 
-            ngx_queue_remove(&sess_id->queue);
+    if (sess_id == NULL) {
+        stripe->misses++;
+        ngx_shmtx_unlock(&stripe->mutex);
+        return NULL;
+    }
 
-            ngx_rbtree_delete(&cache->session_rbtree, node);
+    if (sess_id->expire <= ngx_time()) {
+        ngx_ssl_free_session_slots(stripe, sess_id);
 
-            ngx_explicit_memzero(sess_id->session, sess_id->len);
+        stripe->expired++;
+        stripe->misses++;
 
-#if (NGX_PTR_SIZE == 8)
-            ngx_slab_free_locked(shpool, sess_id->session);
-#endif
-            ngx_slab_free_locked(shpool, sess_id);
+        ngx_shmtx_unlock(&stripe->mutex);
+        return NULL;
+    }
 
-            sess = NULL;
+    slen = sess_id->len;
 
-            goto done;
-        }
+    size = ngx_min(slen, ngx_ssl_session_first_size);
+    p = ngx_cpymem(buf, sess_id->session, size);
 
-        node = (rc < 0) ? node->left : node->right;
+    for (slot = sess_id->next; slot; slot = slot->next) {
+        size = ngx_min((size_t) (buf + slen - p), ngx_ssl_session_next_size);
+        p = ngx_cpymem(p, slot->data, size);
     }
 
-done:
+    stripe->hits++;
 
-    ngx_shmtx_unlock(&shpool->mutex);
+    ngx_shmtx_unlock(&stripe->mutex);
+
+    q = buf;
+    sess = d2i_SSL_SESSION(NULL, &q, slen);
 
     return sess;
 }
@@ -4300,15 +5314,13 @@ ngx_ssl_remove_cached_session(SSL_CTX *ssl, ngx_ssl_session_t *sess)
 static void
 ngx_ssl_remove_session(SSL_CTX *ssl, ngx_ssl_session_t *sess)
 {
-    u_char                   *id;
-    uint32_t                  hash;
-    ngx_int_t                 rc;
-    unsigned int              len;
-    ngx_shm_zone_t           *shm_zone;
-    ngx_slab_pool_t          *shpool;
-    ngx_rbtree_node_t        *node, *sentinel;
-    ngx_ssl_sess_id_t        *sess_id;
-    ngx_ssl_session_cache_t  *cache;
+    u_char                    *id;
+    uint32_t                   hash;
+    unsigned int               len;
+    ngx_shm_zone_t            *shm_zone;
+    ngx_ssl_sess_id_t         *sess_id;
+    ngx_ssl_session_cache_t   *cache;
+    ngx_ssl_session_stripe_t  *stripe;
 
     shm_zone = SSL_CTX_get_ex_data(ssl, ngx_ssl_session_cache_index);
 
@@ -4325,12 +5337,43 @@ ngx_ssl_remove_session(SSL_CTX *ssl, ngx_ssl_session_t *sess)
     ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ngx_cycle->log, 0,
                    "ssl remove session: %08XD:%ud", hash, len);
 
-    shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+    stripe = ngx_ssl_session_stripe(cache, hash);
+
+    ngx_ssl_session_lock(stripe);
+
+    sess_id = ngx_ssl_session_lookup(stripe, id, len, hash);
+
+    if (sess_id) {
+        ngx_ssl_free_session_slots(stripe, sess_id);
+    }
+
+    ngx_shmtx_unlock(&stripe->mutex);
+}
 
-    ngx_shmtx_lock(&shpool->mutex);
 
-    node = cache->session_rbtree.root;
-    sentinel = cache->session_rbtree.sentinel;
+static void
+ngx_ssl_session_lock(ngx_ssl_session_stripe_t *stripe)
+{
+    if (ngx_shmtx_trylock(&stripe->mutex)) {
+        return;
+    }
+
+    ngx_shmtx_lock(&stripe->mutex);
+
+    stripe->lock_waits++;
+}
+
+
+static ngx_ssl_sess_id_t *
+ngx_ssl_session_lookup(ngx_ssl_session_stripe_t *stripe, u_char *id,
+    size_t len, uint32_t hash)
+{
+    ngx_int_t           rc;
+    ngx_rbtree_node_t  *node, *sentinel;
+    ngx_ssl_sess_id_t  *sess_id;
+
+    node = stripe->session_rbtree.root;
+    sentinel = stripe->session_rbtree.sentinel;
 
     while (node != sentinel) {
 
@@ -4351,33 +5394,54 @@ ngx_ssl_remove_session(SSL_CTX *ssl, ngx_ssl_session_t *sess)
         rc = ngx_memn2cmp(id, sess_id->id, len, (size_t) node->data);
 
         if (rc == 0) {
+            return sess_id;
+        }
+
+        node = (rc < 0) ? node->left : node->right;
+    }
 
-            ngx_queue_remove(&sess_id->queue);
+    return NULL;
+}
 
-            ngx_rbtree_delete(&cache->session_rbtree, node);
 
-            ngx_explicit_memzero(sess_id->session, sess_id->len);
+static void
+ngx_ssl_free_session_slots(ngx_ssl_session_stripe_t *stripe,
+    ngx_ssl_sess_id_t *sess_id)
+{
+    ngx_ssl_sess_slot_t  *slot, *next;
 
-#if (NGX_PTR_SIZE == 8)
-            ngx_slab_free_locked(shpool, sess_id->session);
-#endif
-            ngx_slab_free_locked(shpool, sess_id);
+    ngx_queue_remove(&sess_id->queue);
 
-            goto done;
-        }
+    ngx_rbtree_delete(&stripe->session_rbtree, &sess_id->node);
 
-        node = (rc < 0) ? node->left : node->right;
-    }
+    stripe->nsessions--;
 
-done:
+    next = sess_id->next;
 
-    ngx_shmtx_unlock(&shpool->mutex);
+    ngx_explicit_memzero(sess_id->session, ngx_ssl_session_first_size);
+
+    slot = (ngx_ssl_sess_slot_t *) sess_id;
+
+    for ( ;; ) {
+        slot->next = stripe->free;
+        stripe->free = slot;
+        stripe->nfree++;
+
+        slot = next;
+
+        if (slot == NULL) {
+            break;
+        }
+
+        next = slot->next;
+
+        ngx_explicit_memzero(slot->data, ngx_ssl_session_next_size);
+    }
 }
 
 
 static void
-ngx_ssl_expire_sessions(ngx_ssl_session_cache_t *cache,
-    ngx_slab_pool_t *shpool, ngx_uint_t n)
+ngx_ssl_expire_sessions(ngx_ssl_session_stripe_t *stripe, ngx_uint_t n)
 {
     time_t              now;
     ngx_queue_t        *q;
@@ -4387,31 +5451,30 @@ ngx_ssl_expire_sessions(ngx_ssl_session_cache_t *cache,
 
     while (n < 3) {
 
-        if (ngx_queue_empty(&cache->expire_queue)) {
+        if (ngx_queue_empty(&stripe->expire_queue)) {
             return;
         }
 
-        q = ngx_queue_last(&cache->expire_queue);
+        q = ngx_queue_last(&stripe->expire_queue);
 
         sess_id = ngx_queue_data(q, ngx_ssl_sess_id_t, queue);
 
-        if (n++ != 0 && sess_id->expire > now) {
-            return;
-        }
+        if (sess_id->expire > now) {
+            if (n++ != 0) {
+                return;
+            }
+
+            stripe->evicted++;
 
-        ngx_queue_remove(q);
+        } else {
+            n++;
+            stripe->expired++;
+        }
 
         ngx_log_debug1(NGX_LOG_DEBUG_EVENT, ngx_cycle->log, 0,
                        "expire session: %08Xi", sess_id->node.key);
 
-        ngx_rbtree_delete(&cache->session_rbtree, &sess_id->node);
-
-        ngx_explicit_memzero(sess_id->session, sess_id->len);
-
-#if (NGX_PTR_SIZE == 8)
-        ngx_slab_free_locked(shpool, sess_id->session);
-#endif
-        ngx_slab_free_locked(shpool, sess_id);
+        ngx_ssl_free_session_slots(stripe, sess_id);
     }
 }
 
@@ -4458,34 +5521,174 @@ ngx_ssl_session_rbtree_insert_value(ngx_rbtree_node_t *temp,
 }
 
 
+#if (NGX_API)
+
+static ngx_int_t
+ngx_api_ssl_session_caches_handler(ngx_api_entry_data_t data,
+    ngx_api_ctx_t *actx, void *ctx)
+{
+    ngx_list_part_t     part;
+    ngx_api_iter_ctx_t  ictx;
+
+    part = ngx_cycle->shared_memory.part;
+
+    ictx.entry.handler = ngx_api_ssl_session_cache_handler;
+    ictx.entry.data.ents = ngx_api_ssl_session_cache_entries;
+    ictx.elts = &part;
+
+    return ngx_api_object_iterate(ngx_api_ssl_session_caches_iter, &ictx,
+                                  actx);
+}
+
+
+static ngx_int_t
+ngx_api_ssl_session_caches_iter(ngx_api_iter_ctx_t *ictx, ngx_api_ctx_t *actx)
+{
+    ngx_shm_zone_t   *shm_zone;
+    ngx_list_part_t  *part;
+
+    part = ictx->elts;
+
+    for ( ;; ) {
+        if (part->nelts == 0) {
+            if (part->next == NULL) {
+                return NGX_DECLINED;
+            }
+
+            *part = *part->next;
+        }
+
+        shm_zone = part->elts;
+
+        part->elts = shm_zone + 1;
+        part->nelts--;
+
+        if (shm_zone->init != ngx_ssl_session_cache_init) {
+            continue;
+        }
+
+        ictx->entry.name = shm_zone->shm.name;
+        ictx->ctx = shm_zone->data;
+
+        return NGX_OK;
+    }
+}
+
+
+static ngx_int_t
+ngx_api_ssl_session_cache_handler(ngx_api_entry_data_t data,
+    ngx_api_ctx_t *actx, void *ctx)
+{
+    ngx_ssl_session_cache_t *cache = ctx;
+
+    ngx_uint_t                      i;
+    ngx_ssl_session_stripe_t       *stripe;
+    ngx_ssl_session_cache_stats_t  *stats;
+
+    stats = ngx_pcalloc(actx->pool, sizeof(ngx_ssl_session_cache_stats_t));
+    if (stats == NULL) {
+        return NGX_ERROR;
+    }
+
+    stats->stripes = cache->nstripes;
+
+    /* counters are read without locking, the result is approximate */
+
+    for (i = 0; i < cache->nstripes; i++) {
+        stripe = cache->stripes[i];
+
+        stats->slots += stripe->nslots;
+        stats->free += stripe->nfree;
+        stats->sessions += stripe->nsessions;
+        stats->hits += stripe->hits;
+        stats->misses += stripe->misses;
+        stats->stored += stripe->stored;
+        stats->expired += stripe->expired;
+        stats->evicted += stripe->evicted;
+        stats->lock_waits += stripe->lock_waits;
+    }
+
+    return ngx_api_object_handler(data, actx, stats);
+}
+
+#endif
+
+
 #ifdef SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB
 
 ngx_int_t
-ngx_ssl_session_ticket_keys(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_array_t *paths)
+ngx_ssl_session_ticket_keys(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_array_t *paths,
+    time_t rotation, ngx_uint_t keep)
 {
-    u_char                 buf[80];
-    size_t                 size;
-    ssize_t                n;
-    ngx_str_t             *path;
-    ngx_file_t             file;
-    ngx_uint_t             i;
-    ngx_array_t           *keys;
-    ngx_file_info_t        fi;
-    ngx_pool_cleanup_t    *cln;
-    ngx_ssl_ticket_key_t  *key;
+    u_char                  buf[80];
+    size_t                  size;
+    ssize_t                 n;
+    time_t                  timeout;
+    ngx_str_t              *path;
+    ngx_file_t              file;
+    ngx_uint_t              i, nkeys;
+    ngx_array_t            *keys;
+    ngx_file_info_t         fi;
+    ngx_pool_cleanup_t     *cln;
+    ngx_ssl_ticket_key_t   *key;
+    ngx_ssl_ticket_keys_t  *tk;
+
+    if (paths && rotation) {
+        ngx_log_error(NGX_LOG_EMERG, ssl->log, 0,
+                      "\"ssl_session_ticket_key_rotation\" cannot be used "
+                      "with \"ssl_session_ticket_key\"");
+        return NGX_ERROR;
+    }
 
     if (paths == NULL
         && SSL_CTX_get_ex_data(ssl->ctx, ngx_ssl_session_cache_index) == NULL)
     {
+        if (rotation) {
+            ngx_log_error(NGX_LOG_EMERG, ssl->log, 0,
+                          "\"ssl_session_ticket_key_rotation\" requires "
+                          "shared \"ssl_session_cache\"");
+            return NGX_ERROR;
+        }
+
         return NGX_OK;
     }
 
-    keys = ngx_array_create(cf->pool, paths ? paths->nelts : 3,
-                            sizeof(ngx_ssl_ticket_key_t));
-    if (keys == NULL) {
+    if (paths) {
+        nkeys = paths->nelts;
+
+    } else if (rotation) {
+
+        /*
+         * keep enough previous keys to decrypt tickets issued
+         * during the session timeout, unless specified explicitly
+         */
+
+        if (keep == 0) {
+            timeout = SSL_CTX_get_timeout(ssl->ctx);
+            keep = (timeout + rotation - 1) / rotation;
+        }
+
+        nkeys = ngx_min(keep, NGX_SSL_TICKET_KEYS - 1) + 1;
+
+    } else {
+        nkeys = 2;
+    }
+
+    tk = ngx_pcalloc(cf->pool, sizeof(ngx_ssl_ticket_keys_t));
+    if (tk == NULL) {
+        return NGX_ERROR;
+    }
+
+    keys = &tk->keys;
+
+    if (ngx_array_init(keys, cf->pool, nkeys, sizeof(ngx_ssl_ticket_key_t))
+        != NGX_OK)
+    {
         return NGX_ERROR;
     }
 
+    tk->rotation = rotation;
+
     cln = ngx_pool_cleanup_add(cf->pool, 0);
     if (cln == NULL) {
         return NGX_ERROR;
@@ -4494,7 +5697,7 @@ ngx_ssl_session_ticket_keys(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_array_t *paths)
     cln->handler = ngx_ssl_ticket_keys_cleanup;
     cln->data = keys;
 
-    if (SSL_CTX_set_ex_data(ssl->ctx, ngx_ssl_ticket_keys_index, keys) == 0) {
+    if (SSL_CTX_set_ex_data(ssl->ctx, ngx_ssl_ticket_keys_index, tk) == 0) {
         ngx_ssl_error(NGX_LOG_EMERG, ssl->log, 0,
                       "SSL_CTX_set_ex_data() failed");
         return NGX_ERROR;
@@ -4515,13 +5718,12 @@ ngx_ssl_session_ticket_keys(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_array_t *paths)
 
         /* placeholder for keys in shared memory */
 
-        key = ngx_array_push_n(keys, 3);
-        key[0].shared = 1;
-        key[0].expire = 0;
-        key[1].shared = 1;
-        key[1].expire = 0;
-        key[2].shared = 1;
-        key[2].expire = 0;
+        key = ngx_array_push_n(keys, nkeys);
+
+        for (i = 0; i < nkeys; i++) {
+            key[i].shared = 1;
+            key[i].expire = 0;
+        }
 
         return NGX_OK;
     }
@@ -4624,14 +5826,15 @@ ngx_ssl_ticket_key_callback(ngx_ssl_conn_t *ssl_conn,
     unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *ectx,
     HMAC_CTX *hctx, int enc)
 {
-    size_t                 size;
-    SSL_CTX               *ssl_ctx;
-    ngx_uint_t             i;
-    ngx_array_t           *keys;
-    ngx_connection_t      *c;
-    ngx_ssl_ticket_key_t  *key;
-    const EVP_MD          *digest;
-    const EVP_CIPHER      *cipher;
+    size_t                  size;
+    SSL_CTX                *ssl_ctx;
+    ngx_uint_t              i;
+    ngx_array_t            *keys;
+    ngx_connection_t       *c;
+    ngx_ssl_ticket_key_t   *key;
+    ngx_ssl_ticket_keys_t  *tk;
+    const EVP_MD           *digest;
+    const EVP_CIPHER       *cipher;
 
     c = ngx_ssl_get_connection(ssl_conn);
     ssl_ctx = c->ssl->session_ctx;
@@ -4646,11 +5849,12 @@ ngx_ssl_ticket_key_callback(ngx_ssl_conn_t *ssl_conn,
     digest = EVP_sha256();
 #endif
 
-    keys = SSL_CTX_get_ex_data(ssl_ctx, ngx_ssl_ticket_keys_index);
-    if (keys == NULL) {
+    tk = SSL_CTX_get_ex_data(ssl_ctx, ngx_ssl_ticket_keys_index);
+    if (tk == NULL) {
         return -1;
     }
 
+    keys = &tk->keys;
     key = keys->elts;
 
     if (enc == 1) {
@@ -4762,19 +5966,19 @@ static ngx_int_t
 ngx_ssl_rotate_ticket_keys(SSL_CTX *ssl_ctx, ngx_log_t *log)
 {
     time_t                    now, expire;
-    ngx_array_t              *keys;
+    ngx_uint_t                i, rotate;
     ngx_shm_zone_t           *shm_zone;
     ngx_slab_pool_t          *shpool;
     ngx_ssl_ticket_key_t     *key;
+    ngx_ssl_ticket_keys_t    *tk;
     ngx_ssl_session_cache_t  *cache;
-    u_char                    buf[80];
 
-    keys = SSL_CTX_get_ex_data(ssl_ctx, ngx_ssl_ticket_keys_index);
-    if (keys == NULL) {
+    tk = SSL_CTX_get_ex_data(ssl_ctx, ngx_ssl_ticket_keys_index);
+    if (tk == NULL) {
         return NGX_OK;
     }
 
-    key = keys->elts;
+    key = tk->keys.elts;
 
     if (!key[0].shared) {
         return NGX_OK;
@@ -4782,7 +5986,7 @@ ngx_ssl_rotate_ticket_keys(SSL_CTX *ssl_ctx, ngx_log_t *log)
 
     /*
      * if we don't need to update expiration of the current key
-     * and the previous key is still needed, don't sync with shared
+     * and it is not yet time to rotate it, don't sync with shared
      * memory to save some work; in the worst case other worker process
      * will switch to the next key, but this process will still be able
      * to decrypt tickets encrypted with it
@@ -4791,7 +5995,14 @@ ngx_ssl_rotate_ticket_keys(SSL_CTX *ssl_ctx, ngx_log_t *log)
     now = ngx_time();
     expire = now + SSL_CTX_get_timeout(ssl_ctx);
 
-    if (key[0].expire >= expire && key[1].expire >= now) {
+    if (tk->rotation) {
+        rotate = (tk->rotate <= now);
+
+    } else {
+        rotate = (key[1].expire < now);
+    }
+
+    if (key[0].expire >= expire && !rotate) {
         return NGX_OK;
     }
 
@@ -4806,65 +6017,58 @@ ngx_ssl_rotate_ticket_keys(SSL_CTX *ssl_ctx, ngx_log_t *log)
 
     if (key[0].expire == 0) {
 
-        /* initialize the current key */
+        /*
+         * initialize the current key and the next key; previous keys
+         * are initialized with the current key, so no stale or empty
+         * key can be used for decryption
+         */
 
-        if (RAND_bytes(buf, 80) != 1) {
-            ngx_ssl_error(NGX_LOG_ALERT, log, 0, "RAND_bytes() failed");
+        if (ngx_ssl_generate_ticket_key(&key[0], log) != NGX_OK
+            || ngx_ssl_generate_ticket_key(&cache->ticket_key_next, log)
+               != NGX_OK)
+        {
             ngx_shmtx_unlock(&shpool->mutex);
             return NGX_ERROR;
         }
 
-        key[0].shared = 1;
         key[0].expire = expire;
-        key[0].size = 80;
-        ngx_memcpy(key[0].name, buf, 16);
-        ngx_memcpy(key[0].hmac_key, buf + 16, 32);
-        ngx_memcpy(key[0].aes_key, buf + 48, 32);
 
-        ngx_explicit_memzero(&buf, 80);
+        for (i = 1; i < NGX_SSL_TICKET_KEYS; i++) {
+            key[i] = key[0];
+        }
 
-        ngx_log_debug2(NGX_LOG_DEBUG_EVENT, log, 0,
-                       "ssl ticket key: \"%*xs\"",
-                       (size_t) 16, key[0].name);
+        cache->ticket_key_rotate = now + tk->rotation;
+    }
 
-        /*
-         * copy the current key to the next key, as initialization of
-         * the previous key will replace the current key with the next
-         * key
-         */
+    if (tk->rotation) {
+        rotate = (cache->ticket_key_rotate <= now);
 
-        key[2] = key[0];
+    } else {
+        rotate = (key[1].expire < now);
     }
 
-    if (key[1].expire < now) {
+    if (rotate) {
 
         /*
-         * if the previous key is no longer needed (or not initialized),
-         * replace it with the current key, replace the current key with
+         * if it is time to rotate keys, or the previous key is no longer
+         * needed, shift previous keys, replace the current key with
          * the next key, and generate new next key
          */
 
-        key[1] = key[0];
-        key[0] = key[2];
+        for (i = NGX_SSL_TICKET_KEYS - 1; i > 0; i--) {
+            key[i] = key[i - 1];
+        }
+
+        key[0] = cache->ticket_key_next;
 
-        if (RAND_bytes(buf, 80) != 1) {
-            ngx_ssl_error(NGX_LOG_ALERT, log, 0, "RAND_bytes() failed");
+        if (ngx_ssl_generate_ticket_key(&cache->ticket_key_next, log)
+            != NGX_OK)
+        {
             ngx_shmtx_unlock(&shpool->mutex);
             return NGX_ERROR;
         }
 
-        key[2].shared = 1;
-        key[2].expire = 0;
-        key[2].size = 80;
-        ngx_memcpy(key[2].name, buf, 16);
-        ngx_memcpy(key[2].hmac_key, buf + 16, 32);
-        ngx_memcpy(key[2].aes_key, buf + 48, 32);
-
-        ngx_explicit_memzero(&buf, 80);
-
-        ngx_log_debug2(NGX_LOG_DEBUG_EVENT, log, 0,
-                       "ssl ticket key: \"%*xs\"",
-                       (size_t) 16, key[2].name);
+        cache->ticket_key_rotate = now + tk->rotation;
     }
 
     /*
@@ -4878,8 +6082,10 @@ ngx_ssl_rotate_ticket_keys(SSL_CTX *ssl_ctx, ngx_log_t *log)
 
     /* sync keys to the worker process memory */
 
-    ngx_memcpy(keys->elts, cache->ticket_keys,
-               2 * sizeof(ngx_ssl_ticket_key_t));
+    ngx_memcpy(tk->keys.elts, cache->ticket_keys,
+               tk->keys.nelts * sizeof(ngx_ssl_ticket_key_t));
+
+    tk->rotate = cache->ticket_key_rotate;
 
     ngx_shmtx_unlock(&shpool->mutex);
 
@@ -4887,6 +6093,33 @@ ngx_ssl_rotate_ticket_keys(SSL_CTX *ssl_ctx, ngx_log_t *log)
 }
 
 
+static ngx_int_t
+ngx_ssl_generate_ticket_key(ngx_ssl_ticket_key_t *key, ngx_log_t *log)
+{
+    u_char  buf[80];
+
+    if (RAND_bytes(buf, 80) != 1) {
+        ngx_ssl_error(NGX_LOG_ALERT, log, 0, "RAND_bytes() failed");
+        return NGX_ERROR;
+    }
+
+    key->shared = 1;
+    key->expire = 0;
+    key->size = 80;
+    ngx_memcpy(key->name, buf, 16);
+    ngx_memcpy(key->hmac_key, buf + 16, 32);
+    ngx_memcpy(key->aes_key, buf + 48, 32);
+
+    ngx_explicit_memzero(&buf, 80);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, log, 0,
+                   "ssl ticket key: \"%*xs\"",
+                   (size_t) 16, key->name);
+
+    return NGX_OK;
+}
+
+
 static void
 ngx_ssl_ticket_keys_cleanup(void *data)
 {
@@ -4899,7 +6132,8 @@ ngx_ssl_ticket_keys_cleanup(void *data)
 #else
 
 ngx_int_t
-ngx_ssl_session_ticket_keys(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_array_t *paths)
+ngx_ssl_session_ticket_keys(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_array_t *paths,
+    time_t rotation, ngx_uint_t keep)
 {
     if (paths) {
         ngx_log_error(NGX_LOG_WARN, ssl->log, 0,
@@ -5346,6 +6580,26 @@ ngx_ssl_get_session_reused(ngx_connection_t *c, ngx_pool_t *pool, ngx_str_t *s)
 }
 
 
+ngx_int_t
+ngx_ssl_get_ktls(ngx_connection_t *c, ngx_pool_t *pool, ngx_str_t *s)
+{
+    if (c->ssl->sendfile && c->ssl->ktls_recv) {
+        ngx_str_set(s, "tx,rx");
+
+    } else if (c->ssl->sendfile) {
+        ngx_str_set(s, "tx");
+
+    } else if (c->ssl->ktls_recv) {
+        ngx_str_set(s, "rx");
+
+    } else {
+        s->len = 0;
+    }
+
+    return NGX_OK;
+}
+
+
 ngx_int_t
 ngx_ssl_get_early_data(ngx_connection_t *c, ngx_pool_t *pool, ngx_str_t *s)
 {
@@ -6234,6 +7488,21 @@ ngx_openssl_create_conf(ngx_cycle_t *cycle)
 }
 
 
+static char *
+ngx_openssl_init_conf(ngx_cycle_t *cycle, void *conf)
+{
+#if (NGX_API)
+    if (ngx_api_add(cycle, "/status", &ngx_api_ssl_session_caches_entry)
+        != NGX_OK)
+    {
+        return NGX_CONF_ERROR;
+    }
+#endif
+
+    return NGX_CONF_OK;
+}
+
+
 static char *
 ngx_openssl_engine(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
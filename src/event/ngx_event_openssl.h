@@ -84,7 +84,17 @@
 #endif
 
 
+#if (NGX_THREADS && defined SSL_MODE_ASYNC && !defined OPENSSL_NO_ASYNC     \
+     && !defined LIBRESSL_VERSION_NUMBER)
+#include <openssl/async.h>
+#define NGX_SSL_ASYNC_KEYS  1
+#endif
+
+
 typedef struct ngx_ssl_ocsp_s   ngx_ssl_ocsp_t;
+#if (NGX_SSL_ASYNC_KEYS)
+typedef struct ngx_ssl_async_s  ngx_ssl_async_t;
+#endif
 
 
 #if (NGX_API)
@@ -94,19 +104,32 @@ typedef struct {
     ngx_atomic_t                reuses;
     ngx_atomic_t                timedout;
     ngx_atomic_t                failed;
+    ngx_atomic_t                ktls;
 } ngx_ssl_stats_t;
 
 #endif
 
+typedef struct {
+    size_t                      size;
+    size_t                      threshold;
+    ngx_msec_t                  timeout;
+} ngx_ssl_dyn_rec_t;
+
+
 struct ngx_ssl_s {
     SSL_CTX                    *ctx;
     ngx_log_t                  *log;
     size_t                      buffer_size;
+    ngx_ssl_dyn_rec_t           dyn_rec;
 
     ngx_array_t                 certs;
 
     ngx_rbtree_t                staple_rbtree;
     ngx_rbtree_node_t           staple_sentinel;
+
+#if (NGX_SSL_ASYNC_KEYS)
+    unsigned                    async_keys:1;
+#endif
 };
 
 
@@ -118,6 +141,10 @@ struct ngx_ssl_connection_s {
     ngx_buf_t                  *buf;
     size_t                      buffer_size;
 
+    ngx_ssl_dyn_rec_t          *dyn_rec;
+    size_t                      dyn_rec_sent;
+    ngx_msec_t                  dyn_rec_last;
+
     ngx_connection_handler_pt   handler;
 
     ngx_ssl_session_t          *session;
@@ -128,6 +155,10 @@ struct ngx_ssl_connection_s {
 
     ngx_ssl_ocsp_t             *ocsp;
 
+#if (NGX_SSL_ASYNC_KEYS)
+    ngx_ssl_async_t            *async;
+#endif
+
     u_char                      early_buf;
 
     unsigned                    handshaked:1;
@@ -135,6 +166,7 @@ struct ngx_ssl_connection_s {
     unsigned                    renegotiation:1;
     unsigned                    buffer:1;
     unsigned                    sendfile:1;
+    unsigned                    ktls_recv:1;
     unsigned                    no_wait_shutdown:1;
     unsigned                    no_send_shutdown:1;
     unsigned                    shutdown_without_free:1;
@@ -156,7 +188,24 @@ struct ngx_ssl_connection_s {
 
 #define NGX_SSL_MAX_SESSION_SIZE  4096
 
-typedef struct ngx_ssl_sess_id_s  ngx_ssl_sess_id_t;
+#define NGX_SSL_SESSION_SLOT_SIZE  320
+#define NGX_SSL_SESSION_STRIPES    16
+#define NGX_SSL_TICKET_KEYS        8
+
+#define NGX_SSL_SESSION_CACHE_SIGNATURE                                       \
+    "ssl-session-cache:"                                                      \
+    ngx_value(NGX_PTR_SIZE) ":"                                               \
+    ngx_value(NGX_TIME_T_SIZE) ":"                                            \
+    ngx_value(NGX_SSL_SESSION_SLOT_SIZE) ":"                                  \
+    ngx_value(NGX_SSL_TICKET_KEYS)
+
+typedef struct ngx_ssl_sess_id_s    ngx_ssl_sess_id_t;
+typedef struct ngx_ssl_sess_slot_s  ngx_ssl_sess_slot_t;
+
+struct ngx_ssl_sess_slot_s {
+    ngx_ssl_sess_slot_t        *next;
+    u_char                      data[1];
+};
 
 struct ngx_ssl_sess_id_s {
     ngx_rbtree_node_t           node;
@@ -164,11 +213,8 @@ struct ngx_ssl_sess_id_s {
     ngx_queue_t                 queue;
     time_t                      expire;
     u_char                      id[32];
-#if (NGX_PTR_SIZE == 8)
-    u_char                     *session;
-#else
+    ngx_ssl_sess_slot_t        *next;
     u_char                      session[1];
-#endif
 };
 
 
@@ -183,10 +229,40 @@ typedef struct {
 
 
 typedef struct {
+    ngx_array_t                 keys;
+    time_t                      rotation;
+    time_t                      rotate;
+} ngx_ssl_ticket_keys_t;
+
+
+typedef struct {
+    ngx_shmtx_sh_t              lock;
+    ngx_shmtx_t                 mutex;
+
     ngx_rbtree_t                session_rbtree;
     ngx_rbtree_node_t           sentinel;
     ngx_queue_t                 expire_queue;
-    ngx_ssl_ticket_key_t        ticket_keys[3];
+
+    ngx_ssl_sess_slot_t        *free;
+    ngx_uint_t                  nfree;
+    ngx_uint_t                  nslots;
+    ngx_uint_t                  nsessions;
+
+    ngx_uint_t                  hits;
+    ngx_uint_t                  misses;
+    ngx_uint_t                  stored;
+    ngx_uint_t                  expired;
+    ngx_uint_t                  evicted;
+    ngx_uint_t                  lock_waits;
+} ngx_ssl_session_stripe_t;
+
+
+typedef struct {
+    ngx_ssl_session_stripe_t  **stripes;
+    ngx_uint_t                  nstripes;
+    ngx_ssl_ticket_key_t        ticket_keys[NGX_SSL_TICKET_KEYS];
+    ngx_ssl_ticket_key_t        ticket_key_next;
+    time_t                      ticket_key_rotate;
     time_t                      fail_time;
 } ngx_ssl_session_cache_t;
 
@@ -211,6 +287,11 @@ typedef struct {
 
 #define NGX_SSL_BUFSIZE  16384
 
+/* an MSS of 1460 minus TCP timestamps and TLS record overhead */
+#define NGX_SSL_DYN_REC_SIZE       1369
+#define NGX_SSL_DYN_REC_THRESHOLD  (1024 * 1024)
+#define NGX_SSL_DYN_REC_TIMEOUT    1000
+
 
 #define NGX_SSL_CACHE_CERT  0
 #define NGX_SSL_CACHE_PKEY  1
@@ -269,6 +350,9 @@ ngx_int_t ngx_ssl_dhparam(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_str_t *file);
 ngx_int_t ngx_ssl_ecdh_curve(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_str_t *name);
 ngx_int_t ngx_ssl_early_data(ngx_conf_t *cf, ngx_ssl_t *ssl,
     ngx_uint_t enable);
+ngx_int_t ngx_ssl_ktls(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_uint_t enable);
+ngx_int_t ngx_ssl_certificate_compression(ngx_conf_t *cf, ngx_ssl_t *ssl,
+    ngx_array_t *algorithms);
 ngx_int_t ngx_ssl_conf_commands(ngx_conf_t *cf, ngx_ssl_t *ssl,
     ngx_array_t *commands);
 
@@ -278,8 +362,11 @@ ngx_int_t ngx_ssl_session_cache(ngx_ssl_t *ssl, ngx_str_t *sess_ctx,
     ngx_array_t *certificates, ssize_t builtin_session_cache,
     ngx_shm_zone_t *shm_zone, time_t timeout);
 ngx_int_t ngx_ssl_session_ticket_keys(ngx_conf_t *cf, ngx_ssl_t *ssl,
-    ngx_array_t *paths);
+    ngx_array_t *paths, time_t rotation, ngx_uint_t keep);
+ngx_shm_zone_t *ngx_ssl_session_cache_zone(ngx_conf_t *cf, ngx_str_t *spec,
+    void *tag);
 ngx_int_t ngx_ssl_session_cache_init(ngx_shm_zone_t *shm_zone, void *data);
+ngx_int_t ngx_ssl_async_keys(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_str_t *pool);
 
 ngx_int_t ngx_ssl_create_connection(ngx_ssl_t *ssl, ngx_connection_t *c,
     ngx_uint_t flags);
@@ -318,6 +405,8 @@ ngx_int_t ngx_ssl_get_session_id(ngx_connection_t *c, ngx_pool_t *pool,
     ngx_str_t *s);
 ngx_int_t ngx_ssl_get_session_reused(ngx_connection_t *c, ngx_pool_t *pool,
     ngx_str_t *s);
+ngx_int_t ngx_ssl_get_ktls(ngx_connection_t *c, ngx_pool_t *pool,
+    ngx_str_t *s);
 ngx_int_t ngx_ssl_get_early_data(ngx_connection_t *c, ngx_pool_t *pool,
     ngx_str_t *s);
 ngx_int_t ngx_ssl_get_server_name(ngx_connection_t *c, ngx_pool_t *pool,
@@ -0,0 +1,531 @@
+
+/*
+ * Copyright (C) 2026 Web Server LLC
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_event.h>
+
+
+#define ngx_reuseport_bpf_get_conf(cycle)                                     \
+    (ngx_reuseport_bpf_conf_t *)                                              \
+        ngx_get_conf(cycle->conf_ctx, ngx_reuseport_bpf_module)
+
+#define ngx_reuseport_bpf_get_old_conf(cycle)                                 \
+    cycle->old_cycle->conf_ctx ? ngx_reuseport_bpf_get_conf(cycle->old_cycle) \
+                               : NULL
+
+#define ngx_core_get_conf(cycle)                                              \
+    (ngx_core_conf_t *) ngx_get_conf(cycle->conf_ctx, ngx_core_module)
+
+
+typedef struct {
+    ngx_queue_t           queue;
+    int                   map_fd;     /* worker => socket */
+
+    struct sockaddr      *sockaddr;
+    socklen_t             socklen;
+    int                   type;
+} ngx_reuseport_bpf_group_t;
+
+
+typedef struct {
+    ngx_flag_t            enabled;
+    ngx_queue_t           groups;     /* of ngx_reuseport_bpf_group_t */
+} ngx_reuseport_bpf_conf_t;
+
+
+static void *ngx_reuseport_bpf_create_conf(ngx_cycle_t *cycle);
+static ngx_int_t ngx_reuseport_bpf_module_init(ngx_cycle_t *cycle);
+
+static void ngx_reuseport_bpf_cleanup(void *data);
+static ngx_inline void ngx_reuseport_bpf_close(ngx_log_t *log, int fd,
+    const char *name);
+
+static ngx_reuseport_bpf_group_t *ngx_reuseport_bpf_find_group(
+    ngx_reuseport_bpf_conf_t *rcf, ngx_listening_t *ls);
+static ngx_reuseport_bpf_group_t *ngx_reuseport_bpf_get_group(
+    ngx_cycle_t *cycle, ngx_listening_t *ls);
+static ngx_int_t ngx_reuseport_bpf_attach(ngx_cycle_t *cycle,
+    ngx_listening_t *ls);
+static int ngx_reuseport_bpf_cpu_map(ngx_cycle_t *cycle);
+#if (defined SO_DETACH_REUSEPORT_BPF)
+static void ngx_reuseport_bpf_detach(ngx_cycle_t *cycle, ngx_listening_t *ls);
+#endif
+
+
+/*
+ * The program selects the socket of the worker process bound
+ * to the CPU that handles the packet:
+ *
+ *     cpu = bpf_get_smp_processor_id();
+ *     worker = bpf_map_lookup_elem(&ngx_reuseport_cpumap, &cpu);
+ *
+ *     if (worker) {
+ *         bpf_sk_select_reuseport(ctx, &ngx_reuseport_sockmap, worker, 0);
+ *     }
+ *
+ *     return SK_PASS;
+ *
+ * If no socket is selected, the kernel falls back to hashing.
+ */
+
+static struct bpf_insn  ngx_reuseport_bpf_insn[] = {
+    /* opcode dst          src         offset imm */
+    { 0xbf,   BPF_REG_6,   BPF_REG_1, (int16_t)      0,        0x0 },
+    { 0x85,   BPF_REG_0,   BPF_REG_0, (int16_t)      0,
+                                        BPF_FUNC_get_smp_processor_id },
+    { 0x63,  BPF_REG_10,   BPF_REG_0, (int16_t)     -4,        0x0 },
+    { 0x18,   BPF_REG_1,   BPF_REG_0, (int16_t)      0,        0x0 },
+    {  0x0,   BPF_REG_0,   BPF_REG_0, (int16_t)      0,        0x0 },
+    { 0xbf,   BPF_REG_2,  BPF_REG_10, (int16_t)      0,        0x0 },
+    {  0x7,   BPF_REG_2,   BPF_REG_0, (int16_t)      0,         -4 },
+    { 0x85,   BPF_REG_0,   BPF_REG_0, (int16_t)      0,
+                                        BPF_FUNC_map_lookup_elem },
+    { 0x15,   BPF_REG_0,   BPF_REG_0, (int16_t)      9,        0x0 },
+    { 0x61,   BPF_REG_1,   BPF_REG_0, (int16_t)      0,        0x0 },
+    { 0x63,  BPF_REG_10,   BPF_REG_1, (int16_t)     -8,        0x0 },
+    { 0xbf,   BPF_REG_1,   BPF_REG_6, (int16_t)      0,        0x0 },
+    { 0x18,   BPF_REG_2,   BPF_REG_0, (int16_t)      0,        0x0 },
+    {  0x0,   BPF_REG_0,   BPF_REG_0, (int16_t)      0,        0x0 },
+    { 0xbf,   BPF_REG_3,  BPF_REG_10, (int16_t)      0,        0x0 },
+    {  0x7,   BPF_REG_3,   BPF_REG_0, (int16_t)      0,         -8 },
+    { 0xb7,   BPF_REG_4,   BPF_REG_0, (int16_t)      0,        0x0 },
+    { 0x85,   BPF_REG_0,   BPF_REG_0, (int16_t)      0,
+                                        BPF_FUNC_sk_select_reuseport },
+    { 0xb7,   BPF_REG_0,   BPF_REG_0, (int16_t)      0,    SK_PASS },
+    { 0x95,   BPF_REG_0,   BPF_REG_0, (int16_t)      0,        0x0 },
+};
+
+
+static ngx_bpf_reloc_t  ngx_reuseport_bpf_reloc[] = {
+    { "ngx_reuseport_cpumap", 3 },
+    { "ngx_reuseport_sockmap", 12 },
+};
+
+
+static ngx_bpf_program_t  ngx_reuseport_bpf_program = {
+    .relocs = ngx_reuseport_bpf_reloc,
+    .nrelocs = sizeof(ngx_reuseport_bpf_reloc)
+               / sizeof(ngx_reuseport_bpf_reloc[0]),
+    .ins = ngx_reuseport_bpf_insn,
+    .nins = sizeof(ngx_reuseport_bpf_insn)
+            / sizeof(ngx_reuseport_bpf_insn[0]),
+    .license = "BSD",
+    .type = BPF_PROG_TYPE_SK_REUSEPORT,
+};
+
+
+static ngx_command_t  ngx_reuseport_bpf_commands[] = {
+
+    { ngx_string("reuseport_bpf"),
+      NGX_MAIN_CONF|NGX_DIRECT_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      0,
+      offsetof(ngx_reuseport_bpf_conf_t, enabled),
+      NULL },
+
+      ngx_null_command
+};
+
+
+static ngx_core_module_t  ngx_reuseport_bpf_module_ctx = {
+    ngx_string("reuseport_bpf"),
+    ngx_reuseport_bpf_create_conf,
+    NULL
+};
+
+
+ngx_module_t  ngx_reuseport_bpf_module = {
+    NGX_MODULE_V1,
+    &ngx_reuseport_bpf_module_ctx,         /* module context */
+    ngx_reuseport_bpf_commands,            /* module directives */
+    NGX_CORE_MODULE,                       /* module type */
+    NULL,                                  /* init master */
+    ngx_reuseport_bpf_module_init,         /* init module */
+    NULL,                                  /* init process */
+    NULL,                                  /* init thread */
+    NULL,                                  /* exit thread */
+    NULL,                                  /* exit process */
+    NULL,                                  /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+static void *
+ngx_reuseport_bpf_create_conf(ngx_cycle_t *cycle)
+{
+    ngx_reuseport_bpf_conf_t  *rcf;
+
+    rcf = ngx_pcalloc(cycle->pool, sizeof(ngx_reuseport_bpf_conf_t));
+    if (rcf == NULL) {
+        return NULL;
+    }
+
+    rcf->enabled = NGX_CONF_UNSET;
+
+    ngx_queue_init(&rcf->groups);
+
+    return rcf;
+}
+
+
+static ngx_int_t
+ngx_reuseport_bpf_module_init(ngx_cycle_t *cycle)
+{
+    ngx_uint_t                 i;
+    ngx_listening_t           *ls;
+    ngx_core_conf_t           *ccf;
+    ngx_pool_cleanup_t        *cln;
+    ngx_reuseport_bpf_conf_t  *rcf, *old_rcf;
+
+    if (ngx_test_config) {
+        /* SO_REUSEPORT socket option is not set during config test */
+        return NGX_OK;
+    }
+
+    ccf = ngx_core_get_conf(cycle);
+    rcf = ngx_reuseport_bpf_get_conf(cycle);
+    old_rcf = ngx_reuseport_bpf_get_old_conf(cycle);
+
+    ngx_conf_init_value(rcf->enabled, 0);
+
+    if (rcf->enabled && ccf->cpu_affinity == NULL) {
+        ngx_log_error(NGX_LOG_WARN, cycle->log, 0,
+                      "\"reuseport_bpf\" requires \"worker_cpu_affinity\", "
+                      "ignored");
+        rcf->enabled = 0;
+    }
+
+    if (!rcf->enabled && (old_rcf == NULL || !old_rcf->enabled)) {
+        return NGX_OK;
+    }
+
+    cln = ngx_pool_cleanup_add(cycle->pool, 0);
+    if (cln == NULL) {
+        return NGX_ERROR;
+    }
+
+    cln->data = rcf;
+    cln->handler = ngx_reuseport_bpf_cleanup;
+
+    ls = cycle->listening.elts;
+
+    for (i = 0; i < cycle->listening.nelts; i++) {
+
+        if (!ls[i].reuseport || ls[i].worker != 0
+            || ls[i].fd == (ngx_socket_t) -1)
+        {
+            continue;
+        }
+
+#if (NGX_QUIC)
+        if (ls[i].quic) {
+            /* QUIC packets are routed by connection id, see quic_bpf */
+            continue;
+        }
+#endif
+
+        if (!rcf->enabled) {
+#if (defined SO_DETACH_REUSEPORT_BPF)
+            ngx_reuseport_bpf_detach(cycle, &ls[i]);
+#endif
+            continue;
+        }
+
+        if (ngx_reuseport_bpf_attach(cycle, &ls[i]) != NGX_OK) {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, 0,
+                          "reuseport bpf failed for %V, ignored",
+                          &ls[i].addr_text);
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_reuseport_bpf_cleanup(void *data)
+{
+    ngx_reuseport_bpf_conf_t  *rcf = data;
+
+    ngx_queue_t                *q;
+    ngx_reuseport_bpf_group_t  *grp;
+
+    for (q = ngx_queue_head(&rcf->groups);
+         q != ngx_queue_sentinel(&rcf->groups);
+         q = ngx_queue_next(q))
+    {
+        grp = ngx_queue_data(q, ngx_reuseport_bpf_group_t, queue);
+
+        ngx_reuseport_bpf_close(ngx_cycle->log, grp->map_fd, "map");
+    }
+}
+
+
+static ngx_inline void
+ngx_reuseport_bpf_close(ngx_log_t *log, int fd, const char *name)
+{
+    if (close(fd) != -1) {
+        return;
+    }
+
+    ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                  "reuseport bpf close %s fd:%d failed", name, fd);
+}
+
+
+static ngx_reuseport_bpf_group_t *
+ngx_reuseport_bpf_find_group(ngx_reuseport_bpf_conf_t *rcf,
+    ngx_listening_t *ls)
+{
+    ngx_queue_t                *q;
+    ngx_reuseport_bpf_group_t  *grp;
+
+    for (q = ngx_queue_head(&rcf->groups);
+         q != ngx_queue_sentinel(&rcf->groups);
+         q = ngx_queue_next(q))
+    {
+        grp = ngx_queue_data(q, ngx_reuseport_bpf_group_t, queue);
+
+        if (grp->type == ls->type
+            && ngx_cmp_sockaddr(ls->sockaddr, ls->socklen,
+                                grp->sockaddr, grp->socklen, 1)
+               == NGX_OK)
+        {
+            return grp;
+        }
+    }
+
+    return NULL;
+}
+
+
+static ngx_reuseport_bpf_group_t *
+ngx_reuseport_bpf_get_group(ngx_cycle_t *cycle, ngx_listening_t *ls)
+{
+    ngx_reuseport_bpf_conf_t   *rcf, *old_rcf;
+    ngx_reuseport_bpf_group_t  *grp, *ogrp;
+
+    rcf = ngx_reuseport_bpf_get_conf(cycle);
+    old_rcf = ngx_reuseport_bpf_get_old_conf(cycle);
+
+    grp = ngx_pcalloc(cycle->pool, sizeof(ngx_reuseport_bpf_group_t));
+    if (grp == NULL) {
+        return NULL;
+    }
+
+    grp->sockaddr = ls->sockaddr;
+    grp->socklen = ls->socklen;
+    grp->type = ls->type;
+
+    /*
+     * a socket can be placed into a single socket array only,
+     * hence the array of inherited sockets is kept across reloads
+     */
+
+    ogrp = old_rcf ? ngx_reuseport_bpf_find_group(old_rcf, ls) : NULL;
+
+    if (ogrp) {
+        grp->map_fd = dup(ogrp->map_fd);
+        if (grp->map_fd == -1) {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                          "reuseport bpf failed to duplicate map descriptor");
+            return NULL;
+        }
+
+    } else {
+        grp->map_fd = ngx_bpf_map_create(cycle->log,
+                                         BPF_MAP_TYPE_REUSEPORT_SOCKARRAY,
+                                         sizeof(uint32_t), sizeof(uint64_t),
+                                         NGX_MAX_PROCESSES, 0);
+        if (grp->map_fd == -1) {
+            return NULL;
+        }
+    }
+
+    ngx_queue_insert_tail(&rcf->groups, &grp->queue);
+
+    return grp;
+}
+
+
+static ngx_int_t
+ngx_reuseport_bpf_attach(ngx_cycle_t *cycle, ngx_listening_t *ls)
+{
+    int                         cpu_fd, progfd, failed;
+    uint32_t                    key;
+    uint64_t                    value;
+    ngx_uint_t                  i;
+    ngx_listening_t            *nls;
+    ngx_reuseport_bpf_group_t  *grp;
+
+    grp = ngx_reuseport_bpf_get_group(cycle, ls);
+    if (grp == NULL) {
+        return NGX_ERROR;
+    }
+
+    nls = cycle->listening.elts;
+
+    for (i = 0; i < cycle->listening.nelts; i++) {
+
+        if (!nls[i].reuseport
+            || nls[i].type != ls->type
+            || nls[i].fd == (ngx_socket_t) -1
+            || ngx_cmp_sockaddr(nls[i].sockaddr, nls[i].socklen,
+                                ls->sockaddr, ls->socklen, 1)
+               != NGX_OK)
+        {
+            continue;
+        }
+
+        key = nls[i].worker;
+        value = nls[i].fd;
+
+        if (ngx_bpf_map_update(grp->map_fd, &key, &value, BPF_ANY) == -1) {
+
+            if (ngx_errno == NGX_EBUSY) {
+                /* inherited socket is already in the array */
+                continue;
+            }
+
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                          "reuseport bpf failed to add socket of worker %ui",
+                          nls[i].worker);
+            return NGX_ERROR;
+        }
+
+        ngx_log_debug3(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                       "reuseport bpf map fd:%d add socket:%d worker:%ui",
+                       grp->map_fd, nls[i].fd, nls[i].worker);
+    }
+
+    cpu_fd = ngx_reuseport_bpf_cpu_map(cycle);
+    if (cpu_fd == -1) {
+        return NGX_ERROR;
+    }
+
+    ngx_bpf_program_link(&ngx_reuseport_bpf_program,
+                         "ngx_reuseport_cpumap", cpu_fd);
+    ngx_bpf_program_link(&ngx_reuseport_bpf_program,
+                         "ngx_reuseport_sockmap", grp->map_fd);
+
+    progfd = ngx_bpf_load_program(cycle->log, &ngx_reuseport_bpf_program);
+
+    /* the program holds a reference to the map */
+    ngx_reuseport_bpf_close(cycle->log, cpu_fd, "map");
+
+    if (progfd < 0) {
+        return NGX_ERROR;
+    }
+
+    failed = 0;
+
+    if (setsockopt(ls->fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_EBPF,
+                   &progfd, sizeof(int))
+        == -1)
+    {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_socket_errno,
+                      "setsockopt(SO_ATTACH_REUSEPORT_EBPF) %V failed",
+                      &ls->addr_text);
+        failed = 1;
+    }
+
+    ngx_reuseport_bpf_close(cycle->log, progfd, "program");
+
+    return failed ? NGX_ERROR : NGX_OK;
+}
+
+
+static int
+ngx_reuseport_bpf_cpu_map(ngx_cycle_t *cycle)
+{
+    int               fd;
+    uint32_t          key, value;
+    ngx_uint_t        n, cpu, max;
+    ngx_cpuset_t     *mask, used;
+    ngx_core_conf_t  *ccf;
+
+    ccf = ngx_core_get_conf(cycle);
+
+    max = 0;
+
+    for (n = 0; n < (ngx_uint_t) ccf->worker_processes; n++) {
+        mask = ngx_get_cpu_affinity(cycle, n);
+
+        for (cpu = 0; mask && cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, mask)) {
+                max = ngx_max(max, cpu + 1);
+            }
+        }
+    }
+
+    if (max == 0) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, 0,
+                      "reuseport bpf found no worker CPUs");
+        return -1;
+    }
+
+    fd = ngx_bpf_map_create(cycle->log, BPF_MAP_TYPE_HASH, sizeof(uint32_t),
+                            sizeof(uint32_t), max, 0);
+    if (fd == -1) {
+        return -1;
+    }
+
+    CPU_ZERO(&used);
+
+    for (n = 0; n < (ngx_uint_t) ccf->worker_processes; n++) {
+        mask = ngx_get_cpu_affinity(cycle, n);
+
+        for (cpu = 0; mask && cpu < max; cpu++) {
+
+            /* the first worker bound to the CPU takes its packets */
+
+            if (!CPU_ISSET(cpu, mask) || CPU_ISSET(cpu, &used)) {
+                continue;
+            }
+
+            CPU_SET(cpu, &used);
+
+            key = cpu;
+            value = n;
+
+            if (ngx_bpf_map_update(fd, &key, &value, BPF_ANY) == -1) {
+                ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                              "reuseport bpf failed to update cpu map");
+                ngx_reuseport_bpf_close(cycle->log, fd, "map");
+                return -1;
+            }
+
+            ngx_log_debug2(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                           "reuseport bpf cpu:%ui worker:%ui", cpu, n);
+        }
+    }
+
+    return fd;
+}
+
+
+#if (defined SO_DETACH_REUSEPORT_BPF)
+
+static void
+ngx_reuseport_bpf_detach(ngx_cycle_t *cycle, ngx_listening_t *ls)
+{
+    int  unused;
+
+    unused = 0;
+
+    if (setsockopt(ls->fd, SOL_SOCKET, SO_DETACH_REUSEPORT_BPF,
+                   &unused, sizeof(int))
+        == -1
+        && ngx_socket_errno != NGX_ENOENT)
+    {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_socket_errno,
+                      "setsockopt(SO_DETACH_REUSEPORT_BPF) %V failed",
+                      &ls->addr_text);
+    }
+}
+
+#endif
@@ -10,41 +10,120 @@
 #include <ngx_event.h>
 
 
-ngx_rbtree_t              ngx_event_timer_rbtree;
-static ngx_rbtree_node_t  ngx_event_timer_sentinel;
+#define ngx_event_timer_level_shift(level)  ((level) * NGX_TIMER_WHEEL_BITS)
+
+
+static uint64_t ngx_event_timer_next(void);
+static void ngx_event_timer_cascade(void);
+static ngx_inline ngx_uint_t ngx_event_timer_ctz(uint64_t bits);
+
+
+ngx_event_timer_wheel_t  ngx_event_timer_wheel;
 
 /*
- * the event timer rbtree may contain the duplicate keys, however,
- * it should not be a problem, because we use the rbtree to find
- * a minimum timer value only
+ * the wheel keeps its own 64-bit time which starts from zero and
+ * advances along with ngx_current_msec; timer keys are converted to it
+ * using the difference from the msec value the wheel time corresponds to,
+ * so ngx_msec_t wraparound does not matter
+ *
+ * a timer is hashed to the level of the highest 6-bit group in which its
+ * key differs from the wheel time, and to the slot given by the key bits of
+ * this group; when the wheel time reaches the start of an occupied slot of
+ * a higher level, its timers are cascaded down to the lower levels,
+ * so only the slots of level 0 are ever expired
  */
 
+
 ngx_int_t
 ngx_event_timer_init(ngx_log_t *log)
 {
-    ngx_rbtree_init(&ngx_event_timer_rbtree, &ngx_event_timer_sentinel,
-                    ngx_rbtree_insert_timer_value);
+    ngx_uint_t  i;
+
+    ngx_memzero(&ngx_event_timer_wheel, sizeof(ngx_event_timer_wheel_t));
+
+    ngx_event_timer_wheel.msec = ngx_current_msec;
+
+    for (i = 0; i < NGX_TIMER_WHEEL_LEVELS * NGX_TIMER_WHEEL_SLOTS; i++) {
+        ngx_queue_init(&ngx_event_timer_wheel.slots[i]);
+    }
 
     return NGX_OK;
 }
 
 
+void
+ngx_event_timer_insert(ngx_event_timer_t *timer)
+{
+    uint64_t        key, diff;
+    ngx_uint_t      level, slot;
+    ngx_msec_int_t  delta;
+
+    timer->armed = timer->key;
+
+    delta = (ngx_msec_int_t) (timer->key - ngx_event_timer_wheel.msec);
+
+    key = ngx_event_timer_wheel.now;
+
+    if (delta > (ngx_msec_int_t) NGX_MAX_INT32_VALUE) {
+        /* far timers are rehashed closer to their keys on cascading */
+        delta = NGX_MAX_INT32_VALUE;
+    }
+
+    if (delta > 0) {
+        key += delta;
+    }
+
+    diff = key ^ ngx_event_timer_wheel.now;
+
+    for (level = 0; level < NGX_TIMER_WHEEL_LEVELS - 1; level++) {
+
+        if ((diff >> ngx_event_timer_level_shift(level + 1)) == 0) {
+            break;
+        }
+    }
+
+    slot = (key >> ngx_event_timer_level_shift(level)) & NGX_TIMER_WHEEL_MASK;
+
+    timer->slot = (level << NGX_TIMER_WHEEL_BITS) + slot;
+
+    ngx_queue_insert_tail(&ngx_event_timer_wheel.slots[timer->slot],
+                          &timer->queue);
+
+    ngx_event_timer_wheel.occupied[level] |= (uint64_t) 1 << slot;
+    ngx_event_timer_wheel.count++;
+}
+
+
 ngx_msec_t
 ngx_event_find_timer(void)
 {
-    ngx_msec_int_t      timer;
-    ngx_rbtree_node_t  *node, *root, *sentinel;
+    uint64_t        next;
+    ngx_msec_int_t  timer, lag;
 
-    if (ngx_event_timer_rbtree.root == &ngx_event_timer_sentinel) {
+    if (ngx_event_timer_wheel.count == 0) {
         return NGX_TIMER_INFINITE;
     }
 
-    root = ngx_event_timer_rbtree.root;
-    sentinel = ngx_event_timer_rbtree.sentinel;
+    if (!ngx_queue_empty(&ngx_event_timer_wheel.slots[
+                              ngx_event_timer_wheel.now & NGX_TIMER_WHEEL_MASK]))
+    {
+        return 0;
+    }
+
+    /*
+     * for a slot of a higher level this is the time of its cascading,
+     * which is not later than the earliest timer in the slot
+     */
+
+    next = ngx_event_timer_next() - ngx_event_timer_wheel.now;
+
+    if (next > NGX_MAX_INT32_VALUE) {
+        next = NGX_MAX_INT32_VALUE;
+    }
 
-    node = ngx_rbtree_min(root, sentinel);
+    lag = (ngx_msec_int_t) (ngx_current_msec - ngx_event_timer_wheel.msec);
 
-    timer = (ngx_msec_int_t) (node->key - ngx_current_msec);
+    timer = (ngx_msec_int_t) next - lag;
 
     return (ngx_msec_t) (timer > 0 ? timer : 0);
 }
@@ -53,70 +132,200 @@ ngx_event_find_timer(void)
 void
 ngx_event_expire_timers(void)
 {
+    uint64_t            target, next;
+    ngx_queue_t        *slot, *q;
     ngx_event_t        *ev;
-    ngx_rbtree_node_t  *node, *root, *sentinel;
+    ngx_msec_int_t      delta;
+    ngx_event_timer_t  *timer;
 
-    sentinel = ngx_event_timer_rbtree.sentinel;
+    delta = (ngx_msec_int_t) (ngx_current_msec - ngx_event_timer_wheel.msec);
+
+    target = ngx_event_timer_wheel.now + (delta > 0 ? delta : 0);
 
     for ( ;; ) {
-        root = ngx_event_timer_rbtree.root;
 
-        if (root == sentinel) {
-            return;
+        slot = &ngx_event_timer_wheel.slots[
+                              ngx_event_timer_wheel.now & NGX_TIMER_WHEEL_MASK];
+
+        while (!ngx_queue_empty(slot)) {
+
+            q = ngx_queue_head(slot);
+            timer = ngx_queue_data(q, ngx_event_timer_t, queue);
+            ev = ngx_queue_data(timer, ngx_event_t, timer);
+
+            ngx_event_timer_delete(timer);
+
+            if ((ngx_msec_int_t) (timer->key - ngx_event_timer_wheel.msec)
+                > 0)
+            {
+                /* the timer was postponed while in the wheel */
+
+                ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                               "event timer move: %d: %M",
+                               ngx_event_ident(ev->data), ev->timer.key);
+
+                ngx_event_timer_insert(timer);
+                continue;
+            }
+
+            ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                           "event timer del: %d: %M",
+                           ngx_event_ident(ev->data), ev->timer.key);
+
+            ev->timer_set = 0;
+
+            ev->timedout = 1;
+
+            ev->handler(ev);
         }
 
-        node = ngx_rbtree_min(root, sentinel);
+        if (ngx_event_timer_wheel.now == target) {
+            break;
+        }
 
-        /* node->key > ngx_current_msec */
+        next = ngx_event_timer_wheel.count ? ngx_event_timer_next() : target;
 
-        if ((ngx_msec_int_t) (node->key - ngx_current_msec) > 0) {
-            return;
+        if (next > target) {
+            next = target;
         }
 
-        ev = ngx_rbtree_data(node, ngx_event_t, timer);
+        ngx_event_timer_wheel.msec += (ngx_msec_t)
+                                      (next - ngx_event_timer_wheel.now);
+        ngx_event_timer_wheel.now = next;
+
+        ngx_event_timer_cascade();
+    }
+}
 
-        ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
-                       "event timer del: %d: %M",
-                       ngx_event_ident(ev->data), ev->timer.key);
 
-        ngx_rbtree_delete(&ngx_event_timer_rbtree, &ev->timer);
+static uint64_t
+ngx_event_timer_next(void)
+{
+    uint64_t    now, bits;
+    ngx_uint_t  level, shift, slot;
 
-#if (NGX_DEBUG)
-        ev->timer.left = NULL;
-        ev->timer.right = NULL;
-        ev->timer.parent = NULL;
-#endif
+    /*
+     * the wheel time of the nearest occupied slot after the current one;
+     * occupied slots of a level always follow the current slot of the level,
+     * and those of lower levels precede them
+     */
 
-        ev->timer_set = 0;
+    now = ngx_event_timer_wheel.now;
 
-        ev->timedout = 1;
+    for (level = 0; level < NGX_TIMER_WHEEL_LEVELS; level++) {
 
-        ev->handler(ev);
+        shift = ngx_event_timer_level_shift(level);
+        slot = (now >> shift) & NGX_TIMER_WHEEL_MASK;
+
+        bits = ngx_event_timer_wheel.occupied[level]
+               & ~(((uint64_t) 2 << slot) - 1);
+
+        if (bits == 0) {
+            continue;
+        }
+
+        slot = ngx_event_timer_ctz(bits);
+
+        return (now & ~(((uint64_t) 1 << (shift + NGX_TIMER_WHEEL_BITS)) - 1))
+               | ((uint64_t) slot << shift);
     }
+
+    /* not reached, at least one timer is expected */
+
+    return now + 1;
+}
+
+
+static void
+ngx_event_timer_cascade(void)
+{
+    uint64_t            now;
+    ngx_uint_t          level, shift, n;
+    ngx_queue_t        *q, queue;
+    ngx_event_timer_t  *timer;
+
+    now = ngx_event_timer_wheel.now;
+
+    /* higher levels first, so the timers moved down get there in turn */
+
+    for (level = NGX_TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+
+        shift = ngx_event_timer_level_shift(level);
+
+        if (now & (((uint64_t) 1 << shift) - 1)) {
+            continue;
+        }
+
+        n = (level << NGX_TIMER_WHEEL_BITS)
+            + ((now >> shift) & NGX_TIMER_WHEEL_MASK);
+
+        if (ngx_queue_empty(&ngx_event_timer_wheel.slots[n])) {
+            continue;
+        }
+
+        ngx_queue_init(&queue);
+        ngx_queue_add(&queue, &ngx_event_timer_wheel.slots[n]);
+        ngx_queue_init(&ngx_event_timer_wheel.slots[n]);
+
+        ngx_event_timer_wheel.occupied[level]
+                            &= ~((uint64_t) 1 << (n & NGX_TIMER_WHEEL_MASK));
+
+        while (!ngx_queue_empty(&queue)) {
+            q = ngx_queue_head(&queue);
+            ngx_queue_remove(q);
+
+            timer = ngx_queue_data(q, ngx_event_timer_t, queue);
+
+            ngx_event_timer_wheel.count--;
+            ngx_event_timer_insert(timer);
+        }
+    }
+}
+
+
+static ngx_inline ngx_uint_t
+ngx_event_timer_ctz(uint64_t bits)
+{
+#if (NGX_HAVE_GCC_CTZ)
+
+    return __builtin_ctzll(bits);
+
+#else
+
+    ngx_uint_t  n;
+
+    for (n = 0; (bits & 1) == 0; n++) {
+        bits >>= 1;
+    }
+
+    return n;
+
+#endif
 }
 
 
 ngx_int_t
 ngx_event_no_timers_left(void)
 {
+    ngx_uint_t          n;
+    ngx_queue_t        *slot, *q;
     ngx_event_t        *ev;
-    ngx_rbtree_node_t  *node, *root, *sentinel;
+    ngx_event_timer_t  *timer;
 
-    sentinel = ngx_event_timer_rbtree.sentinel;
-    root = ngx_event_timer_rbtree.root;
+    for (n = 0; n < NGX_TIMER_WHEEL_LEVELS * NGX_TIMER_WHEEL_SLOTS; n++) {
 
-    if (root == sentinel) {
-        return NGX_OK;
-    }
+        slot = &ngx_event_timer_wheel.slots[n];
 
-    for (node = ngx_rbtree_min(root, sentinel);
-         node;
-         node = ngx_rbtree_next(&ngx_event_timer_rbtree, node))
-    {
-        ev = ngx_rbtree_data(node, ngx_event_t, timer);
+        for (q = ngx_queue_head(slot);
+             q != ngx_queue_sentinel(slot);
+             q = ngx_queue_next(q))
+        {
+            timer = ngx_queue_data(q, ngx_event_timer_t, queue);
+            ev = ngx_queue_data(timer, ngx_event_t, timer);
 
-        if (!ev->cancelable) {
-            return NGX_AGAIN;
+            if (!ev->cancelable) {
+                return NGX_AGAIN;
+            }
         }
     }
 
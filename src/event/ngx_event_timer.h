@@ -19,13 +19,53 @@
 #define NGX_TIMER_LAZY_DELAY  300
 
 
+/*
+ * timers are kept in a hierarchical hashed wheel: each level has 64 slots,
+ * a slot of level n spans 64^n milliseconds; 7 levels cover 2^42 ms
+ */
+
+#define NGX_TIMER_WHEEL_BITS    6
+#define NGX_TIMER_WHEEL_SLOTS   (1 << NGX_TIMER_WHEEL_BITS)
+#define NGX_TIMER_WHEEL_MASK    (NGX_TIMER_WHEEL_SLOTS - 1)
+#define NGX_TIMER_WHEEL_LEVELS  7
+
+
+typedef struct {
+    uint64_t                  now;
+    ngx_msec_t                msec;
+    ngx_uint_t                count;
+    uint64_t                  occupied[NGX_TIMER_WHEEL_LEVELS];
+    ngx_queue_t               slots[NGX_TIMER_WHEEL_LEVELS
+                                    * NGX_TIMER_WHEEL_SLOTS];
+} ngx_event_timer_wheel_t;
+
+
 ngx_int_t ngx_event_timer_init(ngx_log_t *log);
 ngx_msec_t ngx_event_find_timer(void);
 void ngx_event_expire_timers(void);
 ngx_int_t ngx_event_no_timers_left(void);
+void ngx_event_timer_insert(ngx_event_timer_t *timer);
 
 
-extern ngx_rbtree_t  ngx_event_timer_rbtree;
+extern ngx_event_timer_wheel_t  ngx_event_timer_wheel;
+
+
+static ngx_inline void
+ngx_event_timer_delete(ngx_event_timer_t *timer)
+{
+    ngx_queue_t  *slot;
+
+    ngx_queue_remove(&timer->queue);
+
+    slot = &ngx_event_timer_wheel.slots[timer->slot];
+
+    if (ngx_queue_empty(slot)) {
+        ngx_event_timer_wheel.occupied[timer->slot >> NGX_TIMER_WHEEL_BITS]
+            &= ~((uint64_t) 1 << (timer->slot & NGX_TIMER_WHEEL_MASK));
+    }
+
+    ngx_event_timer_wheel.count--;
+}
 
 
 static ngx_inline void
@@ -35,13 +75,7 @@ ngx_event_del_timer(ngx_event_t *ev)
                    "event timer del: %d: %M",
                     ngx_event_ident(ev->data), ev->timer.key);
 
-    ngx_rbtree_delete(&ngx_event_timer_rbtree, &ev->timer);
-
-#if (NGX_DEBUG)
-    ev->timer.left = NULL;
-    ev->timer.right = NULL;
-    ev->timer.parent = NULL;
-#endif
+    ngx_event_timer_delete(&ev->timer);
 
     ev->timer_set = 0;
 }
@@ -58,17 +92,21 @@ ngx_event_add_timer(ngx_event_t *ev, ngx_msec_t timer)
     if (ev->timer_set) {
 
         /*
-         * Use a previous timer value if difference between it and a new
-         * value is less than NGX_TIMER_LAZY_DELAY milliseconds: this allows
-         * to minimize the rbtree operations for fast connections.
+         * A timer is not moved if its new value is not earlier than the one
+         * it is placed by, only the new value is recorded: the timer is moved
+         * when it fires early.  This allows to touch the timer wheel about
+         * once per timeout for fast connections.  A timer moved to an earlier
+         * value is placed again, so it never fires late.
          */
 
-        diff = (ngx_msec_int_t) (key - ev->timer.key);
+        diff = (ngx_msec_int_t) (key - ev->timer.armed);
 
-        if (ngx_abs(diff) < NGX_TIMER_LAZY_DELAY) {
+        if (diff >= 0) {
             ngx_log_debug3(NGX_LOG_DEBUG_EVENT, ev->log, 0,
                            "event timer: %d, old: %M, new: %M",
                             ngx_event_ident(ev->data), ev->timer.key, key);
+
+            ev->timer.key = key;
             return;
         }
 
@@ -81,7 +119,7 @@ ngx_event_add_timer(ngx_event_t *ev, ngx_msec_t timer)
                    "event timer add: %d: %M:%M",
                     ngx_event_ident(ev->data), timer, ev->timer.key);
 
-    ngx_rbtree_insert(&ngx_event_timer_rbtree, &ev->timer);
+    ngx_event_timer_insert(&ev->timer);
 
     ev->timer_set = 1;
 }
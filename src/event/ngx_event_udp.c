@@ -19,19 +19,37 @@ static ngx_int_t ngx_insert_udp_connection(ngx_connection_t *c);
 static ngx_connection_t *ngx_lookup_udp_connection(ngx_listening_t *ls,
     struct sockaddr *sockaddr, socklen_t socklen,
     struct sockaddr *local_sockaddr, socklen_t local_socklen);
+#if (NGX_HAVE_MMSG)
+static ngx_int_t ngx_udp_recvmmsg(ngx_event_t *ev, ngx_listening_t *ls);
+static ngx_uint_t ngx_udp_same_peer(struct msghdr *m1, struct msghdr *m2);
+
+
+static struct mmsghdr   ngx_udp_msgs[NGX_UDP_MAX_BATCH];
+static struct iovec     ngx_udp_iovs[NGX_UDP_MAX_BATCH];
+static ngx_sockaddr_t   ngx_udp_sockaddrs[NGX_UDP_MAX_BATCH];
+#if (NGX_HAVE_ADDRINFO_CMSG)
+static u_char           ngx_udp_msg_control[NGX_UDP_MAX_BATCH]
+                            [CMSG_SPACE(sizeof(ngx_addrinfo_t))];
+#endif
+static u_char          *ngx_udp_buffers;
+static ngx_buf_t        ngx_udp_bufs[NGX_UDP_MAX_BATCH];
+static ngx_chain_t      ngx_udp_chains[NGX_UDP_MAX_BATCH];
+#endif
 
 
 void
 ngx_event_recvmsg(ngx_event_t *ev)
 {
     ssize_t            n;
+    u_char            *data;
     ngx_buf_t          buf;
     ngx_log_t         *log;
     ngx_err_t          err;
+    ngx_int_t          i, nmsgs;
     socklen_t          socklen, local_socklen;
     ngx_event_t       *rev, *wev;
     struct iovec       iov[1];
-    struct msghdr      msg;
+    struct msghdr      msg, *msgp;
     ngx_sockaddr_t     sa, lsa;
     struct sockaddr   *sockaddr, *local_sockaddr;
     ngx_listening_t   *ls;
@@ -43,6 +61,12 @@ ngx_event_recvmsg(ngx_event_t *ev)
     u_char             msg_control[CMSG_SPACE(sizeof(ngx_addrinfo_t))];
 #endif
 
+#if (NGX_HAVE_MMSG)
+    ngx_int_t          k, first;
+    ngx_buf_t         *b;
+    ngx_chain_t      **ll;
+#endif
+
     if (ev->timedout) {
         if (ngx_enable_accept_events((ngx_cycle_t *) ngx_cycle) != NGX_OK) {
             return;
@@ -64,52 +88,83 @@ ngx_event_recvmsg(ngx_event_t *ev)
     ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
                    "recvmsg on %V, ready: %d", &ls->addr_text, ev->available);
 
+    i = 0;
+    nmsgs = 0;
+
     do {
-        ngx_memzero(&msg, sizeof(struct msghdr));
 
-        iov[0].iov_base = (void *) buffer;
-        iov[0].iov_len = sizeof(buffer);
+#if (NGX_HAVE_MMSG)
+
+        if (ls->batch > 1) {
+
+            if (i == nmsgs) {
+                nmsgs = ngx_udp_recvmmsg(ev, ls);
+
+                if (nmsgs == NGX_AGAIN || nmsgs == NGX_ERROR) {
+                    return;
+                }
+
+                i = 0;
+            }
+
+            msgp = &ngx_udp_msgs[i].msg_hdr;
+            n = ngx_udp_msgs[i].msg_len;
+            data = msgp->msg_iov[0].iov_base;
+
+            i++;
+
+        } else
+#endif
+        {
+            ngx_memzero(&msg, sizeof(struct msghdr));
+
+            iov[0].iov_base = (void *) buffer;
+            iov[0].iov_len = sizeof(buffer);
 
-        msg.msg_name = &sa;
-        msg.msg_namelen = sizeof(ngx_sockaddr_t);
-        msg.msg_iov = iov;
-        msg.msg_iovlen = 1;
+            msg.msg_name = &sa;
+            msg.msg_namelen = sizeof(ngx_sockaddr_t);
+            msg.msg_iov = iov;
+            msg.msg_iovlen = 1;
 
 #if (NGX_HAVE_ADDRINFO_CMSG)
-        if (ls->wildcard) {
-            msg.msg_control = &msg_control;
-            msg.msg_controllen = sizeof(msg_control);
+            if (ls->wildcard) {
+                msg.msg_control = &msg_control;
+                msg.msg_controllen = sizeof(msg_control);
 
-            ngx_memzero(&msg_control, sizeof(msg_control));
-        }
+                ngx_memzero(&msg_control, sizeof(msg_control));
+            }
 #endif
 
-        n = recvmsg(lc->fd, &msg, 0);
+            n = recvmsg(lc->fd, &msg, 0);
+
+            if (n == -1) {
+                err = ngx_socket_errno;
 
-        if (n == -1) {
-            err = ngx_socket_errno;
+                if (err == NGX_EAGAIN) {
+                    ngx_log_debug0(NGX_LOG_DEBUG_EVENT, ev->log, err,
+                                   "recvmsg() not ready");
+                    return;
+                }
+
+                ngx_log_error(NGX_LOG_ALERT, ev->log, err, "recvmsg() failed");
 
-            if (err == NGX_EAGAIN) {
-                ngx_log_debug0(NGX_LOG_DEBUG_EVENT, ev->log, err,
-                               "recvmsg() not ready");
                 return;
             }
 
-            ngx_log_error(NGX_LOG_ALERT, ev->log, err, "recvmsg() failed");
-
-            return;
+            msgp = &msg;
+            data = buffer;
         }
 
 #if (NGX_HAVE_ADDRINFO_CMSG)
-        if (msg.msg_flags & (MSG_TRUNC|MSG_CTRUNC)) {
+        if (msgp->msg_flags & (MSG_TRUNC|MSG_CTRUNC)) {
             ngx_log_error(NGX_LOG_ALERT, ev->log, 0,
                           "recvmsg() truncated data");
             continue;
         }
 #endif
 
-        sockaddr = msg.msg_name;
-        socklen = msg.msg_namelen;
+        sockaddr = msgp->msg_name;
+        socklen = msgp->msg_namelen;
 
         if (socklen > (socklen_t) sizeof(ngx_sockaddr_t)) {
             socklen = sizeof(ngx_sockaddr_t);
@@ -123,8 +178,8 @@ ngx_event_recvmsg(ngx_event_t *ev)
              */
 
             socklen = sizeof(struct sockaddr);
-            ngx_memzero(&sa, sizeof(struct sockaddr));
-            sa.sockaddr.sa_family = ls->sockaddr->sa_family;
+            ngx_memzero(sockaddr, sizeof(struct sockaddr));
+            sockaddr->sa_family = ls->sockaddr->sa_family;
         }
 
         local_sockaddr = ls->sockaddr;
@@ -138,9 +193,9 @@ ngx_event_recvmsg(ngx_event_t *ev)
             ngx_memcpy(&lsa, local_sockaddr, local_socklen);
             local_sockaddr = &lsa.sockaddr;
 
-            for (cmsg = CMSG_FIRSTHDR(&msg);
+            for (cmsg = CMSG_FIRSTHDR(msgp);
                  cmsg != NULL;
-                 cmsg = CMSG_NXTHDR(&msg, cmsg))
+                 cmsg = CMSG_NXTHDR(msgp, cmsg))
             {
                 if (ngx_get_srcaddr_cmsg(cmsg, local_sockaddr) == NGX_OK) {
                     break;
@@ -171,13 +226,50 @@ ngx_event_recvmsg(ngx_event_t *ev)
 
             ngx_memzero(&buf, sizeof(ngx_buf_t));
 
-            buf.pos = buffer;
-            buf.last = buffer + n;
+            buf.pos = data;
+            buf.last = data + n;
 
             rev = c->read;
 
             c->udp->buffer = &buf;
 
+#if (NGX_HAVE_MMSG)
+
+            /*
+             * subsequent datagrams of the same session are queued,
+             * so that they are handled in a single read event
+             */
+
+            first = i;
+            ll = &c->udp->queue;
+
+            for (k = 0;
+                 n && i < nmsgs && ngx_udp_msgs[i].msg_len && !ls->wildcard
+                 && ngx_udp_same_peer(&ngx_udp_msgs[i].msg_hdr, msgp);
+                 k++, i++)
+            {
+                b = &ngx_udp_bufs[k];
+
+                ngx_memzero(b, sizeof(ngx_buf_t));
+
+                b->pos = ngx_udp_msgs[i].msg_hdr.msg_iov[0].iov_base;
+                b->last = b->pos + ngx_udp_msgs[i].msg_len;
+
+                ngx_udp_chains[k].buf = b;
+
+                *ll = &ngx_udp_chains[k];
+                ll = &ngx_udp_chains[k].next;
+            }
+
+            *ll = NULL;
+
+            if (k) {
+                ngx_log_debug1(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                               "recvmsg: %i datagrams queued", k);
+            }
+
+#endif
+
             rev->ready = 1;
             rev->active = 0;
 
@@ -185,6 +277,25 @@ ngx_event_recvmsg(ngx_event_t *ev)
 
             if (c->udp) {
                 c->udp->buffer = NULL;
+#if (NGX_HAVE_MMSG)
+                c->udp->queue = NULL;
+
+            } else {
+
+                /*
+                 * the session has released the address, the datagrams
+                 * it has not read will be passed to a new session
+                 */
+
+                for (k = first; k < i; k++) {
+                    if (ngx_udp_bufs[k - first].pos
+                        != ngx_udp_bufs[k - first].last)
+                    {
+                        i = k;
+                        break;
+                    }
+                }
+#endif
             }
 
             rev->ready = 0;
@@ -264,7 +375,7 @@ ngx_event_recvmsg(ngx_event_t *ev)
             return;
         }
 
-        c->buffer->last = ngx_cpymem(c->buffer->last, buffer, n);
+        c->buffer->last = ngx_cpymem(c->buffer->last, data, n);
 
         rev = c->read;
         wev = c->write;
@@ -344,7 +455,7 @@ ngx_event_recvmsg(ngx_event_t *ev)
             ev->available -= n;
         }
 
-    } while (ev->available);
+    } while (ev->available || i < nmsgs);
 }
 
 
@@ -381,6 +492,14 @@ ngx_udp_shared_recv(ngx_connection_t *c, u_char *buf, size_t size)
 
     ngx_memcpy(buf, b->pos, n);
 
+    b->pos = b->last;
+
+    if (c->udp->queue) {
+        c->udp->buffer = c->udp->queue->buf;
+        c->udp->queue = c->udp->queue->next;
+        return n;
+    }
+
     c->udp->buffer = NULL;
 
     c->read->ready = 0;
@@ -390,6 +509,92 @@ ngx_udp_shared_recv(ngx_connection_t *c, u_char *buf, size_t size)
 }
 
 
+#if (NGX_HAVE_MMSG)
+
+static ngx_int_t
+ngx_udp_recvmmsg(ngx_event_t *ev, ngx_listening_t *ls)
+{
+    int                n;
+    ngx_err_t          err;
+    ngx_uint_t         i;
+    ngx_connection_t  *lc;
+
+    if (ngx_udp_buffers == NULL) {
+        ngx_udp_buffers = ngx_alloc(NGX_UDP_MAX_BATCH * 65535, ev->log);
+        if (ngx_udp_buffers == NULL) {
+            return NGX_ERROR;
+        }
+    }
+
+    lc = ev->data;
+
+    for (i = 0; i < (ngx_uint_t) ls->batch; i++) {
+        ngx_memzero(&ngx_udp_msgs[i], sizeof(struct mmsghdr));
+
+        ngx_udp_iovs[i].iov_base = ngx_udp_buffers + i * 65535;
+        ngx_udp_iovs[i].iov_len = 65535;
+
+        ngx_udp_msgs[i].msg_hdr.msg_name = &ngx_udp_sockaddrs[i];
+        ngx_udp_msgs[i].msg_hdr.msg_namelen = sizeof(ngx_sockaddr_t);
+        ngx_udp_msgs[i].msg_hdr.msg_iov = &ngx_udp_iovs[i];
+        ngx_udp_msgs[i].msg_hdr.msg_iovlen = 1;
+
+#if (NGX_HAVE_ADDRINFO_CMSG)
+        if (ls->wildcard) {
+            ngx_udp_msgs[i].msg_hdr.msg_control = ngx_udp_msg_control[i];
+            ngx_udp_msgs[i].msg_hdr.msg_controllen =
+                                             sizeof(ngx_udp_msg_control[i]);
+
+            ngx_memzero(ngx_udp_msg_control[i],
+                        sizeof(ngx_udp_msg_control[i]));
+        }
+#endif
+    }
+
+    n = recvmmsg(lc->fd, ngx_udp_msgs, ls->batch, 0, NULL);
+
+    if (n == -1) {
+        err = ngx_socket_errno;
+
+        if (err == NGX_EAGAIN) {
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, ev->log, err,
+                           "recvmmsg() not ready");
+            return NGX_AGAIN;
+        }
+
+        ngx_log_error(NGX_LOG_ALERT, ev->log, err, "recvmmsg() failed");
+
+        return NGX_ERROR;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                   "recvmmsg: %d of %d", n, ls->batch);
+
+#if (NGX_STAT_STUB)
+    (void) ngx_atomic_fetch_add(ngx_stat_udp_batches, 1);
+    (void) ngx_atomic_fetch_add(ngx_stat_udp_datagrams, n);
+#endif
+
+    return n;
+}
+
+
+static ngx_uint_t
+ngx_udp_same_peer(struct msghdr *m1, struct msghdr *m2)
+{
+    if (m1->msg_namelen == 0
+        || m1->msg_namelen != m2->msg_namelen
+        || m1->msg_namelen > sizeof(ngx_sockaddr_t))
+    {
+        return 0;
+    }
+
+    return ngx_memcmp(m1->msg_name, m2->msg_name, m1->msg_namelen) == 0;
+}
+
+#endif
+
+
 void
 ngx_udp_rbtree_insert_value(ngx_rbtree_node_t *temp,
     ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel)
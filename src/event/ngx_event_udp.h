@@ -23,10 +23,14 @@
 #endif
 
 
+#define NGX_UDP_MAX_BATCH       64
+
+
 struct ngx_udp_connection_s {
     ngx_rbtree_node_t   node;
     ngx_connection_t   *connection;
     ngx_buf_t          *buffer;
+    ngx_chain_t        *queue;
     ngx_str_t           key;
 };
 
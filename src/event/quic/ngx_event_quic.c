@@ -190,12 +190,25 @@ ngx_quic_apply_transport_params(ngx_connection_t *c, ngx_quic_tp_t *peer_tp)
         qc->tp.max_idle_timeout = peer_tp->max_idle_timeout;
     }
 
-    qc->streams.server.bidi.max = peer_tp->initial_max_streams_bidi;
-    qc->streams.server.uni.max = peer_tp->initial_max_streams_uni;
-
     if (qc->client) {
+
+        /*
+         * streams initiated by the client are limited by the server;
+         * the client defaults were used for early streams
+         */
+
+        qc->streams.client.bidi.max = peer_tp->initial_max_streams_bidi;
+        qc->streams.client.uni.max = peer_tp->initial_max_streams_uni;
+
+        qc->streams.server.bidi.max = qc->tp.initial_max_streams_bidi;
+        qc->streams.server.uni.max = qc->tp.initial_max_streams_uni;
+
         ngx_memcpy(qc->path->cid->sr_token,
                    peer_tp->sr_token, NGX_QUIC_SR_TOKEN_LEN);
+
+    } else {
+        qc->streams.server.bidi.max = peer_tp->initial_max_streams_bidi;
+        qc->streams.server.uni.max = peer_tp->initial_max_streams_uni;
     }
 
     ngx_memcpy(&qc->peer_tp, peer_tp, sizeof(ngx_quic_tp_t));
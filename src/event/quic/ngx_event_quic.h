@@ -128,6 +128,7 @@ void ngx_quic_client_set_ssl_data(ngx_connection_t *c, void *data);
 void *ngx_quic_client_get_ssl_data(ngx_connection_t *c);
 
 ngx_connection_t *ngx_quic_open_stream(ngx_connection_t *c, ngx_uint_t bidi);
+ngx_uint_t ngx_quic_can_open_stream(ngx_connection_t *c, ngx_uint_t bidi);
 void ngx_quic_finalize_connection(ngx_connection_t *c, ngx_uint_t err,
     const char *reason);
 void ngx_quic_shutdown_connection(ngx_connection_t *c, ngx_uint_t err,
@@ -126,6 +126,28 @@ ngx_quic_open_stream(ngx_connection_t *c, ngx_uint_t bidi)
 }
 
 
+ngx_uint_t
+ngx_quic_can_open_stream(ngx_connection_t *c, ngx_uint_t bidi)
+{
+    ngx_connection_t        *pc;
+    ngx_quic_connection_t   *qc;
+    ngx_quic_stream_ctl_t   *sctl;
+    ngx_quic_stream_peer_t  *peer;
+
+    pc = c->quic ? c->quic->parent : c;
+    qc = ngx_quic_get_connection(pc);
+
+    if (qc == NULL || qc->closing || qc->shutdown || qc->draining) {
+        return 0;
+    }
+
+    peer = qc->client ? &qc->streams.client : &qc->streams.server;
+    sctl = bidi ? &peer->bidi : &peer->uni;
+
+    return sctl->count < sctl->max;
+}
+
+
 void
 ngx_quic_rbtree_insert_stream(ngx_rbtree_node_t *temp,
     ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel)
@@ -1797,12 +1819,14 @@ ngx_int_t
 ngx_quic_handle_max_streams_frame(ngx_connection_t *c,
     ngx_quic_header_t *pkt, ngx_quic_max_streams_frame_t *f)
 {
-    ngx_quic_stream_ctl_t  *sctl;
-    ngx_quic_connection_t  *qc;
+    ngx_quic_stream_ctl_t   *sctl;
+    ngx_quic_connection_t   *qc;
+    ngx_quic_stream_peer_t  *peer;
 
     qc = ngx_quic_get_connection(c);
 
-    sctl = f->bidi ? &qc->streams.server.bidi : &qc->streams.server.uni;
+    peer = qc->client ? &qc->streams.client : &qc->streams.server;
+    sctl = f->bidi ? &peer->bidi : &peer->uni;
 
     if (sctl->max < f->limit) {
         sctl->max = f->limit;
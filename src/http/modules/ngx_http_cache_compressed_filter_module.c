@@ -0,0 +1,497 @@
+
+/*
+ * Copyright (C) 2026 Web Server LLC
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+typedef struct {
+    ngx_temp_file_t           *temp_file;
+    ngx_chain_t               *header;
+    ngx_str_t                  encoding;
+    size_t                     body_start;
+    unsigned                   done:1;
+} ngx_http_cache_compressed_ctx_t;
+
+
+static ngx_int_t ngx_http_cache_compressed_create_header(ngx_http_request_t *r,
+    ngx_http_cache_compressed_ctx_t *ctx);
+static ngx_uint_t ngx_http_cache_compressed_vary(ngx_http_upstream_t *u);
+static ngx_int_t ngx_http_cache_compressed_filter_init(ngx_conf_t *cf);
+
+
+static ngx_http_module_t  ngx_http_cache_compressed_filter_module_ctx = {
+    NULL,                                  /* preconfiguration */
+    ngx_http_cache_compressed_filter_init, /* postconfiguration */
+
+    NULL,                                  /* create main configuration */
+    NULL,                                  /* init main configuration */
+
+    NULL,                                  /* create server configuration */
+    NULL,                                  /* merge server configuration */
+
+    NULL,                                  /* create location configuration */
+    NULL                                   /* merge location configuration */
+};
+
+
+ngx_module_t  ngx_http_cache_compressed_filter_module = {
+    NGX_MODULE_V1,
+    &ngx_http_cache_compressed_filter_module_ctx, /* module context */
+    NULL,                                  /* module directives */
+    NGX_HTTP_MODULE,                       /* module type */
+    NULL,                                  /* init master */
+    NULL,                                  /* init module */
+    NULL,                                  /* init process */
+    NULL,                                  /* init thread */
+    NULL,                                  /* exit thread */
+    NULL,                                  /* exit process */
+    NULL,                                  /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+static ngx_http_output_header_filter_pt  ngx_http_next_header_filter;
+static ngx_http_output_body_filter_pt    ngx_http_next_body_filter;
+
+
+static ngx_int_t
+ngx_http_cache_compressed_header_filter(ngx_http_request_t *r)
+{
+    ngx_uint_t                        mask;
+    ngx_table_elt_t                  *h;
+    ngx_temp_file_t                  *tf;
+    ngx_http_cache_t                 *c;
+    ngx_http_upstream_t              *u;
+    ngx_http_cache_compressed_ctx_t  *ctx;
+
+    c = r->cache;
+    u = r->upstream;
+    h = r->headers_out.content_encoding;
+
+    if (c == NULL
+        || c->encoded
+        || u == NULL
+        || !u->cacheable
+        || r != r->main
+        || r->header_only
+        || r->headers_out.status != NGX_HTTP_OK
+        || h == NULL)
+    {
+        return ngx_http_next_header_filter(r);
+    }
+
+#if (NGX_HTTP_V3)
+    if (u->h3) {
+        return ngx_http_next_header_filter(r);
+    }
+#endif
+
+    if (h->value.len == 4
+        && ngx_strncasecmp(h->value.data, (u_char *) "gzip", 4) == 0)
+    {
+        mask = NGX_HTTP_CACHE_COMPRESSED_GZIP;
+
+    } else if (h->value.len == 2
+               && ngx_strncasecmp(h->value.data, (u_char *) "br", 2) == 0)
+    {
+        mask = NGX_HTTP_CACHE_COMPRESSED_BROTLI;
+
+    } else {
+        return ngx_http_next_header_filter(r);
+    }
+
+    if (!(u->conf->cache_compressed & mask)) {
+        return ngx_http_next_header_filter(r);
+    }
+
+    switch (u->cache_status) {
+
+    case NGX_HTTP_CACHE_MISS:
+    case NGX_HTTP_CACHE_EXPIRED:
+    case NGX_HTTP_CACHE_REVALIDATED:
+    case NGX_HTTP_CACHE_HIT:
+        break;
+
+    default:
+        return ngx_http_next_header_filter(r);
+    }
+
+    /* the variant is shared by all values of Accept-Encoding */
+
+    if (!ngx_http_cache_compressed_vary(u)) {
+        return ngx_http_next_header_filter(r);
+    }
+
+    ctx = ngx_pcalloc(r->pool, sizeof(ngx_http_cache_compressed_ctx_t));
+    if (ctx == NULL) {
+        return NGX_ERROR;
+    }
+
+    ctx->encoding = h->value;
+
+    switch (ngx_http_cache_compressed_create_header(r, ctx)) {
+
+    case NGX_OK:
+        break;
+
+    case NGX_DECLINED:
+        return ngx_http_next_header_filter(r);
+
+    default: /* NGX_ERROR */
+        return NGX_ERROR;
+    }
+
+    tf = ngx_pcalloc(r->pool, sizeof(ngx_temp_file_t));
+    if (tf == NULL) {
+        return NGX_ERROR;
+    }
+
+    tf->file.fd = NGX_INVALID_FILE;
+    tf->file.log = r->connection->log;
+    tf->path = c->file_cache->use_temp_path ? u->conf->temp_path
+                                            : c->file_cache->path;
+    tf->pool = r->pool;
+    tf->persistent = 1;
+    tf->clean = 1;
+
+    /* the cache file header is written when the variant is complete */
+
+    tf->offset = c->header_start;
+
+    ctx->temp_file = tf;
+
+    ngx_http_set_ctx(r, ctx, ngx_http_cache_compressed_filter_module);
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http cache compressed \"%V\"", &ctx->encoding);
+
+    return ngx_http_next_header_filter(r);
+}
+
+
+static ngx_int_t
+ngx_http_cache_compressed_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
+{
+    ssize_t                           n;
+    ngx_buf_t                        *b;
+    ngx_uint_t                        last;
+    ngx_chain_t                      *cl, *ln, *out, **ll;
+    ngx_http_cache_t                 *c;
+    ngx_http_cache_compressed_ctx_t  *ctx;
+
+    ctx = ngx_http_get_module_ctx(r, ngx_http_cache_compressed_filter_module);
+
+    if (ctx == NULL || ctx->done || in == NULL) {
+        return ngx_http_next_body_filter(r, in);
+    }
+
+    out = ctx->header;
+    ll = out ? &out->next : &out;
+    last = 0;
+
+    for (cl = in; cl; cl = cl->next) {
+        b = cl->buf;
+
+        if (b->last_buf) {
+            last = 1;
+        }
+
+        if (ngx_buf_special(b)) {
+            continue;
+        }
+
+        if (!ngx_buf_in_memory(b)) {
+            ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                           "http cache compressed file buf");
+            ctx->done = 1;
+            return ngx_http_next_body_filter(r, in);
+        }
+
+        if (b->pos == b->last) {
+            continue;
+        }
+
+        ln = ngx_alloc_chain_link(r->pool);
+        if (ln == NULL) {
+            return NGX_ERROR;
+        }
+
+        ln->buf = b;
+        *ll = ln;
+        ll = &ln->next;
+    }
+
+    *ll = NULL;
+
+    if (out) {
+        n = ngx_write_chain_to_temp_file(ctx->temp_file, out);
+
+        if (n == NGX_ERROR) {
+            ctx->done = 1;
+            return ngx_http_next_body_filter(r, in);
+        }
+
+        ctx->temp_file->offset += n;
+        ctx->header = NULL;
+
+        ngx_free_chain(r->pool, out);
+    }
+
+    if (!last) {
+        return ngx_http_next_body_filter(r, in);
+    }
+
+    ctx->done = 1;
+
+    /* the response may have turned out to be not cacheable */
+
+    c = r->cache;
+
+    if (r->upstream->cacheable && c->valid_sec >= ngx_time()) {
+        ngx_http_file_cache_update_encoded(r, ctx->temp_file, &ctx->encoding,
+                                           ctx->body_start);
+    }
+
+    return ngx_http_next_body_filter(r, in);
+}
+
+
+static ngx_int_t
+ngx_http_cache_compressed_create_header(ngx_http_request_t *r,
+    ngx_http_cache_compressed_ctx_t *ctx)
+{
+    size_t                     len;
+    ngx_buf_t                 *b;
+    ngx_uint_t                 i, vary;
+    ngx_list_part_t           *part;
+    ngx_table_elt_t           *header;
+    ngx_http_upstream_t       *u;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    u = r->upstream;
+
+    /*
+     * the variant is stored with the original response headers,
+     * much like the compression filter modifies them
+     */
+
+    len = sizeof("HTTP/1.1 200 OK" CRLF) - 1
+          + sizeof("Content-Encoding: " CRLF) - 1 + ctx->encoding.len
+          + sizeof("Vary: Accept-Encoding" CRLF) - 1
+          + sizeof(CRLF) - 1;
+
+    part = &u->headers_in.headers.part;
+    header = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+
+            part = part->next;
+            header = part->elts;
+            i = 0;
+        }
+
+        if (header[i].hash == 0) {
+            continue;
+        }
+
+        if (header[i].key.len == sizeof("Content-Encoding") - 1
+            && ngx_strncasecmp(header[i].key.data,
+                               (u_char *) "Content-Encoding",
+                               sizeof("Content-Encoding") - 1)
+               == 0)
+        {
+            return NGX_DECLINED;
+        }
+
+        len += header[i].key.len + sizeof(": " CRLF) - 1
+               + header[i].value.len + sizeof("W/") - 1;
+    }
+
+    if (r->cache->header_start + len > u->conf->buffer_size) {
+        ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "http cache compressed header is too long");
+        return NGX_DECLINED;
+    }
+
+    b = ngx_create_temp_buf(r->pool, len);
+    if (b == NULL) {
+        return NGX_ERROR;
+    }
+
+    b->last = ngx_cpymem(b->last, "HTTP/1.1 200 OK" CRLF,
+                         sizeof("HTTP/1.1 200 OK" CRLF) - 1);
+
+    vary = 0;
+
+    part = &u->headers_in.headers.part;
+    header = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+
+            part = part->next;
+            header = part->elts;
+            i = 0;
+        }
+
+        if (header[i].hash == 0) {
+            continue;
+        }
+
+        if ((header[i].key.len == sizeof("Content-Length") - 1
+             && ngx_strncasecmp(header[i].key.data,
+                                (u_char *) "Content-Length",
+                                sizeof("Content-Length") - 1)
+                == 0)
+            || (header[i].key.len == sizeof("Transfer-Encoding") - 1
+                && ngx_strncasecmp(header[i].key.data,
+                                   (u_char *) "Transfer-Encoding",
+                                   sizeof("Transfer-Encoding") - 1)
+                   == 0)
+            || (header[i].key.len == sizeof("Accept-Ranges") - 1
+                && ngx_strncasecmp(header[i].key.data,
+                                   (u_char *) "Accept-Ranges",
+                                   sizeof("Accept-Ranges") - 1)
+                   == 0))
+        {
+            continue;
+        }
+
+        if (header[i].key.len == sizeof("Vary") - 1
+            && ngx_strncasecmp(header[i].key.data, (u_char *) "Vary",
+                               sizeof("Vary") - 1)
+               == 0)
+        {
+            vary = 1;
+
+        } else if (header[i].key.len == sizeof("ETag") - 1
+                   && ngx_strncasecmp(header[i].key.data, (u_char *) "ETag",
+                                      sizeof("ETag") - 1)
+                      == 0)
+        {
+            /* see ngx_http_weak_etag() */
+
+            if (header[i].value.len > 2
+                && header[i].value.data[0] == 'W'
+                && header[i].value.data[1] == '/')
+            {
+                /* void */
+
+            } else if (header[i].value.len > 0
+                       && header[i].value.data[0] == '"')
+            {
+                b->last = ngx_cpymem(b->last, header[i].key.data,
+                                     header[i].key.len);
+                *b->last++ = ':'; *b->last++ = ' ';
+                *b->last++ = 'W'; *b->last++ = '/';
+                b->last = ngx_cpymem(b->last, header[i].value.data,
+                                     header[i].value.len);
+                *b->last++ = CR; *b->last++ = LF;
+
+                continue;
+
+            } else {
+                continue;
+            }
+        }
+
+        b->last = ngx_cpymem(b->last, header[i].key.data, header[i].key.len);
+        *b->last++ = ':'; *b->last++ = ' ';
+
+        b->last = ngx_cpymem(b->last, header[i].value.data,
+                             header[i].value.len);
+        *b->last++ = CR; *b->last++ = LF;
+    }
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+    if (!vary && r->gzip_vary && clcf->gzip_vary) {
+        b->last = ngx_cpymem(b->last, "Vary: Accept-Encoding" CRLF,
+                             sizeof("Vary: Accept-Encoding" CRLF) - 1);
+    }
+
+    b->last = ngx_cpymem(b->last, "Content-Encoding: ",
+                         sizeof("Content-Encoding: ") - 1);
+    b->last = ngx_cpymem(b->last, ctx->encoding.data, ctx->encoding.len);
+    *b->last++ = CR; *b->last++ = LF;
+
+    /* the header ends with an empty line */
+    *b->last++ = CR; *b->last++ = LF;
+
+    ctx->header = ngx_alloc_chain_link(r->pool);
+    if (ctx->header == NULL) {
+        return NGX_ERROR;
+    }
+
+    ctx->header->buf = b;
+    ctx->header->next = NULL;
+
+    ctx->body_start = r->cache->header_start + (b->last - b->pos);
+
+    return NGX_OK;
+}
+
+
+static ngx_uint_t
+ngx_http_cache_compressed_vary(ngx_http_upstream_t *u)
+{
+    u_char           *p, *last;
+    ngx_table_elt_t  *h;
+
+    for (h = u->headers_in.vary; h; h = h->next) {
+
+        p = h->value.data;
+        last = p + h->value.len;
+
+        while (p < last) {
+
+            if (*p == ' ' || *p == ',') {
+                p++;
+                continue;
+            }
+
+            if ((size_t) (last - p) < sizeof("Accept-Encoding") - 1
+                || ngx_strncasecmp(p, (u_char *) "Accept-Encoding",
+                                   sizeof("Accept-Encoding") - 1)
+                   != 0)
+            {
+                return 0;
+            }
+
+            p += sizeof("Accept-Encoding") - 1;
+
+            if (p < last && *p != ' ' && *p != ',') {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+
+static ngx_int_t
+ngx_http_cache_compressed_filter_init(ngx_conf_t *cf)
+{
+    ngx_http_next_header_filter = ngx_http_top_header_filter;
+    ngx_http_top_header_filter = ngx_http_cache_compressed_header_filter;
+
+    ngx_http_next_body_filter = ngx_http_top_body_filter;
+    ngx_http_top_body_filter = ngx_http_cache_compressed_body_filter;
+
+    return NGX_OK;
+}
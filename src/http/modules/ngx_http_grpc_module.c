@@ -58,12 +58,12 @@ typedef enum {
 } ngx_http_grpc_state_e;
 
 
-typedef struct {
-    size_t                     init_window;
-    size_t                     send_window;
-    size_t                     recv_window;
-    ngx_uint_t                 last_stream_id;
-} ngx_http_grpc_conn_t;
+typedef ngx_http_v2_upstream_conn_t  ngx_http_grpc_conn_t;
+
+
+#define ngx_http_grpc_stream_window(ctx)                                      \
+    ((ctx)->multiplexed ? NGX_HTTP_V2_UPSTREAM_STREAM_WINDOW                  \
+                        : NGX_HTTP_V2_MAX_WINDOW)
 
 
 typedef struct {
@@ -87,6 +87,7 @@ typedef struct {
 
     ssize_t                    send_window;
     size_t                     recv_window;
+    size_t                     init_window;
 
     size_t                     rest;
     ngx_uint_t                 stream_id;
@@ -123,6 +124,7 @@ typedef struct {
     unsigned                   status:1;
     unsigned                   rst:1;
     unsigned                   goaway:1;
+    unsigned                   multiplexed:1;
 
     ngx_http_request_t        *request;
 
@@ -368,6 +370,27 @@ static ngx_command_t  ngx_http_grpc_commands[] = {
       offsetof(ngx_http_grpc_loc_conf_t, upstream.connection_drop),
       NULL },
 
+    { ngx_string("grpc_multiplex"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_grpc_loc_conf_t, upstream.multiplex),
+      NULL },
+
+    { ngx_string("grpc_multiplex_streams"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_grpc_loc_conf_t, upstream.multiplex_streams),
+      NULL },
+
+    { ngx_string("grpc_multiplex_timeout"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_msec_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_grpc_loc_conf_t, upstream.multiplex_timeout),
+      NULL },
+
 #if (NGX_HTTP_SSL)
 
     { ngx_string("grpc_ssl_session_reuse"),
@@ -517,6 +540,23 @@ static u_char  ngx_http_grpc_connection_start[] =
     "\x7f\xff\x00\x00";
 
 
+/*
+ * multiplexed connections limit the windows, so the data of a stream
+ * cannot occupy the whole connection window
+ */
+
+static u_char  ngx_http_grpc_multiplex_start[] =
+    "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"         /* connection preface */
+
+    "\x00\x00\x12\x04\x00\x00\x00\x00\x00"     /* settings frame */
+    "\x00\x01\x00\x00\x00\x00"                 /* header table size */
+    "\x00\x02\x00\x00\x00\x00"                 /* disable push */
+    "\x00\x04\x00\x10\x00\x00"                 /* initial window */
+
+    "\x00\x00\x04\x08\x00\x00\x00\x00\x00"     /* window update frame */
+    "\x00\xff\x00\x01";
+
+
 static ngx_keyval_t  ngx_http_grpc_headers[] = {
     { ngx_string("Content-Length"), ngx_string("$content_length") },
     { ngx_string("TE"), ngx_string("$grpc_internal_trailers") },
@@ -747,8 +787,14 @@ ngx_http_grpc_create_request(ngx_http_request_t *r)
 
     ctx = ngx_http_get_module_ctx(r, ngx_http_grpc_module);
 
-    len = sizeof(ngx_http_grpc_connection_start) - 1
-          + sizeof(ngx_http_grpc_frame_t);             /* headers frame */
+    if (glcf->upstream.multiplex) {
+        len = sizeof(ngx_http_grpc_multiplex_start) - 1;
+
+    } else {
+        len = sizeof(ngx_http_grpc_connection_start) - 1;
+    }
+
+    len += sizeof(ngx_http_grpc_frame_t);              /* headers frame */
 
     /* :method header */
 
@@ -892,8 +938,14 @@ ngx_http_grpc_create_request(ngx_http_request_t *r)
 
     /* connection preface */
 
-    b->last = ngx_copy(b->last, ngx_http_grpc_connection_start,
-                       sizeof(ngx_http_grpc_connection_start) - 1);
+    if (glcf->upstream.multiplex) {
+        b->last = ngx_copy(b->last, ngx_http_grpc_multiplex_start,
+                           sizeof(ngx_http_grpc_multiplex_start) - 1);
+
+    } else {
+        b->last = ngx_copy(b->last, ngx_http_grpc_connection_start,
+                           sizeof(ngx_http_grpc_connection_start) - 1);
+    }
 
     /* headers frame */
 
@@ -1242,16 +1294,17 @@ ngx_http_grpc_body_output_filter(void *data, ngx_chain_t *in)
 {
     ngx_http_request_t  *r = data;
 
-    off_t                   file_pos;
-    u_char                 *p, *pos, *start;
-    size_t                  len, limit;
-    ngx_buf_t              *b;
-    ngx_int_t               rc;
-    ngx_uint_t              next, last;
-    ngx_chain_t            *cl, *out, *ln, **ll;
-    ngx_http_upstream_t    *u;
-    ngx_http_grpc_ctx_t    *ctx;
-    ngx_http_grpc_frame_t  *f;
+    off_t                      file_pos;
+    u_char                    *p, *pos, *start;
+    size_t                     len, limit;
+    ngx_buf_t                 *b;
+    ngx_int_t                  rc;
+    ngx_uint_t                 next, last;
+    ngx_chain_t               *cl, *out, *ln, **ll;
+    ngx_http_upstream_t       *u;
+    ngx_http_grpc_ctx_t       *ctx;
+    ngx_http_grpc_frame_t     *f;
+    ngx_http_grpc_loc_conf_t  *glcf;
 
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                    "grpc output filter");
@@ -1285,8 +1338,16 @@ ngx_http_grpc_body_output_filter(void *data, ngx_chain_t *in)
              * update stream identifiers
              */
 
+            glcf = ngx_http_get_module_loc_conf(r, ngx_http_grpc_module);
+
             b = ctx->in->buf;
-            b->pos += sizeof(ngx_http_grpc_connection_start) - 1;
+
+            if (glcf->upstream.multiplex) {
+                b->pos += sizeof(ngx_http_grpc_multiplex_start) - 1;
+
+            } else {
+                b->pos += sizeof(ngx_http_grpc_connection_start) - 1;
+            }
 
             p = b->pos;
 
@@ -2112,7 +2173,9 @@ ngx_http_grpc_filter(void *data, ssize_t bytes)
                     return NGX_ERROR;
                 }
 
-                if (ctx->rest > ctx->connection->recv_window) {
+                if (!ctx->multiplexed
+                    && ctx->rest > ctx->connection->recv_window)
+                {
                     ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
                                   "upstream violated connection flow control, "
                                   "received %uz data frame with window %uz",
@@ -2121,10 +2184,17 @@ ngx_http_grpc_filter(void *data, ssize_t bytes)
                 }
 
                 ctx->recv_window -= ctx->rest;
-                ctx->connection->recv_window -= ctx->rest;
 
-                if (ctx->connection->recv_window < NGX_HTTP_V2_MAX_WINDOW / 4
-                    || ctx->recv_window < NGX_HTTP_V2_MAX_WINDOW / 4)
+                /* the connection window of a session is maintained there */
+
+                if (!ctx->multiplexed) {
+                    ctx->connection->recv_window -= ctx->rest;
+                }
+
+                if ((!ctx->multiplexed
+                     && ctx->connection->recv_window
+                        < NGX_HTTP_V2_MAX_WINDOW / 4)
+                    || ctx->recv_window < ngx_http_grpc_stream_window(ctx) / 4)
                 {
                     if (ngx_http_grpc_send_window_update(r, ctx) != NGX_OK) {
                         return NGX_ERROR;
@@ -3874,8 +3944,9 @@ ngx_http_grpc_parse_settings(ngx_http_request_t *r, ngx_http_grpc_ctx_t *ctx,
                     return NGX_ERROR;
                 }
 
-                window_update = ctx->setting_value
-                                - ctx->connection->init_window;
+                window_update = ctx->setting_value - ctx->init_window;
+
+                ctx->init_window = ctx->setting_value;
                 ctx->connection->init_window = ctx->setting_value;
 
                 if (ctx->send_window > 0
@@ -3906,6 +3977,11 @@ ngx_http_grpc_parse_settings(ngx_http_request_t *r, ngx_http_grpc_ctx_t *ctx,
 
     ctx->state = ngx_http_grpc_st_start;
 
+    if (ctx->multiplexed) {
+        /* acknowledged by the session */
+        return NGX_OK;
+    }
+
     return ngx_http_grpc_send_settings_ack(r, ctx);
 }
 
@@ -4098,6 +4174,10 @@ ngx_http_grpc_send_window_update(ngx_http_request_t *r,
         return NGX_ERROR;
     }
 
+    if (ctx->multiplexed) {
+        goto stream;
+    }
+
     f = (ngx_http_grpc_frame_t *) cl->buf->last;
     cl->buf->last += sizeof(ngx_http_grpc_frame_t);
 
@@ -4119,6 +4199,8 @@ ngx_http_grpc_send_window_update(ngx_http_request_t *r,
     *cl->buf->last++ = (u_char) ((n >> 8) & 0xff);
     *cl->buf->last++ = (u_char) (n & 0xff);
 
+stream:
+
     f = (ngx_http_grpc_frame_t *) cl->buf->last;
     cl->buf->last += sizeof(ngx_http_grpc_frame_t);
 
@@ -4132,8 +4214,8 @@ ngx_http_grpc_send_window_update(ngx_http_request_t *r,
     f->stream_id_2 = (u_char) ((ctx->id >> 8) & 0xff);
     f->stream_id_3 = (u_char) (ctx->id & 0xff);
 
-    n = NGX_HTTP_V2_MAX_WINDOW - ctx->recv_window;
-    ctx->recv_window = NGX_HTTP_V2_MAX_WINDOW;
+    n = ngx_http_grpc_stream_window(ctx) - ctx->recv_window;
+    ctx->recv_window = ngx_http_grpc_stream_window(ctx);
 
     *cl->buf->last++ = (u_char) ((n >> 24) & 0xff);
     *cl->buf->last++ = (u_char) ((n >> 16) & 0xff);
@@ -4219,6 +4301,25 @@ ngx_http_grpc_get_connection_data(ngx_http_request_t *r,
 
     c = pc->connection;
 
+    ctx->connection = ngx_http_v2_upstream_get_conn(c);
+
+    if (ctx->connection) {
+
+        /* a stream of a multiplexed connection */
+
+        ctx->multiplexed = 1;
+
+        ctx->id = ctx->connection->last_stream_id
+                  ? ctx->connection->last_stream_id + 2 : 1;
+        ctx->connection->last_stream_id = ctx->id;
+
+        ctx->init_window = ctx->connection->init_window;
+        ctx->send_window = ctx->connection->init_window;
+        ctx->recv_window = NGX_HTTP_V2_UPSTREAM_STREAM_WINDOW;
+
+        return NGX_OK;
+    }
+
     if (pc->cached) {
 
         /*
@@ -4240,6 +4341,7 @@ ngx_http_grpc_get_connection_data(ngx_http_request_t *r,
             return NGX_ERROR;
         }
 
+        ctx->init_window = ctx->connection->init_window;
         ctx->send_window = ctx->connection->init_window;
         ctx->recv_window = NGX_HTTP_V2_MAX_WINDOW;
 
@@ -4261,6 +4363,7 @@ ngx_http_grpc_get_connection_data(ngx_http_request_t *r,
     ctx->connection->send_window = NGX_HTTP_V2_DEFAULT_WINDOW;
     ctx->connection->recv_window = NGX_HTTP_V2_MAX_WINDOW;
 
+    ctx->init_window = NGX_HTTP_V2_DEFAULT_WINDOW;
     ctx->send_window = NGX_HTTP_V2_DEFAULT_WINDOW;
     ctx->recv_window = NGX_HTTP_V2_MAX_WINDOW;
 
@@ -4389,6 +4492,10 @@ ngx_http_grpc_create_loc_conf(ngx_conf_t *cf)
     conf->upstream.next_upstream_timeout = NGX_CONF_UNSET_MSEC;
     conf->upstream.connection_drop = NGX_CONF_UNSET_MSEC;
 
+    conf->upstream.multiplex = NGX_CONF_UNSET;
+    conf->upstream.multiplex_streams = NGX_CONF_UNSET_UINT;
+    conf->upstream.multiplex_timeout = NGX_CONF_UNSET_MSEC;
+
     conf->upstream.buffer_size = NGX_CONF_UNSET_SIZE;
 
     conf->upstream.hide_headers = NGX_CONF_UNSET_PTR;
@@ -4467,6 +4574,21 @@ ngx_http_grpc_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
                               prev->upstream.connection_drop,
                               NGX_HTTP_UPSTREAM_CONNECTION_DROP_OFF);
 
+    ngx_conf_merge_value(conf->upstream.multiplex,
+                              prev->upstream.multiplex, 0);
+
+    ngx_conf_merge_uint_value(conf->upstream.multiplex_streams,
+                              prev->upstream.multiplex_streams, 128);
+
+    ngx_conf_merge_msec_value(conf->upstream.multiplex_timeout,
+                              prev->upstream.multiplex_timeout, 60000);
+
+    if (conf->upstream.multiplex_streams == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "\"grpc_multiplex_streams\" must be greater than 0");
+        return NGX_CONF_ERROR;
+    }
+
     ngx_conf_merge_size_value(conf->upstream.buffer_size,
                               prev->upstream.buffer_size,
                               (size_t) ngx_pagesize);
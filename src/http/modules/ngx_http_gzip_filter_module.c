@@ -27,6 +27,10 @@ typedef struct {
     size_t               memlevel;
     ssize_t              min_length;
 
+#if (NGX_THREADS)
+    ngx_thread_pool_t   *thread_pool;
+#endif
+
     ngx_array_t         *types_keys;
 } ngx_http_gzip_conf_t;
 
@@ -58,15 +62,34 @@ typedef struct {
     unsigned             nomem:1;
     unsigned             buffering:1;
     unsigned             state_allocated:1;
+#if (NGX_THREADS)
+    unsigned             thread_busy:1;
+    unsigned             thread_done:1;
+#endif
 
     size_t               zin;
     size_t               zout;
 
     z_stream             zstream;
     ngx_http_request_t  *request;
+
+#if (NGX_THREADS)
+    ngx_thread_task_t   *thread_task;
+#endif
 } ngx_http_gzip_ctx_t;
 
 
+#if (NGX_THREADS)
+
+typedef struct {
+    z_stream            *zstream;
+    int                  flush;
+    int                  rc;
+} ngx_http_gzip_thread_ctx_t;
+
+#endif
+
+
 static void ngx_http_gzip_filter_memory(ngx_http_request_t *r,
     ngx_http_gzip_ctx_t *ctx);
 static ngx_int_t ngx_http_gzip_filter_buffer(ngx_http_gzip_ctx_t *ctx,
@@ -81,6 +104,12 @@ static ngx_int_t ngx_http_gzip_filter_deflate(ngx_http_request_t *r,
     ngx_http_gzip_ctx_t *ctx);
 static ngx_int_t ngx_http_gzip_filter_deflate_end(ngx_http_request_t *r,
     ngx_http_gzip_ctx_t *ctx);
+#if (NGX_THREADS)
+static ngx_int_t ngx_http_gzip_filter_deflate_thread(ngx_http_request_t *r,
+    ngx_http_gzip_ctx_t *ctx, ngx_thread_pool_t *tp);
+static void ngx_http_gzip_thread_handler(void *data, ngx_log_t *log);
+static void ngx_http_gzip_thread_event_handler(ngx_event_t *ev);
+#endif
 
 static void *ngx_http_gzip_filter_alloc(void *opaque, u_int items,
     u_int size);
@@ -98,6 +127,8 @@ static char *ngx_http_gzip_merge_conf(ngx_conf_t *cf,
     void *parent, void *child);
 static char *ngx_http_gzip_window(ngx_conf_t *cf, void *post, void *data);
 static char *ngx_http_gzip_hash(ngx_conf_t *cf, void *post, void *data);
+static char *ngx_http_gzip_threads(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
 
 
 static ngx_conf_num_bounds_t  ngx_http_gzip_comp_level_bounds = {
@@ -174,6 +205,13 @@ static ngx_command_t  ngx_http_gzip_filter_commands[] = {
       offsetof(ngx_http_gzip_conf_t, min_length),
       NULL },
 
+    { ngx_string("gzip_threads"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_http_gzip_threads,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
       ngx_null_command
 };
 
@@ -358,6 +396,12 @@ ngx_http_gzip_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
         r->connection->buffered |= NGX_HTTP_GZIP_BUFFERED;
     }
 
+#if (NGX_THREADS)
+    if (ctx->thread_busy) {
+        return NGX_AGAIN;
+    }
+#endif
+
     if (ctx->nomem) {
 
         /* flush busy buffers */
@@ -385,6 +429,12 @@ ngx_http_gzip_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
 
             /* cycle while there is data to feed zlib and ... */
 
+#if (NGX_THREADS)
+            if (ctx->thread_done) {
+                goto deflate;
+            }
+#endif
+
             rc = ngx_http_gzip_filter_add_data(r, ctx);
 
             if (rc == NGX_DECLINED) {
@@ -408,6 +458,9 @@ ngx_http_gzip_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
                 goto failed;
             }
 
+#if (NGX_THREADS)
+        deflate:
+#endif
 
             rc = ngx_http_gzip_filter_deflate(r, ctx);
 
@@ -419,6 +472,13 @@ ngx_http_gzip_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
                 goto failed;
             }
 
+#if (NGX_THREADS)
+            if (rc == NGX_BUSY) {
+                /* deflate() is running in a thread */
+                return NGX_AGAIN;
+            }
+#endif
+
             /* rc == NGX_AGAIN */
         }
 
@@ -735,10 +795,28 @@ ngx_http_gzip_filter_get_buf(ngx_http_request_t *r, ngx_http_gzip_ctx_t *ctx)
 static ngx_int_t
 ngx_http_gzip_filter_deflate(ngx_http_request_t *r, ngx_http_gzip_ctx_t *ctx)
 {
-    int                    rc;
-    ngx_buf_t             *b;
-    ngx_chain_t           *cl;
-    ngx_http_gzip_conf_t  *conf;
+    int                          rc;
+    ngx_buf_t                   *b;
+    ngx_chain_t                 *cl;
+    ngx_http_gzip_conf_t        *conf;
+#if (NGX_THREADS)
+    ngx_http_gzip_thread_ctx_t  *tctx;
+#endif
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_gzip_filter_module);
+
+#if (NGX_THREADS)
+
+    if (ctx->thread_done) {
+        ctx->thread_done = 0;
+
+        tctx = ctx->thread_task->ctx;
+        rc = tctx->rc;
+
+        goto deflated;
+    }
+
+#endif
 
     ngx_log_debug6(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                  "deflate in: ni:%p no:%p ai:%ud ao:%ud fl:%d redo:%d",
@@ -746,8 +824,20 @@ ngx_http_gzip_filter_deflate(ngx_http_request_t *r, ngx_http_gzip_ctx_t *ctx)
                  ctx->zstream.avail_in, ctx->zstream.avail_out,
                  ctx->flush, ctx->redo);
 
+#if (NGX_THREADS)
+
+    if (conf->thread_pool) {
+        return ngx_http_gzip_filter_deflate_thread(r, ctx, conf->thread_pool);
+    }
+
+#endif
+
     rc = deflate(&ctx->zstream, ctx->flush);
 
+#if (NGX_THREADS)
+deflated:
+#endif
+
     if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) {
         ngx_log_error(NGX_LOG_ALERT, r->connection->log, 0,
                       "deflate() failed: %d, %d", ctx->flush, rc);
@@ -838,8 +928,6 @@ ngx_http_gzip_filter_deflate(ngx_http_request_t *r, ngx_http_gzip_ctx_t *ctx)
         return NGX_OK;
     }
 
-    conf = ngx_http_get_module_loc_conf(r, ngx_http_gzip_filter_module);
-
     if (conf->no_buffer && ctx->in == NULL) {
 
         cl = ngx_alloc_chain_link(r->pool);
@@ -911,6 +999,117 @@ ngx_http_gzip_filter_deflate_end(ngx_http_request_t *r,
 }
 
 
+#if (NGX_THREADS)
+
+static ngx_int_t
+ngx_http_gzip_filter_deflate_thread(ngx_http_request_t *r,
+    ngx_http_gzip_ctx_t *ctx, ngx_thread_pool_t *tp)
+{
+    ngx_thread_task_t           *task;
+    ngx_http_gzip_thread_ctx_t  *tctx;
+
+    task = ctx->thread_task;
+
+    if (task == NULL) {
+        task = ngx_thread_task_alloc(r->pool,
+                                     sizeof(ngx_http_gzip_thread_ctx_t));
+        if (task == NULL) {
+            return NGX_ERROR;
+        }
+
+        task->handler = ngx_http_gzip_thread_handler;
+
+        ctx->thread_task = task;
+    }
+
+    tctx = task->ctx;
+
+    tctx->zstream = &ctx->zstream;
+    tctx->flush = ctx->flush;
+
+    task->event.data = r;
+    task->event.handler = ngx_http_gzip_thread_event_handler;
+    task->event.log = r->connection->log;
+
+    if (ngx_thread_task_post(tp, task) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    ngx_add_timer(&task->event, 60000);
+
+    /*
+     * r->aio is not set, as the request may wait for another
+     * thread operation at the same time, e.g., reading a file
+     * with "aio threads"
+     */
+
+    r->main->blocked++;
+    r->connection->buffered |= NGX_HTTP_GZIP_BUFFERED;
+
+    ctx->thread_busy = 1;
+
+    return NGX_BUSY;
+}
+
+
+static void
+ngx_http_gzip_thread_handler(void *data, ngx_log_t *log)
+{
+    ngx_http_gzip_thread_ctx_t *ctx = data;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_CORE, log, 0, "gzip thread handler");
+
+    /* zlib does not allocate memory after deflateInit2() */
+
+    ctx->rc = deflate(ctx->zstream, ctx->flush);
+}
+
+
+static void
+ngx_http_gzip_thread_event_handler(ngx_event_t *ev)
+{
+    ngx_connection_t     *c;
+    ngx_http_request_t   *r;
+    ngx_http_gzip_ctx_t  *ctx;
+
+    r = ev->data;
+    c = r->connection;
+
+    ngx_http_set_log_request(c->log, r);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http gzip thread: \"%V?%V\"", &r->uri, &r->args);
+
+    if (ev->timedout) {
+        ngx_log_error(NGX_LOG_ALERT, c->log, 0,
+                      "gzip thread operation took too long");
+        ev->timedout = 0;
+        return;
+    }
+
+    if (ev->timer_set) {
+        ngx_del_timer(ev);
+    }
+
+    ctx = ngx_http_get_module_ctx(r, ngx_http_gzip_filter_module);
+
+    ctx->thread_busy = 0;
+    ctx->thread_done = 1;
+
+    r->main->blocked--;
+
+    if (r->done || r->main->terminated) {
+        c->write->handler(c->write);
+
+    } else {
+        r->write_event_handler(r);
+        ngx_http_run_posted_requests(c);
+    }
+}
+
+#endif
+
+
 static void *
 ngx_http_gzip_filter_alloc(void *opaque, u_int items, u_int size)
 {
@@ -1083,6 +1282,10 @@ ngx_http_gzip_create_conf(ngx_conf_t *cf)
     conf->memlevel = NGX_CONF_UNSET_SIZE;
     conf->min_length = NGX_CONF_UNSET;
 
+#if (NGX_THREADS)
+    conf->thread_pool = NGX_CONF_UNSET_PTR;
+#endif
+
     return conf;
 }
 
@@ -1107,6 +1310,10 @@ ngx_http_gzip_merge_conf(ngx_conf_t *cf, void *parent, void *child)
                               MAX_MEM_LEVEL - 1);
     ngx_conf_merge_value(conf->min_length, prev->min_length, 20);
 
+#if (NGX_THREADS)
+    ngx_conf_merge_ptr_value(conf->thread_pool, prev->thread_pool, NULL);
+#endif
+
     if (ngx_http_merge_types(cf, &conf->types_keys, &conf->types,
                              &prev->types_keys, &prev->types,
                              ngx_http_html_default_types)
@@ -1180,3 +1387,60 @@ ngx_http_gzip_hash(ngx_conf_t *cf, void *post, void *data)
 
     return "must be 512, 1k, 2k, 4k, 8k, 16k, 32k, 64k, or 128k";
 }
+
+
+static char *
+ngx_http_gzip_threads(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+#if (NGX_THREADS)
+    ngx_http_gzip_conf_t *gcf = conf;
+#endif
+
+    ngx_str_t  *value;
+
+    value = cf->args->elts;
+
+#if (NGX_THREADS)
+
+    if (gcf->thread_pool != NGX_CONF_UNSET_PTR) {
+        return "is duplicate";
+    }
+
+    if (ngx_strcmp(value[1].data, "off") == 0) {
+        gcf->thread_pool = NULL;
+        return NGX_CONF_OK;
+    }
+
+    if (ngx_strcmp(value[1].data, "on") == 0) {
+        gcf->thread_pool = ngx_thread_pool_add(cf, NULL);
+
+    } else if (ngx_strncmp(value[1].data, "pool=", 5) == 0
+               && value[1].len > 5)
+    {
+        value[1].len -= 5;
+        value[1].data += 5;
+
+        gcf->thread_pool = ngx_thread_pool_add(cf, &value[1]);
+
+    } else {
+        return "invalid value";
+    }
+
+    if (gcf->thread_pool == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    return NGX_CONF_OK;
+
+#else
+
+    if (ngx_strcmp(value[1].data, "off") == 0) {
+        return NGX_CONF_OK;
+    }
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "\"gzip_threads\" is unsupported on this platform");
+    return NGX_CONF_ERROR;
+
+#endif
+}
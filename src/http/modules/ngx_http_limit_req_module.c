@@ -1004,6 +1004,7 @@ ngx_http_limit_req_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     ngx_memzero(&zp, sizeof(ngx_shm_zone_params_t));
 
     zp.min_size = 8 * ngx_pagesize;
+    zp.numa_aware = 1;
 
     rate = 1;
     scale = 1;
@@ -1060,8 +1061,9 @@ ngx_http_limit_req_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 
     ctx->rate = rate * 1000 / scale;
 
-    shm_zone = ngx_shared_memory_add(cf, &zp.name, zp.size,
-                                     &ngx_http_limit_req_module);
+    zp.tag = &ngx_http_limit_req_module;
+
+    shm_zone = ngx_shared_memory_add_ext(cf, &zp);
     if (shm_zone == NULL) {
         return NGX_CONF_ERROR;
     }
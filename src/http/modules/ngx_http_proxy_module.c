@@ -251,6 +251,10 @@ static char *ngx_http_proxy_ssl_password_file(ngx_conf_t *cf,
 #endif
 
 static char *ngx_http_proxy_lowat_check(ngx_conf_t *cf, void *post, void *data);
+#if (NGX_HTTP_CACHE)
+static char *ngx_http_proxy_cache_partial_check(ngx_conf_t *cf, void *post,
+    void *data);
+#endif
 #if (NGX_HTTP_SSL)
 static char *ngx_http_proxy_ssl_conf_command_check(ngx_conf_t *cf, void *post,
     void *data);
@@ -368,6 +372,22 @@ static ngx_conf_bitmask_t  ngx_http_proxy_next_upstream_masks[] = {
 };
 
 
+#if (NGX_HTTP_CACHE)
+
+static ngx_conf_post_t  ngx_http_proxy_cache_partial_post =
+    { ngx_http_proxy_cache_partial_check };
+
+
+static ngx_conf_bitmask_t  ngx_http_proxy_cache_compressed_masks[] = {
+    { ngx_string("gzip"), NGX_HTTP_CACHE_COMPRESSED_GZIP },
+    { ngx_string("br"), NGX_HTTP_CACHE_COMPRESSED_BROTLI },
+    { ngx_string("off"), NGX_HTTP_CACHE_COMPRESSED_OFF },
+    { ngx_null_string, 0 }
+};
+
+#endif
+
+
 #if (NGX_HTTP_SSL)
 
 static ngx_conf_bitmask_t  ngx_http_proxy_ssl_protocols[] = {
@@ -483,6 +503,20 @@ static ngx_command_t  ngx_http_proxy_commands[] = {
       offsetof(ngx_http_proxy_loc_conf_t, upstream.socket_keepalive),
       NULL },
 
+    { ngx_string("proxy_collapse"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_proxy_loc_conf_t, upstream.collapse),
+      NULL },
+
+    { ngx_string("proxy_collapse_key"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_http_set_complex_value_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_proxy_loc_conf_t, upstream.collapse_key),
+      NULL },
+
     { ngx_string("proxy_connect_timeout"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
       ngx_conf_set_msec_slot,
@@ -709,6 +743,20 @@ static ngx_command_t  ngx_http_proxy_commands[] = {
       offsetof(ngx_http_proxy_loc_conf_t, upstream.cache_lock_age),
       NULL },
 
+    { ngx_string("proxy_cache_lock_stream"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_proxy_loc_conf_t, upstream.cache_lock_stream),
+      NULL },
+
+    { ngx_string("proxy_cache_partial"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_size_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_proxy_loc_conf_t, upstream.cache_partial),
+      &ngx_http_proxy_cache_partial_post },
+
     { ngx_string("proxy_cache_revalidate"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
       ngx_conf_set_flag_slot,
@@ -730,6 +778,13 @@ static ngx_command_t  ngx_http_proxy_commands[] = {
       offsetof(ngx_http_proxy_loc_conf_t, upstream.cache_background_update),
       NULL },
 
+    { ngx_string("proxy_cache_compressed"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_1MORE,
+      ngx_conf_set_bitmask_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_proxy_loc_conf_t, upstream.cache_compressed),
+      &ngx_http_proxy_cache_compressed_masks },
+
 #endif
 
     { ngx_string("proxy_temp_path"),
@@ -989,6 +1044,27 @@ static ngx_command_t  ngx_http_proxy_commands[] = {
                upstream.h3_settings.max_table_capacity),
       NULL },
 
+    { ngx_string("proxy_http3_multiplex"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_proxy_loc_conf_t, upstream.h3_multiplex),
+      NULL },
+
+    { ngx_string("proxy_http3_multiplex_streams"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_proxy_loc_conf_t, upstream.h3_multiplex_streams),
+      NULL },
+
+    { ngx_string("proxy_http3_multiplex_timeout"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_msec_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_proxy_loc_conf_t, upstream.h3_multiplex_timeout),
+      NULL },
+
 #endif
 
       ngx_null_command
@@ -1083,7 +1159,7 @@ static ngx_keyval_t  ngx_http_v3_proxy_cache_headers[] = {
     { ngx_string("If-Unmodified-Since"), ngx_string("") },
     { ngx_string("If-None-Match"), ngx_string("$upstream_cache_etag") },
     { ngx_string("If-Match"), ngx_string("") },
-    { ngx_string("Range"), ngx_string("") },
+    { ngx_string("Range"), ngx_string("$upstream_cache_range") },
     { ngx_string("If-Range"), ngx_string("") },
     { ngx_null_string, ngx_null_string }
 };
@@ -1122,7 +1198,7 @@ static ngx_keyval_t  ngx_http_proxy_cache_headers[] = {
     { ngx_string("If-Unmodified-Since"), ngx_string("") },
     { ngx_string("If-None-Match"), ngx_string("$upstream_cache_etag") },
     { ngx_string("If-Match"), ngx_string("") },
-    { ngx_string("Range"), ngx_string("") },
+    { ngx_string("Range"), ngx_string("$upstream_cache_range") },
     { ngx_string("If-Range"), ngx_string("") },
     { ngx_null_string, ngx_null_string }
 };
@@ -3877,6 +3953,7 @@ ngx_http_proxy_create_loc_conf(ngx_conf_t *cf)
      *     conf->upstream.cache_zone = NULL;
      *     conf->upstream.cache_use_stale = 0;
      *     conf->upstream.cache_methods = 0;
+     *     conf->upstream.cache_compressed = 0;
      *     conf->upstream.temp_path = NULL;
      *     conf->upstream.hide_headers_hash = { NULL, 0 };
      *     conf->upstream.store_lengths = NULL;
@@ -3925,6 +4002,9 @@ ngx_http_proxy_create_loc_conf(ngx_conf_t *cf)
     conf->upstream.local = NGX_CONF_UNSET_PTR;
     conf->upstream.socket_keepalive = NGX_CONF_UNSET;
 
+    conf->upstream.collapse = NGX_CONF_UNSET;
+    conf->upstream.collapse_key = NGX_CONF_UNSET_PTR;
+
     conf->upstream.connect_timeout = NGX_CONF_UNSET_MSEC;
     conf->upstream.send_timeout = NGX_CONF_UNSET_MSEC;
     conf->upstream.read_timeout = NGX_CONF_UNSET_MSEC;
@@ -3953,6 +4033,8 @@ ngx_http_proxy_create_loc_conf(ngx_conf_t *cf)
     conf->upstream.cache_lock = NGX_CONF_UNSET;
     conf->upstream.cache_lock_timeout = NGX_CONF_UNSET_MSEC;
     conf->upstream.cache_lock_age = NGX_CONF_UNSET_MSEC;
+    conf->upstream.cache_lock_stream = NGX_CONF_UNSET;
+    conf->upstream.cache_partial = NGX_CONF_UNSET_SIZE;
     conf->upstream.cache_revalidate = NGX_CONF_UNSET;
     conf->upstream.cache_convert_head = NGX_CONF_UNSET;
     conf->upstream.cache_background_update = NGX_CONF_UNSET;
@@ -4029,6 +4111,10 @@ ngx_http_proxy_create_loc_conf(ngx_conf_t *cf)
     conf->upstream.h3_settings.max_table_capacity = NGX_CONF_UNSET;
     conf->upstream.h3_settings.max_concurrent_streams = NGX_CONF_UNSET_UINT;
 
+    conf->upstream.h3_multiplex = NGX_CONF_UNSET;
+    conf->upstream.h3_multiplex_streams = NGX_CONF_UNSET_UINT;
+    conf->upstream.h3_multiplex_timeout = NGX_CONF_UNSET_MSEC;
+
 #endif
 
     return conf;
@@ -4094,6 +4180,35 @@ ngx_http_proxy_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_conf_merge_value(conf->upstream.socket_keepalive,
                               prev->upstream.socket_keepalive, 0);
 
+    ngx_conf_merge_value(conf->upstream.collapse,
+                              prev->upstream.collapse, 0);
+
+    ngx_conf_merge_ptr_value(conf->upstream.collapse_key,
+                              prev->upstream.collapse_key, NULL);
+
+    if (conf->upstream.collapse && conf->upstream.collapse_key == NULL) {
+        ngx_str_t                          key;
+        ngx_http_compile_complex_value_t   ccv;
+
+        ngx_str_set(&key, "$scheme$proxy_host$request_uri");
+
+        conf->upstream.collapse_key = ngx_palloc(cf->pool,
+                                             sizeof(ngx_http_complex_value_t));
+        if (conf->upstream.collapse_key == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        ngx_memzero(&ccv, sizeof(ngx_http_compile_complex_value_t));
+
+        ccv.cf = cf;
+        ccv.value = &key;
+        ccv.complex_value = conf->upstream.collapse_key;
+
+        if (ngx_http_compile_complex_value(&ccv) != NGX_OK) {
+            return NGX_CONF_ERROR;
+        }
+    }
+
     ngx_conf_merge_msec_value(conf->upstream.connect_timeout,
                               prev->upstream.connect_timeout, 60000);
 
@@ -4307,6 +4422,12 @@ ngx_http_proxy_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_conf_merge_msec_value(conf->upstream.cache_lock_age,
                               prev->upstream.cache_lock_age, 5000);
 
+    ngx_conf_merge_value(conf->upstream.cache_lock_stream,
+                              prev->upstream.cache_lock_stream, 0);
+
+    ngx_conf_merge_size_value(conf->upstream.cache_partial,
+                              prev->upstream.cache_partial, 0);
+
     ngx_conf_merge_value(conf->upstream.cache_revalidate,
                               prev->upstream.cache_revalidate, 0);
 
@@ -4316,6 +4437,16 @@ ngx_http_proxy_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_conf_merge_value(conf->upstream.cache_background_update,
                               prev->upstream.cache_background_update, 0);
 
+    ngx_conf_merge_bitmask_value(conf->upstream.cache_compressed,
+                              prev->upstream.cache_compressed,
+                              (NGX_CONF_BITMASK_SET
+                               |NGX_HTTP_CACHE_COMPRESSED_OFF));
+
+    if (conf->upstream.cache_compressed & NGX_HTTP_CACHE_COMPRESSED_OFF) {
+        conf->upstream.cache_compressed = NGX_CONF_BITMASK_SET
+                                          |NGX_HTTP_CACHE_COMPRESSED_OFF;
+    }
+
 #endif
 
     ngx_conf_merge_value(conf->upstream.pass_request_headers,
@@ -4541,6 +4672,21 @@ ngx_http_proxy_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_conf_merge_str_value(conf->upstream.quic.host_key,
                              prev->upstream.quic.host_key, "");
 
+    ngx_conf_merge_value(conf->upstream.h3_multiplex,
+                         prev->upstream.h3_multiplex, 0);
+
+    ngx_conf_merge_uint_value(conf->upstream.h3_multiplex_streams,
+                              prev->upstream.h3_multiplex_streams, 128);
+
+    ngx_conf_merge_msec_value(conf->upstream.h3_multiplex_timeout,
+                              prev->upstream.h3_multiplex_timeout, 60000);
+
+    if (conf->upstream.h3_multiplex_streams == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "\"proxy_http3_multiplex_streams\" must be "
+                           "greater than 0");
+        return NGX_CONF_ERROR;
+    }
 
     if (conf->http_version == NGX_HTTP_VERSION_30) {
         if (ngx_http_v3_proxy_merge_quic(cf, conf, prev) != NGX_OK) {
@@ -5781,6 +5927,26 @@ ngx_http_proxy_lowat_check(ngx_conf_t *cf, void *post, void *data)
 }
 
 
+#if (NGX_HTTP_CACHE)
+
+static char *
+ngx_http_proxy_cache_partial_check(ngx_conf_t *cf, void *post, void *data)
+{
+    size_t *sp = data;
+
+    if (*sp != 0 && *sp < ngx_pagesize) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "\"proxy_cache_partial\" must be at least %ui",
+                           ngx_pagesize);
+        return NGX_CONF_ERROR;
+    }
+
+    return NGX_CONF_OK;
+}
+
+#endif
+
+
 #if (NGX_HTTP_SSL)
 
 static char *
@@ -52,6 +52,14 @@ static char *ngx_http_ssl_password_file(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 static char *ngx_http_ssl_session_cache(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
+static char *ngx_http_ssl_session_ticket_key_rotation(ngx_conf_t *cf,
+    ngx_command_t *cmd, void *conf);
+static char *ngx_http_ssl_async_keys(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+static char *ngx_http_ssl_certificate_compression(ngx_conf_t *cf,
+    ngx_command_t *cmd, void *conf);
+static char *ngx_http_ssl_dynamic_records(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
 static char *ngx_http_ssl_ocsp_cache(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 
@@ -238,6 +246,34 @@ static ngx_command_t  ngx_http_ssl_commands[] = {
       offsetof(ngx_http_ssl_srv_conf_t, session_ticket_keys),
       NULL },
 
+    { ngx_string("ssl_session_ticket_key_rotation"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_CONF_TAKE12,
+      ngx_http_ssl_session_ticket_key_rotation,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("ssl_async_keys"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_CONF_TAKE1,
+      ngx_http_ssl_async_keys,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("ssl_certificate_compression"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_CONF_1MORE,
+      ngx_http_ssl_certificate_compression,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("ssl_dynamic_records"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_CONF_1MORE,
+      ngx_http_ssl_dynamic_records,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      0,
+      NULL },
+
     { ngx_string("ssl_session_timeout"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_CONF_TAKE1,
       ngx_conf_set_sec_slot,
@@ -308,6 +344,13 @@ static ngx_command_t  ngx_http_ssl_commands[] = {
       offsetof(ngx_http_ssl_srv_conf_t, early_data),
       NULL },
 
+    { ngx_string("ssl_ktls"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      offsetof(ngx_http_ssl_srv_conf_t, ktls),
+      NULL },
+
     { ngx_string("ssl_conf_command"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_CONF_TAKE2,
       ngx_conf_set_keyval_slot,
@@ -389,6 +432,9 @@ static ngx_http_variable_t  ngx_http_ssl_vars[] = {
     { ngx_string("ssl_session_reused"), NULL, ngx_http_ssl_variable,
       (uintptr_t) ngx_ssl_get_session_reused, NGX_HTTP_VAR_CHANGEABLE, 0 },
 
+    { ngx_string("ssl_ktls"), NULL, ngx_http_ssl_variable,
+      (uintptr_t) ngx_ssl_get_ktls, NGX_HTTP_VAR_CHANGEABLE, 0 },
+
     { ngx_string("ssl_early_data"), NULL, ngx_http_ssl_variable,
       (uintptr_t) ngx_ssl_get_early_data,
       NGX_HTTP_VAR_CHANGEABLE|NGX_HTTP_VAR_NOCACHEABLE, 0 },
@@ -657,6 +703,7 @@ ngx_http_ssl_create_srv_conf(ngx_conf_t *cf)
 
     sscf->prefer_server_ciphers = NGX_CONF_UNSET;
     sscf->early_data = NGX_CONF_UNSET;
+    sscf->ktls = NGX_CONF_UNSET;
     sscf->reject_handshake = NGX_CONF_UNSET;
     sscf->buffer_size = NGX_CONF_UNSET_SIZE;
     sscf->verify = NGX_CONF_UNSET_UINT;
@@ -670,6 +717,10 @@ ngx_http_ssl_create_srv_conf(ngx_conf_t *cf)
     sscf->session_timeout = NGX_CONF_UNSET;
     sscf->session_tickets = NGX_CONF_UNSET;
     sscf->session_ticket_keys = NGX_CONF_UNSET_PTR;
+    sscf->session_ticket_key_rotation = NGX_CONF_UNSET;
+    sscf->async_keys = NGX_CONF_UNSET_PTR;
+    sscf->certificate_compression = NGX_CONF_UNSET_PTR;
+    sscf->dynamic_records = NGX_CONF_UNSET;
     sscf->ocsp = NGX_CONF_UNSET_UINT;
     sscf->ocsp_cache_zone = NGX_CONF_UNSET_PTR;
     sscf->stapling = NGX_CONF_UNSET;
@@ -697,6 +748,7 @@ ngx_http_ssl_merge_srv_conf(ngx_conf_t *cf, void *parent, void *child)
                          prev->prefer_server_ciphers, 0);
 
     ngx_conf_merge_value(conf->early_data, prev->early_data, 0);
+    ngx_conf_merge_value(conf->ktls, prev->ktls, 0);
     ngx_conf_merge_value(conf->reject_handshake, prev->reject_handshake, 0);
 
     ngx_conf_merge_bitmask_value(conf->protocols, prev->protocols,
@@ -732,6 +784,20 @@ ngx_http_ssl_merge_srv_conf(ngx_conf_t *cf, void *parent, void *child)
 
     ngx_conf_merge_ptr_value(conf->conf_commands, prev->conf_commands, NULL);
 
+    ngx_conf_merge_ptr_value(conf->async_keys, prev->async_keys, NULL);
+
+    ngx_conf_merge_ptr_value(conf->certificate_compression,
+                             prev->certificate_compression, NULL);
+
+    if (conf->dynamic_records == NGX_CONF_UNSET) {
+        conf->dynamic_records = prev->dynamic_records;
+        conf->dynamic_record_size = prev->dynamic_record_size;
+        conf->dynamic_record_threshold = prev->dynamic_record_threshold;
+        conf->dynamic_record_timeout = prev->dynamic_record_timeout;
+    }
+
+    ngx_conf_init_value(conf->dynamic_records, 0);
+
     ngx_conf_merge_uint_value(conf->ocsp, prev->ocsp, 0);
     ngx_conf_merge_str_value(conf->ocsp_responder, prev->ocsp_responder, "");
     ngx_conf_merge_ptr_value(conf->ocsp_cache_zone,
@@ -834,6 +900,25 @@ ngx_http_ssl_merge_srv_conf(ngx_conf_t *cf, void *parent, void *child)
         {
             return NGX_CONF_ERROR;
         }
+
+        if (conf->async_keys
+            && ngx_ssl_async_keys(cf, &conf->ssl, conf->async_keys) != NGX_OK)
+        {
+            return NGX_CONF_ERROR;
+        }
+    }
+
+    if (ngx_ssl_certificate_compression(cf, &conf->ssl,
+                                        conf->certificate_compression)
+        != NGX_OK)
+    {
+        return NGX_CONF_ERROR;
+    }
+
+    if (conf->dynamic_records) {
+        conf->ssl.dyn_rec.size = conf->dynamic_record_size;
+        conf->ssl.dyn_rec.threshold = conf->dynamic_record_threshold;
+        conf->ssl.dyn_rec.timeout = conf->dynamic_record_timeout;
     }
 
     conf->ssl.buffer_size = conf->buffer_size;
@@ -922,7 +1007,16 @@ ngx_http_ssl_merge_srv_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_conf_merge_ptr_value(conf->session_ticket_keys,
                          prev->session_ticket_keys, NULL);
 
-    if (ngx_ssl_session_ticket_keys(cf, &conf->ssl, conf->session_ticket_keys)
+    if (conf->session_ticket_key_rotation == NGX_CONF_UNSET) {
+        conf->session_ticket_key_rotation = prev->session_ticket_key_rotation;
+        conf->session_ticket_key_keep = prev->session_ticket_key_keep;
+    }
+
+    ngx_conf_init_value(conf->session_ticket_key_rotation, 0);
+
+    if (ngx_ssl_session_ticket_keys(cf, &conf->ssl, conf->session_ticket_keys,
+                                    conf->session_ticket_key_rotation,
+                                    conf->session_ticket_key_keep)
         != NGX_OK)
     {
         return NGX_CONF_ERROR;
@@ -943,6 +1037,10 @@ ngx_http_ssl_merge_srv_conf(ngx_conf_t *cf, void *parent, void *child)
         return NGX_CONF_ERROR;
     }
 
+    if (ngx_ssl_ktls(cf, &conf->ssl, conf->ktls) != NGX_OK) {
+        return NGX_CONF_ERROR;
+    }
+
     if (ngx_ssl_conf_commands(cf, &conf->ssl, conf->conf_commands) != NGX_OK) {
         return NGX_CONF_ERROR;
     }
@@ -1164,10 +1262,9 @@ ngx_http_ssl_session_cache(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
     ngx_http_ssl_srv_conf_t *sscf = conf;
 
-    size_t       len;
-    ngx_str_t   *value, name, size;
+    ngx_str_t   *value;
     ngx_int_t    n;
-    ngx_uint_t   i, j;
+    ngx_uint_t   i;
 
     value = cf->args->elts;
 
@@ -1208,47 +1305,274 @@ ngx_http_ssl_session_cache(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             && ngx_strncmp(value[i].data, "shared:", sizeof("shared:") - 1)
                == 0)
         {
-            len = 0;
-
-            for (j = sizeof("shared:") - 1; j < value[i].len; j++) {
-                if (value[i].data[j] == ':') {
-                    break;
-                }
+            value[i].data += sizeof("shared:") - 1;
+            value[i].len -= sizeof("shared:") - 1;
 
-                len++;
+            sscf->shm_zone = ngx_ssl_session_cache_zone(cf, &value[i],
+                                                        &ngx_http_ssl_module);
+            if (sscf->shm_zone == NULL) {
+                return NGX_CONF_ERROR;
             }
 
-            if (len == 0 || j == value[i].len) {
+            continue;
+        }
+
+        goto invalid;
+    }
+
+    if (sscf->shm_zone && sscf->builtin_session_cache == NGX_CONF_UNSET) {
+        sscf->builtin_session_cache = NGX_SSL_NO_BUILTIN_SCACHE;
+    }
+
+    return NGX_CONF_OK;
+
+invalid:
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "invalid session cache \"%V\"", &value[i]);
+
+    return NGX_CONF_ERROR;
+}
+
+
+static char *
+ngx_http_ssl_session_ticket_key_rotation(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf)
+{
+    ngx_http_ssl_srv_conf_t *sscf = conf;
+
+    ngx_int_t   n;
+    ngx_str_t  *value;
+
+    if (sscf->session_ticket_key_rotation != NGX_CONF_UNSET) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "off") == 0) {
+
+        if (cf->args->nelts > 2) {
+            goto invalid;
+        }
+
+        sscf->session_ticket_key_rotation = 0;
+        return NGX_CONF_OK;
+    }
+
+    sscf->session_ticket_key_rotation = ngx_parse_time(&value[1], 1);
+
+    if (sscf->session_ticket_key_rotation == (time_t) NGX_ERROR
+        || sscf->session_ticket_key_rotation == 0)
+    {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid rotation interval \"%V\"", &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    if (cf->args->nelts == 2) {
+        return NGX_CONF_OK;
+    }
+
+    if (ngx_strncmp(value[2].data, "keep=", 5) != 0) {
+        goto invalid;
+    }
+
+    n = ngx_atoi(value[2].data + 5, value[2].len - 5);
+
+    if (n == NGX_ERROR || n == 0 || n >= NGX_SSL_TICKET_KEYS) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid number of previous keys \"%V\", "
+                           "it must be between 1 and %d",
+                           &value[2], NGX_SSL_TICKET_KEYS - 1);
+        return NGX_CONF_ERROR;
+    }
+
+    sscf->session_ticket_key_keep = n;
+
+    return NGX_CONF_OK;
+
+invalid:
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "invalid parameter \"%V\"", &value[2]);
+
+    return NGX_CONF_ERROR;
+}
+
+
+static char *
+ngx_http_ssl_async_keys(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_ssl_srv_conf_t *sscf = conf;
+
+    ngx_str_t  *value;
+
+    if (sscf->async_keys != NGX_CONF_UNSET_PTR) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "off") == 0) {
+        sscf->async_keys = NULL;
+        return NGX_CONF_OK;
+    }
+
+    if (ngx_strncmp(value[1].data, "threads", 7) == 0
+        && (value[1].len == 7 || value[1].data[7] == '='))
+    {
+#if (NGX_THREADS)
+        sscf->async_keys = ngx_pcalloc(cf->pool, sizeof(ngx_str_t));
+        if (sscf->async_keys == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        if (value[1].len >= 8) {
+            sscf->async_keys->len = value[1].len - 8;
+            sscf->async_keys->data = value[1].data + 8;
+        }
+
+        return NGX_CONF_OK;
+#else
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "\"ssl_async_keys threads\" "
+                           "is unsupported on this platform");
+        return NGX_CONF_ERROR;
+#endif
+    }
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "invalid value \"%V\"", &value[1]);
+    return NGX_CONF_ERROR;
+}
+
+
+static char *
+ngx_http_ssl_certificate_compression(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf)
+{
+    ngx_http_ssl_srv_conf_t *sscf = conf;
+
+    ngx_str_t   *value, *s;
+    ngx_uint_t   i;
+
+    if (sscf->certificate_compression != NGX_CONF_UNSET_PTR) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "off") == 0) {
+
+        if (cf->args->nelts > 2) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "invalid parameter \"%V\"", &value[2]);
+            return NGX_CONF_ERROR;
+        }
+
+        sscf->certificate_compression = NULL;
+        return NGX_CONF_OK;
+    }
+
+    sscf->certificate_compression = ngx_array_create(cf->pool,
+                                                     cf->args->nelts - 1,
+                                                     sizeof(ngx_str_t));
+    if (sscf->certificate_compression == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    for (i = 1; i < cf->args->nelts; i++) {
+        s = ngx_array_push(sscf->certificate_compression);
+        if (s == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        *s = value[i];
+    }
+
+    return NGX_CONF_OK;
+}
+
+
+static char *
+ngx_http_ssl_dynamic_records(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_ssl_srv_conf_t *sscf = conf;
+
+    ngx_str_t   *value, s;
+    ngx_uint_t   i;
+
+    if (sscf->dynamic_records != NGX_CONF_UNSET) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "off") == 0) {
+
+        if (cf->args->nelts > 2) {
+            i = 2;
+            goto invalid;
+        }
+
+        sscf->dynamic_records = 0;
+        return NGX_CONF_OK;
+    }
+
+    if (ngx_strcmp(value[1].data, "on") != 0) {
+        i = 1;
+        goto invalid;
+    }
+
+    sscf->dynamic_records = 1;
+    sscf->dynamic_record_size = NGX_SSL_DYN_REC_SIZE;
+    sscf->dynamic_record_threshold = NGX_SSL_DYN_REC_THRESHOLD;
+    sscf->dynamic_record_timeout = NGX_SSL_DYN_REC_TIMEOUT;
+
+    for (i = 2; i < cf->args->nelts; i++) {
+
+        if (ngx_strncmp(value[i].data, "size=", 5) == 0) {
+
+            s.len = value[i].len - 5;
+            s.data = value[i].data + 5;
+
+            sscf->dynamic_record_size = ngx_parse_size(&s);
+
+            if (sscf->dynamic_record_size == (size_t) NGX_ERROR
+                || sscf->dynamic_record_size == 0
+                || sscf->dynamic_record_size > NGX_SSL_BUFSIZE)
+            {
                 goto invalid;
             }
 
-            name.len = len;
-            name.data = value[i].data + sizeof("shared:") - 1;
+            continue;
+        }
 
-            size.len = value[i].len - j - 1;
-            size.data = name.data + len + 1;
+        if (ngx_strncmp(value[i].data, "threshold=", 10) == 0) {
 
-            n = ngx_parse_size(&size);
+            s.len = value[i].len - 10;
+            s.data = value[i].data + 10;
 
-            if (n == NGX_ERROR) {
+            sscf->dynamic_record_threshold = ngx_parse_size(&s);
+
+            if (sscf->dynamic_record_threshold == (size_t) NGX_ERROR) {
                 goto invalid;
             }
 
-            if (n < (ngx_int_t) (8 * ngx_pagesize)) {
-                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
-                                   "session cache \"%V\" is too small",
-                                   &value[i]);
+            continue;
+        }
 
-                return NGX_CONF_ERROR;
-            }
+        if (ngx_strncmp(value[i].data, "timeout=", 8) == 0) {
 
-            sscf->shm_zone = ngx_shared_memory_add(cf, &name, n,
-                                                   &ngx_http_ssl_module);
-            if (sscf->shm_zone == NULL) {
-                return NGX_CONF_ERROR;
-            }
+            s.len = value[i].len - 8;
+            s.data = value[i].data + 8;
+
+            sscf->dynamic_record_timeout = ngx_parse_time(&s, 0);
 
-            sscf->shm_zone->init = ngx_ssl_session_cache_init;
+            if (sscf->dynamic_record_timeout == (ngx_msec_t) NGX_ERROR) {
+                goto invalid;
+            }
 
             continue;
         }
@@ -1256,16 +1580,12 @@ ngx_http_ssl_session_cache(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         goto invalid;
     }
 
-    if (sscf->shm_zone && sscf->builtin_session_cache == NGX_CONF_UNSET) {
-        sscf->builtin_session_cache = NGX_SSL_NO_BUILTIN_SCACHE;
-    }
-
     return NGX_CONF_OK;
 
 invalid:
 
     ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
-                       "invalid session cache \"%V\"", &value[i]);
+                       "invalid parameter \"%V\"", &value[i]);
 
     return NGX_CONF_ERROR;
 }
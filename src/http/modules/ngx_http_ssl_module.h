@@ -20,6 +20,7 @@ typedef struct {
 
     ngx_flag_t                      prefer_server_ciphers;
     ngx_flag_t                      early_data;
+    ngx_flag_t                      ktls;
     ngx_flag_t                      reject_handshake;
 
     ngx_uint_t                      protocols;
@@ -56,6 +57,17 @@ typedef struct {
 
     ngx_flag_t                      session_tickets;
     ngx_array_t                    *session_ticket_keys;
+    time_t                          session_ticket_key_rotation;
+    ngx_uint_t                      session_ticket_key_keep;
+
+    ngx_str_t                      *async_keys;
+
+    ngx_array_t                    *certificate_compression;
+
+    ngx_flag_t                      dynamic_records;
+    size_t                          dynamic_record_size;
+    size_t                          dynamic_record_threshold;
+    ngx_msec_t                      dynamic_record_timeout;
 
     ngx_uint_t                      ocsp;
     ngx_str_t                       ocsp_responder;
@@ -23,11 +23,25 @@ typedef struct {
 
 
 typedef struct {
-    ngx_uint_t                 min_match_len;
+    uint32_t                   match;   /* pattern index + 1 */
+    uint32_t                   output;
+    uint32_t                   fail;
+    uint32_t                   depth;
+    uint32_t                   ext;     /* longest prefix to be continued */
+} ngx_http_sub_state_t;
+
+
+typedef struct {
     ngx_uint_t                 max_match_len;
+    ngx_uint_t                 classes;
+    ngx_int_t                  first;   /* the only byte starting a match */
+
+    ngx_http_sub_state_t      *states;
+    uint32_t                  *next;
+    uint32_t                  *same;
 
-    u_char                     index[257];
-    u_char                     shift[256];
+    u_char                     map[256];
+    u_char                     start[256];
 } ngx_http_sub_tables_t;
 
 
@@ -71,30 +85,30 @@ typedef struct {
 
     ngx_int_t                  offset;
     ngx_uint_t                 index;
+    ngx_uint_t                 state;
+
+    ngx_uint_t                 match;
+    ngx_int_t                  start;
 
     ngx_http_sub_tables_t     *tables;
     ngx_array_t               *matches;
 } ngx_http_sub_ctx_t;
 
 
-static ngx_uint_t ngx_http_sub_cmp_index;
-
-
 static ngx_int_t ngx_http_sub_output(ngx_http_request_t *r,
     ngx_http_sub_ctx_t *ctx);
 static ngx_int_t ngx_http_sub_parse(ngx_http_request_t *r,
-    ngx_http_sub_ctx_t *ctx, ngx_uint_t flush);
-static ngx_int_t ngx_http_sub_match(ngx_http_sub_ctx_t *ctx, ngx_int_t start,
-    ngx_str_t *m);
+    ngx_http_sub_ctx_t *ctx, ngx_uint_t last);
+static ngx_int_t ngx_http_sub_match(ngx_http_sub_ctx_t *ctx,
+    ngx_uint_t state, ngx_uint_t once);
 
 static char * ngx_http_sub_filter(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 static void *ngx_http_sub_create_conf(ngx_conf_t *cf);
 static char *ngx_http_sub_merge_conf(ngx_conf_t *cf,
     void *parent, void *child);
-static void ngx_http_sub_init_tables(ngx_http_sub_tables_t *tables,
-    ngx_http_sub_match_t *match, ngx_uint_t n);
-static ngx_int_t ngx_http_sub_cmp_matches(const void *one, const void *two);
+static ngx_int_t ngx_http_sub_init_tables(ngx_pool_t *pool,
+    ngx_http_sub_tables_t *tables, ngx_http_sub_match_t *match, ngx_uint_t n);
 static ngx_int_t ngx_http_sub_filter_init(ngx_conf_t *cf);
 
 
@@ -244,8 +258,12 @@ ngx_http_sub_header_filter(ngx_http_request_t *r)
             return NGX_ERROR;
         }
 
-        ngx_http_sub_init_tables(ctx->tables, ctx->matches->elts,
-                                 ctx->matches->nelts);
+        if (ngx_http_sub_init_tables(r->pool, ctx->tables,
+                                     ctx->matches->elts, ctx->matches->nelts)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
     }
 
     ctx->saved.data = ngx_pnalloc(r->pool, ctx->tables->max_match_len - 1);
@@ -260,7 +278,6 @@ ngx_http_sub_header_filter(ngx_http_request_t *r)
 
     ngx_http_set_ctx(r, ctx, ngx_http_sub_filter_module);
 
-    ctx->offset = ctx->tables->min_match_len - 1;
     ctx->last_out = &ctx->out;
 
     r->filter_need_in_memory = 1;
@@ -287,7 +304,7 @@ ngx_http_sub_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
     ngx_int_t                  rc;
     ngx_buf_t                 *b;
     ngx_str_t                 *sub;
-    ngx_uint_t                 flush, last;
+    ngx_uint_t                 last;
     ngx_chain_t               *cl;
     ngx_http_sub_ctx_t        *ctx;
     ngx_http_sub_match_t      *match;
@@ -329,9 +346,6 @@ ngx_http_sub_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                    "http sub filter \"%V\"", &r->uri);
 
-    flush = 0;
-    last = 0;
-
     while (ctx->in || ctx->buf) {
 
         if (ctx->buf == NULL) {
@@ -344,18 +358,15 @@ ngx_http_sub_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
             ngx_free_chain(r->pool, cl);
         }
 
-        if (ctx->buf->flush || ctx->buf->recycled) {
-            flush = 1;
-        }
+        /* a match pending at the end of data is complete */
 
-        if (ctx->in == NULL) {
-            last = flush;
-        }
+        last = ctx->buf->last_buf || ctx->buf->last_in_chain;
 
         b = NULL;
 
-        while (ctx->pos < ctx->buf->last) {
-
+        while (ctx->pos < ctx->buf->last
+               || (last && (ctx->offset < 0 || ctx->match)))
+        {
             rc = ngx_http_sub_parse(r, ctx, last);
 
             ngx_log_debug4(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
@@ -472,7 +483,6 @@ ngx_http_sub_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
             *ctx->last_out = cl;
             ctx->last_out = &cl->next;
 
-            ctx->index = 0;
             ctx->once = slcf->once && (++ctx->applied == ctx->matches->nelts);
 
             continue;
@@ -609,12 +619,11 @@ ngx_http_sub_output(ngx_http_request_t *r, ngx_http_sub_ctx_t *ctx)
 
 static ngx_int_t
 ngx_http_sub_parse(ngx_http_request_t *r, ngx_http_sub_ctx_t *ctx,
-    ngx_uint_t flush)
+    ngx_uint_t last)
 {
-    u_char                   *p, c;
-    ngx_str_t                *m;
-    ngx_int_t                 offset, start, next, end, len, rc;
-    ngx_uint_t                shift, i, j;
+    u_char                   *p, *e, c;
+    ngx_int_t                 offset, start, next, end, len, rc, i;
+    ngx_uint_t                state;
     ngx_http_sub_match_t     *match;
     ngx_http_sub_tables_t    *tables;
     ngx_http_sub_loc_conf_t  *slcf;
@@ -624,99 +633,115 @@ ngx_http_sub_parse(ngx_http_request_t *r, ngx_http_sub_ctx_t *ctx,
     match = ctx->matches->elts;
 
     offset = ctx->offset;
+    state = ctx->state;
     end = ctx->buf->last - ctx->pos;
 
     if (ctx->once) {
         /* sets start and next to end */
-        offset = end + (ngx_int_t) tables->min_match_len - 1;
+        offset = end;
+        state = 0;
+        ctx->match = 0;
         goto again;
     }
 
     while (offset < end) {
 
-        c = offset < 0 ? ctx->looked.data[ctx->looked.len + offset]
-                       : ctx->pos[offset];
+        if (state == 0 && offset >= 0) {
 
-        c = ngx_tolower(c);
-
-        shift = tables->shift[c];
-        if (shift > 0) {
-            offset += shift;
-            continue;
-        }
+            /* skip bytes which cannot start a match */
 
-        /* a potential match */
+            p = ctx->pos + offset;
+            e = ctx->pos + end;
 
-        start = offset - (ngx_int_t) tables->min_match_len + 1;
+            if (tables->first != -1) {
+                p = memchr(p, tables->first, e - p);
+                if (p == NULL) {
+                    p = e;
+                }
 
-        i = ngx_max((ngx_uint_t) tables->index[c], ctx->index);
-        j = tables->index[c + 1];
+            } else {
+                while (p < e && tables->start[*p] == 0) {
+                    p++;
+                }
+            }
 
-        while (i != j) {
+            offset = p - ctx->pos;
 
-            if (slcf->once && ctx->sub && ctx->sub[i].data) {
-                goto next;
+            if (offset == end) {
+                break;
             }
+        }
 
-            m = &match[i].match;
+        c = offset < 0 ? ctx->looked.data[ctx->looked.len + offset]
+                       : ctx->pos[offset];
 
-            rc = ngx_http_sub_match(ctx, start, m);
+        state = tables->next[state * tables->classes + tables->map[c]];
 
-            if (rc == NGX_DECLINED) {
-                goto next;
-            }
+        i = ngx_http_sub_match(ctx, state, slcf->once);
 
-            ctx->index = i;
+        if (i != NGX_DECLINED) {
+            start = offset - (ngx_int_t) match[i].match.len + 1;
 
-            if (rc == NGX_AGAIN) {
-                goto again;
-            }
+            /* the leftmost match wins, then the first one configured */
 
-            ctx->offset = offset + (ngx_int_t) m->len;
-            next = start + (ngx_int_t) m->len;
-            end = ngx_max(next, 0);
-            rc = NGX_OK;
+            if (ctx->match == 0
+                || start < ctx->start
+                || (start == ctx->start && (ngx_uint_t) i < ctx->match - 1))
+            {
+                ctx->match = i + 1;
+                ctx->start = start;
+            }
+        }
 
-            goto done;
+        offset++;
 
-        next:
+        /*
+         * the match is found when no pattern which starts
+         * at the same position or earlier can be matched further
+         */
 
-            i++;
+        if (ctx->match
+            && offset - (ngx_int_t) tables->states[state].ext > ctx->start)
+        {
+            goto found;
         }
+    }
 
-        offset++;
-        ctx->index = 0;
+    if (ctx->match == 0 || !last) {
+        goto again;
     }
 
-    if (flush) {
-        for ( ;; ) {
-            start = offset - (ngx_int_t) tables->min_match_len + 1;
+found:
 
-            if (start >= end) {
-                break;
-            }
+    ctx->index = ctx->match - 1;
+    ctx->match = 0;
 
-            for (i = 0; i < ctx->matches->nelts; i++) {
-                m = &match[i].match;
+    start = ctx->start;
+    next = start + (ngx_int_t) match[ctx->index].match.len;
 
-                if (ngx_http_sub_match(ctx, start, m) == NGX_AGAIN) {
-                    goto again;
-                }
-            }
+    /* continue right after the match */
 
-            offset++;
-        }
-    }
+    offset = next;
+    state = 0;
+
+    end = ngx_max(next, 0);
+    rc = NGX_OK;
+
+    goto done;
 
 again:
 
-    ctx->offset = offset;
-    start = offset - (ngx_int_t) tables->min_match_len + 1;
+    /* keep bytes which can still be matched */
+
+    start = offset - (ngx_int_t) tables->states[state].ext;
     next = start;
     rc = NGX_AGAIN;
 
 done:
 
+    ctx->offset = offset;
+    ctx->state = state;
+
     /* send [ - looked.len, start ] to client */
 
     ctx->saved.len = ctx->looked.len + ngx_min(start, 0);
@@ -739,53 +764,42 @@ done:
 
     ctx->pos += end;
     ctx->offset -= end;
+    ctx->start -= end;
 
     return rc;
 }
 
 
 static ngx_int_t
-ngx_http_sub_match(ngx_http_sub_ctx_t *ctx, ngx_int_t start, ngx_str_t *m)
+ngx_http_sub_match(ngx_http_sub_ctx_t *ctx, ngx_uint_t state, ngx_uint_t once)
 {
-    u_char  *p, *last, *pat, *pat_end;
-
-    pat = m->data;
-    pat_end = m->data + m->len;
+    ngx_uint_t              i;
+    ngx_http_sub_state_t   *st;
+    ngx_http_sub_tables_t  *tables;
 
-    if (start >= 0) {
-        p = ctx->pos + start;
+    /*
+     * patterns ending in the state are checked from the longest one,
+     * the first pattern not yet applied is returned
+     */
 
-    } else {
-        last = ctx->looked.data + ctx->looked.len;
-        p = last + start;
+    tables = ctx->tables;
 
-        while (p < last && pat < pat_end) {
-            if (ngx_tolower(*p) != *pat) {
-                return NGX_DECLINED;
-            }
+    while (state) {
+        st = &tables->states[state];
 
-            p++;
-            pat++;
-        }
+        for (i = st->match; i; i = tables->same[i - 1]) {
 
-        p = ctx->pos;
-    }
+            if (once && ctx->sub && ctx->sub[i - 1].data) {
+                continue;
+            }
 
-    while (p < ctx->buf->last && pat < pat_end) {
-        if (ngx_tolower(*p) != *pat) {
-            return NGX_DECLINED;
+            return i - 1;
         }
 
-        p++;
-        pat++;
+        state = st->output;
     }
 
-    if (pat != pat_end) {
-        /* partial match */
-        return NGX_AGAIN;
-    }
-
-    return NGX_OK;
+    return NGX_DECLINED;
 }
 
 
@@ -940,72 +954,172 @@ ngx_http_sub_merge_conf(ngx_conf_t *cf, void *parent, void *child)
             return NGX_CONF_ERROR;
         }
 
-        ngx_http_sub_init_tables(conf->tables, conf->matches->elts,
-                                 conf->matches->nelts);
+        if (ngx_http_sub_init_tables(cf->pool, conf->tables,
+                                     conf->matches->elts, conf->matches->nelts)
+            != NGX_OK)
+        {
+            return NGX_CONF_ERROR;
+        }
     }
 
     return NGX_CONF_OK;
 }
 
 
-static void
-ngx_http_sub_init_tables(ngx_http_sub_tables_t *tables,
+static ngx_int_t
+ngx_http_sub_init_tables(ngx_pool_t *pool, ngx_http_sub_tables_t *tables,
     ngx_http_sub_match_t *match, ngx_uint_t n)
 {
-    u_char      c;
-    ngx_uint_t  i, j, min, max, ch;
+    u_char                *p, *last;
+    uint32_t              *next, *queue, s, t, f;
+    ngx_uint_t             i, c, k, max, size, nstates, nclasses, head, tail;
+    ngx_http_sub_state_t  *states;
+
+    /*
+     * an Aho-Corasick automaton: the trie of patterns with transitions
+     * completed by failure links, so each byte is looked at once;
+     * bytes are mapped to classes, letters are case-insensitive
+     */
 
-    min = match[0].match.len;
-    max = match[0].match.len;
+    ngx_memzero(tables->map, 256);
 
-    for (i = 1; i < n; i++) {
-        min = ngx_min(min, match[i].match.len);
+    max = 0;
+    size = 1;
+    nclasses = 1;
+
+    for (i = 0; i < n; i++) {
         max = ngx_max(max, match[i].match.len);
+        size += match[i].match.len;
+
+        p = match[i].match.data;
+        last = p + match[i].match.len;
+
+        for ( /* void */ ; p < last; p++) {
+            if (tables->map[*p] == 0) {
+                tables->map[*p] = (u_char) nclasses;
+                tables->map[ngx_toupper(*p)] = (u_char) nclasses;
+                nclasses++;
+            }
+        }
     }
 
-    tables->min_match_len = min;
     tables->max_match_len = max;
+    tables->classes = nclasses;
 
-    ngx_http_sub_cmp_index = tables->min_match_len - 1;
-    ngx_sort(match, n, sizeof(ngx_http_sub_match_t), ngx_http_sub_cmp_matches);
+    states = ngx_pcalloc(pool, size * sizeof(ngx_http_sub_state_t));
+    if (states == NULL) {
+        return NGX_ERROR;
+    }
+
+    next = ngx_pcalloc(pool, size * nclasses * sizeof(uint32_t));
+    if (next == NULL) {
+        return NGX_ERROR;
+    }
 
-    min = ngx_min(min, 255);
-    ngx_memset(tables->shift, min, 256);
+    tables->same = ngx_pcalloc(pool, n * sizeof(uint32_t));
+    if (tables->same == NULL) {
+        return NGX_ERROR;
+    }
 
-    ch = 0;
+    nstates = 1;
 
     for (i = 0; i < n; i++) {
+        s = 0;
+
+        p = match[i].match.data;
+        last = p + match[i].match.len;
 
-        for (j = 0; j < min; j++) {
-            c = match[i].match.data[tables->min_match_len - 1 - j];
-            tables->shift[c] = ngx_min(tables->shift[c], (u_char) j);
+        for ( /* void */ ; p < last; p++) {
+            k = s * nclasses + tables->map[*p];
+
+            if (next[k] == 0) {
+                /* a state with transitions can be matched further */
+                states[s].ext = states[s].depth;
+
+                states[nstates].depth = states[s].depth + 1;
+                next[k] = nstates++;
+            }
+
+            s = next[k];
         }
 
-        c = match[i].match.data[tables->min_match_len - 1];
-        while (ch <= (ngx_uint_t) c) {
-            tables->index[ch++] = (u_char) i;
+        /* identical patterns are chained in the order configured */
+
+        if (states[s].match == 0) {
+            states[s].match = i + 1;
+            continue;
         }
+
+        for (k = states[s].match; tables->same[k - 1]; k = tables->same[k - 1])
+        {
+            /* void */
+        }
+
+        tables->same[k - 1] = i + 1;
     }
 
-    while (ch < 257) {
-        tables->index[ch++] = (u_char) n;
+    queue = ngx_palloc(pool, nstates * sizeof(uint32_t));
+    if (queue == NULL) {
+        return NGX_ERROR;
     }
-}
 
+    head = 0;
+    tail = 0;
 
-static ngx_int_t
-ngx_http_sub_cmp_matches(const void *one, const void *two)
-{
-    ngx_int_t              c1, c2;
-    ngx_http_sub_match_t  *first, *second;
+    queue[tail++] = 0;
+
+    while (head < tail) {
+        s = queue[head++];
+
+        for (c = 1; c < nclasses; c++) {
+            k = s * nclasses + c;
+            t = next[k];
+
+            if (t == 0) {
+                if (s) {
+                    next[k] = next[states[s].fail * nclasses + c];
+                }
+
+                continue;
+            }
+
+            f = s ? next[states[s].fail * nclasses + c] : 0;
 
-    first = (ngx_http_sub_match_t *) one;
-    second = (ngx_http_sub_match_t *) two;
+            states[t].fail = f;
+            states[t].output = states[f].match ? f : states[f].output;
 
-    c1 = first->match.data[ngx_http_sub_cmp_index];
-    c2 = second->match.data[ngx_http_sub_cmp_index];
+            if (states[t].ext == 0) {
+                states[t].ext = states[f].ext;
+            }
+
+            queue[tail++] = t;
+        }
+    }
+
+    ngx_pfree(pool, queue);
+
+    tables->states = states;
+    tables->next = next;
+
+    /* bytes which can start a match, a single one is searched with memchr() */
+
+    tables->first = -1;
+    k = 0;
 
-    return c1 - c2;
+    for (c = 0; c < 256; c++) {
+        tables->start[c] = (next[tables->map[c]] != 0);
+
+        if (tables->start[c]) {
+            tables->first = c;
+            k++;
+        }
+    }
+
+    if (k != 1) {
+        tables->first = -1;
+    }
+
+    return NGX_OK;
 }
 
 
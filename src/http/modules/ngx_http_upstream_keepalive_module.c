@@ -338,6 +338,20 @@ ngx_http_upstream_close_keepalive_peer(ngx_peer_connection_t *pc, void *data,
         return;
     }
 
+#if (NGX_HTTP_V2)
+    if (u->conf->multiplex) {
+        /* streams are kept in their http2 sessions */
+        return;
+    }
+#endif
+
+#if (NGX_HTTP_V3)
+    if (u->h3 && u->conf->h3_multiplex) {
+        /* streams are closed, connections are kept in http3 sessions */
+        return;
+    }
+#endif
+
     if (!u->keepalive) {
         return;
     }
@@ -324,6 +324,7 @@ ngx_http_upstream_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     ngx_memzero(&zp, sizeof(ngx_shm_zone_params_t));
 
     zp.min_size = 8 * ngx_pagesize;
+    zp.numa_aware = 1;
 
     if (cf->args->nelts == 3) {
         if (ngx_conf_parse_zone_size(cf, &zp, &value[2]) != NGX_OK) {
@@ -335,8 +336,9 @@ ngx_http_upstream_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         return NGX_CONF_ERROR;
     }
 
-    uscf->shm_zone = ngx_shared_memory_add(cf, &zp.name, zp.size,
-                                           &ngx_http_upstream_module);
+    zp.tag = &ngx_http_upstream_module;
+
+    uscf->shm_zone = ngx_shared_memory_add_ext(cf, &zp);
     if (uscf->shm_zone == NULL) {
         return NGX_CONF_ERROR;
     }
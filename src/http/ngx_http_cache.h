@@ -28,7 +28,11 @@
 #define NGX_HTTP_CACHE_ETAG_LEN      128
 #define NGX_HTTP_CACHE_VARY_LEN      128
 
-#define NGX_HTTP_CACHE_VERSION       5
+#define NGX_HTTP_CACHE_VERSION       6
+
+#define NGX_HTTP_CACHE_COMPRESSED_OFF     0x0002
+#define NGX_HTTP_CACHE_COMPRESSED_GZIP    0x0004
+#define NGX_HTTP_CACHE_COMPRESSED_BROTLI  0x0008
 
 
 #if (NGX_API)
@@ -49,7 +53,7 @@
     ngx_value(NGX_SIG_ATOMIC_T_SIZE) ":"                                      \
     ngx_value(NGX_TIME_T_SIZE) ":"                                            \
     ngx_value(NGX_HTTP_CACHE_KEY_LEN) ":"                                     \
-    NGX_HTTP_CACHE_SIGN_API ":" NGX_HTTP_CACHE_SIGN_SHARDS "1"
+    NGX_HTTP_CACHE_SIGN_API ":" NGX_HTTP_CACHE_SIGN_SHARDS "2"
 
 
 typedef struct {
@@ -77,7 +81,8 @@ typedef struct {
     unsigned                         updating:1;
     unsigned                         deleting:1;
     unsigned                         purged:1;
-                                     /* 10 unused bits */
+    unsigned                         waiters:1;
+                                     /* 9 unused bits */
 
     ngx_file_uniq_t                  uniq;
     time_t                           expire;
@@ -85,6 +90,8 @@ typedef struct {
     size_t                           body_start;
     off_t                            fs_size;
     ngx_msec_t                       lock_time;
+    off_t                            stream_size;
+    uint32_t                         stream_id;
 } ngx_http_file_cache_node_t;
 
 
@@ -106,6 +113,8 @@ struct ngx_http_cache_s {
     ngx_str_t                        vary;
     u_char                           variant[NGX_HTTP_CACHE_KEY_LEN];
 
+    ngx_str_t                        encoding;
+
     size_t                           buffer_size;
     size_t                           header_start;
     size_t                           body_start;
@@ -132,9 +141,24 @@ struct ngx_http_cache_s {
     ngx_msec_t                       wait_time;
 
     ngx_event_t                      wait_event;
+    ngx_queue_t                      wait_queue;
+
+    off_t                            stream_size;
+    uint32_t                         stream_id;
+    ngx_buf_t                       *stream_buf;
+
+    off_t                            range_start;
+    off_t                            range_end;
+    off_t                            partial_start;
+    off_t                            partial_end;
+    off_t                            partial_length;
+    size_t                           partial_block;
 
     unsigned                         lock:1;
     unsigned                         waiting:1;
+    unsigned                         stream:1;
+    unsigned                         streaming:1;
+    unsigned                         stream_waiting:1;
 
     unsigned                         updated:1;
     unsigned                         updating:1;
@@ -145,9 +169,12 @@ struct ngx_http_cache_s {
     unsigned                         secondary:1;
     unsigned                         update_variant:1;
     unsigned                         background:1;
+    unsigned                         encoded:1;
 
     unsigned                         stale_updating:1;
     unsigned                         stale_error:1;
+
+    unsigned                         partial:1;
 };
 
 
@@ -158,6 +185,8 @@ typedef struct {
     time_t                           error_sec;
     time_t                           last_modified;
     time_t                           date;
+    off_t                            partial_length;
+    size_t                           partial_block;
     uint32_t                         crc32;
     u_short                          valid_msec;
     u_short                          header_start;
@@ -198,6 +227,7 @@ typedef struct {
 
 #if (NGX_API)
     ngx_http_cache_stats_t           stats[NGX_HTTP_CACHE_HIT];
+    ngx_http_cache_stats_t           compressed;
 #endif
 } ngx_http_file_cache_sh_t;
 
@@ -240,6 +270,11 @@ ngx_int_t ngx_http_file_cache_open(ngx_http_request_t *r);
 ngx_int_t ngx_http_file_cache_set_header(ngx_http_request_t *r, u_char *buf);
 void ngx_http_file_cache_update(ngx_http_request_t *r, ngx_temp_file_t *tf);
 void ngx_http_file_cache_update_header(ngx_http_request_t *r);
+void ngx_http_file_cache_stream(ngx_http_request_t *r, ngx_temp_file_t *tf);
+ngx_int_t ngx_http_file_cache_partial_response(ngx_http_request_t *r,
+    off_t start, off_t end, off_t length);
+void ngx_http_file_cache_update_encoded(ngx_http_request_t *r,
+    ngx_temp_file_t *tf, ngx_str_t *encoding, size_t body_start);
 ngx_int_t ngx_http_cache_send(ngx_http_request_t *);
 void ngx_http_file_cache_free(ngx_http_cache_t *c, ngx_temp_file_t *tf);
 time_t ngx_http_file_cache_valid(ngx_array_t *cache_valid, ngx_uint_t status);
@@ -83,7 +83,9 @@ static char *ngx_http_core_internal(ngx_conf_t *cf, ngx_command_t *cmd,
 static char *ngx_http_core_resolver(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 #if (NGX_HTTP_GZIP)
-static ngx_int_t ngx_http_gzip_accept_encoding(ngx_str_t *ae);
+static ngx_int_t ngx_http_gzip_test(ngx_http_request_t *r);
+static ngx_uint_t ngx_http_gzip_accept_encoding(ngx_str_t *ae, char *name,
+    size_t len);
 static ngx_uint_t ngx_http_gzip_quantity(u_char *p, u_char *last);
 static char *ngx_http_gzip_disable(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
@@ -260,6 +262,13 @@ static ngx_command_t  ngx_http_core_commands[] = {
       offsetof(ngx_http_core_srv_conf_t, request_pool_size),
       &ngx_http_core_pool_size_p },
 
+    { ngx_string("client_header_buffers_cache"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_core_main_conf_t, client_header_buffers_cache),
+      NULL },
+
     { ngx_string("client_header_timeout"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_CONF_TAKE1,
       ngx_conf_set_msec_slot,
@@ -837,6 +846,13 @@ static ngx_command_t  ngx_http_core_commands[] = {
       offsetof(ngx_http_core_main_conf_t, location_zones),
       &ngx_api_http_location_zones_handler },
 
+    { ngx_string("pool_stats"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_core_main_conf_t, pool_stats),
+      NULL },
+
 #endif
 
       ngx_null_command
@@ -947,6 +963,8 @@ ngx_http_handler(ngx_http_request_t *r)
     r->gzip_tested = 0;
     r->gzip_ok = 0;
     r->gzip_vary = 0;
+    r->brotli_tested = 0;
+    r->brotli_ok = 0;
 #endif
 
     r->write_event_handler = ngx_http_core_run_phases;
@@ -2134,10 +2152,7 @@ ngx_http_auth_basic_user(ngx_http_request_t *r)
 ngx_int_t
 ngx_http_gzip_ok(ngx_http_request_t *r)
 {
-    time_t                     date, expires;
-    ngx_uint_t                 p;
-    ngx_table_elt_t           *e, *d, *ae, *cc;
-    ngx_http_core_loc_conf_t  *clcf;
+    ngx_table_elt_t  *ae;
 
     r->gzip_tested = 1;
 
@@ -2164,11 +2179,68 @@ ngx_http_gzip_ok(ngx_http_request_t *r)
      */
 
     if (ngx_memcmp(ae->value.data, "gzip,", 5) != 0
-        && ngx_http_gzip_accept_encoding(&ae->value) != NGX_OK)
+        && ngx_http_gzip_accept_encoding(&ae->value, "gzip", 4) == 0)
     {
         return NGX_DECLINED;
     }
 
+    if (ngx_http_gzip_test(r) != NGX_OK) {
+        return NGX_DECLINED;
+    }
+
+    r->gzip_ok = 1;
+
+    return NGX_OK;
+}
+
+
+ngx_int_t
+ngx_http_brotli_ok(ngx_http_request_t *r)
+{
+    ngx_uint_t        q;
+    ngx_table_elt_t  *ae;
+
+    r->brotli_tested = 1;
+
+    if (r != r->main) {
+        return NGX_DECLINED;
+    }
+
+    ae = r->headers_in.accept_encoding;
+    if (ae == NULL) {
+        return NGX_DECLINED;
+    }
+
+    if (ae->value.len < sizeof("br") - 1) {
+        return NGX_DECLINED;
+    }
+
+    /* brotli is preferred over gzip, unless gzip has a higher quantity */
+
+    q = ngx_http_gzip_accept_encoding(&ae->value, "br", 2);
+
+    if (q == 0 || q < ngx_http_gzip_accept_encoding(&ae->value, "gzip", 4)) {
+        return NGX_DECLINED;
+    }
+
+    if (ngx_http_gzip_test(r) != NGX_OK) {
+        return NGX_DECLINED;
+    }
+
+    r->brotli_ok = 1;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_gzip_test(ngx_http_request_t *r)
+{
+    time_t                     date, expires;
+    ngx_uint_t                 p;
+    ngx_table_elt_t           *e, *d, *cc;
+    ngx_http_core_loc_conf_t  *clcf;
+
     clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
 
     if (r->headers_in.msie6 && clcf->gzip_disable_msie6) {
@@ -2285,21 +2357,18 @@ ok:
 
 #endif
 
-    r->gzip_ok = 1;
-
     return NGX_OK;
 }
 
 
 /*
- * gzip is enabled for the following quantities:
- *     "gzip; q=0.001" ... "gzip; q=1.000"
- * gzip is disabled for the following quantities:
- *     "gzip; q=0" ... "gzip; q=0.000", and for any invalid cases
+ * returns the quantity of the encoding, from 1 for "gzip; q=0.001"
+ * to 1000 for "gzip; q=1.000" or "gzip", and 0 for "gzip; q=0",
+ * a missing encoding, and for any invalid cases
  */
 
-static ngx_int_t
-ngx_http_gzip_accept_encoding(ngx_str_t *ae)
+static ngx_uint_t
+ngx_http_gzip_accept_encoding(ngx_str_t *ae, char *name, size_t len)
 {
     u_char  *p, *start, *last;
 
@@ -2307,34 +2376,37 @@ ngx_http_gzip_accept_encoding(ngx_str_t *ae)
     last = start + ae->len;
 
     for ( ;; ) {
-        p = ngx_strcasestrn(start, "gzip", 4 - 1);
+        p = ngx_strcasestrn(start, name, len - 1);
         if (p == NULL) {
-            return NGX_DECLINED;
+            return 0;
         }
 
-        if (p == start || (*(p - 1) == ',' || *(p - 1) == ' ')) {
+        if ((p == start || *(p - 1) == ',' || *(p - 1) == ' ')
+            && (p + len == last || p[len] == ',' || p[len] == ';'
+                || p[len] == ' '))
+        {
             break;
         }
 
-        start = p + 4;
+        start = p + len;
     }
 
-    p += 4;
+    p += len;
 
     while (p < last) {
         switch (*p++) {
         case ',':
-            return NGX_OK;
+            return 1000;
         case ';':
             goto quantity;
         case ' ':
             continue;
         default:
-            return NGX_DECLINED;
+            return 0;
         }
     }
 
-    return NGX_OK;
+    return 1000;
 
 quantity:
 
@@ -2346,23 +2418,19 @@ quantity:
         case ' ':
             continue;
         default:
-            return NGX_DECLINED;
+            return 0;
         }
     }
 
-    return NGX_OK;
+    return 1000;
 
 equal:
 
     if (p + 2 > last || *p++ != '=') {
-        return NGX_DECLINED;
-    }
-
-    if (ngx_http_gzip_quantity(p, last) == 0) {
-        return NGX_DECLINED;
+        return 0;
     }
 
-    return NGX_OK;
+    return ngx_http_gzip_quantity(p, last);
 }
 
 
@@ -2370,7 +2438,7 @@ static ngx_uint_t
 ngx_http_gzip_quantity(u_char *p, u_char *last)
 {
     u_char      c;
-    ngx_uint_t  n, q;
+    ngx_uint_t  n, q, d;
 
     c = *p++;
 
@@ -2378,7 +2446,7 @@ ngx_http_gzip_quantity(u_char *p, u_char *last)
         return 0;
     }
 
-    q = (c - '0') * 100;
+    q = (c - '0') * 1000;
 
     if (p == last) {
         return q;
@@ -2395,6 +2463,7 @@ ngx_http_gzip_quantity(u_char *p, u_char *last)
     }
 
     n = 0;
+    d = 100;
 
     while (p < last) {
         c = *p++;
@@ -2403,8 +2472,9 @@ ngx_http_gzip_quantity(u_char *p, u_char *last)
             break;
         }
 
-        if (c >= '0' && c <= '9') {
-            q += c - '0';
+        if (c >= '0' && c <= '9' && n < 3) {
+            q += (c - '0') * d;
+            d /= 10;
             n++;
             continue;
         }
@@ -2412,7 +2482,7 @@ ngx_http_gzip_quantity(u_char *p, u_char *last)
         return 0;
     }
 
-    if (q > 100 || n > 3) {
+    if (q > 1000) {
         return 0;
     }
 
@@ -3608,6 +3678,12 @@ ngx_http_core_create_main_conf(ngx_conf_t *cf)
     cmcf->variables_hash_max_size = NGX_CONF_UNSET_UINT;
     cmcf->variables_hash_bucket_size = NGX_CONF_UNSET_UINT;
 
+    cmcf->client_header_buffers_cache = NGX_CONF_UNSET_UINT;
+
+#if (NGX_API)
+    cmcf->pool_stats = NGX_CONF_UNSET;
+#endif
+
     return cmcf;
 }
 
@@ -3635,6 +3711,12 @@ ngx_http_core_init_main_conf(ngx_conf_t *cf, void *conf)
         cmcf->ncaptures = (cmcf->ncaptures + 1) * 3;
     }
 
+    ngx_conf_init_uint_value(cmcf->client_header_buffers_cache, 0);
+
+#if (NGX_API)
+    ngx_conf_init_value(cmcf->pool_stats, 0);
+#endif
+
     return NGX_CONF_OK;
 }
 
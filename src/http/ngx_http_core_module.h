@@ -161,6 +161,20 @@ typedef struct {
 
 #if (NGX_API)
 
+/* pool sizes up to 1k, 2k, ..., 512k, and larger */
+#define NGX_HTTP_POOL_STATS_SIZES  11
+
+
+typedef struct {
+    ngx_atomic_t               pools;
+    ngx_atomic_t               size;
+    ngx_atomic_t               peak;
+    ngx_atomic_t               blocks;
+    ngx_atomic_t               large;
+    ngx_atomic_t               sizes[NGX_HTTP_POOL_STATS_SIZES];
+} ngx_http_pool_stats_t;
+
+
 struct ngx_http_server_stats_s {
     ngx_atomic_t               processing;
     ngx_atomic_t               requests;
@@ -170,6 +184,8 @@ struct ngx_http_server_stats_s {
 #if (NGX_HTTP_SSL)
     ngx_ssl_stats_t            ssl;
 #endif
+    ngx_http_pool_stats_t      request_pool;
+    ngx_http_pool_stats_t      connection_pool;
     ngx_atomic_t               responses[501];
 };
 
@@ -179,6 +195,7 @@ typedef struct {
     ngx_atomic_t               discarded;
     ngx_atomic_t               received;
     ngx_atomic_t               sent;
+    ngx_http_pool_stats_t      request_pool;
     ngx_atomic_t               responses[501];
 } ngx_http_location_stats_t;
 
@@ -262,6 +279,8 @@ typedef struct {
 
     ngx_hash_keys_arrays_t    *variables_keys;
 
+    ngx_uint_t                 client_header_buffers_cache;
+
     ngx_array_t               *ports;
 
     ngx_http_phase_t           phases[NGX_HTTP_LOG_PHASE + 1];
@@ -269,6 +288,7 @@ typedef struct {
 #if (NGX_API)
     ngx_http_stats_zone_t     *server_zones;
     ngx_http_stats_zone_t     *location_zones;
+    ngx_flag_t                 pool_stats;
 #endif
 } ngx_http_core_main_conf_t;
 
@@ -628,6 +648,7 @@ u_char *ngx_http_map_uri_to_path(ngx_http_request_t *r, ngx_str_t *name,
 ngx_int_t ngx_http_auth_basic_user(ngx_http_request_t *r);
 #if (NGX_HTTP_GZIP)
 ngx_int_t ngx_http_gzip_ok(ngx_http_request_t *r);
+ngx_int_t ngx_http_brotli_ok(ngx_http_request_t *r);
 #endif
 
 
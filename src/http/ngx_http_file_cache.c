@@ -15,8 +15,30 @@
 static ngx_int_t ngx_http_file_cache_lock(ngx_http_request_t *r,
     ngx_http_cache_t *c);
 static void ngx_http_file_cache_lock_wait_handler(ngx_event_t *ev);
+static ngx_int_t ngx_http_file_cache_wait(ngx_http_request_t *r,
+    ngx_http_cache_t *c);
 static ngx_int_t ngx_http_file_cache_lock_wait(ngx_http_request_t *r,
     ngx_http_cache_t *c);
+static void ngx_http_file_cache_lock_release(ngx_http_file_cache_node_t *fcn);
+static void ngx_http_file_cache_lock_wakeup(ngx_http_file_cache_node_t *fcn);
+#if !(NGX_WIN32)
+static void ngx_http_file_cache_lock_notify(ngx_cycle_t *cycle, void *data);
+#endif
+static ngx_int_t ngx_http_file_cache_stream_open(ngx_http_request_t *r,
+    ngx_http_cache_t *c);
+static ngx_int_t ngx_http_file_cache_stream_fallback(ngx_http_request_t *r,
+    ngx_http_cache_t *c);
+static ngx_int_t ngx_http_file_cache_stream_send(ngx_http_request_t *r);
+static ngx_int_t ngx_http_file_cache_stream_size(ngx_http_request_t *r,
+    ngx_http_cache_t *c, off_t *size);
+static void ngx_http_file_cache_stream_handler(ngx_http_request_t *r);
+static void ngx_http_file_cache_stream_wait_handler(ngx_event_t *ev);
+static ngx_int_t ngx_http_file_cache_partial(ngx_http_request_t *r,
+    ngx_http_cache_t *c, size_t block);
+static void ngx_http_file_cache_partial_fetch(ngx_http_cache_t *c,
+    off_t length);
+static void ngx_http_file_cache_partial_range(ngx_http_cache_t *c,
+    off_t length, off_t *start, off_t *end);
 static ngx_int_t ngx_http_file_cache_read(ngx_http_request_t *r,
     ngx_http_cache_t *c);
 static ssize_t ngx_http_file_cache_aio_read(ngx_http_request_t *r,
@@ -33,6 +55,8 @@ static ngx_int_t ngx_http_file_cache_exists(ngx_http_file_cache_t *cache,
     ngx_http_cache_t *c);
 static ngx_int_t ngx_http_file_cache_name(ngx_http_request_t *r,
     ngx_path_t *path);
+static ngx_int_t ngx_http_file_cache_key_name(ngx_pool_t *pool,
+    ngx_path_t *path, u_char *key, ngx_str_t *name);
 static ngx_http_file_cache_node_t *
     ngx_http_file_cache_lookup(ngx_http_file_cache_t *cache, u_char *key);
 static void ngx_http_file_cache_rbtree_insert_value(ngx_rbtree_node_t *temp,
@@ -43,8 +67,28 @@ static void ngx_http_file_cache_vary_header(ngx_http_request_t *r,
     ngx_md5_t *md5, ngx_str_t *name);
 static ngx_int_t ngx_http_file_cache_reopen(ngx_http_request_t *r,
     ngx_http_cache_t *c);
+#if (NGX_HTTP_GZIP)
+static ngx_int_t ngx_http_file_cache_encoded(ngx_http_request_t *r,
+    ngx_http_cache_t *c);
+static void ngx_http_file_cache_encoded_key(ngx_http_request_t *r,
+    ngx_str_t *encoding, u_char *key);
+static ngx_int_t ngx_http_file_cache_reopen_main(ngx_http_request_t *r,
+    ngx_http_cache_t *c);
+#endif
 static ngx_int_t ngx_http_file_cache_update_variant(ngx_http_request_t *r,
     ngx_http_cache_t *c);
+static void ngx_http_file_cache_update_partial(ngx_http_request_t *r,
+    ngx_temp_file_t *tf);
+static ngx_int_t ngx_http_file_cache_partial_merge(ngx_http_request_t *r,
+    ngx_temp_file_t *tf, ngx_file_info_t *fi);
+static ngx_int_t ngx_http_file_cache_partial_create(ngx_http_request_t *r,
+    ngx_temp_file_t *tf, ngx_file_info_t *fi);
+static ngx_int_t ngx_http_file_cache_partial_copy(ngx_http_request_t *r,
+    ngx_file_t *src, ngx_file_t *dst, size_t body_start, ngx_uint_t merge);
+static ngx_int_t ngx_http_file_cache_partial_store(ngx_http_request_t *r,
+    ngx_file_t *src, off_t src_offset, ngx_file_t *dst, off_t dst_offset,
+    off_t size, u_char **buf);
+static void ngx_http_cache_send_stats(ngx_http_request_t *r);
 static void ngx_http_file_cache_cleanup(void *data);
 static time_t ngx_http_file_cache_forced_expire(ngx_http_file_cache_t *cache);
 static time_t ngx_http_file_cache_expire(ngx_http_file_cache_t *cache);
@@ -66,6 +110,10 @@ static ngx_int_t ngx_http_file_cache_delete_file(ngx_tree_ctx_t *ctx,
 static void ngx_http_file_cache_set_watermark(ngx_http_file_cache_t *cache);
 
 
+/* requests of this process waiting for cache locks */
+static ngx_queue_t  ngx_http_file_cache_waiters;
+
+
 ngx_str_t  ngx_http_cache_status[] = {
     ngx_string("MISS"),
     ngx_string("BYPASS"),
@@ -165,6 +213,12 @@ static ngx_api_entry_t  ngx_api_http_cache_entries[] = {
                               stats[NGX_HTTP_CACHE_BYPASS - 1])
     },
 
+    {
+        .name      = ngx_string("compressed"),
+        .handler   = ngx_api_http_cache_miss_handler,
+        .data.off  = offsetof(ngx_http_file_cache_sh_t, compressed)
+    },
+
     ngx_api_null_entry
 };
 
@@ -230,6 +284,13 @@ ngx_http_file_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 
     cache = shm_zone->data;
 
+    if (ngx_http_file_cache_waiters.prev == NULL) {
+        ngx_queue_init(&ngx_http_file_cache_waiters);
+#if !(NGX_WIN32)
+        ngx_process_notify = ngx_http_file_cache_lock_notify;
+#endif
+    }
+
     if (ocache) {
         if (ngx_strcmp(cache->path->name.data, ocache->path->name.data) != 0) {
             ngx_log_error(NGX_LOG_EMERG, shm_zone->shm.log, 0,
@@ -300,6 +361,7 @@ ngx_http_file_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 #if (NGX_API)
     ngx_memzero(cache->sh->stats,
                 NGX_HTTP_CACHE_HIT * sizeof(ngx_http_cache_stats_t));
+    ngx_memzero(&cache->sh->compressed, sizeof(ngx_http_cache_stats_t));
 #endif
 
     cache->bsize = ngx_fs_bsize(cache->path->name.data);
@@ -429,7 +491,7 @@ ngx_http_file_cache_open(ngx_http_request_t *r)
     }
 
     if (c->reading) {
-        return ngx_http_file_cache_read(r, c);
+        goto read;
     }
 
     cache = c->file_cache;
@@ -442,6 +504,12 @@ ngx_http_file_cache_open(ngx_http_request_t *r)
 
         cln->handler = ngx_http_file_cache_cleanup;
         cln->data = c;
+
+#if (NGX_HTTP_GZIP)
+        if (c->encoding.len && !c->secondary) {
+            (void) ngx_http_file_cache_encoded(r, c);
+        }
+#endif
     }
 
     c->buffer_size = c->body_start;
@@ -539,11 +607,37 @@ ngx_http_file_cache_open(ngx_http_request_t *r)
         return NGX_ERROR;
     }
 
-    return ngx_http_file_cache_read(r, c);
+read:
+
+    rc = ngx_http_file_cache_read(r, c);
+
+    if (c->streaming && rc != NGX_OK && rc != NGX_AGAIN) {
+        return ngx_http_file_cache_stream_fallback(r, c);
+    }
+
+#if (NGX_HTTP_GZIP)
+    if (rc == NGX_DECLINED && c->encoded) {
+        return ngx_http_file_cache_reopen_main(r, c);
+    }
+#endif
+
+    return rc;
 
 done:
 
+#if (NGX_HTTP_GZIP)
+    if (c->encoded) {
+        return ngx_http_file_cache_reopen_main(r, c);
+    }
+#endif
+
     if (rv == NGX_DECLINED) {
+
+        if (c->partial_block) {
+            ngx_http_file_cache_partial_fetch(c, -1);
+            return rv;
+        }
+
         return ngx_http_file_cache_lock(r, c);
     }
 
@@ -572,24 +666,47 @@ ngx_http_file_cache_lock(ngx_http_request_t *r, ngx_http_cache_t *c)
     if (!c->node->updating || (ngx_msec_int_t) timer <= 0) {
         c->node->updating = 1;
         c->node->lock_time = now + c->lock_age;
+        c->node->stream_id = 0;
+        c->node->stream_size = 0;
         c->updating = 1;
         c->lock_time = c->node->lock_time;
+
+    } else if (c->stream && c->node->stream_id) {
+        c->stream_id = c->node->stream_id;
+
+    } else if (c->lock_timeout) {
+        c->node->waiters = 1;
     }
 
     ngx_shmtx_unlock(&cache->shpool->mutex);
 
-    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-                   "http file cache lock u:%d wt:%M",
-                   c->updating, c->wait_time);
+    ngx_log_debug3(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache lock u:%d wt:%M s:%uD",
+                   c->updating, c->wait_time, c->stream_id);
 
     if (c->updating) {
         return NGX_DECLINED;
     }
 
+    if (c->stream_id) {
+        return ngx_http_file_cache_stream_open(r, c);
+    }
+
+    return ngx_http_file_cache_wait(r, c);
+}
+
+
+static ngx_int_t
+ngx_http_file_cache_wait(ngx_http_request_t *r, ngx_http_cache_t *c)
+{
+    ngx_msec_t  now, timer;
+
     if (c->lock_timeout == 0) {
         return NGX_HTTP_CACHE_SCARCE;
     }
 
+    now = ngx_current_msec;
+
     c->waiting = 1;
 
     if (c->wait_time == 0) {
@@ -602,8 +719,15 @@ ngx_http_file_cache_lock(ngx_http_request_t *r, ngx_http_cache_t *c)
 
     timer = c->wait_time - now;
 
+    /*
+     * the lock holder wakes up waiting requests when the lock is released,
+     * the timer is a fallback in case the notification is lost
+     */
+
     ngx_add_timer(&c->wait_event, (timer > 500) ? 500 : timer);
 
+    ngx_queue_insert_tail(&ngx_http_file_cache_waiters, &c->wait_queue);
+
     r->main->blocked++;
 
     return NGX_AGAIN;
@@ -634,6 +758,8 @@ ngx_http_file_cache_lock_wait_handler(ngx_event_t *ev)
     r->cache->waiting = 0;
     r->main->blocked--;
 
+    ngx_queue_remove(&r->cache->wait_queue);
+
     if (r->main->terminated) {
         /*
          * trigger connection event handler if the request was
@@ -674,7 +800,10 @@ ngx_http_file_cache_lock_wait(ngx_http_request_t *r, ngx_http_cache_t *c)
 
     timer = c->node->lock_time - now;
 
-    if (c->node->updating && (ngx_msec_int_t) timer > 0) {
+    if (c->node->updating && (ngx_msec_int_t) timer > 0
+        && !(c->stream && c->node->stream_id))
+    {
+        c->node->waiters = 1;
         wait = 1;
     }
 
@@ -689,964 +818,2159 @@ ngx_http_file_cache_lock_wait(ngx_http_request_t *r, ngx_http_cache_t *c)
 }
 
 
-static ngx_int_t
-ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
+static void
+ngx_http_file_cache_lock_release(ngx_http_file_cache_node_t *fcn)
 {
-    u_char                        *p;
-    time_t                         now;
-    ssize_t                        n;
-    ngx_str_t                     *key;
-    ngx_int_t                      rc;
-    ngx_uint_t                     i;
-    ngx_http_file_cache_t         *cache;
-    ngx_http_file_cache_header_t  *h;
-
-    n = ngx_http_file_cache_aio_read(r, c);
+    ngx_http_file_cache_lock_wakeup(fcn);
 
-    if (n < 0) {
-        return n;
-    }
+#if !(NGX_WIN32)
+    ngx_notify_processes((ngx_cycle_t *) ngx_cycle, fcn);
+#endif
+}
 
-    if ((size_t) n < c->header_start) {
-        ngx_log_error(NGX_LOG_CRIT, r->connection->log, 0,
-                      "cache file \"%s\" is too small", c->file.name.data);
-        return NGX_DECLINED;
-    }
 
-    h = (ngx_http_file_cache_header_t *) c->buf->pos;
+static void
+ngx_http_file_cache_lock_wakeup(ngx_http_file_cache_node_t *fcn)
+{
+    ngx_queue_t       *q;
+    ngx_http_cache_t  *c;
 
-    if (h->version != NGX_HTTP_CACHE_VERSION) {
-        ngx_log_error(NGX_LOG_INFO, r->connection->log, 0,
-                      "cache file \"%s\" version mismatch", c->file.name.data);
-        return NGX_DECLINED;
-    }
+    for (q = ngx_queue_head(&ngx_http_file_cache_waiters);
+         q != ngx_queue_sentinel(&ngx_http_file_cache_waiters);
+         q = ngx_queue_next(q))
+    {
+        c = ngx_queue_data(q, ngx_http_cache_t, wait_queue);
 
-    if (h->crc32 != c->crc32 || (size_t) h->header_start != c->header_start) {
-        ngx_log_error(NGX_LOG_CRIT, r->connection->log, 0,
-                      "cache file \"%s\" has md5 collision", c->file.name.data);
-        return NGX_DECLINED;
-    }
+        if (c->node != fcn) {
+            continue;
+        }
 
-    p = c->buf->pos + sizeof(ngx_http_file_cache_header_t)
-        + sizeof(ngx_http_file_cache_key);
+        ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->wait_event.log, 0,
+                       "http file cache lock wakeup");
 
-    key = c->keys.elts;
-    for (i = 0; i < c->keys.nelts; i++) {
-        if (ngx_memcmp(p, key[i].data, key[i].len) != 0) {
-            ngx_log_error(NGX_LOG_CRIT, r->connection->log, 0,
-                          "cache file \"%s\" has md5 collision",
-                          c->file.name.data);
-            return NGX_DECLINED;
+        if (c->wait_event.timer_set) {
+            ngx_del_timer(&c->wait_event);
         }
 
-        p += key[i].len;
+        if (!c->wait_event.posted) {
+            ngx_post_event(&c->wait_event, &ngx_posted_events);
+        }
     }
+}
 
-    if ((size_t) h->body_start > c->body_start) {
-        ngx_log_error(NGX_LOG_CRIT, r->connection->log, 0,
-                      "cache file \"%s\" has too long header",
-                      c->file.name.data);
-        return NGX_DECLINED;
-    }
 
-    if (h->vary_len > NGX_HTTP_CACHE_VARY_LEN) {
-        ngx_log_error(NGX_LOG_CRIT, r->connection->log, 0,
-                      "cache file \"%s\" has incorrect vary length",
-                      c->file.name.data);
-        return NGX_DECLINED;
-    }
+#if !(NGX_WIN32)
 
-    if (h->vary_len) {
-        ngx_http_file_cache_vary(r, h->vary, h->vary_len, c->variant);
+static void
+ngx_http_file_cache_lock_notify(ngx_cycle_t *cycle, void *data)
+{
+    /*
+     * a lock was released in another process; the node is in shared
+     * memory, which is mapped at the same address in all processes
+     */
 
-        if (ngx_memcmp(c->variant, h->variant, NGX_HTTP_CACHE_KEY_LEN) != 0) {
-            ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-                           "http file cache vary mismatch");
-            return ngx_http_file_cache_reopen(r, c);
-        }
-    }
+    ngx_http_file_cache_lock_wakeup(data);
+}
 
-    c->buf->last += n;
+#endif
 
-    c->valid_sec = h->valid_sec;
-    c->updating_sec = h->updating_sec;
-    c->error_sec = h->error_sec;
-    c->last_modified = h->last_modified;
-    c->date = h->date;
-    c->valid_msec = h->valid_msec;
-    c->body_start = h->body_start;
-    c->etag.len = h->etag_len;
-    c->etag.data = h->etag;
 
-    r->cached = 1;
+static ngx_int_t
+ngx_http_file_cache_stream_open(ngx_http_request_t *r, ngx_http_cache_t *c)
+{
+    ngx_int_t                 rc;
+    ngx_str_t                 name;
+    ngx_file_info_t           fi;
+    ngx_pool_cleanup_t       *cln;
+    ngx_pool_cleanup_file_t  *clnf;
 
-    cache = c->file_cache;
+    /* the response is read from the temporary file while it is written */
 
-    if (cache->sh->cold) {
+    name.len = c->file.name.len + 1 + 10;
 
-        ngx_shmtx_lock(&cache->shpool->mutex);
+    name.data = ngx_pnalloc(r->pool, name.len + 1);
+    if (name.data == NULL) {
+        return NGX_ERROR;
+    }
 
-        if (!c->node->exists) {
-            c->node->uses = 1;
-            c->node->body_start = c->body_start;
-            c->node->exists = 1;
-            c->node->uniq = c->uniq;
-            c->node->fs_size = c->fs_size;
+    (void) ngx_sprintf(name.data, "%V.%010uD%Z", &c->file.name, c->stream_id);
 
-            cache->sh->size += c->fs_size;
-        }
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache stream: \"%s\"", name.data);
 
-        ngx_shmtx_unlock(&cache->shpool->mutex);
+    cln = ngx_pool_cleanup_add(r->pool, sizeof(ngx_pool_cleanup_file_t));
+    if (cln == NULL) {
+        return NGX_ERROR;
     }
 
-    now = ngx_time();
+    c->file.fd = ngx_open_file(name.data, NGX_FILE_RDONLY|NGX_FILE_NONBLOCK,
+                               NGX_FILE_OPEN, 0);
 
-    if (c->valid_sec < now) {
-        c->stale_updating = c->valid_sec + c->updating_sec >= now;
-        c->stale_error = c->valid_sec + c->error_sec >= now;
+    if (c->file.fd == NGX_INVALID_FILE) {
+        if (ngx_errno != NGX_ENOENT) {
+            ngx_log_error(NGX_LOG_CRIT, r->connection->log, ngx_errno,
+                          ngx_open_file_n " \"%s\" failed", name.data);
+        }
 
-        ngx_shmtx_lock(&cache->shpool->mutex);
+        /* the response may have been already cached */
 
-        if (c->node->updating) {
-            rc = NGX_HTTP_CACHE_UPDATING;
+        return ngx_http_file_cache_stream_fallback(r, c);
+    }
 
-        } else {
-            c->node->updating = 1;
-            c->updating = 1;
-            c->lock_time = c->node->lock_time;
-            rc = NGX_HTTP_CACHE_STALE;
-        }
+    cln->handler = ngx_pool_cleanup_file;
+    clnf = cln->data;
 
-        ngx_shmtx_unlock(&cache->shpool->mutex);
+    clnf->fd = c->file.fd;
+    clnf->name = name.data;
+    clnf->log = r->pool->log;
 
-        ngx_log_debug3(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-                       "http file cache expired: %i %T %T",
-                       rc, c->valid_sec, now);
+    if (ngx_fd_info(c->file.fd, &fi) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, r->connection->log, ngx_errno,
+                      ngx_fd_info_n " \"%s\" failed", name.data);
+        return NGX_ERROR;
+    }
 
-        return rc;
+    c->file.log = r->connection->log;
+    c->uniq = ngx_file_uniq(&fi);
+    c->length = ngx_file_size(&fi);
+    c->streaming = 1;
+
+    c->buf = ngx_create_temp_buf(r->pool, c->body_start);
+    if (c->buf == NULL) {
+        return NGX_ERROR;
     }
 
-    return NGX_OK;
+    rc = ngx_http_file_cache_read(r, c);
+
+    if (rc != NGX_OK && rc != NGX_AGAIN) {
+        return ngx_http_file_cache_stream_fallback(r, c);
+    }
+
+    return rc;
 }
 
 
-static ssize_t
-ngx_http_file_cache_aio_read(ngx_http_request_t *r, ngx_http_cache_t *c)
+static ngx_int_t
+ngx_http_file_cache_stream_fallback(ngx_http_request_t *r, ngx_http_cache_t *c)
 {
-#if (NGX_HAVE_FILE_AIO || NGX_THREADS)
-    ssize_t                    n;
-    ngx_http_core_loc_conf_t  *clcf;
+    ngx_int_t  rc;
 
-    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
-#endif
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache stream fallback");
 
-#if (NGX_HAVE_FILE_AIO)
+    c->file.fd = NGX_INVALID_FILE;
+    c->buf = NULL;
+    c->stream = 0;
+    c->streaming = 0;
+    c->stream_id = 0;
 
-    if (clcf->aio == NGX_HTTP_AIO_ON && ngx_file_aio) {
-        n = ngx_file_aio_read(&c->file, c->buf->pos, c->body_start, 0, r->pool);
+    r->cached = 0;
 
-        if (n != NGX_AGAIN) {
-            c->reading = 0;
-            return n;
-        }
+    rc = ngx_http_file_cache_wait(r, c);
 
-        c->reading = 1;
+    if (rc == NGX_AGAIN) {
 
-        c->file.aio->data = r;
-        c->file.aio->handler = ngx_http_cache_aio_event_handler;
+        /* recheck the lock, it is probably released already */
 
-        ngx_add_timer(&c->file.aio->event, 60000);
+        ngx_del_timer(&c->wait_event);
+        ngx_post_event(&c->wait_event, &ngx_posted_events);
+    }
 
-        r->main->blocked++;
-        r->aio = 1;
+    return rc;
+}
 
-        return NGX_AGAIN;
-    }
 
-#endif
+void
+ngx_http_file_cache_stream(ngx_http_request_t *r, ngx_temp_file_t *tf)
+{
+    ngx_int_t                    n;
+    ngx_uint_t                   waiters;
+    ngx_http_cache_t            *c;
+    ngx_http_file_cache_t       *cache;
+    ngx_http_file_cache_node_t  *fcn;
 
-#if (NGX_THREADS)
+    c = r->cache;
+    cache = c->file_cache;
 
-    if (clcf->aio == NGX_HTTP_AIO_THREADS) {
-        c->file.thread_task = c->thread_task;
-        c->file.thread_handler = ngx_http_cache_thread_handler;
-        c->file.thread_ctx = r;
+    if (!c->stream || !c->updating || c->updated
+        || cache->use_temp_path
+        || tf->file.fd == NGX_INVALID_FILE
+        || tf->offset < (off_t) c->body_start
+        || tf->offset == c->stream_size)
+    {
+        return;
+    }
 
-        n = ngx_thread_read(&c->file, c->buf->pos, c->body_start, 0, r->pool);
+    if (c->stream_id == 0) {
 
-        c->thread_task = c->file.thread_task;
-        c->reading = (n == NGX_AGAIN);
+        /*
+         * temporary files in cache have a suffix consisting of a dot
+         * followed by 10 digits, the number identifies the file
+         */
 
-        return n;
+        n = ngx_atoi(tf->file.name.data + tf->file.name.len - 10, 10);
+
+        if (n == NGX_ERROR || n == 0) {
+            c->stream = 0;
+            return;
+        }
+
+        c->stream_id = (uint32_t) n;
     }
 
-#endif
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache stream: %uD %O", c->stream_id, tf->offset);
 
-    return ngx_read_file(&c->file, c->buf->pos, c->body_start, 0);
-}
+    c->stream_size = tf->offset;
 
+    ngx_shmtx_lock(&cache->shpool->mutex);
 
-#if (NGX_HAVE_FILE_AIO)
+    fcn = c->node;
+    waiters = 0;
 
-static void
-ngx_http_cache_aio_event_handler(ngx_event_t *ev)
-{
-    ngx_event_aio_t     *aio;
-    ngx_connection_t    *c;
-    ngx_http_request_t  *r;
-
-    aio = ev->data;
-    r = aio->data;
-    c = r->connection;
+    if (fcn->updating && fcn->lock_time == c->lock_time) {
+        fcn->stream_id = c->stream_id;
+        fcn->stream_size = c->stream_size;
 
-    ngx_http_set_log_request(c->log, r);
+        /* the lock is held while the response is being received */
 
-    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
-                   "http file cache aio: \"%V?%V\"", &r->uri, &r->args);
+        fcn->lock_time = ngx_current_msec + c->lock_age;
+        c->lock_time = fcn->lock_time;
 
-    if (ev->timedout) {
-        ngx_log_error(NGX_LOG_ALERT, c->log, 0,
-                      "aio operation took too long");
-        ev->timedout = 0;
-        return;
+        waiters = fcn->waiters;
+        fcn->waiters = 0;
     }
 
-    if (ev->timer_set) {
-        ngx_del_timer(ev);
+    ngx_shmtx_unlock(&cache->shpool->mutex);
+
+    if (waiters) {
+        ngx_http_file_cache_lock_release(fcn);
     }
+}
 
-    r->main->blocked--;
-    r->aio = 0;
 
-    if (r->main->terminated) {
-        /*
-         * trigger connection event handler if the request was
-         * terminated
-         */
+static ngx_int_t
+ngx_http_file_cache_stream_send(ngx_http_request_t *r)
+{
+    off_t                      size;
+    ngx_int_t                  rc;
+    ngx_buf_t                 *b;
+    ngx_file_t                *file;
+    ngx_chain_t                out;
+    ngx_event_t               *wev;
+    ngx_http_cache_t          *c;
+    ngx_http_core_loc_conf_t  *clcf;
 
-        c->write->handler(c->write);
+    c = r->cache;
+    wev = r->connection->write;
 
-    } else {
-        r->write_event_handler(r);
-        ngx_http_run_posted_requests(c);
-    }
-}
+    for ( ;; ) {
 
-#endif
+        if (r->buffered || r->postponed || r->connection->buffered) {
 
+            if (ngx_http_output_filter(r, NULL) == NGX_ERROR) {
+                return NGX_ERROR;
+            }
 
-#if (NGX_THREADS)
+            if (r->buffered || r->postponed || r->connection->buffered) {
 
-static ngx_int_t
-ngx_http_cache_thread_handler(ngx_thread_task_t *task, ngx_file_t *file)
-{
-    ngx_str_t                  name;
-    ngx_thread_pool_t         *tp;
-    ngx_http_request_t        *r;
-    ngx_http_core_loc_conf_t  *clcf;
+                clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
 
-    r = file->thread_ctx;
+                if (!wev->delayed) {
+                    ngx_add_timer(wev, clcf->send_timeout);
+                }
 
-    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
-    tp = clcf->thread_pool;
+                if (ngx_handle_write_event(wev, clcf->send_lowat) != NGX_OK) {
+                    return NGX_ERROR;
+                }
 
-    if (tp == NULL) {
-        if (ngx_http_complex_value(r, clcf->thread_pool_value, &name)
-            != NGX_OK)
-        {
-            return NGX_ERROR;
+                return NGX_DONE;
+            }
+
+            if (wev->timer_set && !wev->delayed) {
+                ngx_del_timer(wev);
+            }
         }
 
-        tp = ngx_thread_pool_get((ngx_cycle_t *) ngx_cycle, &name);
+        rc = ngx_http_file_cache_stream_size(r, c, &size);
 
-        if (tp == NULL) {
-            ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
-                          "thread pool \"%V\" not found", &name);
+        if (rc == NGX_ERROR) {
             return NGX_ERROR;
         }
-    }
 
-    task->event.data = r;
-    task->event.handler = ngx_http_cache_thread_event_handler;
+        if (rc == NGX_AGAIN && size <= c->stream_size) {
 
-    if (ngx_thread_task_post(tp, task) != NGX_OK) {
-        return NGX_ERROR;
-    }
+            /* everything written so far is sent, wait for more */
 
-    ngx_add_timer(&task->event, 60000);
+            c->wait_event.handler = ngx_http_file_cache_stream_wait_handler;
+            c->wait_event.data = r;
+            c->wait_event.log = r->connection->log;
 
-    r->main->blocked++;
-    r->aio = 1;
+            ngx_add_timer(&c->wait_event, 500);
 
-    return NGX_OK;
-}
+            if (!c->stream_waiting) {
+                ngx_queue_insert_tail(&ngx_http_file_cache_waiters,
+                                      &c->wait_queue);
+                c->stream_waiting = 1;
+            }
 
+            return NGX_DONE;
+        }
 
-static void
-ngx_http_cache_thread_event_handler(ngx_event_t *ev)
-{
-    ngx_connection_t    *c;
-    ngx_http_request_t  *r;
+        b = c->stream_buf;
+        file = b->file;
 
-    r = ev->data;
-    c = r->connection;
+        ngx_memzero(b, sizeof(ngx_buf_t));
 
-    ngx_http_set_log_request(c->log, r);
+        b->file = file;
+        b->file_pos = c->stream_size;
+        b->file_last = size;
+        b->in_file = (size > c->stream_size) ? 1 : 0;
 
-    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
-                   "http file cache thread: \"%V?%V\"", &r->uri, &r->args);
+        c->stream_size = size;
 
-    if (ev->timedout) {
-        ngx_log_error(NGX_LOG_ALERT, c->log, 0,
-                      "thread operation took too long");
-        ev->timedout = 0;
-        return;
-    }
+        out.buf = b;
+        out.next = NULL;
 
-    if (ev->timer_set) {
-        ngx_del_timer(ev);
-    }
+        if (rc == NGX_OK) {
+            b->last_buf = 1;
+            b->last_in_chain = 1;
 
-    r->main->blocked--;
-    r->aio = 0;
+            c->length = size;
 
-    if (r->main->terminated) {
-        /*
-         * trigger connection event handler if the request was
-         * terminated
-         */
+            ngx_http_cache_send_stats(r);
 
-        c->write->handler(c->write);
+            return ngx_http_output_filter(r, &out);
+        }
 
-    } else {
-        r->write_event_handler(r);
-        ngx_http_run_posted_requests(c);
+        b->flush = 1;
+
+        if (ngx_http_output_filter(r, &out) == NGX_ERROR) {
+            return NGX_ERROR;
+        }
     }
 }
 
-#endif
-
 
 static ngx_int_t
-ngx_http_file_cache_exists(ngx_http_file_cache_t *cache, ngx_http_cache_t *c)
+ngx_http_file_cache_stream_size(ngx_http_request_t *r, ngx_http_cache_t *c,
+    off_t *size)
 {
     ngx_int_t                    rc;
+    ngx_file_info_t              fi;
+    ngx_http_file_cache_t       *cache;
     ngx_http_file_cache_node_t  *fcn;
 
+    cache = c->file_cache;
+
     ngx_shmtx_lock(&cache->shpool->mutex);
 
     fcn = c->node;
 
-    if (fcn == NULL) {
-        fcn = ngx_http_file_cache_lookup(cache, c->key);
-    }
-
-    if (fcn) {
-        ngx_queue_remove(&fcn->queue);
+    if (fcn->updating
+        && fcn->stream_id == c->stream_id
+        && (ngx_msec_int_t) (fcn->lock_time - ngx_current_msec) > 0)
+    {
+        *size = fcn->stream_size;
 
-        if (c->node == NULL) {
-            fcn->uses++;
-            fcn->count++;
+        if (*size <= c->stream_size) {
+            fcn->waiters = 1;
         }
 
-        if (fcn->error) {
-
-            if (fcn->valid_sec < ngx_time()) {
-                goto renew;
-            }
+        rc = NGX_AGAIN;
 
-            rc = NGX_OK;
+    } else if (fcn->exists && fcn->uniq == c->uniq) {
+        rc = NGX_OK;
 
-            goto done;
-        }
+    } else {
+        rc = NGX_ERROR;
+    }
 
-        if (fcn->exists || fcn->uses >= c->min_uses) {
+    ngx_shmtx_unlock(&cache->shpool->mutex);
 
-            c->exists = fcn->exists;
-            if (fcn->body_start && !c->update_variant) {
-                c->body_start = fcn->body_start;
-            }
+    if (rc == NGX_OK) {
 
-            rc = NGX_OK;
+        /* the file is complete */
 
-            goto done;
+        if (ngx_fd_info(c->file.fd, &fi) == NGX_FILE_ERROR) {
+            ngx_log_error(NGX_LOG_CRIT, r->connection->log, ngx_errno,
+                          ngx_fd_info_n " \"%s\" failed", c->file.name.data);
+            return NGX_ERROR;
         }
 
-        rc = NGX_AGAIN;
+        *size = ngx_file_size(&fi);
 
-        goto done;
+    } else if (rc == NGX_ERROR) {
+        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                      "cache file \"%s\" was not completed",
+                      c->file.name.data);
     }
 
-    fcn = ngx_slab_calloc_locked(cache->shpool,
-                                 sizeof(ngx_http_file_cache_node_t));
-    if (fcn == NULL) {
-        ngx_http_file_cache_set_watermark(cache);
+    return rc;
+}
 
-        ngx_shmtx_unlock(&cache->shpool->mutex);
 
-        (void) ngx_http_file_cache_forced_expire(cache);
+static void
+ngx_http_file_cache_stream_handler(ngx_http_request_t *r)
+{
+    ngx_int_t                  rc;
+    ngx_event_t               *wev;
+    ngx_http_core_loc_conf_t  *clcf;
 
-        ngx_shmtx_lock(&cache->shpool->mutex);
+    wev = r->connection->write;
 
-        fcn = ngx_slab_calloc_locked(cache->shpool,
-                                     sizeof(ngx_http_file_cache_node_t));
-        if (fcn == NULL) {
-            ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0,
-                          "could not allocate node%s", cache->shpool->log_ctx);
-            rc = NGX_ERROR;
-            goto failed;
-        }
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, wev->log, 0,
+                   "http file cache stream handler: \"%V?%V\"",
+                   &r->uri, &r->args);
+
+    if (wev->timedout) {
+        ngx_log_error(NGX_LOG_INFO, r->connection->log, NGX_ETIMEDOUT,
+                      "client timed out");
+        r->connection->timedout = 1;
+
+        ngx_http_finalize_request(r, NGX_HTTP_REQUEST_TIME_OUT);
+        return;
     }
 
-    cache->sh->count++;
+    if (wev->delayed || r->aio) {
 
-    ngx_memcpy((u_char *) &fcn->node.key, c->key, sizeof(ngx_rbtree_key_t));
+        if (!wev->delayed) {
+            clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
 
-    ngx_memcpy(fcn->key, &c->key[sizeof(ngx_rbtree_key_t)],
-               NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+            ngx_add_timer(wev, clcf->send_timeout);
 
-    ngx_rbtree_insert(&cache->sh->rbtree, &fcn->node);
+            if (ngx_handle_write_event(wev, clcf->send_lowat) != NGX_OK) {
+                ngx_http_finalize_request(r, NGX_ERROR);
+            }
+        }
 
-    fcn->uses = 1;
-    fcn->count = 1;
+        return;
+    }
 
-renew:
+    rc = ngx_http_file_cache_stream_send(r);
 
-    rc = NGX_DECLINED;
+    if (rc == NGX_DONE) {
+        return;
+    }
 
-    fcn->valid_msec = 0;
-    fcn->error = 0;
-    fcn->exists = 0;
-    fcn->valid_sec = 0;
-    fcn->uniq = 0;
-    fcn->body_start = 0;
-    fcn->fs_size = 0;
+    r->write_event_handler = ngx_http_request_empty_handler;
 
-done:
+    ngx_http_finalize_request(r, rc);
+}
 
-    fcn->expire = ngx_time() + cache->inactive;
 
-    ngx_queue_insert_head(&cache->sh->queue, &fcn->queue);
+static void
+ngx_http_file_cache_stream_wait_handler(ngx_event_t *ev)
+{
+    ngx_connection_t    *c;
+    ngx_http_request_t  *r;
 
-    c->uniq = fcn->uniq;
-    c->error = fcn->error;
-    c->node = fcn;
+    r = ev->data;
+    c = r->connection;
 
-failed:
+    ngx_http_set_log_request(c->log, r);
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http file cache stream wait: \"%V?%V\"",
+                   &r->uri, &r->args);
 
-    return rc;
+    if (r->cache->stream_waiting) {
+        ngx_queue_remove(&r->cache->wait_queue);
+        r->cache->stream_waiting = 0;
+    }
+
+    r->write_event_handler(r);
+
+    ngx_http_run_posted_requests(c);
 }
 
 
 static ngx_int_t
-ngx_http_file_cache_name(ngx_http_request_t *r, ngx_path_t *path)
+ngx_http_file_cache_partial(ngx_http_request_t *r, ngx_http_cache_t *c,
+    size_t block)
 {
-    u_char            *p;
-    ngx_http_cache_t  *c;
+    off_t     start, end, first, last, length;
+    size_t    size;
+    ssize_t   n;
+    u_char    map[1024];
 
-    c = r->cache;
+    length = c->partial_length;
+    c->partial_length = 0;
 
-    if (c->file.name.len) {
-        return NGX_OK;
+    if (c->partial_block == 0) {
+        ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "http file cache partial");
+        return NGX_DECLINED;
     }
 
-    c->file.name.len = path->name.len + 1 + path->len
-                       + 2 * NGX_HTTP_CACHE_KEY_LEN;
+    if (block != c->partial_block || c->valid_sec < ngx_time()) {
+        ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "http file cache partial expired");
 
-    c->file.name.data = ngx_pnalloc(r->pool, c->file.name.len + 1);
-    if (c->file.name.data == NULL) {
-        return NGX_ERROR;
+        ngx_http_file_cache_partial_fetch(c, -1);
+        return NGX_DECLINED;
     }
 
-    ngx_memcpy(c->file.name.data, path->name.data, path->name.len);
+    ngx_http_file_cache_partial_range(c, length, &start, &end);
 
-    p = c->file.name.data + path->name.len + 1 + path->len;
-    p = ngx_hex_dump(p, c->key, NGX_HTTP_CACHE_KEY_LEN);
-    *p = '\0';
+    if (start < end) {
 
-    ngx_create_hashed_filename(path, c->file.name.data, c->file.name.len);
+        /*
+         * the map of present blocks follows the body,
+         * a byte per block
+         */
 
-    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-                   "cache file: \"%s\"", c->file.name.data);
+        first = start / block;
+        last = (end - 1) / block + 1;
 
-    return NGX_OK;
-}
+        while (first < last) {
+            size = (size_t) ngx_min(last - first, (off_t) sizeof(map));
 
+            n = ngx_read_file(&c->file, map, size,
+                              c->body_start + length + first);
 
-static ngx_http_file_cache_node_t *
-ngx_http_file_cache_lookup(ngx_http_file_cache_t *cache, u_char *key)
-{
-    ngx_int_t                    rc;
-    ngx_rbtree_key_t             node_key;
-    ngx_rbtree_node_t           *node, *sentinel;
-    ngx_http_file_cache_node_t  *fcn;
+            if (n == NGX_ERROR) {
+                return NGX_ERROR;
+            }
 
-    ngx_memcpy((u_char *) &node_key, key, sizeof(ngx_rbtree_key_t));
+            if ((size_t) n != size || ngx_strlchr(map, map + n, 0) != NULL) {
+                ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                               "http file cache partial miss: %O-%O",
+                               start, end);
 
-    node = cache->sh->rbtree.root;
-    sentinel = cache->sh->rbtree.sentinel;
+                ngx_http_file_cache_partial_fetch(c, length);
+                return NGX_DECLINED;
+            }
 
-    while (node != sentinel) {
+            first += n;
+        }
+    }
 
-        if (node_key < node->key) {
-            node = node->left;
-            continue;
-        }
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache partial hit: %O-%O", start, end);
 
-        if (node_key > node->key) {
-            node = node->right;
-            continue;
-        }
+    c->partial_start = start;
+    c->partial_end = end;
+    c->partial_length = length;
 
-        /* node_key == node->key */
+    return NGX_OK;
+}
 
-        fcn = (ngx_http_file_cache_node_t *) node;
 
-        rc = ngx_memcmp(&key[sizeof(ngx_rbtree_key_t)], fcn->key,
-                        NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+static void
+ngx_http_file_cache_partial_fetch(ngx_http_cache_t *c, off_t length)
+{
+    off_t  start, end, block;
 
-        if (rc == 0) {
-            return fcn;
-        }
+    /*
+     * the range requested from upstream covers the whole blocks
+     * the requested range falls into
+     */
 
-        node = (rc < 0) ? node->left : node->right;
+    block = c->partial_block;
+
+    c->partial = 1;
+
+    if (length != -1) {
+        ngx_http_file_cache_partial_range(c, length, &start, &end);
+
+        c->partial_start = start / block * block;
+        c->partial_end = ngx_min((end + block - 1) / block * block, length);
+
+        return;
     }
 
-    /* not found */
+    if (c->range_start == -1) {
 
-    return NULL;
+        /* the length is not known, a suffix range can't be aligned */
+
+        c->partial_start = -1;
+        c->partial_end = c->range_end;
+
+        return;
+    }
+
+    c->partial_start = c->range_start / block * block;
+
+    if (c->range_end == -1 || c->range_end > NGX_MAX_OFF_T_VALUE - block) {
+        c->partial_end = -1;
+
+    } else {
+        c->partial_end = (c->range_end + block - 1) / block * block;
+    }
 }
 
 
 static void
-ngx_http_file_cache_rbtree_insert_value(ngx_rbtree_node_t *temp,
-    ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel)
+ngx_http_file_cache_partial_range(ngx_http_cache_t *c, off_t length,
+    off_t *start, off_t *end)
 {
-    ngx_rbtree_node_t           **p;
-    ngx_http_file_cache_node_t   *cn, *cnt;
+    /*
+     * range_start is -1 for a suffix range, with range_end
+     * being its length; range_end is -1 if the range is not closed
+     */
 
-    for ( ;; ) {
+    if (c->range_start == -1) {
+        *start = (c->range_end < length) ? length - c->range_end : 0;
+        *end = length;
 
-        if (node->key < temp->key) {
+    } else {
+        *start = c->range_start;
+        *end = (c->range_end == -1 || c->range_end > length)
+               ? length : c->range_end;
+    }
 
-            p = &temp->left;
+    if (*start >= *end) {
 
-        } else if (node->key > temp->key) {
+        /* not satisfiable */
 
-            p = &temp->right;
+        *start = 0;
+        *end = 0;
+    }
+}
 
-        } else { /* node->key == temp->key */
 
-            cn = (ngx_http_file_cache_node_t *) node;
-            cnt = (ngx_http_file_cache_node_t *) temp;
+ngx_int_t
+ngx_http_file_cache_partial_response(ngx_http_request_t *r, off_t start,
+    off_t end, off_t length)
+{
+    off_t              rstart, rend;
+    ngx_http_cache_t  *c;
 
-            p = (ngx_memcmp(cn->key, cnt->key,
-                            NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t))
-                 < 0)
-                    ? &temp->left : &temp->right;
-        }
+    c = r->cache;
 
-        if (*p == sentinel) {
-            break;
-        }
+    ngx_log_debug3(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache partial response: %O-%O/%O",
+                   start, end, length);
 
-        temp = *p;
+    c->partial_start = start;
+    c->partial_end = end;
+    c->partial_length = length;
+
+    ngx_http_file_cache_partial_range(c, length, &rstart, &rend);
+
+    if (rstart < rend && (rstart < start || rend > end)) {
+        return NGX_DECLINED;
     }
 
-    *p = node;
-    node->parent = temp;
-    node->left = sentinel;
-    node->right = sentinel;
-    ngx_rbt_red(node);
+    return NGX_OK;
 }
 
 
-static void
-ngx_http_file_cache_vary(ngx_http_request_t *r, u_char *vary, size_t len,
-    u_char *hash)
+static ngx_int_t
+ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
 {
-    u_char     *p, *last;
-    ngx_str_t   name;
-    ngx_md5_t   md5;
-    u_char      buf[NGX_HTTP_CACHE_VARY_LEN];
+    u_char                        *p;
+    time_t                         now;
+    ssize_t                        n;
+    ngx_str_t                     *key;
+    ngx_int_t                      rc;
+    ngx_uint_t                     i;
+    ngx_http_file_cache_t         *cache;
+    ngx_http_file_cache_header_t  *h;
 
-    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-                   "http file cache vary: \"%*s\"", len, vary);
+    n = ngx_http_file_cache_aio_read(r, c);
 
-    ngx_md5_init(&md5);
-    ngx_md5_update(&md5, r->cache->main, NGX_HTTP_CACHE_KEY_LEN);
+    if (n < 0) {
+        return n;
+    }
 
-    ngx_strlow(buf, vary, len);
+    if ((size_t) n < c->header_start) {
+        ngx_log_error(NGX_LOG_CRIT, r->connection->log, 0,
+                      "cache file \"%s\" is too small", c->file.name.data);
+        return NGX_DECLINED;
+    }
 
-    p = buf;
-    last = buf + len;
+    h = (ngx_http_file_cache_header_t *) c->buf->pos;
 
-    while (p < last) {
+    if (h->version != NGX_HTTP_CACHE_VERSION) {
+        ngx_log_error(NGX_LOG_INFO, r->connection->log, 0,
+                      "cache file \"%s\" version mismatch", c->file.name.data);
+        return NGX_DECLINED;
+    }
 
-        while (p < last && (*p == ' ' || *p == ',')) { p++; }
+    if (h->crc32 != c->crc32 || (size_t) h->header_start != c->header_start) {
+        ngx_log_error(NGX_LOG_CRIT, r->connection->log, 0,
+                      "cache file \"%s\" has md5 collision", c->file.name.data);
+        return NGX_DECLINED;
+    }
 
-        name.data = p;
+    p = c->buf->pos + sizeof(ngx_http_file_cache_header_t)
+        + sizeof(ngx_http_file_cache_key);
 
-        while (p < last && *p != ',' && *p != ' ') { p++; }
+    key = c->keys.elts;
+    for (i = 0; i < c->keys.nelts; i++) {
+        if (ngx_memcmp(p, key[i].data, key[i].len) != 0) {
+            ngx_log_error(NGX_LOG_CRIT, r->connection->log, 0,
+                          "cache file \"%s\" has md5 collision",
+                          c->file.name.data);
+            return NGX_DECLINED;
+        }
 
-        name.len = p - name.data;
+        p += key[i].len;
+    }
 
-        if (name.len == 0) {
-            break;
-        }
+    if ((size_t) h->body_start > c->body_start) {
+        ngx_log_error(NGX_LOG_CRIT, r->connection->log, 0,
+                      "cache file \"%s\" has too long header",
+                      c->file.name.data);
+        return NGX_DECLINED;
+    }
 
-        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-                       "http file cache vary: %V", &name);
+    if (h->vary_len > NGX_HTTP_CACHE_VARY_LEN) {
+        ngx_log_error(NGX_LOG_CRIT, r->connection->log, 0,
+                      "cache file \"%s\" has incorrect vary length",
+                      c->file.name.data);
+        return NGX_DECLINED;
+    }
 
-        ngx_md5_update(&md5, name.data, name.len);
-        ngx_md5_update(&md5, (u_char *) ":", sizeof(":") - 1);
+    if (h->vary_len) {
+        ngx_http_file_cache_vary(r, h->vary, h->vary_len, c->variant);
 
-        ngx_http_file_cache_vary_header(r, &md5, &name);
+        if (ngx_memcmp(c->variant, h->variant, NGX_HTTP_CACHE_KEY_LEN) != 0) {
+            ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                           "http file cache vary mismatch");
 
-        ngx_md5_update(&md5, (u_char *) CRLF, sizeof(CRLF) - 1);
+            if (c->streaming) {
+                return NGX_DECLINED;
+            }
+
+            return ngx_http_file_cache_reopen(r, c);
+        }
     }
 
-    ngx_md5_final(hash, &md5);
-}
+    c->buf->last += n;
 
+    c->valid_sec = h->valid_sec;
+    c->updating_sec = h->updating_sec;
+    c->error_sec = h->error_sec;
+    c->last_modified = h->last_modified;
+    c->date = h->date;
+    c->valid_msec = h->valid_msec;
+    c->body_start = h->body_start;
+    c->etag.len = h->etag_len;
+    c->etag.data = h->etag;
+    c->partial_length = h->partial_length;
 
-static void
-ngx_http_file_cache_vary_header(ngx_http_request_t *r, ngx_md5_t *md5,
-    ngx_str_t *name)
-{
-    size_t            len;
-    u_char           *p, *start, *last;
-    ngx_uint_t        i, multiple, normalize;
-    ngx_list_part_t  *part;
-    ngx_table_elt_t  *header;
+    r->cached = 1;
 
-    multiple = 0;
-    normalize = 0;
+    cache = c->file_cache;
 
-    if (name->len == sizeof("Accept-Charset") - 1
-        && ngx_strncasecmp(name->data, (u_char *) "Accept-Charset",
-                           sizeof("Accept-Charset") - 1) == 0)
-    {
-        normalize = 1;
+    if (cache->sh->cold && !c->streaming) {
 
-    } else if (name->len == sizeof("Accept-Encoding") - 1
-        && ngx_strncasecmp(name->data, (u_char *) "Accept-Encoding",
-                           sizeof("Accept-Encoding") - 1) == 0)
-    {
-        normalize = 1;
+        ngx_shmtx_lock(&cache->shpool->mutex);
 
-    } else if (name->len == sizeof("Accept-Language") - 1
-        && ngx_strncasecmp(name->data, (u_char *) "Accept-Language",
-                           sizeof("Accept-Language") - 1) == 0)
-    {
-        normalize = 1;
+        if (!c->node->exists) {
+            c->node->uses = 1;
+            c->node->body_start = c->body_start;
+            c->node->exists = 1;
+            c->node->uniq = c->uniq;
+            c->node->fs_size = c->fs_size;
+
+            cache->sh->size += c->fs_size;
+        }
+
+        ngx_shmtx_unlock(&cache->shpool->mutex);
     }
 
-    part = &r->headers_in.headers.part;
-    header = part->elts;
+    if (c->partial_length) {
+        return ngx_http_file_cache_partial(r, c, h->partial_block);
+    }
 
-    for (i = 0; /* void */ ; i++) {
+    now = ngx_time();
 
-        if (i >= part->nelts) {
-            if (part->next == NULL) {
-                break;
-            }
+    if (c->valid_sec < now) {
 
-            part = part->next;
-            header = part->elts;
-            i = 0;
+        if (c->encoded) {
+            ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                           "http file cache encoded expired");
+            return NGX_DECLINED;
+        }
+
+        c->stale_updating = c->valid_sec + c->updating_sec >= now;
+        c->stale_error = c->valid_sec + c->error_sec >= now;
+
+        ngx_shmtx_lock(&cache->shpool->mutex);
+
+        if (c->node->updating) {
+            rc = NGX_HTTP_CACHE_UPDATING;
+
+        } else {
+            c->node->updating = 1;
+            c->node->stream_id = 0;
+            c->node->stream_size = 0;
+            c->updating = 1;
+            c->lock_time = c->node->lock_time;
+            rc = NGX_HTTP_CACHE_STALE;
+        }
+
+        ngx_shmtx_unlock(&cache->shpool->mutex);
+
+        ngx_log_debug3(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "http file cache expired: %i %T %T",
+                       rc, c->valid_sec, now);
+
+        return rc;
+    }
+
+    return NGX_OK;
+}
+
+
+static ssize_t
+ngx_http_file_cache_aio_read(ngx_http_request_t *r, ngx_http_cache_t *c)
+{
+#if (NGX_HAVE_FILE_AIO || NGX_THREADS)
+    ssize_t                    n;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+#endif
+
+#if (NGX_HAVE_FILE_AIO)
+
+    if (clcf->aio == NGX_HTTP_AIO_ON && ngx_file_aio) {
+        n = ngx_file_aio_read(&c->file, c->buf->pos, c->body_start, 0, r->pool);
+
+        if (n != NGX_AGAIN) {
+            c->reading = 0;
+            return n;
+        }
+
+        c->reading = 1;
+
+        c->file.aio->data = r;
+        c->file.aio->handler = ngx_http_cache_aio_event_handler;
+
+        ngx_add_timer(&c->file.aio->event, 60000);
+
+        r->main->blocked++;
+        r->aio = 1;
+
+        return NGX_AGAIN;
+    }
+
+#endif
+
+#if (NGX_THREADS)
+
+    if (clcf->aio == NGX_HTTP_AIO_THREADS) {
+        c->file.thread_task = c->thread_task;
+        c->file.thread_handler = ngx_http_cache_thread_handler;
+        c->file.thread_ctx = r;
+
+        n = ngx_thread_read(&c->file, c->buf->pos, c->body_start, 0, r->pool);
+
+        c->thread_task = c->file.thread_task;
+        c->reading = (n == NGX_AGAIN);
+
+        return n;
+    }
+
+#endif
+
+    return ngx_read_file(&c->file, c->buf->pos, c->body_start, 0);
+}
+
+
+#if (NGX_HAVE_FILE_AIO)
+
+static void
+ngx_http_cache_aio_event_handler(ngx_event_t *ev)
+{
+    ngx_event_aio_t     *aio;
+    ngx_connection_t    *c;
+    ngx_http_request_t  *r;
+
+    aio = ev->data;
+    r = aio->data;
+    c = r->connection;
+
+    ngx_http_set_log_request(c->log, r);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http file cache aio: \"%V?%V\"", &r->uri, &r->args);
+
+    if (ev->timedout) {
+        ngx_log_error(NGX_LOG_ALERT, c->log, 0,
+                      "aio operation took too long");
+        ev->timedout = 0;
+        return;
+    }
+
+    if (ev->timer_set) {
+        ngx_del_timer(ev);
+    }
+
+    r->main->blocked--;
+    r->aio = 0;
+
+    if (r->main->terminated) {
+        /*
+         * trigger connection event handler if the request was
+         * terminated
+         */
+
+        c->write->handler(c->write);
+
+    } else {
+        r->write_event_handler(r);
+        ngx_http_run_posted_requests(c);
+    }
+}
+
+#endif
+
+
+#if (NGX_THREADS)
+
+static ngx_int_t
+ngx_http_cache_thread_handler(ngx_thread_task_t *task, ngx_file_t *file)
+{
+    ngx_str_t                  name;
+    ngx_thread_pool_t         *tp;
+    ngx_http_request_t        *r;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    r = file->thread_ctx;
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+    tp = clcf->thread_pool;
+
+    if (tp == NULL) {
+        if (ngx_http_complex_value(r, clcf->thread_pool_value, &name)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+        tp = ngx_thread_pool_get((ngx_cycle_t *) ngx_cycle, &name);
+
+        if (tp == NULL) {
+            ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                          "thread pool \"%V\" not found", &name);
+            return NGX_ERROR;
+        }
+    }
+
+    task->event.data = r;
+    task->event.handler = ngx_http_cache_thread_event_handler;
+
+    if (ngx_thread_task_post(tp, task) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    ngx_add_timer(&task->event, 60000);
+
+    r->main->blocked++;
+    r->aio = 1;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_cache_thread_event_handler(ngx_event_t *ev)
+{
+    ngx_connection_t    *c;
+    ngx_http_request_t  *r;
+
+    r = ev->data;
+    c = r->connection;
+
+    ngx_http_set_log_request(c->log, r);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http file cache thread: \"%V?%V\"", &r->uri, &r->args);
+
+    if (ev->timedout) {
+        ngx_log_error(NGX_LOG_ALERT, c->log, 0,
+                      "thread operation took too long");
+        ev->timedout = 0;
+        return;
+    }
+
+    if (ev->timer_set) {
+        ngx_del_timer(ev);
+    }
+
+    r->main->blocked--;
+    r->aio = 0;
+
+    if (r->main->terminated) {
+        /*
+         * trigger connection event handler if the request was
+         * terminated
+         */
+
+        c->write->handler(c->write);
+
+    } else {
+        r->write_event_handler(r);
+        ngx_http_run_posted_requests(c);
+    }
+}
+
+#endif
+
+
+static ngx_int_t
+ngx_http_file_cache_exists(ngx_http_file_cache_t *cache, ngx_http_cache_t *c)
+{
+    ngx_int_t                    rc;
+    ngx_http_file_cache_node_t  *fcn;
+
+    ngx_shmtx_lock(&cache->shpool->mutex);
+
+    fcn = c->node;
+
+    if (fcn == NULL) {
+        fcn = ngx_http_file_cache_lookup(cache, c->key);
+    }
+
+    if (fcn) {
+        ngx_queue_remove(&fcn->queue);
+
+        if (c->node == NULL) {
+            fcn->uses++;
+            fcn->count++;
+        }
+
+        if (fcn->error) {
+
+            if (fcn->valid_sec < ngx_time()) {
+                goto renew;
+            }
+
+            rc = NGX_OK;
+
+            goto done;
+        }
+
+        if (fcn->exists || fcn->uses >= c->min_uses) {
+
+            c->exists = fcn->exists;
+            if (fcn->body_start && !c->update_variant) {
+                c->body_start = fcn->body_start;
+            }
+
+            rc = NGX_OK;
+
+            goto done;
+        }
+
+        rc = NGX_AGAIN;
+
+        goto done;
+    }
+
+    fcn = ngx_slab_calloc_locked(cache->shpool,
+                                 sizeof(ngx_http_file_cache_node_t));
+    if (fcn == NULL) {
+        ngx_http_file_cache_set_watermark(cache);
+
+        ngx_shmtx_unlock(&cache->shpool->mutex);
+
+        (void) ngx_http_file_cache_forced_expire(cache);
+
+        ngx_shmtx_lock(&cache->shpool->mutex);
+
+        fcn = ngx_slab_calloc_locked(cache->shpool,
+                                     sizeof(ngx_http_file_cache_node_t));
+        if (fcn == NULL) {
+            ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0,
+                          "could not allocate node%s", cache->shpool->log_ctx);
+            rc = NGX_ERROR;
+            goto failed;
+        }
+    }
+
+    cache->sh->count++;
+
+    ngx_memcpy((u_char *) &fcn->node.key, c->key, sizeof(ngx_rbtree_key_t));
+
+    ngx_memcpy(fcn->key, &c->key[sizeof(ngx_rbtree_key_t)],
+               NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+
+    ngx_rbtree_insert(&cache->sh->rbtree, &fcn->node);
+
+    fcn->uses = 1;
+    fcn->count = 1;
+
+renew:
+
+    rc = NGX_DECLINED;
+
+    fcn->valid_msec = 0;
+    fcn->error = 0;
+    fcn->exists = 0;
+    fcn->valid_sec = 0;
+    fcn->uniq = 0;
+    fcn->body_start = 0;
+    fcn->fs_size = 0;
+
+done:
+
+    fcn->expire = ngx_time() + cache->inactive;
+
+    ngx_queue_insert_head(&cache->sh->queue, &fcn->queue);
+
+    c->uniq = fcn->uniq;
+    c->error = fcn->error;
+    c->node = fcn;
+
+failed:
+
+    ngx_shmtx_unlock(&cache->shpool->mutex);
+
+    return rc;
+}
+
+
+static ngx_int_t
+ngx_http_file_cache_name(ngx_http_request_t *r, ngx_path_t *path)
+{
+    ngx_http_cache_t  *c;
+
+    c = r->cache;
+
+    if (c->file.name.len) {
+        return NGX_OK;
+    }
+
+    if (ngx_http_file_cache_key_name(r->pool, path, c->key, &c->file.name)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "cache file: \"%s\"", c->file.name.data);
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_file_cache_key_name(ngx_pool_t *pool, ngx_path_t *path, u_char *key,
+    ngx_str_t *name)
+{
+    u_char  *p;
+
+    name->len = path->name.len + 1 + path->len + 2 * NGX_HTTP_CACHE_KEY_LEN;
+
+    name->data = ngx_pnalloc(pool, name->len + 1);
+    if (name->data == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_memcpy(name->data, path->name.data, path->name.len);
+
+    p = name->data + path->name.len + 1 + path->len;
+    p = ngx_hex_dump(p, key, NGX_HTTP_CACHE_KEY_LEN);
+    *p = '\0';
+
+    ngx_create_hashed_filename(path, name->data, name->len);
+
+    return NGX_OK;
+}
+
+
+static ngx_http_file_cache_node_t *
+ngx_http_file_cache_lookup(ngx_http_file_cache_t *cache, u_char *key)
+{
+    ngx_int_t                    rc;
+    ngx_rbtree_key_t             node_key;
+    ngx_rbtree_node_t           *node, *sentinel;
+    ngx_http_file_cache_node_t  *fcn;
+
+    ngx_memcpy((u_char *) &node_key, key, sizeof(ngx_rbtree_key_t));
+
+    node = cache->sh->rbtree.root;
+    sentinel = cache->sh->rbtree.sentinel;
+
+    while (node != sentinel) {
+
+        if (node_key < node->key) {
+            node = node->left;
+            continue;
+        }
+
+        if (node_key > node->key) {
+            node = node->right;
+            continue;
+        }
+
+        /* node_key == node->key */
+
+        fcn = (ngx_http_file_cache_node_t *) node;
+
+        rc = ngx_memcmp(&key[sizeof(ngx_rbtree_key_t)], fcn->key,
+                        NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+
+        if (rc == 0) {
+            return fcn;
+        }
+
+        node = (rc < 0) ? node->left : node->right;
+    }
+
+    /* not found */
+
+    return NULL;
+}
+
+
+static void
+ngx_http_file_cache_rbtree_insert_value(ngx_rbtree_node_t *temp,
+    ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel)
+{
+    ngx_rbtree_node_t           **p;
+    ngx_http_file_cache_node_t   *cn, *cnt;
+
+    for ( ;; ) {
+
+        if (node->key < temp->key) {
+
+            p = &temp->left;
+
+        } else if (node->key > temp->key) {
+
+            p = &temp->right;
+
+        } else { /* node->key == temp->key */
+
+            cn = (ngx_http_file_cache_node_t *) node;
+            cnt = (ngx_http_file_cache_node_t *) temp;
+
+            p = (ngx_memcmp(cn->key, cnt->key,
+                            NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t))
+                 < 0)
+                    ? &temp->left : &temp->right;
+        }
+
+        if (*p == sentinel) {
+            break;
+        }
+
+        temp = *p;
+    }
+
+    *p = node;
+    node->parent = temp;
+    node->left = sentinel;
+    node->right = sentinel;
+    ngx_rbt_red(node);
+}
+
+
+static void
+ngx_http_file_cache_vary(ngx_http_request_t *r, u_char *vary, size_t len,
+    u_char *hash)
+{
+    u_char     *p, *last;
+    ngx_str_t   name;
+    ngx_md5_t   md5;
+    u_char      buf[NGX_HTTP_CACHE_VARY_LEN];
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache vary: \"%*s\"", len, vary);
+
+    ngx_md5_init(&md5);
+    ngx_md5_update(&md5, r->cache->main, NGX_HTTP_CACHE_KEY_LEN);
+
+    ngx_strlow(buf, vary, len);
+
+    p = buf;
+    last = buf + len;
+
+    while (p < last) {
+
+        while (p < last && (*p == ' ' || *p == ',')) { p++; }
+
+        name.data = p;
+
+        while (p < last && *p != ',' && *p != ' ') { p++; }
+
+        name.len = p - name.data;
+
+        if (name.len == 0) {
+            break;
+        }
+
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "http file cache vary: %V", &name);
+
+        ngx_md5_update(&md5, name.data, name.len);
+        ngx_md5_update(&md5, (u_char *) ":", sizeof(":") - 1);
+
+        ngx_http_file_cache_vary_header(r, &md5, &name);
+
+        ngx_md5_update(&md5, (u_char *) CRLF, sizeof(CRLF) - 1);
+    }
+
+    ngx_md5_final(hash, &md5);
+}
+
+
+static void
+ngx_http_file_cache_vary_header(ngx_http_request_t *r, ngx_md5_t *md5,
+    ngx_str_t *name)
+{
+    size_t            len;
+    u_char           *p, *start, *last;
+    ngx_uint_t        i, multiple, normalize;
+    ngx_list_part_t  *part;
+    ngx_table_elt_t  *header;
+
+    multiple = 0;
+    normalize = 0;
+
+    if (name->len == sizeof("Accept-Charset") - 1
+        && ngx_strncasecmp(name->data, (u_char *) "Accept-Charset",
+                           sizeof("Accept-Charset") - 1) == 0)
+    {
+        normalize = 1;
+
+    } else if (name->len == sizeof("Accept-Encoding") - 1
+        && ngx_strncasecmp(name->data, (u_char *) "Accept-Encoding",
+                           sizeof("Accept-Encoding") - 1) == 0)
+    {
+        normalize = 1;
+
+    } else if (name->len == sizeof("Accept-Language") - 1
+        && ngx_strncasecmp(name->data, (u_char *) "Accept-Language",
+                           sizeof("Accept-Language") - 1) == 0)
+    {
+        normalize = 1;
+    }
+
+    part = &r->headers_in.headers.part;
+    header = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+
+            part = part->next;
+            header = part->elts;
+            i = 0;
+        }
+
+        if (header[i].hash == 0) {
+            continue;
+        }
+
+        if (header[i].key.len != name->len) {
+            continue;
+        }
+
+        if (ngx_strncasecmp(header[i].key.data, name->data, name->len) != 0) {
+            continue;
+        }
+
+        if (!normalize) {
+
+            if (multiple) {
+                ngx_md5_update(md5, (u_char *) ",", sizeof(",") - 1);
+            }
+
+            ngx_md5_update(md5, header[i].value.data, header[i].value.len);
+
+            multiple = 1;
+
+            continue;
+        }
+
+        /* normalize spaces */
+
+        p = header[i].value.data;
+        last = p + header[i].value.len;
+
+        while (p < last) {
+
+            while (p < last && (*p == ' ' || *p == ',')) { p++; }
+
+            start = p;
+
+            while (p < last && *p != ',' && *p != ' ') { p++; }
+
+            len = p - start;
+
+            if (len == 0) {
+                break;
+            }
+
+            if (multiple) {
+                ngx_md5_update(md5, (u_char *) ",", sizeof(",") - 1);
+            }
+
+            ngx_md5_update(md5, start, len);
+
+            multiple = 1;
+        }
+    }
+}
+
+
+static ngx_int_t
+ngx_http_file_cache_reopen(ngx_http_request_t *r, ngx_http_cache_t *c)
+{
+    ngx_http_file_cache_t  *cache;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->file.log, 0,
+                   "http file cache reopen");
+
+    if (c->secondary) {
+        ngx_log_error(NGX_LOG_CRIT, r->connection->log, 0,
+                      "cache file \"%s\" has incorrect vary hash",
+                      c->file.name.data);
+        return NGX_DECLINED;
+    }
+
+    cache = c->file_cache;
+
+    ngx_shmtx_lock(&cache->shpool->mutex);
+
+    c->node->count--;
+    c->node = NULL;
+
+    ngx_shmtx_unlock(&cache->shpool->mutex);
+
+    c->secondary = 1;
+    c->file.name.len = 0;
+    c->body_start = c->buffer_size;
+
+    ngx_memcpy(c->key, c->variant, NGX_HTTP_CACHE_KEY_LEN);
+
+    return ngx_http_file_cache_open(r);
+}
+
+
+#if (NGX_HTTP_GZIP)
+
+static ngx_int_t
+ngx_http_file_cache_encoded(ngx_http_request_t *r, ngx_http_cache_t *c)
+{
+    u_char                       key[NGX_HTTP_CACHE_KEY_LEN];
+    ngx_http_file_cache_t       *cache;
+    ngx_http_file_cache_node_t  *fcn;
+
+    ngx_http_file_cache_encoded_key(r, &c->encoding, key);
+
+    cache = c->file_cache;
+
+    ngx_shmtx_lock(&cache->shpool->mutex);
+
+    fcn = ngx_http_file_cache_lookup(cache, key);
+
+    if (fcn == NULL || !fcn->exists) {
+        ngx_shmtx_unlock(&cache->shpool->mutex);
+
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "http file cache no \"%V\" variant", &c->encoding);
+
+        c->encoding.len = 0;
+
+        return NGX_DECLINED;
+    }
+
+    /*
+     * the encoded variant is only used if it is already cached;
+     * the node is referenced here so it can't go away before the file
+     * is opened, and ngx_http_file_cache_exists() won't create a new one
+     */
+
+    fcn->uses++;
+    fcn->count++;
+
+    ngx_shmtx_unlock(&cache->shpool->mutex);
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache \"%V\" variant", &c->encoding);
+
+    c->node = fcn;
+    c->encoded = 1;
+
+    ngx_memcpy(c->key, key, NGX_HTTP_CACHE_KEY_LEN);
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_file_cache_encoded_key(ngx_http_request_t *r, ngx_str_t *encoding,
+    u_char *key)
+{
+    ngx_md5_t  md5;
+
+    /* LF can't appear in the Vary header names used for the variant hash */
+
+    ngx_md5_init(&md5);
+    ngx_md5_update(&md5, r->cache->main, NGX_HTTP_CACHE_KEY_LEN);
+    ngx_md5_update(&md5, (u_char *) "\nContent-Encoding: ",
+                   sizeof("\nContent-Encoding: ") - 1);
+    ngx_md5_update(&md5, encoding->data, encoding->len);
+    ngx_md5_final(key, &md5);
+}
+
+
+static ngx_int_t
+ngx_http_file_cache_reopen_main(ngx_http_request_t *r, ngx_http_cache_t *c)
+{
+    ngx_http_file_cache_t  *cache;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->file.log, 0,
+                   "http file cache reopen main");
+
+    cache = c->file_cache;
+
+    ngx_shmtx_lock(&cache->shpool->mutex);
+
+    c->node->count--;
+    c->node = NULL;
+
+    ngx_shmtx_unlock(&cache->shpool->mutex);
+
+    r->cached = 0;
+
+    c->encoded = 0;
+    c->encoding.len = 0;
+    c->exists = 0;
+    c->file.name.len = 0;
+    c->body_start = c->buffer_size;
+
+    ngx_memcpy(c->key, c->main, NGX_HTTP_CACHE_KEY_LEN);
+
+    return ngx_http_file_cache_open(r);
+}
+
+#endif
+
+
+ngx_int_t
+ngx_http_file_cache_set_header(ngx_http_request_t *r, u_char *buf)
+{
+    ngx_http_file_cache_header_t  *h = (ngx_http_file_cache_header_t *) buf;
+
+    u_char            *p;
+    ngx_str_t         *key;
+    ngx_uint_t         i;
+    ngx_http_cache_t  *c;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache set header");
+
+    c = r->cache;
+
+    ngx_memzero(h, sizeof(ngx_http_file_cache_header_t));
+
+    h->version = NGX_HTTP_CACHE_VERSION;
+    h->valid_sec = c->valid_sec;
+    h->updating_sec = c->updating_sec;
+    h->error_sec = c->error_sec;
+    h->last_modified = c->last_modified;
+    h->date = c->date;
+    h->crc32 = c->crc32;
+    h->valid_msec = (u_short) c->valid_msec;
+    h->header_start = (u_short) c->header_start;
+    h->body_start = (u_short) c->body_start;
+
+    if (c->partial_length) {
+        h->partial_length = c->partial_length;
+        h->partial_block = c->partial_block;
+    }
+
+    if (c->etag.len <= NGX_HTTP_CACHE_ETAG_LEN) {
+        h->etag_len = (u_char) c->etag.len;
+        ngx_memcpy(h->etag, c->etag.data, c->etag.len);
+    }
+
+    if (c->vary.len) {
+        if (c->vary.len > NGX_HTTP_CACHE_VARY_LEN) {
+            /* should not happen */
+            c->vary.len = NGX_HTTP_CACHE_VARY_LEN;
+        }
+
+        h->vary_len = (u_char) c->vary.len;
+        ngx_memcpy(h->vary, c->vary.data, c->vary.len);
+
+        ngx_http_file_cache_vary(r, c->vary.data, c->vary.len, c->variant);
+        ngx_memcpy(h->variant, c->variant, NGX_HTTP_CACHE_KEY_LEN);
+    }
+
+    if (ngx_http_file_cache_update_variant(r, c) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    p = buf + sizeof(ngx_http_file_cache_header_t);
+
+    p = ngx_cpymem(p, ngx_http_file_cache_key, sizeof(ngx_http_file_cache_key));
+
+    key = c->keys.elts;
+    for (i = 0; i < c->keys.nelts; i++) {
+        p = ngx_copy(p, key[i].data, key[i].len);
+    }
+
+    *p = LF;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_file_cache_update_variant(ngx_http_request_t *r, ngx_http_cache_t *c)
+{
+    ngx_uint_t                   waiters;
+    ngx_http_file_cache_t       *cache;
+    ngx_http_file_cache_node_t  *fcn;
+
+    if (!c->secondary) {
+        return NGX_OK;
+    }
+
+    if (c->vary.len
+        && ngx_memcmp(c->variant, c->key, NGX_HTTP_CACHE_KEY_LEN) == 0)
+    {
+        return NGX_OK;
+    }
+
+    /*
+     * if the variant hash doesn't match one we used as a secondary
+     * cache key, switch back to the original key
+     */
+
+    cache = c->file_cache;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache main key");
+
+    ngx_shmtx_lock(&cache->shpool->mutex);
+
+    fcn = c->node;
+    waiters = fcn->updating && fcn->waiters;
+
+    fcn->count--;
+    fcn->updating = 0;
+    fcn->waiters = 0;
+    fcn->stream_id = 0;
+    c->node = NULL;
+
+    ngx_shmtx_unlock(&cache->shpool->mutex);
+
+    if (waiters) {
+        ngx_http_file_cache_lock_release(fcn);
+    }
+
+    c->file.name.len = 0;
+    c->update_variant = 1;
+
+    ngx_memcpy(c->key, c->main, NGX_HTTP_CACHE_KEY_LEN);
+
+    if (ngx_http_file_cache_exists(cache, c) == NGX_ERROR) {
+        return NGX_ERROR;
+    }
+
+    if (ngx_http_file_cache_name(r, cache->path) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+
+void
+ngx_http_file_cache_update(ngx_http_request_t *r, ngx_temp_file_t *tf)
+{
+    off_t                        fs_size;
+    ngx_int_t                    rc;
+    ngx_uint_t                   waiters;
+    ngx_file_uniq_t              uniq;
+    ngx_file_info_t              fi;
+    ngx_http_cache_t            *c;
+    ngx_ext_rename_file_t        ext;
+    ngx_http_file_cache_t       *cache;
+    ngx_http_file_cache_node_t  *fcn;
+
+    c = r->cache;
+
+    if (c->updated) {
+        return;
+    }
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache update");
+
+    cache = c->file_cache;
+
+    c->updated = 1;
+    c->updating = 0;
+
+    if (c->partial_length) {
+        ngx_http_file_cache_update_partial(r, tf);
+        return;
+    }
+
+    uniq = 0;
+    fs_size = 0;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache rename: \"%s\" to \"%s\"",
+                   tf->file.name.data, c->file.name.data);
+
+    ext.access = NGX_FILE_OWNER_ACCESS;
+    ext.path_access = NGX_FILE_OWNER_ACCESS;
+    ext.time = -1;
+    ext.create_path = 1;
+    ext.delete_file = 1;
+    ext.log = r->connection->log;
+
+    rc = ngx_ext_rename_file(&tf->file.name, &c->file.name, &ext);
+
+    if (rc == NGX_OK) {
+
+        if (ngx_fd_info(tf->file.fd, &fi) == NGX_FILE_ERROR) {
+            ngx_log_error(NGX_LOG_CRIT, r->connection->log, ngx_errno,
+                          ngx_fd_info_n " \"%s\" failed", tf->file.name.data);
+
+            rc = NGX_ERROR;
+
+        } else {
+            uniq = ngx_file_uniq(&fi);
+            fs_size = (ngx_file_fs_size(&fi) + cache->bsize - 1) / cache->bsize;
+        }
+    }
+
+    ngx_shmtx_lock(&cache->shpool->mutex);
+
+    c->node->count--;
+    c->node->error = 0;
+    c->node->uniq = uniq;
+    c->node->body_start = c->body_start;
+
+    cache->sh->size += fs_size - c->node->fs_size;
+    c->node->fs_size = fs_size;
+
+    if (rc == NGX_OK) {
+        c->node->exists = 1;
+
+#if (NGX_API)
+        {
+        ngx_http_cache_stats_t  *stats;
+
+        stats = &cache->sh->stats[r->upstream->cache_status - 1];
+
+        stats->responses_written++;
+        stats->bytes_written += ngx_file_size(&fi) - c->body_start;
         }
+#endif
+    }
 
-        if (header[i].hash == 0) {
-            continue;
-        }
+    fcn = c->node;
+    waiters = fcn->waiters;
 
-        if (header[i].key.len != name->len) {
-            continue;
-        }
+    fcn->updating = 0;
+    fcn->waiters = 0;
+    fcn->stream_id = 0;
 
-        if (ngx_strncasecmp(header[i].key.data, name->data, name->len) != 0) {
-            continue;
-        }
+    ngx_shmtx_unlock(&cache->shpool->mutex);
 
-        if (!normalize) {
+    if (waiters) {
+        ngx_http_file_cache_lock_release(fcn);
+    }
+}
 
-            if (multiple) {
-                ngx_md5_update(md5, (u_char *) ",", sizeof(",") - 1);
-            }
 
-            ngx_md5_update(md5, header[i].value.data, header[i].value.len);
+static void
+ngx_http_file_cache_update_partial(ngx_http_request_t *r, ngx_temp_file_t *tf)
+{
+    off_t                   fs_size;
+    ngx_int_t               rc;
+    ngx_file_info_t         fi;
+    ngx_http_cache_t       *c;
+    ngx_http_file_cache_t  *cache;
 
-            multiple = 1;
+    c = r->cache;
+    cache = c->file_cache;
 
-            continue;
-        }
+    ngx_log_debug3(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache update partial: %O-%O/%O",
+                   c->partial_start, c->partial_end, c->partial_length);
 
-        /* normalize spaces */
+    /*
+     * the received blocks are added to the cached response
+     * if it is the same one, otherwise the cached response is replaced
+     */
 
-        p = header[i].value.data;
-        last = p + header[i].value.len;
+    rc = ngx_http_file_cache_partial_merge(r, tf, &fi);
 
-        while (p < last) {
+    if (rc == NGX_DECLINED) {
+        rc = ngx_http_file_cache_partial_create(r, tf, &fi);
+    }
 
-            while (p < last && (*p == ' ' || *p == ',')) { p++; }
+    fs_size = 0;
 
-            start = p;
+    if (rc == NGX_OK) {
+        fs_size = (ngx_file_sparse_fs_size(&fi) + cache->bsize - 1)
+                  / cache->bsize;
+    }
 
-            while (p < last && *p != ',' && *p != ' ') { p++; }
+    ngx_shmtx_lock(&cache->shpool->mutex);
 
-            len = p - start;
+    c->node->count--;
 
-            if (len == 0) {
-                break;
-            }
+    if (rc == NGX_OK) {
+        c->node->error = 0;
+        c->node->exists = 1;
+        c->node->uniq = ngx_file_uniq(&fi);
+        c->node->body_start = c->body_start;
 
-            if (multiple) {
-                ngx_md5_update(md5, (u_char *) ",", sizeof(",") - 1);
-            }
+        cache->sh->size += fs_size - c->node->fs_size;
+        c->node->fs_size = fs_size;
 
-            ngx_md5_update(md5, start, len);
+#if (NGX_API)
+        {
+        ngx_http_cache_stats_t  *stats;
 
-            multiple = 1;
+        stats = &cache->sh->stats[r->upstream->cache_status - 1];
+
+        stats->responses_written++;
+        stats->bytes_written += c->partial_end - c->partial_start;
         }
+#endif
     }
+
+    ngx_shmtx_unlock(&cache->shpool->mutex);
 }
 
 
 static ngx_int_t
-ngx_http_file_cache_reopen(ngx_http_request_t *r, ngx_http_cache_t *c)
+ngx_http_file_cache_partial_merge(ngx_http_request_t *r, ngx_temp_file_t *tf,
+    ngx_file_info_t *fi)
 {
-    ngx_http_file_cache_t  *cache;
+    size_t                         len;
+    ssize_t                        n;
+    ngx_int_t                      rc;
+    ngx_err_t                      err;
+    ngx_file_t                     file;
+    ngx_http_cache_t              *c;
+    ngx_http_file_cache_header_t   h;
 
-    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->file.log, 0,
-                   "http file cache reopen");
+    c = r->cache;
+
+    ngx_memzero(&file, sizeof(ngx_file_t));
+
+    file.name = c->file.name;
+    file.log = r->connection->log;
+    file.fd = ngx_open_file(file.name.data, NGX_FILE_RDWR, NGX_FILE_OPEN, 0);
+
+    if (file.fd == NGX_INVALID_FILE) {
+        err = ngx_errno;
+
+        if (err != NGX_ENOENT && err != NGX_ENOTDIR) {
+            ngx_log_error(NGX_LOG_CRIT, r->connection->log, err,
+                          ngx_open_file_n " \"%s\" failed", file.name.data);
+        }
 
-    if (c->secondary) {
-        ngx_log_error(NGX_LOG_CRIT, r->connection->log, 0,
-                      "cache file \"%s\" has incorrect vary hash",
-                      c->file.name.data);
         return NGX_DECLINED;
     }
 
-    cache = c->file_cache;
+    rc = NGX_DECLINED;
 
-    ngx_shmtx_lock(&cache->shpool->mutex);
+    n = ngx_read_file(&file, (u_char *) &h,
+                      sizeof(ngx_http_file_cache_header_t), 0);
 
-    c->node->count--;
-    c->node = NULL;
+    if (n == NGX_ERROR) {
+        goto done;
+    }
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
+    len = (c->etag.len <= NGX_HTTP_CACHE_ETAG_LEN) ? c->etag.len : 0;
 
-    c->secondary = 1;
-    c->file.name.len = 0;
-    c->body_start = c->buffer_size;
+    if ((size_t) n != sizeof(ngx_http_file_cache_header_t)
+        || h.version != NGX_HTTP_CACHE_VERSION
+        || h.valid_sec < ngx_time()
+        || h.crc32 != c->crc32
+        || (size_t) h.header_start != c->header_start
+        || h.partial_length != c->partial_length
+        || h.partial_block != c->partial_block
+        || h.last_modified != c->last_modified
+        || h.etag_len != len
+        || ngx_memcmp(h.etag, c->etag.data, len) != 0
+        || h.vary_len != c->vary.len
+        || (c->vary.len
+            && ngx_memcmp(h.variant, c->variant, NGX_HTTP_CACHE_KEY_LEN) != 0))
+    {
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "http file cache \"%s\" partial mismatch",
+                       file.name.data);
+        goto done;
+    }
 
-    ngx_memcpy(c->key, c->variant, NGX_HTTP_CACHE_KEY_LEN);
+    rc = ngx_http_file_cache_partial_copy(r, &tf->file, &file, h.body_start,
+                                          1);
+    if (rc != NGX_OK) {
+        goto done;
+    }
 
-    return ngx_http_file_cache_open(r);
-}
+    if (ngx_fd_info(file.fd, fi) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, r->connection->log, ngx_errno,
+                      ngx_fd_info_n " \"%s\" failed", file.name.data);
+        rc = NGX_ERROR;
+        goto done;
+    }
 
+    c->body_start = h.body_start;
 
-ngx_int_t
-ngx_http_file_cache_set_header(ngx_http_request_t *r, u_char *buf)
-{
-    ngx_http_file_cache_header_t  *h = (ngx_http_file_cache_header_t *) buf;
+done:
 
-    u_char            *p;
-    ngx_str_t         *key;
-    ngx_uint_t         i;
-    ngx_http_cache_t  *c;
+    if (ngx_close_file(file.fd) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, r->connection->log, ngx_errno,
+                      ngx_close_file_n " \"%s\" failed", file.name.data);
+    }
 
-    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-                   "http file cache set header");
+    if (rc != NGX_DECLINED) {
+        if (ngx_delete_file(tf->file.name.data) == NGX_FILE_ERROR) {
+            ngx_log_error(NGX_LOG_CRIT, r->connection->log, ngx_errno,
+                          ngx_delete_file_n " \"%s\" failed",
+                          tf->file.name.data);
+        }
+    }
 
-    c = r->cache;
+    return rc;
+}
 
-    ngx_memzero(h, sizeof(ngx_http_file_cache_header_t));
 
-    h->version = NGX_HTTP_CACHE_VERSION;
-    h->valid_sec = c->valid_sec;
-    h->updating_sec = c->updating_sec;
-    h->error_sec = c->error_sec;
-    h->last_modified = c->last_modified;
-    h->date = c->date;
-    h->crc32 = c->crc32;
-    h->valid_msec = (u_short) c->valid_msec;
-    h->header_start = (u_short) c->header_start;
-    h->body_start = (u_short) c->body_start;
+static ngx_int_t
+ngx_http_file_cache_partial_create(ngx_http_request_t *r, ngx_temp_file_t *tf,
+    ngx_file_info_t *fi)
+{
+    ngx_int_t               rc;
+    ngx_http_cache_t       *c;
+    ngx_ext_rename_file_t   ext;
 
-    if (c->etag.len <= NGX_HTTP_CACHE_ETAG_LEN) {
-        h->etag_len = (u_char) c->etag.len;
-        ngx_memcpy(h->etag, c->etag.data, c->etag.len);
-    }
+    c = r->cache;
 
-    if (c->vary.len) {
-        if (c->vary.len > NGX_HTTP_CACHE_VARY_LEN) {
-            /* should not happen */
-            c->vary.len = NGX_HTTP_CACHE_VARY_LEN;
-        }
+    /* the received blocks are already in place */
 
-        h->vary_len = (u_char) c->vary.len;
-        ngx_memcpy(h->vary, c->vary.data, c->vary.len);
+    rc = ngx_http_file_cache_partial_copy(r, &tf->file, &tf->file,
+                                          c->body_start, 0);
 
-        ngx_http_file_cache_vary(r, c->vary.data, c->vary.len, c->variant);
-        ngx_memcpy(h->variant, c->variant, NGX_HTTP_CACHE_KEY_LEN);
-    }
+    if (rc != NGX_OK) {
+        if (ngx_delete_file(tf->file.name.data) == NGX_FILE_ERROR) {
+            ngx_log_error(NGX_LOG_CRIT, r->connection->log, ngx_errno,
+                          ngx_delete_file_n " \"%s\" failed",
+                          tf->file.name.data);
+        }
 
-    if (ngx_http_file_cache_update_variant(r, c) != NGX_OK) {
         return NGX_ERROR;
     }
 
-    p = buf + sizeof(ngx_http_file_cache_header_t);
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache rename: \"%s\" to \"%s\"",
+                   tf->file.name.data, c->file.name.data);
 
-    p = ngx_cpymem(p, ngx_http_file_cache_key, sizeof(ngx_http_file_cache_key));
+    ext.access = NGX_FILE_OWNER_ACCESS;
+    ext.path_access = NGX_FILE_OWNER_ACCESS;
+    ext.time = -1;
+    ext.create_path = 1;
+    ext.delete_file = 1;
+    ext.log = r->connection->log;
 
-    key = c->keys.elts;
-    for (i = 0; i < c->keys.nelts; i++) {
-        p = ngx_copy(p, key[i].data, key[i].len);
+    if (ngx_ext_rename_file(&tf->file.name, &c->file.name, &ext) != NGX_OK) {
+        return NGX_ERROR;
     }
 
-    *p = LF;
+    if (ngx_fd_info(tf->file.fd, fi) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, r->connection->log, ngx_errno,
+                      ngx_fd_info_n " \"%s\" failed", c->file.name.data);
+        return NGX_ERROR;
+    }
 
     return NGX_OK;
 }
 
 
 static ngx_int_t
-ngx_http_file_cache_update_variant(ngx_http_request_t *r, ngx_http_cache_t *c)
+ngx_http_file_cache_partial_copy(ngx_http_request_t *r, ngx_file_t *src,
+    ngx_file_t *dst, size_t body_start, ngx_uint_t merge)
 {
-    ngx_http_file_cache_t  *cache;
+    off_t              i, j, n, first, last, block, start, end, offset;
+    u_char            *buf;
+    ssize_t            rc;
+    ngx_http_cache_t  *c;
+    u_char             map[1024];
 
-    if (!c->secondary) {
-        return NGX_OK;
+    c = r->cache;
+    block = c->partial_block;
+
+    /* only the blocks received completely are stored */
+
+    first = (c->partial_start + block - 1) / block;
+
+    if (c->partial_end == c->partial_length) {
+        last = (c->partial_length + block - 1) / block;
+
+    } else {
+        last = c->partial_end / block;
     }
 
-    if (c->vary.len
-        && ngx_memcmp(c->variant, c->key, NGX_HTTP_CACHE_KEY_LEN) == 0)
-    {
-        return NGX_OK;
+    if (first >= last) {
+        ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "http file cache partial no blocks");
+        return NGX_DECLINED;
     }
 
-    /*
-     * if the variant hash doesn't match one we used as a secondary
-     * cache key, switch back to the original key
-     */
+    buf = NULL;
+    offset = body_start + c->partial_length;
 
-    cache = c->file_cache;
+    while (first < last) {
+        n = ngx_min(last - first, (off_t) sizeof(map));
 
-    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-                   "http file cache main key");
+        if (merge) {
+            rc = ngx_read_file(dst, map, (size_t) n, offset + first);
 
-    ngx_shmtx_lock(&cache->shpool->mutex);
+            if (rc == NGX_ERROR) {
+                goto failed;
+            }
 
-    c->node->count--;
-    c->node->updating = 0;
-    c->node = NULL;
+            /* blocks after the end of the file are not present yet */
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
+            ngx_memzero(map + rc, (size_t) (n - rc));
 
-    c->file.name.len = 0;
-    c->update_variant = 1;
+        } else {
+            ngx_memzero(map, (size_t) n);
+        }
 
-    ngx_memcpy(c->key, c->main, NGX_HTTP_CACHE_KEY_LEN);
+        for (i = 0; i < n; i = j) {
 
-    if (ngx_http_file_cache_exists(cache, c) == NGX_ERROR) {
-        return NGX_ERROR;
-    }
+            if (map[i]) {
+                j = i + 1;
+                continue;
+            }
 
-    if (ngx_http_file_cache_name(r, cache->path) != NGX_OK) {
-        return NGX_ERROR;
-    }
+            for (j = i; j < n && map[j] == 0; j++) { /* void */ }
 
-    return NGX_OK;
-}
+            start = (first + i) * block;
+            end = ngx_min((first + j) * block, c->partial_length);
 
+            ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                           "http file cache partial store: %O-%O",
+                           start, end);
 
-void
-ngx_http_file_cache_update(ngx_http_request_t *r, ngx_temp_file_t *tf)
-{
-    off_t                   fs_size;
-    ngx_int_t               rc;
-    ngx_file_uniq_t         uniq;
-    ngx_file_info_t         fi;
-    ngx_http_cache_t        *c;
-    ngx_ext_rename_file_t   ext;
-    ngx_http_file_cache_t  *cache;
+            if (src != dst
+                && ngx_http_file_cache_partial_store(r, src,
+                                                     c->body_start + start,
+                                                     dst, body_start + start,
+                                                     end - start, &buf)
+                   != NGX_OK)
+            {
+                goto failed;
+            }
 
-    c = r->cache;
+            ngx_memset(map + i, 1, (size_t) (j - i));
+
+            if (ngx_write_file(dst, map + i, (size_t) (j - i),
+                               offset + first + i)
+                == NGX_ERROR)
+            {
+                goto failed;
+            }
+        }
+
+        first += n;
+    }
 
-    if (c->updated) {
-        return;
+    if (buf) {
+        ngx_free(buf);
     }
 
-    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-                   "http file cache update");
+    return NGX_OK;
 
-    cache = c->file_cache;
+failed:
 
-    c->updated = 1;
-    c->updating = 0;
+    if (buf) {
+        ngx_free(buf);
+    }
 
-    uniq = 0;
-    fs_size = 0;
+    return NGX_ERROR;
+}
 
-    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-                   "http file cache rename: \"%s\" to \"%s\"",
-                   tf->file.name.data, c->file.name.data);
 
-    ext.access = NGX_FILE_OWNER_ACCESS;
-    ext.path_access = NGX_FILE_OWNER_ACCESS;
-    ext.time = -1;
-    ext.create_path = 1;
-    ext.delete_file = 1;
-    ext.log = r->connection->log;
+static ngx_int_t
+ngx_http_file_cache_partial_store(ngx_http_request_t *r, ngx_file_t *src,
+    off_t src_offset, ngx_file_t *dst, off_t dst_offset, off_t size,
+    u_char **buf)
+{
+    size_t   len, bsize;
+    ssize_t  n;
 
-    rc = ngx_ext_rename_file(&tf->file.name, &c->file.name, &ext);
+    bsize = 65536;
 
-    if (rc == NGX_OK) {
+#if (NGX_HAVE_COPY_FILE_RANGE)
 
-        if (ngx_fd_info(tf->file.fd, &fi) == NGX_FILE_ERROR) {
-            ngx_log_error(NGX_LOG_CRIT, r->connection->log, ngx_errno,
-                          ngx_fd_info_n " \"%s\" failed", tf->file.name.data);
+    /*
+     * the data are copied by the kernel where possible,
+     * the buffer is only allocated once copy_file_range() is declined
+     */
 
-            rc = NGX_ERROR;
+    if (*buf == NULL) {
+        n = ngx_copy_file_range(src, src_offset, dst, dst_offset,
+                                (size_t) size);
 
-        } else {
-            uniq = ngx_file_uniq(&fi);
-            fs_size = (ngx_file_fs_size(&fi) + cache->bsize - 1) / cache->bsize;
+        if (n == NGX_ERROR) {
+            return NGX_ERROR;
+        }
+
+        if (n != NGX_DECLINED) {
+            if (n != size) {
+                ngx_log_error(NGX_LOG_CRIT, r->connection->log, 0,
+                              ngx_copy_file_range_n " copied only %z of %O "
+                              "from \"%s\"", n, size, src->name.data);
+                return NGX_ERROR;
+            }
+
+            return NGX_OK;
         }
     }
 
-    ngx_shmtx_lock(&cache->shpool->mutex);
+#endif
 
-    c->node->count--;
-    c->node->error = 0;
-    c->node->uniq = uniq;
-    c->node->body_start = c->body_start;
+    if (*buf == NULL) {
+        *buf = ngx_alloc(bsize, r->connection->log);
+        if (*buf == NULL) {
+            return NGX_ERROR;
+        }
+    }
 
-    cache->sh->size += fs_size - c->node->fs_size;
-    c->node->fs_size = fs_size;
+    while (size) {
+        len = (size_t) ngx_min(size, (off_t) bsize);
 
-    if (rc == NGX_OK) {
-        c->node->exists = 1;
+        n = ngx_read_file(src, *buf, len, src_offset);
 
-#if (NGX_API)
-        {
-        ngx_http_cache_stats_t  *stats;
+        if (n == NGX_ERROR) {
+            return NGX_ERROR;
+        }
 
-        stats = &cache->sh->stats[r->upstream->cache_status - 1];
+        if ((size_t) n != len) {
+            ngx_log_error(NGX_LOG_CRIT, r->connection->log, 0,
+                          ngx_read_file_n " read only %z of %uz from \"%s\"",
+                          n, len, src->name.data);
+            return NGX_ERROR;
+        }
 
-        stats->responses_written++;
-        stats->bytes_written += ngx_file_size(&fi) - c->body_start;
+        if (ngx_write_file(dst, *buf, len, dst_offset) == NGX_ERROR) {
+            return NGX_ERROR;
         }
-#endif
-    }
 
-    c->node->updating = 0;
+        src_offset += len;
+        dst_offset += len;
+        size -= len;
+    }
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
+    return NGX_OK;
 }
 
 
@@ -1782,36 +3106,186 @@ done:
 }
 
 
-ngx_int_t
-ngx_http_cache_send(ngx_http_request_t *r)
+#if (NGX_HTTP_GZIP)
+
+void
+ngx_http_file_cache_update_encoded(ngx_http_request_t *r, ngx_temp_file_t *tf,
+    ngx_str_t *encoding, size_t body_start)
 {
-    ngx_int_t          rc;
-    ngx_buf_t         *b;
-    ngx_chain_t        out;
-    ngx_http_cache_t  *c;
+    u_char                        *p;
+    off_t                          fs_size;
+    ngx_str_t                      name, *key;
+    ngx_uint_t                     i;
+    ngx_file_info_t                fi;
+    ngx_http_cache_t              *c;
+    ngx_ext_rename_file_t          ext;
+    ngx_http_file_cache_t         *cache;
+    ngx_http_file_cache_node_t    *fcn;
+    ngx_http_file_cache_header_t  *h;
+    u_char                         k[NGX_HTTP_CACHE_KEY_LEN];
 
     c = r->cache;
+    cache = c->file_cache;
 
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-                   "http file cache send: %s", c->file.name.data);
+                   "http file cache update \"%V\" variant", encoding);
 
-#if (NGX_API)
+    /* the space for the header was left at the start of the file */
+
+    p = ngx_pcalloc(r->pool, c->header_start);
+    if (p == NULL) {
+        goto failed;
+    }
+
+    h = (ngx_http_file_cache_header_t *) p;
+
+    h->version = NGX_HTTP_CACHE_VERSION;
+    h->valid_sec = c->valid_sec;
+    h->updating_sec = c->updating_sec;
+    h->error_sec = c->error_sec;
+    h->last_modified = c->last_modified;
+    h->date = c->date;
+    h->crc32 = c->crc32;
+    h->valid_msec = (u_short) c->valid_msec;
+    h->header_start = (u_short) c->header_start;
+    h->body_start = (u_short) body_start;
+
+    p += sizeof(ngx_http_file_cache_header_t);
+
+    p = ngx_cpymem(p, ngx_http_file_cache_key, sizeof(ngx_http_file_cache_key));
+
+    key = c->keys.elts;
+    for (i = 0; i < c->keys.nelts; i++) {
+        p = ngx_copy(p, key[i].data, key[i].len);
+    }
+
+    *p = LF;
+
+    if (ngx_write_file(&tf->file, (u_char *) h, c->header_start, 0)
+        == NGX_ERROR)
     {
-    ngx_http_file_cache_t   *cache;
-    ngx_http_cache_stats_t  *stats;
+        goto failed;
+    }
 
-    cache = c->file_cache;
-    stats = &cache->sh->stats[r->upstream->cache_status - 1];
+    ngx_http_file_cache_encoded_key(r, encoding, k);
+
+    if (ngx_http_file_cache_key_name(r->pool, cache->path, k, &name)
+        != NGX_OK)
+    {
+        goto failed;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache rename: \"%s\" to \"%s\"",
+                   tf->file.name.data, name.data);
+
+    ext.access = NGX_FILE_OWNER_ACCESS;
+    ext.path_access = NGX_FILE_OWNER_ACCESS;
+    ext.time = -1;
+    ext.create_path = 1;
+    ext.delete_file = 1;
+    ext.log = r->connection->log;
+
+    if (ngx_ext_rename_file(&tf->file.name, &name, &ext) != NGX_OK) {
+        return;
+    }
+
+    if (ngx_fd_info(tf->file.fd, &fi) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, r->connection->log, ngx_errno,
+                      ngx_fd_info_n " \"%s\" failed", name.data);
+        return;
+    }
+
+    fs_size = (ngx_file_fs_size(&fi) + cache->bsize - 1) / cache->bsize;
 
     ngx_shmtx_lock(&cache->shpool->mutex);
 
-    stats->responses++;
-    stats->bytes += c->length - c->body_start;
+    fcn = ngx_http_file_cache_lookup(cache, k);
+
+    if (fcn) {
+        ngx_queue_remove(&fcn->queue);
+
+    } else {
+        fcn = ngx_slab_calloc_locked(cache->shpool,
+                                     sizeof(ngx_http_file_cache_node_t));
+        if (fcn == NULL) {
+            ngx_http_file_cache_set_watermark(cache);
+
+            ngx_shmtx_unlock(&cache->shpool->mutex);
+
+            ngx_log_error(NGX_LOG_ALERT, r->connection->log, 0,
+                          "could not allocate node%s",
+                          cache->shpool->log_ctx);
+
+            if (ngx_delete_file(name.data) == NGX_FILE_ERROR) {
+                ngx_log_error(NGX_LOG_CRIT, r->connection->log, ngx_errno,
+                              ngx_delete_file_n " \"%s\" failed", name.data);
+            }
+
+            return;
+        }
+
+        cache->sh->count++;
+
+        ngx_memcpy((u_char *) &fcn->node.key, k, sizeof(ngx_rbtree_key_t));
+
+        ngx_memcpy(fcn->key, &k[sizeof(ngx_rbtree_key_t)],
+                   NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+
+        ngx_rbtree_insert(&cache->sh->rbtree, &fcn->node);
+
+        fcn->uses = 1;
+    }
+
+    fcn->error = 0;
+    fcn->exists = 1;
+    fcn->uniq = ngx_file_uniq(&fi);
+    fcn->body_start = body_start;
+    fcn->expire = ngx_time() + cache->inactive;
+
+    cache->sh->size += fs_size - fcn->fs_size;
+    fcn->fs_size = fs_size;
+
+    ngx_queue_insert_head(&cache->sh->queue, &fcn->queue);
+
+#if (NGX_API)
+    cache->sh->compressed.responses_written++;
+    cache->sh->compressed.bytes_written += ngx_file_size(&fi) - body_start;
+#endif
 
     ngx_shmtx_unlock(&cache->shpool->mutex);
+
+    return;
+
+failed:
+
+    if (ngx_delete_file(tf->file.name.data) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, r->connection->log, ngx_errno,
+                      ngx_delete_file_n " \"%s\" failed",
+                      tf->file.name.data);
     }
+}
+
 #endif
 
+
+ngx_int_t
+ngx_http_cache_send(ngx_http_request_t *r)
+{
+    ngx_int_t          rc;
+    ngx_buf_t         *b;
+    ngx_chain_t        out;
+    ngx_http_cache_t  *c;
+
+    c = r->cache;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache send: %s", c->file.name.data);
+
+    if (!c->streaming) {
+        ngx_http_cache_send_stats(r);
+    }
+
     /* we need to allocate all before the header would be sent */
 
     b = ngx_calloc_buf(r->pool);
@@ -1824,24 +3298,43 @@ ngx_http_cache_send(ngx_http_request_t *r)
         return NGX_HTTP_INTERNAL_SERVER_ERROR;
     }
 
+    if (c->streaming) {
+        r->allow_ranges = 0;
+    }
+
     rc = ngx_http_send_header(r);
 
     if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
         return rc;
     }
 
-    b->file_pos = c->body_start;
-    b->file_last = c->length;
+    b->file->fd = c->file.fd;
+    b->file->name = c->file.name;
+    b->file->log = r->connection->log;
+
+    if (c->streaming) {
+        c->stream_buf = b;
+        c->stream_size = c->body_start;
+
+        r->write_event_handler = ngx_http_file_cache_stream_handler;
+
+        return ngx_http_file_cache_stream_send(r);
+    }
+
+    if (c->partial_length) {
+        b->file_pos = c->body_start + c->partial_start;
+        b->file_last = c->body_start + c->partial_end;
+
+    } else {
+        b->file_pos = c->body_start;
+        b->file_last = c->length;
+    }
 
-    b->in_file = (c->length - c->body_start) ? 1 : 0;
+    b->in_file = (b->file_last - b->file_pos) ? 1 : 0;
     b->last_buf = (r == r->main) ? 1 : 0;
     b->last_in_chain = 1;
     b->sync = (b->last_buf || b->in_file) ? 0 : 1;
 
-    b->file->fd = c->file.fd;
-    b->file->name = c->file.name;
-    b->file->log = r->connection->log;
-
     out.buf = b;
     out.next = NULL;
 
@@ -1849,9 +3342,45 @@ ngx_http_cache_send(ngx_http_request_t *r)
 }
 
 
+static void
+ngx_http_cache_send_stats(ngx_http_request_t *r)
+{
+#if (NGX_API)
+    off_t                    size;
+    ngx_http_cache_t        *c;
+    ngx_http_file_cache_t   *cache;
+    ngx_http_cache_stats_t  *stats;
+
+    c = r->cache;
+    cache = c->file_cache;
+    stats = &cache->sh->stats[r->upstream->cache_status - 1];
+
+    if (c->partial_length) {
+        size = c->partial_end - c->partial_start;
+
+    } else {
+        size = c->length - c->body_start;
+    }
+
+    ngx_shmtx_lock(&cache->shpool->mutex);
+
+    stats->responses++;
+    stats->bytes += size;
+
+    if (c->encoded) {
+        cache->sh->compressed.responses++;
+        cache->sh->compressed.bytes += size;
+    }
+
+    ngx_shmtx_unlock(&cache->shpool->mutex);
+#endif
+}
+
+
 void
 ngx_http_file_cache_free(ngx_http_cache_t *c, ngx_temp_file_t *tf)
 {
+    ngx_uint_t                   waiters;
     ngx_http_file_cache_t       *cache;
     ngx_http_file_cache_node_t  *fcn;
 
@@ -1869,8 +3398,13 @@ ngx_http_file_cache_free(ngx_http_cache_t *c, ngx_temp_file_t *tf)
     fcn = c->node;
     fcn->count--;
 
+    waiters = 0;
+
     if (c->updating && fcn->lock_time == c->lock_time) {
+        waiters = fcn->waiters;
         fcn->updating = 0;
+        fcn->waiters = 0;
+        fcn->stream_id = 0;
     }
 
     if (c->error) {
@@ -1891,6 +3425,10 @@ ngx_http_file_cache_free(ngx_http_cache_t *c, ngx_temp_file_t *tf)
 
     ngx_shmtx_unlock(&cache->shpool->mutex);
 
+    if (waiters) {
+        ngx_http_file_cache_lock_release(fcn);
+    }
+
     c->updated = 1;
     c->updating = 0;
 
@@ -1919,6 +3457,21 @@ ngx_http_file_cache_cleanup(void *data)
 {
     ngx_http_cache_t  *c = data;
 
+    if (c->stream_waiting) {
+        ngx_queue_remove(&c->wait_queue);
+        c->stream_waiting = 0;
+    }
+
+    if (c->streaming) {
+        if (c->wait_event.timer_set) {
+            ngx_del_timer(&c->wait_event);
+        }
+
+        if (c->wait_event.posted) {
+            ngx_delete_posted_event(&c->wait_event);
+        }
+    }
+
     if (c->updated) {
         return;
     }
@@ -2612,6 +4165,7 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     zp.min_size = 2 * ngx_pagesize;
     zp.size = NGX_CONF_UNSET;
     zp.restorable = 1;
+    zp.numa_aware = 1;
     zp.tag = cmd->post;
 
     s.len = sizeof(NGX_HTTP_CACHE_SH_SIGNATURE) + NGX_INT64_LEN * 2 + 3;
@@ -19,6 +19,15 @@
 #endif
 
 
+#define NGX_HTTP_BUFFER_CACHES  4
+
+
+typedef struct {
+    size_t                     size;
+    void                      *free;
+} ngx_http_buffer_cache_t;
+
+
 static void ngx_http_wait_request_handler(ngx_event_t *ev);
 static ngx_http_request_t *ngx_http_alloc_request(ngx_connection_t *c);
 static void ngx_http_process_request_line(ngx_event_t *rev);
@@ -52,6 +61,9 @@ static void ngx_http_request_finalizer(ngx_http_request_t *r);
 
 static void ngx_http_set_keepalive(ngx_http_request_t *r);
 static void ngx_http_keepalive_handler(ngx_event_t *ev);
+static void *ngx_http_alloc_header_buffer(ngx_connection_t *c, size_t size);
+static ngx_int_t ngx_http_free_header_buffer(ngx_connection_t *c, void *p,
+    size_t size);
 static void ngx_http_set_lingering_close(ngx_connection_t *c);
 static void ngx_http_lingering_close_handler(ngx_event_t *ev);
 static ngx_int_t ngx_http_post_action(ngx_http_request_t *r);
@@ -72,6 +84,13 @@ static ngx_int_t ngx_api_http_zones_iter(ngx_api_iter_ctx_t *ictx,
     ngx_api_ctx_t *actx);
 static ngx_int_t ngx_api_http_zone_handler(ngx_api_entry_data_t data,
     ngx_api_ctx_t *actx, void *ctx);
+static void ngx_http_connection_pool_statistic(void *data);
+static void ngx_http_pool_statistic(ngx_http_pool_stats_t *ps,
+    ngx_pool_stats_t *stats);
+static ngx_int_t ngx_api_http_pools_handler(ngx_api_entry_data_t data,
+    ngx_api_ctx_t *actx, void *ctx);
+static ngx_int_t ngx_api_http_pool_handler(ngx_api_entry_data_t data,
+    ngx_api_ctx_t *actx, void *ctx);
 static ngx_int_t ngx_api_http_response_codes_handler(ngx_api_entry_data_t data,
     ngx_api_ctx_t *actx, void *ctx);
 static ngx_int_t ngx_api_http_response_codes_iter(ngx_api_iter_ctx_t *ictx,
@@ -89,6 +108,12 @@ static ngx_int_t ngx_api_http_ssl_handler(ngx_api_entry_data_t data,
 #endif
 
 
+/* per worker free lists of client header buffers by their sizes */
+
+static ngx_http_buffer_cache_t  ngx_http_buffer_cache[NGX_HTTP_BUFFER_CACHES];
+static ngx_uint_t               ngx_http_buffer_cache_n;
+
+
 static char *ngx_http_client_errors[] = {
 
     /* NGX_HTTP_PARSE_INVALID_METHOD */
@@ -257,12 +282,161 @@ static ngx_api_entry_t  ngx_api_http_server_zone_ssl_entries[] = {
         .data.off  = offsetof(ngx_http_server_stats_t, ssl.failed)
     },
 
+    {
+        .name      = ngx_string("ktls"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_http_server_stats_t, ssl.ktls)
+    },
+
     ngx_api_null_entry
 };
 
 #endif
 
 
+static ngx_api_entry_t  ngx_api_http_pool_sizes_entries[] = {
+
+    {
+        .name      = ngx_string("1k"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_http_pool_stats_t, sizes[0])
+    },
+
+    {
+        .name      = ngx_string("2k"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_http_pool_stats_t, sizes[1])
+    },
+
+    {
+        .name      = ngx_string("4k"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_http_pool_stats_t, sizes[2])
+    },
+
+    {
+        .name      = ngx_string("8k"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_http_pool_stats_t, sizes[3])
+    },
+
+    {
+        .name      = ngx_string("16k"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_http_pool_stats_t, sizes[4])
+    },
+
+    {
+        .name      = ngx_string("32k"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_http_pool_stats_t, sizes[5])
+    },
+
+    {
+        .name      = ngx_string("64k"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_http_pool_stats_t, sizes[6])
+    },
+
+    {
+        .name      = ngx_string("128k"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_http_pool_stats_t, sizes[7])
+    },
+
+    {
+        .name      = ngx_string("256k"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_http_pool_stats_t, sizes[8])
+    },
+
+    {
+        .name      = ngx_string("512k"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_http_pool_stats_t, sizes[9])
+    },
+
+    {
+        .name      = ngx_string("more"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_http_pool_stats_t, sizes[10])
+    },
+    ngx_api_null_entry
+};
+
+
+static ngx_api_entry_t  ngx_api_http_pool_entries[] = {
+
+    {
+        .name      = ngx_string("pools"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_http_pool_stats_t, pools)
+    },
+
+    {
+        .name      = ngx_string("size"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_http_pool_stats_t, size)
+    },
+
+    {
+        .name      = ngx_string("peak"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_http_pool_stats_t, peak)
+    },
+
+    {
+        .name      = ngx_string("blocks"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_http_pool_stats_t, blocks)
+    },
+
+    {
+        .name      = ngx_string("large"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_http_pool_stats_t, large)
+    },
+
+    {
+        .name      = ngx_string("sizes"),
+        .handler   = ngx_api_object_handler,
+        .data.ents = ngx_api_http_pool_sizes_entries
+    },
+
+    ngx_api_null_entry
+};
+
+
+static ngx_api_entry_t  ngx_api_http_server_zone_pools_entries[] = {
+
+    {
+        .name      = ngx_string("request"),
+        .handler   = ngx_api_http_pool_handler,
+        .data.off  = offsetof(ngx_http_server_stats_t, request_pool)
+    },
+
+    {
+        .name      = ngx_string("connection"),
+        .handler   = ngx_api_http_pool_handler,
+        .data.off  = offsetof(ngx_http_server_stats_t, connection_pool)
+    },
+
+    ngx_api_null_entry
+};
+
+
+static ngx_api_entry_t  ngx_api_http_location_zone_pools_entries[] = {
+
+    {
+        .name      = ngx_string("request"),
+        .handler   = ngx_api_http_pool_handler,
+        .data.off  = offsetof(ngx_http_location_stats_t, request_pool)
+    },
+
+    ngx_api_null_entry
+};
+
+
 static ngx_api_entry_t  ngx_api_http_server_zone_requests_entries[] = {
 
     {
@@ -333,6 +507,12 @@ static ngx_api_entry_t  ngx_api_http_server_zone_entries[] = {
         .data.ents = ngx_api_http_server_zone_data_entries
     },
 
+    {
+        .name      = ngx_string("pools"),
+        .handler   = ngx_api_http_pools_handler,
+        .data.ents = ngx_api_http_server_zone_pools_entries
+    },
+
     ngx_api_null_entry
 };
 
@@ -393,6 +573,12 @@ static ngx_api_entry_t  ngx_api_http_location_zone_entries[] = {
         .data.ents = ngx_api_http_location_zone_data_entries
     },
 
+    {
+        .name      = ngx_string("pools"),
+        .handler   = ngx_api_http_pools_handler,
+        .data.ents = ngx_api_http_location_zone_pools_entries
+    },
+
     ngx_api_null_entry
 };
 
@@ -402,17 +588,21 @@ static ngx_api_entry_t  ngx_api_http_location_zone_entries[] = {
 void
 ngx_http_init_connection(ngx_connection_t *c)
 {
-    ngx_uint_t                 i;
-    ngx_event_t               *rev;
-    struct sockaddr_in        *sin;
-    ngx_http_port_t           *port;
-    ngx_http_in_addr_t        *addr;
-    ngx_http_log_ctx_t        *ctx;
-    ngx_http_connection_t     *hc;
-    ngx_http_core_srv_conf_t  *cscf;
+    ngx_uint_t                  i;
+    ngx_event_t                *rev;
+    struct sockaddr_in         *sin;
+    ngx_http_port_t            *port;
+    ngx_http_in_addr_t         *addr;
+    ngx_http_log_ctx_t         *ctx;
+    ngx_http_connection_t      *hc;
+    ngx_http_core_srv_conf_t   *cscf;
+#if (NGX_API)
+    ngx_pool_cleanup_t         *cln;
+    ngx_http_core_main_conf_t  *cmcf;
+#endif
 #if (NGX_HAVE_INET6)
-    struct sockaddr_in6       *sin6;
-    ngx_http_in6_addr_t       *addr6;
+    struct sockaddr_in6        *sin6;
+    ngx_http_in6_addr_t        *addr6;
 #endif
 
     hc = ngx_pcalloc(c->pool, sizeof(ngx_http_connection_t));
@@ -500,6 +690,30 @@ ngx_http_init_connection(ngx_connection_t *c)
     /* the default server configuration for the address:port */
     hc->conf_ctx = hc->addr_conf->default_server->ctx;
 
+#if (NGX_API)
+
+    cmcf = ngx_http_get_module_main_conf(hc->conf_ctx, ngx_http_core_module);
+
+    if (cmcf->pool_stats) {
+        if (ngx_pool_enable_stats(c->pool) != NGX_OK) {
+            ngx_http_close_connection(c);
+            return;
+        }
+
+        cln = ngx_pool_cleanup_add(c->pool, 0);
+        if (cln == NULL) {
+            ngx_http_close_connection(c);
+            return;
+        }
+
+        cln->handler = ngx_http_connection_pool_statistic;
+        cln->data = hc;
+
+        hc->pool_stats = ngx_pool_get_stats(c->pool);
+    }
+
+#endif
+
     ctx = ngx_palloc(c->pool, sizeof(ngx_http_log_ctx_t));
     if (ctx == NULL) {
         ngx_http_close_connection(c);
@@ -602,17 +816,18 @@ ngx_http_wait_request_handler(ngx_event_t *rev)
     b = c->buffer;
 
     if (b == NULL) {
-        b = ngx_create_temp_buf(c->pool, size);
+        b = ngx_calloc_buf(c->pool);
         if (b == NULL) {
             ngx_http_close_connection(c);
             return;
         }
 
         c->buffer = b;
+    }
 
-    } else if (b->start == NULL) {
+    if (b->start == NULL) {
 
-        b->start = ngx_palloc(c->pool, size);
+        b->start = ngx_http_alloc_header_buffer(c, size);
         if (b->start == NULL) {
             ngx_http_close_connection(c);
             return;
@@ -621,6 +836,7 @@ ngx_http_wait_request_handler(ngx_event_t *rev)
         b->pos = b->start;
         b->last = b->start;
         b->end = b->last + size;
+        b->temporary = 1;
     }
 
     size = b->end - b->last;
@@ -646,7 +862,9 @@ ngx_http_wait_request_handler(ngx_event_t *rev)
              * idle connection.
              */
 
-            if (ngx_pfree(c->pool, b->start) == NGX_OK) {
+            if (ngx_http_free_header_buffer(c, b->start, b->end - b->start)
+                == NGX_OK)
+            {
                 b->start = NULL;
             }
         }
@@ -778,6 +996,17 @@ ngx_http_alloc_request(ngx_connection_t *c)
         return NULL;
     }
 
+#if (NGX_API)
+
+    cmcf = ngx_http_get_module_main_conf(hc->conf_ctx, ngx_http_core_module);
+
+    if (cmcf->pool_stats && ngx_pool_enable_stats(pool) != NGX_OK) {
+        ngx_destroy_pool(pool);
+        return NULL;
+    }
+
+#endif
+
     r = ngx_pcalloc(pool, sizeof(ngx_http_request_t));
     if (r == NULL) {
         ngx_destroy_pool(pool);
@@ -1910,12 +2139,22 @@ ngx_http_alloc_large_header_buffer(ngx_http_request_t *r,
 
     } else if (hc->nbusy < cscf->large_client_header_buffers.num) {
 
-        b = ngx_create_temp_buf(r->connection->pool,
-                                cscf->large_client_header_buffers.size);
+        b = ngx_calloc_buf(r->connection->pool);
         if (b == NULL) {
             return NGX_ERROR;
         }
 
+        b->start = ngx_http_alloc_header_buffer(r->connection,
+                                        cscf->large_client_header_buffers.size);
+        if (b->start == NULL) {
+            return NGX_ERROR;
+        }
+
+        b->pos = b->start;
+        b->last = b->start;
+        b->end = b->last + cscf->large_client_header_buffers.size;
+        b->temporary = 1;
+
         cl = ngx_alloc_chain_link(r->connection->pool);
         if (cl == NULL) {
             return NGX_ERROR;
@@ -3493,7 +3732,8 @@ ngx_http_set_keepalive(ngx_http_request_t *r)
 
     b = c->buffer;
 
-    if (ngx_pfree(c->pool, b->start) == NGX_OK) {
+    if (ngx_http_free_header_buffer(c, b->start, b->end - b->start) == NGX_OK)
+    {
 
         /*
          * the special note for ngx_http_keepalive_handler() that
@@ -3514,7 +3754,8 @@ ngx_http_set_keepalive(ngx_http_request_t *r)
         for (cl = hc->free; cl; /* void */) {
             ln = cl;
             cl = cl->next;
-            ngx_pfree(c->pool, ln->buf->start);
+            ngx_http_free_header_buffer(c, ln->buf->start,
+                                        ln->buf->end - ln->buf->start);
             ngx_free_chain(c->pool, ln);
         }
 
@@ -3528,7 +3769,8 @@ ngx_http_set_keepalive(ngx_http_request_t *r)
         for (cl = hc->busy; cl; /* void */) {
             ln = cl;
             cl = cl->next;
-            ngx_pfree(c->pool, ln->buf->start);
+            ngx_http_free_header_buffer(c, ln->buf->start,
+                                        ln->buf->end - ln->buf->start);
             ngx_free_chain(c->pool, ln);
         }
 
@@ -3661,7 +3903,7 @@ ngx_http_keepalive_handler(ngx_event_t *rev)
          * to keep the buffer size.
          */
 
-        b->pos = ngx_palloc(c->pool, size);
+        b->pos = ngx_http_alloc_header_buffer(c, size);
         if (b->pos == NULL) {
             ngx_http_close_connection(c);
             return;
@@ -3694,7 +3936,7 @@ ngx_http_keepalive_handler(ngx_event_t *rev)
          * c->buffer's memory for a keepalive connection.
          */
 
-        if (ngx_pfree(c->pool, b->start) == NGX_OK) {
+        if (ngx_http_free_header_buffer(c, b->start, size) == NGX_OK) {
 
             /*
              * the special note that c->buffer's memory was freed
@@ -3744,6 +3986,93 @@ ngx_http_keepalive_handler(ngx_event_t *rev)
 }
 
 
+static void *
+ngx_http_alloc_header_buffer(ngx_connection_t *c, size_t size)
+{
+    void                     *p;
+    ngx_uint_t                i;
+    ngx_http_buffer_cache_t  *cache;
+
+    for (i = 0; ngx_http_buffer_cache_n && i < NGX_HTTP_BUFFER_CACHES; i++) {
+
+        cache = &ngx_http_buffer_cache[i];
+
+        if (cache->size != size || cache->free == NULL) {
+            continue;
+        }
+
+        p = cache->free;
+
+        if (ngx_pattach(c->pool, p, size) != NGX_OK) {
+            return NULL;
+        }
+
+        cache->free = *(void **) p;
+        ngx_http_buffer_cache_n--;
+
+        ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                       "http header buffer cached: %p %uz", p, size);
+
+        return p;
+    }
+
+    return ngx_palloc(c->pool, size);
+}
+
+
+static ngx_int_t
+ngx_http_free_header_buffer(ngx_connection_t *c, void *p, size_t size)
+{
+    ngx_uint_t                  i;
+    ngx_http_buffer_cache_t    *cache;
+    ngx_http_core_main_conf_t  *cmcf;
+
+    cmcf = ngx_http_cycle_get_module_main_conf(ngx_cycle, ngx_http_core_module);
+
+    if (ngx_http_buffer_cache_n >= cmcf->client_header_buffers_cache
+        || size < sizeof(void *))
+    {
+        return ngx_pfree(c->pool, p);
+    }
+
+    cache = NULL;
+
+    for (i = 0; i < NGX_HTTP_BUFFER_CACHES; i++) {
+
+        if (ngx_http_buffer_cache[i].size == size) {
+            cache = &ngx_http_buffer_cache[i];
+            break;
+        }
+
+        if (cache == NULL && ngx_http_buffer_cache[i].free == NULL) {
+            cache = &ngx_http_buffer_cache[i];
+        }
+    }
+
+    if (cache == NULL) {
+        return ngx_pfree(c->pool, p);
+    }
+
+    /* the buffers allocated from the pool itself are kept */
+
+    if (ngx_pdetach(c->pool, p) != NGX_OK) {
+        return NGX_DECLINED;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http header buffer to cache: %p %uz", p, size);
+
+    *(void **) p = cache->free;
+
+    cache->free = p;
+    cache->size = size;
+
+    ngx_http_buffer_cache_n++;
+
+    return NGX_OK;
+}
+
+
 static void
 ngx_http_set_lingering_close(ngx_connection_t *c)
 {
@@ -4318,6 +4647,10 @@ ngx_http_calculate_ssl_statistic(ngx_connection_t *c,
             (void) ngx_atomic_fetch_add(&stats->ssl.reuses, 1);
         }
 
+        if (c->ssl->sendfile || c->ssl->ktls_recv) {
+            (void) ngx_atomic_fetch_add(&stats->ssl.ktls, 1);
+        }
+
     } else if (c->read->timedout) {
         (void) ngx_atomic_fetch_add(&stats->ssl.timedout, 1);
 
@@ -4333,6 +4666,7 @@ static void
 ngx_http_calculate_post_request_statistic(ngx_http_request_t *r)
 {
     ngx_uint_t                  code, idx;
+    ngx_pool_stats_t           *pstats;
     ngx_http_server_stats_t    *sstats;
     ngx_http_core_srv_conf_t   *cscf;
     ngx_http_core_loc_conf_t   *clcf;
@@ -4382,6 +4716,16 @@ ngx_http_calculate_post_request_statistic(ngx_http_request_t *r)
         (void) ngx_atomic_fetch_add(&sstats->discarded, 1);
     }
 
+    pstats = ngx_pool_get_stats(r->pool);
+
+    if (pstats) {
+        ngx_http_pool_statistic(&sstats->request_pool, pstats);
+    }
+
+    /* the connection pool is accounted once the connection is closed */
+
+    r->http_connection->server_stats = sstats;
+
 loc_stats:
 
     clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
@@ -4411,6 +4755,56 @@ loc_stats:
     } else {
         (void) ngx_atomic_fetch_add(&lstats->discarded, 1);
     }
+
+    pstats = ngx_pool_get_stats(r->pool);
+
+    if (pstats) {
+        ngx_http_pool_statistic(&lstats->request_pool, pstats);
+    }
+}
+
+
+static void
+ngx_http_connection_pool_statistic(void *data)
+{
+    ngx_http_connection_t *hc = data;
+
+    if (hc->server_stats) {
+        ngx_http_pool_statistic(&hc->server_stats->connection_pool,
+                                hc->pool_stats);
+    }
+}
+
+
+static void
+ngx_http_pool_statistic(ngx_http_pool_stats_t *ps, ngx_pool_stats_t *stats)
+{
+    size_t             size;
+    ngx_uint_t         i;
+    ngx_atomic_uint_t  peak;
+
+    (void) ngx_atomic_fetch_add(&ps->pools, 1);
+    (void) ngx_atomic_fetch_add(&ps->size, stats->size);
+    (void) ngx_atomic_fetch_add(&ps->blocks, stats->blocks);
+    (void) ngx_atomic_fetch_add(&ps->large, stats->large);
+
+    for (i = 0, size = 1024;
+         i < NGX_HTTP_POOL_STATS_SIZES - 1 && stats->size > size;
+         i++, size <<= 1)
+    {
+        /* void */
+    }
+
+    (void) ngx_atomic_fetch_add(&ps->sizes[i], 1);
+
+    do {
+        peak = ps->peak;
+
+        if (stats->peak <= peak) {
+            break;
+        }
+
+    } while (!ngx_atomic_cmp_set(&ps->peak, peak, stats->peak));
 }
 
 
@@ -4520,6 +4914,36 @@ ngx_api_http_zone_handler(ngx_api_entry_data_t data, ngx_api_ctx_t *actx,
 }
 
 
+static ngx_int_t
+ngx_api_http_pools_handler(ngx_api_entry_data_t data, ngx_api_ctx_t *actx,
+    void *ctx)
+{
+    ngx_http_core_main_conf_t  *cmcf;
+
+    cmcf = ngx_http_cycle_get_module_main_conf(ngx_cycle, ngx_http_core_module);
+
+    if (!cmcf->pool_stats) {
+        return NGX_DECLINED;
+    }
+
+    return ngx_api_http_zone_handler(data, actx, ctx);
+}
+
+
+static ngx_int_t
+ngx_api_http_pool_handler(ngx_api_entry_data_t data, ngx_api_ctx_t *actx,
+    void *ctx)
+{
+    ngx_http_pool_stats_t  *ps;
+
+    ps = (ngx_http_pool_stats_t *) ((u_char *) ctx + data.off);
+
+    data.ents = ngx_api_http_pool_entries;
+
+    return ngx_api_object_handler(data, actx, ps);
+}
+
+
 static ngx_int_t
 ngx_api_http_response_codes_handler(ngx_api_entry_data_t data,
     ngx_api_ctx_t *actx, void *ctx)
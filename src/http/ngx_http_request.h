@@ -149,6 +149,7 @@
 #define NGX_HTTP_LOWLEVEL_BUFFERED         0xf0
 #define NGX_HTTP_WRITE_BUFFERED            0x10
 #define NGX_HTTP_GZIP_BUFFERED             0x20
+#define NGX_HTTP_BROTLI_BUFFERED           0x40
 #define NGX_HTTP_SSI_BUFFERED              0x01
 #define NGX_HTTP_SUB_BUFFERED              0x02
 #define NGX_HTTP_COPY_BUFFERED             0x04
@@ -333,6 +334,11 @@ typedef struct {
 
     ngx_msec_t                        keepalive_timeout;
 
+#if (NGX_API)
+    ngx_http_server_stats_t          *server_stats;
+    ngx_pool_stats_t                 *pool_stats;
+#endif
+
     unsigned                          ssl:1;
     unsigned                          proxy_protocol:1;
 } ngx_http_connection_t;
@@ -516,6 +522,8 @@ struct ngx_http_request_s {
     unsigned                          gzip_tested:1;
     unsigned                          gzip_ok:1;
     unsigned                          gzip_vary:1;
+    unsigned                          brotli_tested:1;
+    unsigned                          brotli_ok:1;
 #endif
 
 #if (NGX_PCRE)
@@ -9,6 +9,31 @@
 #include <ngx_config.h>
 #include <ngx_core.h>
 #include <ngx_http.h>
+#include <ngx_md5.h>
+
+
+#define NGX_HTTP_UPSTREAM_COLLAPSE_KEY_LEN  16
+
+
+struct ngx_http_upstream_collapse_s {
+    ngx_rbtree_node_t                node;
+    u_char                           key[NGX_HTTP_UPSTREAM_COLLAPSE_KEY_LEN];
+
+    ngx_http_request_t              *request;
+    ngx_http_upstream_collapse_t    *leader;
+
+    ngx_queue_t                      waiters;
+    ngx_queue_t                      queue;
+
+    ngx_event_pipe_input_filter_pt   pipe_input_filter;
+    ngx_int_t                      (*input_filter)(void *data, ssize_t bytes);
+    void                            *input_filter_ctx;
+
+    ngx_int_t                        rc;
+
+    unsigned                         leading:1;
+    unsigned                         header_sent:1;
+};
 
 
 #if (NGX_HTTP_UPSTREAM_STICKY)
@@ -24,19 +49,33 @@ static ngx_int_t ngx_http_upstream_cache_get(ngx_http_request_t *r,
     ngx_http_upstream_t *u, ngx_http_file_cache_t **cache);
 static ngx_int_t ngx_http_upstream_cache_send(ngx_http_request_t *r,
     ngx_http_upstream_t *u);
+#if (NGX_HTTP_GZIP)
+static void ngx_http_upstream_cache_encoding(ngx_http_request_t *r,
+    ngx_http_upstream_t *u);
+#endif
 static ngx_int_t ngx_http_upstream_cache_background_update(
     ngx_http_request_t *r, ngx_http_upstream_t *u);
 static ngx_int_t ngx_http_upstream_cache_check_range(ngx_http_request_t *r,
     ngx_http_upstream_t *u);
+static void ngx_http_upstream_cache_partial_range(ngx_http_request_t *r,
+    ngx_http_upstream_t *u);
+static ngx_int_t ngx_http_upstream_cache_partial(ngx_http_request_t *r,
+    ngx_http_upstream_t *u);
+static ngx_int_t ngx_http_upstream_cache_partial_file(ngx_http_request_t *r,
+    ngx_http_upstream_t *u);
 static ngx_int_t ngx_http_upstream_cache_status(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data);
 static ngx_int_t ngx_http_upstream_cache_last_modified(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data);
 static ngx_int_t ngx_http_upstream_cache_etag(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data);
+static ngx_int_t ngx_http_upstream_cache_range(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data);
 #endif
 
 static void ngx_http_upstream_init_request(ngx_http_request_t *r);
+static void ngx_http_upstream_start(ngx_http_request_t *r,
+    ngx_http_upstream_t *u);
 static void ngx_http_upstream_resolve_handler(ngx_resolver_ctx_t *ctx);
 static void ngx_http_upstream_rd_check_broken_connection(ngx_http_request_t *r);
 static void ngx_http_upstream_wr_check_broken_connection(ngx_http_request_t *r);
@@ -113,6 +152,47 @@ static void ngx_http_upstream_finalize_request(ngx_http_request_t *r,
     ngx_http_upstream_t *u, ngx_int_t rc);
 static ngx_int_t ngx_http_upstream_need_connection_drop(ngx_http_upstream_t *u);
 
+static ngx_int_t ngx_http_upstream_collapse(ngx_http_request_t *r,
+    ngx_http_upstream_t *u);
+static ngx_uint_t ngx_http_upstream_collapse_key_has(ngx_str_t *key,
+    ngx_table_elt_t *h);
+static ngx_uint_t ngx_http_upstream_collapse_shared(ngx_http_upstream_t *u);
+static ngx_http_upstream_collapse_t *ngx_http_upstream_collapse_lookup(
+    ngx_rbtree_t *rbtree, u_char *key);
+static void ngx_http_upstream_collapse_rbtree_insert_value(
+    ngx_rbtree_node_t *temp, ngx_rbtree_node_t *node,
+    ngx_rbtree_node_t *sentinel);
+static void ngx_http_upstream_collapse_send_header(ngx_http_request_t *r,
+    ngx_http_upstream_t *u);
+static void ngx_http_upstream_collapse_process_header(ngx_http_request_t *r,
+    ngx_http_upstream_t *u, ngx_http_request_t *lr);
+static void ngx_http_upstream_collapse_input_filters(ngx_http_request_t *r,
+    ngx_http_upstream_t *u);
+static ngx_int_t ngx_http_upstream_collapse_pipe_filter(ngx_event_pipe_t *p,
+    ngx_buf_t *buf);
+static ngx_int_t ngx_http_upstream_collapse_non_buffered_filter(void *data,
+    ssize_t bytes);
+static void ngx_http_upstream_collapse_send_body(
+    ngx_http_upstream_collapse_t *uc, ngx_chain_t *in);
+static ngx_int_t ngx_http_upstream_collapse_copy(ngx_http_request_t *r,
+    ngx_http_upstream_t *u, ngx_chain_t *in);
+static void ngx_http_upstream_collapse_process_downstream(
+    ngx_http_request_t *r);
+static void ngx_http_upstream_collapse_process_request(ngx_http_request_t *r,
+    ngx_http_upstream_t *u);
+static void ngx_http_upstream_collapse_finalize(ngx_http_request_t *r,
+    ngx_http_upstream_t *u, ngx_int_t rc);
+static void ngx_http_upstream_collapse_promote(
+    ngx_http_upstream_collapse_t *uc);
+static void ngx_http_upstream_collapse_release(
+    ngx_http_upstream_collapse_t *uc, ngx_int_t rc);
+static void ngx_http_upstream_collapse_restart(
+    ngx_http_upstream_collapse_t *uc);
+static void ngx_http_upstream_collapse_detach(ngx_http_upstream_collapse_t *w,
+    ngx_int_t rc);
+static void ngx_http_upstream_collapse_start_handler(ngx_http_request_t *r);
+static void ngx_http_upstream_collapse_finalize_handler(ngx_http_request_t *r);
+
 static ngx_int_t ngx_http_upstream_process_header_line(ngx_http_request_t *r,
     ngx_table_elt_t *h, ngx_uint_t offset);
 static ngx_int_t
@@ -203,6 +283,8 @@ static void ngx_http_upstream_ssl_handshake(ngx_http_request_t *,
 static void ngx_http_upstream_ssl_save_session(ngx_connection_t *c);
 static ngx_int_t ngx_http_upstream_ssl_name(ngx_http_request_t *r,
     ngx_http_upstream_t *u, ngx_connection_t *c);
+static ngx_int_t ngx_http_upstream_ssl_get_name(ngx_http_request_t *r,
+    ngx_http_upstream_t *u, ngx_str_t *name);
 static ngx_int_t ngx_http_upstream_ssl_certificate(ngx_http_request_t *r,
     ngx_http_upstream_t *u, ngx_connection_t *c);
 #if (NGX_HTTP_PROXY_MULTICERT)
@@ -211,7 +293,24 @@ static ngx_int_t ngx_http_upstream_ssl_certificates(ngx_http_request_t *r,
 #endif
 #endif
 
+#if (NGX_HTTP_V2)
+static ngx_int_t ngx_http_v2_upstream_init_connection(ngx_http_request_t *r,
+    ngx_http_upstream_t *u);
+#endif
+
 #if (NGX_HTTP_V3)
+
+typedef struct {
+    ngx_queue_t                      queue;
+    ngx_connection_t                *connection;
+    ngx_uint_t                       processing;
+    socklen_t                        socklen;
+    ngx_sockaddr_t                   sockaddr;
+    ngx_ssl_t                       *ssl;
+    ngx_str_t                        ssl_name;
+} ngx_http_v3_upstream_session_t;
+
+
 static ngx_int_t ngx_http_v3_upstream_init_connection(ngx_http_request_t *,
     ngx_http_upstream_t *u, ngx_connection_t *c);
 static ngx_int_t ngx_http_v3_upstream_init_ssl(ngx_connection_t *c, void *data);
@@ -224,6 +323,13 @@ static ngx_int_t ngx_http_v3_upstream_connected(ngx_http_request_t *r,
     ngx_http_upstream_t *u, ngx_connection_t *sc);
 static ngx_int_t ngx_http_v3_upstream_send_request(ngx_http_request_t *r,
     ngx_http_upstream_t *u, ngx_connection_t *sc);
+static ngx_int_t ngx_http_v3_upstream_connect_peer(ngx_peer_connection_t *pc,
+    void *data);
+static ngx_int_t ngx_http_v3_upstream_add_session(ngx_http_request_t *r,
+    ngx_http_upstream_t *u, ngx_connection_t *c);
+static ngx_int_t ngx_http_v3_upstream_keep_session(ngx_http_upstream_t *u,
+    ngx_connection_t *c);
+static void ngx_http_v3_upstream_cleanup_session(void *data);
 static void ngx_http_quic_upstream_dummy_handler(ngx_event_t *ev);
 static void ngx_http_quic_stream_close_handler(ngx_event_t *ev);
 #endif
@@ -479,6 +585,10 @@ static ngx_http_variable_t  ngx_http_upstream_vars[] = {
       ngx_http_upstream_cache_etag, 0,
       NGX_HTTP_VAR_NOCACHEABLE|NGX_HTTP_VAR_NOHASH, 0 },
 
+    { ngx_string("upstream_cache_range"), NULL,
+      ngx_http_upstream_cache_range, 0,
+      NGX_HTTP_VAR_NOCACHEABLE|NGX_HTTP_VAR_NOHASH, 0 },
+
 #endif
 
 #if (NGX_HTTP_UPSTREAM_STICKY)
@@ -621,14 +731,9 @@ ngx_http_upstream_init(ngx_http_request_t *r)
 static void
 ngx_http_upstream_init_request(ngx_http_request_t *r)
 {
-    ngx_str_t                      *host;
-    ngx_uint_t                      i;
-    ngx_resolver_ctx_t             *ctx, temp;
-    ngx_http_cleanup_t             *cln;
-    ngx_http_upstream_t            *u;
-    ngx_http_core_loc_conf_t       *clcf;
-    ngx_http_upstream_srv_conf_t   *uscf, **uscfp;
-    ngx_http_upstream_main_conf_t  *umcf;
+    ngx_http_cleanup_t        *cln;
+    ngx_http_upstream_t       *u;
+    ngx_http_core_loc_conf_t  *clcf;
 
     if (r->aio) {
         return;
@@ -668,6 +773,11 @@ ngx_http_upstream_init_request(ngx_http_request_t *r)
                 u->buffer.start = NULL;
                 u->cache_status = NGX_HTTP_CACHE_MISS;
                 u->request_sent = 1;
+
+                if (r->cache->encoded) {
+                    /* the cache key is the one of the compressed variant */
+                    u->cacheable = 0;
+                }
             }
         }
 
@@ -760,6 +870,37 @@ ngx_http_upstream_init_request(ngx_http_request_t *r)
     cln->data = r;
     u->cleanup = &cln->handler;
 
+    if (u->conf->collapse) {
+
+        switch (ngx_http_upstream_collapse(r, u)) {
+
+        case NGX_ERROR:
+            ngx_http_upstream_finalize_request(r, u,
+                                               NGX_HTTP_INTERNAL_SERVER_ERROR);
+            return;
+
+        case NGX_DONE:
+            return;
+
+        default: /* NGX_OK, NGX_DECLINED */
+            break;
+        }
+    }
+
+    ngx_http_upstream_start(r, u);
+}
+
+
+static void
+ngx_http_upstream_start(ngx_http_request_t *r, ngx_http_upstream_t *u)
+{
+    ngx_str_t                      *host;
+    ngx_uint_t                      i;
+    ngx_resolver_ctx_t             *ctx, temp;
+    ngx_http_core_loc_conf_t       *clcf;
+    ngx_http_upstream_srv_conf_t   *uscf, **uscfp;
+    ngx_http_upstream_main_conf_t  *umcf;
+
     if (u->resolved == NULL) {
 
         uscf = u->conf->upstream;
@@ -822,6 +963,8 @@ ngx_http_upstream_init_request(ngx_http_request_t *r)
             return;
         }
 
+        clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
         temp.name = *host;
 
         ctx = ngx_resolve_start(clcf->resolver, &temp);
@@ -964,6 +1107,20 @@ ngx_http_upstream_cache(ngx_http_request_t *r, ngx_http_upstream_t *u)
         c->lock = u->conf->cache_lock;
         c->lock_timeout = u->conf->cache_lock_timeout;
         c->lock_age = u->conf->cache_lock_age;
+        c->stream = (u->conf->cache_lock_stream && r == r->main) ? 1 : 0;
+
+        if (u->conf->cache_partial) {
+            ngx_http_upstream_cache_partial_range(r, u);
+        }
+
+#if (NGX_HTTP_GZIP)
+        if ((u->conf->cache_compressed & (NGX_HTTP_CACHE_COMPRESSED_GZIP
+                                          |NGX_HTTP_CACHE_COMPRESSED_BROTLI))
+            && !c->partial_block)
+        {
+            ngx_http_upstream_cache_encoding(r, u);
+        }
+#endif
 
         u->cache_status = NGX_HTTP_CACHE_MISS;
     }
@@ -1063,7 +1220,9 @@ ngx_http_upstream_cache(ngx_http_request_t *r, ngx_http_upstream_t *u)
         return rc;
     }
 
-    if (ngx_http_upstream_cache_check_range(r, u) == NGX_DECLINED) {
+    if (!c->partial
+        && ngx_http_upstream_cache_check_range(r, u) == NGX_DECLINED)
+    {
         u->cacheable = 0;
     }
 
@@ -1073,6 +1232,41 @@ ngx_http_upstream_cache(ngx_http_request_t *r, ngx_http_upstream_t *u)
 }
 
 
+#if (NGX_HTTP_GZIP)
+
+static void
+ngx_http_upstream_cache_encoding(ngx_http_request_t *r, ngx_http_upstream_t *u)
+{
+    ngx_http_cache_t  *c;
+
+#if (NGX_HTTP_V3)
+    if (u->h3) {
+        /* compressed variants are stored with HTTP/1.x headers */
+        return;
+    }
+#endif
+
+    c = r->cache;
+
+    /* the same order as the compression filters use */
+
+    if ((u->conf->cache_compressed & NGX_HTTP_CACHE_COMPRESSED_BROTLI)
+        && ngx_http_brotli_ok(r) == NGX_OK)
+    {
+        ngx_str_set(&c->encoding, "br");
+        return;
+    }
+
+    if ((u->conf->cache_compressed & NGX_HTTP_CACHE_COMPRESSED_GZIP)
+        && ngx_http_gzip_ok(r) == NGX_OK)
+    {
+        ngx_str_set(&c->encoding, "gzip");
+    }
+}
+
+#endif
+
+
 static ngx_int_t
 ngx_http_upstream_cache_get(ngx_http_request_t *r, ngx_http_upstream_t *u,
     ngx_http_file_cache_t **cache)
@@ -1163,6 +1357,11 @@ ngx_http_upstream_cache_send(ngx_http_request_t *r, ngx_http_upstream_t *u)
             return rc;
         }
 
+        if (c->encoded) {
+            /* compressed variants are stored without Content-Length */
+            r->headers_out.content_length_n = c->length - c->body_start;
+        }
+
         return ngx_http_cache_send(r);
     }
 
@@ -1258,160 +1457,457 @@ ngx_http_upstream_cache_check_range(ngx_http_request_t *r,
     return NGX_OK;
 }
 
-#endif
-
 
 static void
-ngx_http_upstream_resolve_handler(ngx_resolver_ctx_t *ctx)
+ngx_http_upstream_cache_partial_range(ngx_http_request_t *r,
+    ngx_http_upstream_t *u)
 {
-    ngx_uint_t                     run_posted;
-    ngx_connection_t              *c;
-    ngx_http_request_t            *r;
-    ngx_http_upstream_t           *u;
-    ngx_http_upstream_resolved_t  *ur;
-
-    run_posted = ctx->async;
+    off_t                      start, end;
+    u_char                    *p, *last;
+    ngx_table_elt_t           *h;
+    ngx_http_cache_t          *c;
+    ngx_http_core_loc_conf_t  *clcf;
 
-    r = ctx->data;
-    c = r->connection;
+    /* a single byte range of the response is looked up in the cache */
 
-    u = r->upstream;
-    ur = u->resolved;
+    h = r->headers_in.range;
 
-    ngx_http_set_log_request(c->log, r);
+    if (h == NULL
+        || r != r->main
+        || r->method != NGX_HTTP_GET
+        || r->headers_in.if_range)
+    {
+        return;
+    }
 
-    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
-                   "http upstream resolve: \"%V?%V\"", &r->uri, &r->args);
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
 
-    if (ctx->state) {
-        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
-                      "%V could not be resolved (%i: %s)",
-                      &ctx->name, ctx->state,
-                      ngx_resolver_strerror(ctx->state));
+    if (clcf->max_ranges == 0) {
+        return;
+    }
 
-        ngx_http_upstream_finalize_request(r, u, NGX_HTTP_BAD_GATEWAY);
-        goto failed;
+    if (h->value.len < 7
+        || ngx_strncasecmp(h->value.data, (u_char *) "bytes=", 6) != 0)
+    {
+        return;
     }
 
-    ur->naddrs = ctx->naddrs;
-    ur->addrs = ctx->addrs;
+    p = h->value.data + 6;
+    last = h->value.data + h->value.len;
 
-#if (NGX_DEBUG)
-    {
-    u_char      text[NGX_SOCKADDR_STRLEN];
-    ngx_str_t   addr;
-    ngx_uint_t  i;
+    while (p < last && *p == ' ') { p++; }
 
-    addr.data = text;
+    start = -1;
+    end = -1;
 
-    for (i = 0; i < ctx->naddrs; i++) {
-        addr.len = ngx_sock_ntop(ur->addrs[i].sockaddr, ur->addrs[i].socklen,
-                                 text, NGX_SOCKADDR_STRLEN, 0);
+    if (p < last && *p != '-') {
+        start = 0;
 
-        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-                       "name was resolved to %V", &addr);
-    }
+        if (*p < '0' || *p > '9') {
+            return;
+        }
+
+        while (p < last && *p >= '0' && *p <= '9') {
+            if (start >= NGX_MAX_OFF_T_VALUE / 10) {
+                return;
+            }
+
+            start = start * 10 + (*p++ - '0');
+        }
+
+        while (p < last && *p == ' ') { p++; }
     }
-#endif
 
-    if (ngx_http_upstream_create_round_robin_peer(r, ur) != NGX_OK) {
-        ngx_http_upstream_finalize_request(r, u,
-                                           NGX_HTTP_INTERNAL_SERVER_ERROR);
-        goto failed;
+    if (p == last || *p++ != '-') {
+        return;
     }
 
-    ngx_resolve_name_done(ctx);
-    ur->ctx = NULL;
+    while (p < last && *p == ' ') { p++; }
 
-    u->peer.start_time = ngx_current_msec;
+    if (p < last && *p >= '0' && *p <= '9') {
+        end = 0;
 
-    if (u->conf->next_upstream_tries
-        && u->peer.tries > u->conf->next_upstream_tries)
-    {
-        u->peer.tries = u->conf->next_upstream_tries;
-    }
+        while (p < last && *p >= '0' && *p <= '9') {
+            if (end >= NGX_MAX_OFF_T_VALUE / 10) {
+                return;
+            }
 
-    ngx_http_upstream_connect(r, u);
+            end = end * 10 + (*p++ - '0');
+        }
 
-failed:
+        while (p < last && *p == ' ') { p++; }
+    }
 
-    if (run_posted) {
-        ngx_http_run_posted_requests(c);
+    if (p != last) {
+        return;
     }
-}
 
+    if (start == -1) {
 
-static ngx_int_t
-ngx_http_upstream_need_connection_drop(ngx_http_upstream_t *u)
-{
-#if (NGX_HTTP_UPSTREAM_ZONE)
-    ngx_http_upstream_rr_peer_t       *peer;
-    ngx_http_upstream_rr_peer_data_t  *rrp;
+        /* suffix range, "bytes=-N" */
 
-    if (u->upstream == NULL || u->upstream->shm_zone == NULL) {
-        return 0;
-    }
+        if (end <= 0) {
+            return;
+        }
 
-    rrp = u->peer.data;
+    } else if (end != -1) {
 
-    if (rrp == NULL) {
-        return 0;
+        if (end < start) {
+            return;
+        }
+
+        end++;
     }
 
-    peer = rrp->current;
+    c = r->cache;
 
-    if (!peer->zombie) {
-        return 0;
-    }
+    c->partial_block = u->conf->cache_partial;
+    c->range_start = start;
+    c->range_end = end;
 
-    if (u->conf->connection_drop == NGX_HTTP_UPSTREAM_CONNECTION_DROP_OFF) {
-        return 0;
-    }
+    /* partial responses are not streamed to waiting requests */
 
-    if (ngx_current_msec - peer->zombie >= u->conf->connection_drop) {
-        return 1;
-    }
-#endif
+    c->stream = 0;
 
-    return 0;
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http upstream cache partial range: %O-%O", start, end);
 }
 
 
-static void
-ngx_http_upstream_handler(ngx_event_t *ev)
+static ngx_int_t
+ngx_http_upstream_cache_partial(ngx_http_request_t *r, ngx_http_upstream_t *u)
 {
-    ngx_connection_t     *c;
-    ngx_http_request_t   *r;
-    ngx_http_upstream_t  *u;
-
-    c = ev->data;
-    r = c->data;
+    off_t              start, end, length, cutoff, cutlim;
+    u_char            *p;
+    ngx_table_elt_t   *h;
+    ngx_http_cache_t  *c;
 
-    u = r->upstream;
-    c = r->connection;
+    c = r->cache;
 
-    ngx_http_set_log_request(c->log, r);
+    if (r->cached) {
+        goto convert;
+    }
 
-    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
-                   "http upstream request: \"%V?%V\"", &r->uri, &r->args);
+    c->partial_length = 0;
 
-    if (ev->delayed && ev->timedout) {
-        ev->delayed = 0;
-        ev->timedout = 0;
+    if (u->headers_in.status_n != NGX_HTTP_PARTIAL_CONTENT) {
+        return NGX_OK;
     }
 
-    if (ev->write) {
-        u->write_event_handler(r, u);
+    /* "bytes start-end/length" */
 
-    } else {
-        u->read_event_handler(r, u);
+    h = r->headers_out.content_range;
+
+    if (h == NULL
+        || h->value.len < 7
+        || ngx_strncmp(h->value.data, "bytes ", 6) != 0)
+    {
+        goto invalid;
     }
 
-    ngx_http_run_posted_requests(c);
-}
+    p = h->value.data + 6;
 
+    cutoff = NGX_MAX_OFF_T_VALUE / 10;
+    cutlim = NGX_MAX_OFF_T_VALUE % 10;
 
-static void
+    start = 0;
+    end = 0;
+    length = 0;
+
+    while (*p == ' ') { p++; }
+
+    if (*p < '0' || *p > '9') {
+        goto invalid;
+    }
+
+    while (*p >= '0' && *p <= '9') {
+        if (start >= cutoff && (start > cutoff || *p - '0' > cutlim)) {
+            goto invalid;
+        }
+
+        start = start * 10 + (*p++ - '0');
+    }
+
+    while (*p == ' ') { p++; }
+
+    if (*p++ != '-') {
+        goto invalid;
+    }
+
+    while (*p == ' ') { p++; }
+
+    if (*p < '0' || *p > '9') {
+        goto invalid;
+    }
+
+    while (*p >= '0' && *p <= '9') {
+        if (end >= cutoff && (end > cutoff || *p - '0' > cutlim)) {
+            goto invalid;
+        }
+
+        end = end * 10 + (*p++ - '0');
+    }
+
+    end++;
+
+    while (*p == ' ') { p++; }
+
+    if (*p++ != '/') {
+        goto invalid;
+    }
+
+    while (*p == ' ') { p++; }
+
+    if (*p < '0' || *p > '9') {
+        goto invalid;
+    }
+
+    while (*p >= '0' && *p <= '9') {
+        if (length >= cutoff && (length > cutoff || *p - '0' > cutlim)) {
+            goto invalid;
+        }
+
+        length = length * 10 + (*p++ - '0');
+    }
+
+    while (*p == ' ') { p++; }
+
+    if (*p != '\0'
+        || start >= end
+        || end > length
+        || (u->headers_in.content_length_n != -1
+            && u->headers_in.content_length_n != end - start))
+    {
+        goto invalid;
+    }
+
+    if (ngx_http_file_cache_partial_response(r, start, end, length)
+        != NGX_OK)
+    {
+        /* the response does not cover the range requested */
+        return NGX_OK;
+    }
+
+convert:
+
+    /*
+     * the response is passed as a part of the complete one,
+     * the range filter then extracts the range requested
+     */
+
+    r->headers_out.status = NGX_HTTP_OK;
+    r->headers_out.status_line.len = 0;
+
+    r->headers_out.content_length_n = c->partial_length;
+    r->headers_out.content_offset = c->partial_start;
+
+    if (r->headers_out.content_length) {
+        r->headers_out.content_length->hash = 0;
+        r->headers_out.content_length = NULL;
+    }
+
+    if (r->headers_out.content_range) {
+        r->headers_out.content_range->hash = 0;
+        r->headers_out.content_range = NULL;
+    }
+
+    r->allow_ranges = 1;
+
+    return NGX_OK;
+
+invalid:
+
+    ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                  "upstream sent invalid \"Content-Range\" header "
+                  "in a partial response");
+
+    u->cacheable = 0;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_upstream_cache_partial_file(ngx_http_request_t *r,
+    ngx_http_upstream_t *u)
+{
+    ngx_chain_t        out;
+    ngx_event_pipe_t  *p;
+
+    /*
+     * the body is written at its offset in the complete response,
+     * so a new cache file is created by renaming the temporary file
+     */
+
+    p = u->pipe;
+
+    out.buf = p->buf_to_file;
+    out.next = NULL;
+
+    if (ngx_write_chain_to_temp_file(p->temp_file, &out) == NGX_ERROR) {
+        return NGX_ERROR;
+    }
+
+    p->temp_file->offset = r->cache->body_start + r->cache->partial_start;
+    p->buf_to_file = NULL;
+
+    return NGX_OK;
+}
+
+#endif
+
+
+static void
+ngx_http_upstream_resolve_handler(ngx_resolver_ctx_t *ctx)
+{
+    ngx_uint_t                     run_posted;
+    ngx_connection_t              *c;
+    ngx_http_request_t            *r;
+    ngx_http_upstream_t           *u;
+    ngx_http_upstream_resolved_t  *ur;
+
+    run_posted = ctx->async;
+
+    r = ctx->data;
+    c = r->connection;
+
+    u = r->upstream;
+    ur = u->resolved;
+
+    ngx_http_set_log_request(c->log, r);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http upstream resolve: \"%V?%V\"", &r->uri, &r->args);
+
+    if (ctx->state) {
+        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                      "%V could not be resolved (%i: %s)",
+                      &ctx->name, ctx->state,
+                      ngx_resolver_strerror(ctx->state));
+
+        ngx_http_upstream_finalize_request(r, u, NGX_HTTP_BAD_GATEWAY);
+        goto failed;
+    }
+
+    ur->naddrs = ctx->naddrs;
+    ur->addrs = ctx->addrs;
+
+#if (NGX_DEBUG)
+    {
+    u_char      text[NGX_SOCKADDR_STRLEN];
+    ngx_str_t   addr;
+    ngx_uint_t  i;
+
+    addr.data = text;
+
+    for (i = 0; i < ctx->naddrs; i++) {
+        addr.len = ngx_sock_ntop(ur->addrs[i].sockaddr, ur->addrs[i].socklen,
+                                 text, NGX_SOCKADDR_STRLEN, 0);
+
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "name was resolved to %V", &addr);
+    }
+    }
+#endif
+
+    if (ngx_http_upstream_create_round_robin_peer(r, ur) != NGX_OK) {
+        ngx_http_upstream_finalize_request(r, u,
+                                           NGX_HTTP_INTERNAL_SERVER_ERROR);
+        goto failed;
+    }
+
+    ngx_resolve_name_done(ctx);
+    ur->ctx = NULL;
+
+    u->peer.start_time = ngx_current_msec;
+
+    if (u->conf->next_upstream_tries
+        && u->peer.tries > u->conf->next_upstream_tries)
+    {
+        u->peer.tries = u->conf->next_upstream_tries;
+    }
+
+    ngx_http_upstream_connect(r, u);
+
+failed:
+
+    if (run_posted) {
+        ngx_http_run_posted_requests(c);
+    }
+}
+
+
+static ngx_int_t
+ngx_http_upstream_need_connection_drop(ngx_http_upstream_t *u)
+{
+#if (NGX_HTTP_UPSTREAM_ZONE)
+    ngx_http_upstream_rr_peer_t       *peer;
+    ngx_http_upstream_rr_peer_data_t  *rrp;
+
+    if (u->upstream == NULL || u->upstream->shm_zone == NULL) {
+        return 0;
+    }
+
+    rrp = u->peer.data;
+
+    if (rrp == NULL) {
+        return 0;
+    }
+
+    peer = rrp->current;
+
+    if (!peer->zombie) {
+        return 0;
+    }
+
+    if (u->conf->connection_drop == NGX_HTTP_UPSTREAM_CONNECTION_DROP_OFF) {
+        return 0;
+    }
+
+    if (ngx_current_msec - peer->zombie >= u->conf->connection_drop) {
+        return 1;
+    }
+#endif
+
+    return 0;
+}
+
+
+static void
+ngx_http_upstream_handler(ngx_event_t *ev)
+{
+    ngx_connection_t     *c;
+    ngx_http_request_t   *r;
+    ngx_http_upstream_t  *u;
+
+    c = ev->data;
+    r = c->data;
+
+    u = r->upstream;
+    c = r->connection;
+
+    ngx_http_set_log_request(c->log, r);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http upstream request: \"%V?%V\"", &r->uri, &r->args);
+
+    if (ev->delayed && ev->timedout) {
+        ev->delayed = 0;
+        ev->timedout = 0;
+    }
+
+    if (ev->write) {
+        u->write_event_handler(r, u);
+
+    } else {
+        u->read_event_handler(r, u);
+    }
+
+    ngx_http_run_posted_requests(c);
+}
+
+
+static void
 ngx_http_upstream_rd_check_broken_connection(ngx_http_request_t *r)
 {
     ngx_http_upstream_check_broken_connection(r, r->connection->read);
@@ -1659,6 +2155,20 @@ ngx_http_upstream_connect(ngx_http_request_t *r, ngx_http_upstream_t *u)
     u->state->connect_time = (ngx_msec_t) -1;
     u->state->header_time = (ngx_msec_t) -1;
 
+#if (NGX_HTTP_V2)
+    if (u->conf->multiplex) {
+        u->peer.connect = ngx_http_v2_upstream_connect_peer;
+        u->peer.close = NULL;
+    }
+#endif
+
+#if (NGX_HTTP_V3)
+    if (u->h3 && u->conf->h3_multiplex) {
+        u->peer.connect = ngx_http_v3_upstream_connect_peer;
+        u->peer.close = NULL;
+    }
+#endif
+
     rc = ngx_event_connect_peer(&u->peer);
 
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
@@ -2047,7 +2557,16 @@ ngx_http_upstream_ssl_save_session(ngx_connection_t *c)
     }
 #endif
 
-    if (c->idle) {
+#if (NGX_HTTP_V2)
+    /* SSL callback is called on multiplexed connection */
+    c = ngx_http_v2_upstream_get_ssl_data(c);
+    if (c == NULL) {
+        /* no streams */
+        return;
+    }
+#endif
+
+    if (c->idle) {
         return;
     }
 
@@ -2066,44 +2585,17 @@ static ngx_int_t
 ngx_http_upstream_ssl_name(ngx_http_request_t *r, ngx_http_upstream_t *u,
     ngx_connection_t *c)
 {
-    u_char     *p, *last;
+    u_char     *p;
     ngx_str_t   name;
 
-    if (u->conf->ssl_name) {
-        if (ngx_http_complex_value(r, u->conf->ssl_name, &name) != NGX_OK) {
-            return NGX_ERROR;
-        }
-
-    } else {
-        name = u->ssl_name;
+    if (ngx_http_upstream_ssl_get_name(r, u, &name) != NGX_OK) {
+        return NGX_ERROR;
     }
 
     if (name.len == 0) {
         goto done;
     }
 
-    /*
-     * ssl name here may contain port, notably if derived from $proxy_host
-     * or $http_host; we have to strip it
-     */
-
-    p = name.data;
-    last = name.data + name.len;
-
-    if (*p == '[') {
-        p = ngx_strlchr(p, last, ']');
-
-        if (p == NULL) {
-            p = name.data;
-        }
-    }
-
-    p = ngx_strlchr(p, last, ':');
-
-    if (p != NULL) {
-        name.len = p - name.data;
-    }
-
     if (!u->conf->ssl_server_name) {
         goto done;
     }
@@ -2156,6 +2648,51 @@ done:
 }
 
 
+static ngx_int_t
+ngx_http_upstream_ssl_get_name(ngx_http_request_t *r, ngx_http_upstream_t *u,
+    ngx_str_t *name)
+{
+    u_char  *p, *last;
+
+    if (u->conf->ssl_name) {
+        if (ngx_http_complex_value(r, u->conf->ssl_name, name) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+    } else {
+        *name = u->ssl_name;
+    }
+
+    if (name->len == 0) {
+        return NGX_OK;
+    }
+
+    /*
+     * ssl name here may contain port, notably if derived from $proxy_host
+     * or $http_host; we have to strip it
+     */
+
+    p = name->data;
+    last = name->data + name->len;
+
+    if (*p == '[') {
+        p = ngx_strlchr(p, last, ']');
+
+        if (p == NULL) {
+            p = name->data;
+        }
+    }
+
+    p = ngx_strlchr(p, last, ':');
+
+    if (p != NULL) {
+        name->len = p - name->data;
+    }
+
+    return NGX_OK;
+}
+
+
 static ngx_int_t
 ngx_http_upstream_ssl_certificate(ngx_http_request_t *r,
     ngx_http_upstream_t *u, ngx_connection_t *c)
@@ -2376,6 +2913,18 @@ ngx_http_upstream_send_request(ngx_http_request_t *r, ngx_http_upstream_t *u,
         return;
     }
 
+#if (NGX_HTTP_V2)
+    if (u->conf->multiplex && !c->shared) {
+        if (ngx_http_v2_upstream_init_connection(r, u) != NGX_OK) {
+            ngx_http_upstream_finalize_request(r, u,
+                                               NGX_HTTP_INTERNAL_SERVER_ERROR);
+            return;
+        }
+
+        c = u->peer.connection;
+    }
+#endif
+
     c->log->action = "sending request to upstream";
 
     rc = ngx_http_upstream_send_request_body(r, u, do_write);
@@ -2877,6 +3426,10 @@ ngx_http_upstream_process_header(ngx_http_request_t *r, ngx_http_upstream_t *u)
         return;
     }
 
+    if (u->collapse) {
+        ngx_http_upstream_collapse_send_header(r, u);
+    }
+
     ngx_http_upstream_send_response(r, u);
 }
 
@@ -3314,6 +3867,19 @@ ngx_http_upstream_process_headers(ngx_http_request_t *r, ngx_http_upstream_t *u)
 #endif
     }
 
+#if (NGX_HTTP_CACHE)
+
+    if (r->cache
+        && ((r->cached && r->cache->partial_length)
+            || (!r->cached && r->cache->partial)))
+    {
+        if (ngx_http_upstream_cache_partial(r, u) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+
+#endif
+
     u->length = -1;
 
     return NGX_OK;
@@ -3452,6 +4018,10 @@ ngx_http_upstream_send_response(ngx_http_request_t *r, ngx_http_upstream_t *u)
             return;
         }
 
+        if (u->collapse) {
+            ngx_http_upstream_collapse_input_filters(r, u);
+        }
+
         if (clcf->tcp_nodelay && ngx_tcp_nodelay(c) != NGX_OK) {
             ngx_http_upstream_finalize_request(r, u, NGX_ERROR);
             return;
@@ -3529,7 +4099,9 @@ ngx_http_upstream_send_response(ngx_http_request_t *r, ngx_http_upstream_t *u)
 
         if (valid == 0) {
             valid = ngx_http_file_cache_valid(u->conf->cache_valid,
-                                              u->headers_in.status_n);
+                                              r->cache->partial_length
+                                              ? NGX_HTTP_OK
+                                              : u->headers_in.status_n);
             if (valid) {
                 r->cache->valid_sec = now + valid;
             }
@@ -3657,6 +4229,15 @@ ngx_http_upstream_send_response(ngx_http_request_t *r, ngx_http_upstream_t *u)
         p->buf_to_file->pos = u->buffer.start;
         p->buf_to_file->last = u->buffer.pos;
         p->buf_to_file->temporary = 1;
+
+#if (NGX_HTTP_CACHE)
+        if (r->cache->partial_length && r->cache->partial_start) {
+            if (ngx_http_upstream_cache_partial_file(r, u) != NGX_OK) {
+                ngx_http_upstream_finalize_request(r, u, NGX_ERROR);
+                return;
+            }
+        }
+#endif
     }
 
     if (ngx_event_flags & NGX_USE_IOCP_EVENT) {
@@ -3701,6 +4282,10 @@ ngx_http_upstream_send_response(ngx_http_request_t *r, ngx_http_upstream_t *u)
         return;
     }
 
+    if (u->collapse) {
+        ngx_http_upstream_collapse_input_filters(r, u);
+    }
+
     u->read_event_handler = ngx_http_upstream_process_upstream;
     r->write_event_handler = ngx_http_upstream_process_downstream;
 
@@ -4568,7 +5153,9 @@ ngx_http_upstream_process_request(ngx_http_request_t *r,
                 if (p->length == -1
                     && (u->headers_in.content_length_n == -1
                         || u->headers_in.content_length_n
-                           == tf->offset - (off_t) r->cache->body_start))
+                           == tf->offset - (off_t) r->cache->body_start
+                              - (r->cache->partial_length
+                                 ? r->cache->partial_start : 0)))
                 {
                     ngx_http_file_cache_update(r, tf);
 
@@ -4578,6 +5165,9 @@ ngx_http_upstream_process_request(ngx_http_request_t *r,
 
             } else if (p->upstream_error) {
                 ngx_http_file_cache_free(r->cache, p->temp_file);
+
+            } else {
+                ngx_http_file_cache_stream(r, p->temp_file);
             }
         }
 
@@ -4857,6 +5447,14 @@ ngx_http_upstream_close_peer_connection(ngx_http_request_t *r,
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                    "close http upstream connection: %d", c->fd);
 
+#if (NGX_HTTP_V2)
+    if (u->conf->multiplex && c->shared) {
+        ngx_http_v2_upstream_close_stream(c);
+        u->peer.connection = NULL;
+        return;
+    }
+#endif
+
 #if (NGX_HTTP_V3)
     if (c->type == SOCK_DGRAM || c->quic) {
 
@@ -4868,6 +5466,13 @@ ngx_http_upstream_close_peer_connection(ngx_http_request_t *r,
 
             ngx_http_v3_upstream_close_request_stream(sc, 1);
 
+            if (u->conf->h3_multiplex
+                && ngx_http_v3_upstream_keep_session(u, c) == NGX_OK)
+            {
+                u->peer.connection = NULL;
+                return;
+            }
+
             if (u->h3_started && !u->hq) {
                 /* HTTP/3 was initialized on this stream, close gracefully */
                 ngx_http_v3_shutdown(c);
@@ -4987,6 +5592,10 @@ ngx_http_upstream_finalize_request(ngx_http_request_t *r,
     *u->cleanup = NULL;
     u->cleanup = NULL;
 
+    if (u->collapse) {
+        ngx_http_upstream_collapse_finalize(r, u, rc);
+    }
+
     if (u->resolved && u->resolved->ctx) {
         ngx_resolve_name_done(u->resolved->ctx);
         u->resolved->ctx = NULL;
@@ -5077,68 +5686,933 @@ ngx_http_upstream_finalize_request(ngx_http_request_t *r,
             cache = r->cache->file_cache;
             stats = &cache->sh->stats[u->cache_status - 1];
 
-            ngx_shmtx_lock(&cache->shpool->mutex);
+            ngx_shmtx_lock(&cache->shpool->mutex);
+
+            stats->responses++;
+
+            if (u->state) {
+                stats->bytes += u->state->response_length;
+            }
+
+            ngx_shmtx_unlock(&cache->shpool->mutex);
+        }
+
+#endif
+
+    }
+
+#endif
+
+    r->read_event_handler = ngx_http_block_reading;
+
+    if (rc == NGX_DECLINED) {
+        return;
+    }
+
+    r->connection->log->action = "sending to client";
+
+    if (!u->header_sent
+        || rc == NGX_HTTP_REQUEST_TIME_OUT
+        || rc == NGX_HTTP_CLIENT_CLOSED_REQUEST)
+    {
+        ngx_http_finalize_request(r, rc);
+        return;
+    }
+
+    flush = 0;
+
+    if (rc >= NGX_HTTP_SPECIAL_RESPONSE) {
+        rc = NGX_ERROR;
+        flush = 1;
+    }
+
+    if (r->header_only
+        || (u->pipe && u->pipe->downstream_error))
+    {
+        ngx_http_finalize_request(r, rc);
+        return;
+    }
+
+    if (rc == 0) {
+
+        if (ngx_http_upstream_process_trailers(r, u) != NGX_OK) {
+            ngx_http_finalize_request(r, NGX_ERROR);
+            return;
+        }
+
+        rc = ngx_http_send_special(r, NGX_HTTP_LAST);
+
+    } else if (flush) {
+        r->keepalive = 0;
+        rc = ngx_http_send_special(r, NGX_HTTP_FLUSH);
+    }
+
+    ngx_http_finalize_request(r, rc);
+}
+
+
+static ngx_int_t
+ngx_http_upstream_collapse(ngx_http_request_t *r, ngx_http_upstream_t *u)
+{
+    ngx_str_t                       key;
+    ngx_md5_t                       md5;
+    ngx_http_upstream_collapse_t   *uc, *leader;
+    ngx_http_upstream_main_conf_t  *umcf;
+
+    if (r != r->main
+        || r->method != NGX_HTTP_GET
+        || r->post_action
+        || u->store
+        || r->headers_in.content_length_n > 0
+        || r->headers_in.chunked
+        || r->headers_in.upgrade
+        || r->headers_in.range
+        || r->headers_in.if_modified_since
+        || r->headers_in.if_unmodified_since
+        || r->headers_in.if_match
+        || r->headers_in.if_none_match)
+    {
+        return NGX_DECLINED;
+    }
+
+#if (NGX_HTTP_CACHE)
+    if (r->cache) {
+        return NGX_DECLINED;
+    }
+#endif
+
+#if (NGX_HTTP_V3)
+    if (u->h3) {
+        return NGX_DECLINED;
+    }
+#endif
+
+    if (ngx_http_complex_value(r, u->conf->collapse_key, &key) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    /* credentials are only shared if they are a part of the key */
+
+    if (!ngx_http_upstream_collapse_key_has(&key, r->headers_in.cookie)
+        || !ngx_http_upstream_collapse_key_has(&key,
+                                               r->headers_in.authorization))
+    {
+        ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "http upstream collapse: credentials not in key");
+        return NGX_DECLINED;
+    }
+
+    uc = ngx_pcalloc(r->pool, sizeof(ngx_http_upstream_collapse_t));
+    if (uc == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_md5_init(&md5);
+    ngx_md5_update(&md5, key.data, key.len);
+    ngx_md5_final(uc->key, &md5);
+
+    ngx_memcpy((u_char *) &uc->node.key, uc->key, sizeof(ngx_rbtree_key_t));
+
+    uc->request = r;
+    u->collapse = uc;
+
+    umcf = ngx_http_get_module_main_conf(r, ngx_http_upstream_module);
+
+    leader = ngx_http_upstream_collapse_lookup(&umcf->collapse, uc->key);
+
+    if (leader) {
+        ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "http upstream collapse wait: \"%V\" %p",
+                       &key, leader->request);
+
+        uc->leader = leader;
+        ngx_queue_insert_tail(&leader->waiters, &uc->queue);
+
+        u->start_time = ngx_current_msec;
+
+        return NGX_DONE;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http upstream collapse lead: \"%V\"", &key);
+
+    uc->leading = 1;
+    ngx_queue_init(&uc->waiters);
+
+    ngx_rbtree_insert(&umcf->collapse, &uc->node);
+
+    return NGX_OK;
+}
+
+
+static ngx_uint_t
+ngx_http_upstream_collapse_key_has(ngx_str_t *key, ngx_table_elt_t *h)
+{
+    u_char  *p, *last;
+
+    for ( /* void */ ; h; h = h->next) {
+
+        if (h->value.len > key->len) {
+            return 0;
+        }
+
+        last = key->data + key->len - h->value.len;
+
+        for (p = key->data; p <= last; p++) {
+            if (ngx_memcmp(p, h->value.data, h->value.len) == 0) {
+                break;
+            }
+        }
+
+        if (p > last) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+static ngx_uint_t
+ngx_http_upstream_collapse_shared(ngx_http_upstream_t *u)
+{
+    u_char           *last;
+    ngx_table_elt_t  *h;
+
+    /* responses with cookies or private ones are not passed to others */
+
+    if (u->headers_in.set_cookie) {
+        return 0;
+    }
+
+    for (h = u->headers_in.cache_control; h; h = h->next) {
+        last = h->value.data + h->value.len;
+
+        if (ngx_strlcasestrn(h->value.data, last, (u_char *) "private", 7 - 1)
+            || ngx_strlcasestrn(h->value.data, last, (u_char *) "no-store",
+                                8 - 1))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+static ngx_http_upstream_collapse_t *
+ngx_http_upstream_collapse_lookup(ngx_rbtree_t *rbtree, u_char *key)
+{
+    ngx_int_t                      rc;
+    ngx_rbtree_key_t               node_key;
+    ngx_rbtree_node_t             *node, *sentinel;
+    ngx_http_upstream_collapse_t  *uc;
+
+    ngx_memcpy((u_char *) &node_key, key, sizeof(ngx_rbtree_key_t));
+
+    node = rbtree->root;
+    sentinel = rbtree->sentinel;
+
+    while (node != sentinel) {
+
+        if (node_key < node->key) {
+            node = node->left;
+            continue;
+        }
+
+        if (node_key > node->key) {
+            node = node->right;
+            continue;
+        }
+
+        /* node_key == node->key */
+
+        uc = (ngx_http_upstream_collapse_t *) node;
+
+        rc = ngx_memcmp(key, uc->key, NGX_HTTP_UPSTREAM_COLLAPSE_KEY_LEN);
+
+        if (rc == 0) {
+            return uc;
+        }
+
+        node = (rc < 0) ? node->left : node->right;
+    }
+
+    /* not found */
+
+    return NULL;
+}
+
+
+static void
+ngx_http_upstream_collapse_rbtree_insert_value(ngx_rbtree_node_t *temp,
+    ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel)
+{
+    ngx_rbtree_node_t             **p;
+    ngx_http_upstream_collapse_t   *uc, *uct;
+
+    for ( ;; ) {
+
+        if (node->key < temp->key) {
+
+            p = &temp->left;
+
+        } else if (node->key > temp->key) {
+
+            p = &temp->right;
+
+        } else { /* node->key == temp->key */
+
+            uc = (ngx_http_upstream_collapse_t *) node;
+            uct = (ngx_http_upstream_collapse_t *) temp;
+
+            p = (ngx_memcmp(uc->key, uct->key,
+                            NGX_HTTP_UPSTREAM_COLLAPSE_KEY_LEN) < 0)
+                ? &temp->left : &temp->right;
+        }
+
+        if (*p == sentinel) {
+            break;
+        }
+
+        temp = *p;
+    }
+
+    *p = node;
+    node->parent = temp;
+    node->left = sentinel;
+    node->right = sentinel;
+    ngx_rbt_red(node);
+}
+
+
+static void
+ngx_http_upstream_collapse_send_header(ngx_http_request_t *r,
+    ngx_http_upstream_t *u)
+{
+    ngx_queue_t                    *q, *next;
+    ngx_http_upstream_collapse_t   *uc, *w;
+    ngx_http_upstream_main_conf_t  *umcf;
+
+    uc = u->collapse;
+
+    if (!uc->leading || uc->header_sent) {
+        return;
+    }
+
+    /* requests arriving from now on are not collapsed into this one */
+
+    umcf = ngx_http_get_module_main_conf(r, ngx_http_upstream_module);
+
+    ngx_rbtree_delete(&umcf->collapse, &uc->node);
+    uc->header_sent = 1;
+
+    if (ngx_queue_empty(&uc->waiters)) {
+        return;
+    }
+
+    if (u->buffer.pos == u->buffer.start) {
+
+        /* no header to pass to waiters, e.g. an HTTP/0.9 response */
+
+        ngx_http_upstream_collapse_promote(uc);
+        return;
+    }
+
+    if (!ngx_http_upstream_collapse_shared(u)) {
+        ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "http upstream collapse: response not shared");
+
+        ngx_http_upstream_collapse_restart(uc);
+        return;
+    }
+
+    for (q = ngx_queue_head(&uc->waiters);
+         q != ngx_queue_sentinel(&uc->waiters);
+         q = next)
+    {
+        next = ngx_queue_next(q);
+
+        w = ngx_queue_data(q, ngx_http_upstream_collapse_t, queue);
+
+        ngx_http_upstream_collapse_process_header(w->request,
+                                                  w->request->upstream, r);
+    }
+}
+
+
+static void
+ngx_http_upstream_collapse_process_header(ngx_http_request_t *r,
+    ngx_http_upstream_t *u, ngx_http_request_t *lr)
+{
+    size_t                     len;
+    u_char                    *p;
+    ngx_int_t                  rc;
+    ngx_buf_t                 *b;
+    ngx_http_upstream_t       *lu;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http upstream collapse header");
+
+    lu = lr->upstream;
+    b = &u->buffer;
+
+    /* the header is parsed again with the request's own upstream module */
+
+    len = lu->buffer.pos - lu->buffer.start;
+
+    p = ngx_pnalloc(r->pool, len);
+    if (p == NULL) {
+        rc = NGX_ERROR;
+        goto failed;
+    }
+
+    ngx_memcpy(p, lu->buffer.start, len);
+
+    b->start = p;
+    b->pos = p;
+    b->last = p + len;
+    b->end = p + len;
+    b->temporary = 1;
+
+    ngx_memzero(&u->headers_in, sizeof(ngx_http_upstream_headers_in_t));
+    u->headers_in.content_length_n = -1;
+    u->headers_in.last_modified_time = -1;
+
+    if (ngx_list_init(&u->headers_in.headers, r->pool, 8,
+                      sizeof(ngx_table_elt_t))
+        != NGX_OK)
+    {
+        rc = NGX_ERROR;
+        goto failed;
+    }
+
+    if (ngx_list_init(&u->headers_in.trailers, r->pool, 2,
+                      sizeof(ngx_table_elt_t))
+        != NGX_OK)
+    {
+        rc = NGX_ERROR;
+        goto failed;
+    }
+
+    u->state = ngx_array_push(r->upstream_states);
+    if (u->state == NULL) {
+        rc = NGX_ERROR;
+        goto failed;
+    }
+
+    ngx_memzero(u->state, sizeof(ngx_http_upstream_state_t));
+
+    u->state->response_time = (ngx_msec_t) -1;
+    u->state->header_time = ngx_current_msec - u->start_time;
+
+    rc = u->process_header(r);
+
+    if (rc != NGX_OK) {
+        ngx_log_error(NGX_LOG_ALERT, r->connection->log, 0,
+                      "collapsed upstream response contains invalid header");
+        rc = NGX_ERROR;
+        goto failed;
+    }
+
+    rc = ngx_http_upstream_process_headers(r, u);
+
+    if (rc == NGX_DONE) {
+        return;
+    }
+
+    if (rc != NGX_OK) {
+        goto failed;
+    }
+
+    rc = ngx_http_send_header(r);
+
+    if (rc == NGX_ERROR || rc > NGX_OK || r->post_action) {
+        goto failed;
+    }
+
+    u->header_sent = 1;
+
+    if (r->header_only) {
+        ngx_http_upstream_collapse_detach(u->collapse, rc);
+        return;
+    }
+
+    r->write_event_handler = ngx_http_upstream_collapse_process_downstream;
+
+    r->limit_rate = 0;
+    r->limit_rate_set = 1;
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+    if (clcf->tcp_nodelay && ngx_tcp_nodelay(r->connection) != NGX_OK) {
+        rc = NGX_ERROR;
+        goto failed;
+    }
+
+    return;
+
+failed:
+
+    ngx_http_upstream_collapse_detach(u->collapse, rc);
+}
+
+
+static void
+ngx_http_upstream_collapse_input_filters(ngx_http_request_t *r,
+    ngx_http_upstream_t *u)
+{
+    ngx_http_upstream_collapse_t  *uc;
+
+    uc = u->collapse;
+
+    if (!uc->leading || ngx_queue_empty(&uc->waiters)) {
+        return;
+    }
+
+    /* response body is passed to waiters as it is read from upstream */
+
+    if (u->buffering) {
+        uc->pipe_input_filter = u->pipe->input_filter;
+        u->pipe->input_filter = ngx_http_upstream_collapse_pipe_filter;
+
+    } else {
+        uc->input_filter = u->input_filter;
+        uc->input_filter_ctx = u->input_filter_ctx;
+
+        u->input_filter = ngx_http_upstream_collapse_non_buffered_filter;
+        u->input_filter_ctx = r;
+    }
+}
+
+
+static ngx_int_t
+ngx_http_upstream_collapse_pipe_filter(ngx_event_pipe_t *p, ngx_buf_t *buf)
+{
+    ngx_int_t                      rc;
+    ngx_chain_t                  **ll;
+    ngx_http_request_t            *r;
+    ngx_http_upstream_collapse_t  *uc;
+
+    r = p->output_ctx;
+    uc = r->upstream->collapse;
+
+    ll = p->in ? p->last_in : &p->in;
+
+    rc = uc->pipe_input_filter(p, buf);
+
+    if (rc == NGX_OK && *ll) {
+        ngx_http_upstream_collapse_send_body(uc, *ll);
+    }
+
+    return rc;
+}
+
+
+static ngx_int_t
+ngx_http_upstream_collapse_non_buffered_filter(void *data, ssize_t bytes)
+{
+    ngx_http_request_t  *r = data;
+
+    ngx_int_t                      rc;
+    ngx_chain_t                   *cl, **ll;
+    ngx_http_upstream_t           *u;
+    ngx_http_upstream_collapse_t  *uc;
+
+    u = r->upstream;
+    uc = u->collapse;
+
+    for (cl = u->out_bufs, ll = &u->out_bufs; cl; cl = cl->next) {
+        ll = &cl->next;
+    }
+
+    rc = uc->input_filter(uc->input_filter_ctx, bytes);
+
+    if (rc == NGX_OK && *ll) {
+        ngx_http_upstream_collapse_send_body(uc, *ll);
+    }
+
+    return rc;
+}
+
+
+static void
+ngx_http_upstream_collapse_send_body(ngx_http_upstream_collapse_t *uc,
+    ngx_chain_t *in)
+{
+    ngx_int_t                      rc;
+    ngx_queue_t                   *q, *next;
+    ngx_http_request_t            *r;
+    ngx_http_upstream_t           *u;
+    ngx_http_upstream_collapse_t  *w;
+
+    for (q = ngx_queue_head(&uc->waiters);
+         q != ngx_queue_sentinel(&uc->waiters);
+         q = next)
+    {
+        next = ngx_queue_next(q);
+
+        w = ngx_queue_data(q, ngx_http_upstream_collapse_t, queue);
+
+        r = w->request;
+        u = r->upstream;
+
+        rc = ngx_http_upstream_collapse_copy(r, u, in);
+
+        if (rc == NGX_DECLINED) {
+            ngx_log_error(NGX_LOG_WARN, r->connection->log, 0,
+                          "collapsed response is not sent to a slow client "
+                          "fast enough");
+        }
+
+        if (rc != NGX_OK) {
+            ngx_http_upstream_collapse_detach(w, NGX_ERROR);
+            continue;
+        }
+
+        ngx_http_upstream_collapse_process_request(r, u);
+    }
+}
+
+
+static ngx_int_t
+ngx_http_upstream_collapse_copy(ngx_http_request_t *r, ngx_http_upstream_t *u,
+    ngx_chain_t *in)
+{
+    off_t         queued;
+    size_t        size;
+    ngx_buf_t    *b;
+    ngx_chain_t  *cl, **ll;
+
+    /*
+     * the response data not yet sent to the client
+     * is limited by the configured buffers
+     */
+
+    queued = 0;
+
+    for (cl = u->busy_bufs; cl; cl = cl->next) {
+        queued += ngx_buf_size(cl->buf);
+    }
+
+    for (cl = in; cl; cl = cl->next) {
+        queued += ngx_buf_size(cl->buf);
+    }
+
+    for (cl = u->out_bufs, ll = &u->out_bufs; cl; cl = cl->next) {
+        queued += ngx_buf_size(cl->buf);
+        ll = &cl->next;
+    }
+
+    if (queued > (off_t) (u->conf->bufs.num * u->conf->bufs.size
+                          + u->conf->buffer_size))
+    {
+        return NGX_DECLINED;
+    }
+
+    for ( /* void */ ; in; in = in->next) {
+
+        size = in->buf->last - in->buf->pos;
+
+        if (size == 0) {
+            continue;
+        }
+
+        cl = ngx_chain_get_free_buf(r->pool, &u->free_bufs);
+        if (cl == NULL) {
+            return NGX_ERROR;
+        }
+
+        b = cl->buf;
+
+        if ((size_t) (b->end - b->start) < size) {
+            size = ngx_max(size, u->conf->buffer_size);
+
+            b->start = ngx_palloc(r->pool, size);
+            if (b->start == NULL) {
+                return NGX_ERROR;
+            }
+
+            b->end = b->start + size;
+            size = in->buf->last - in->buf->pos;
+        }
+
+        b->pos = b->start;
+        b->last = ngx_cpymem(b->pos, in->buf->pos, size);
+
+        b->temporary = 1;
+        b->flush = 1;
+        b->tag = u->output.tag;
+
+        *ll = cl;
+        ll = &cl->next;
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_upstream_collapse_process_downstream(ngx_http_request_t *r)
+{
+    ngx_event_t       *wev;
+    ngx_connection_t  *c;
+
+    c = r->connection;
+    wev = c->write;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http upstream collapse process downstream");
+
+    c->log->action = "sending to client";
+
+    if (wev->timedout) {
+        c->timedout = 1;
+        ngx_connection_error(c, NGX_ETIMEDOUT, "client timed out");
+        ngx_http_upstream_finalize_request(r, r->upstream,
+                                           NGX_HTTP_REQUEST_TIME_OUT);
+        return;
+    }
+
+    ngx_http_upstream_collapse_process_request(r, r->upstream);
+}
+
+
+static void
+ngx_http_upstream_collapse_process_request(ngx_http_request_t *r,
+    ngx_http_upstream_t *u)
+{
+    ngx_int_t                  rc;
+    ngx_connection_t          *c;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    c = r->connection;
+
+    if (u->out_bufs || u->busy_bufs || c->buffered) {
+        rc = ngx_http_output_filter(r, u->out_bufs);
+
+        if (rc == NGX_ERROR) {
+            ngx_http_upstream_collapse_detach(u->collapse, NGX_ERROR);
+            return;
+        }
+
+        ngx_chain_update_chains(r->pool, &u->free_bufs, &u->busy_bufs,
+                                &u->out_bufs, u->output.tag);
+    }
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+    if (c->data == r) {
+        if (ngx_handle_write_event(c->write, clcf->send_lowat) != NGX_OK) {
+            ngx_http_upstream_collapse_detach(u->collapse, NGX_ERROR);
+            return;
+        }
+    }
+
+    if (c->write->active && !c->write->ready) {
+        ngx_add_timer(c->write, clcf->send_timeout);
+
+    } else if (c->write->timer_set) {
+        ngx_del_timer(c->write);
+    }
+}
+
+
+static void
+ngx_http_upstream_collapse_finalize(ngx_http_request_t *r,
+    ngx_http_upstream_t *u, ngx_int_t rc)
+{
+    ngx_http_upstream_collapse_t   *uc;
+    ngx_http_upstream_main_conf_t  *umcf;
+
+    uc = u->collapse;
+
+    if (!uc->leading) {
+
+        if (uc->leader) {
+            ngx_queue_remove(&uc->queue);
+            uc->leader = NULL;
+        }
+
+        return;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http upstream collapse finalize: %i", rc);
+
+    if (uc->header_sent) {
+        ngx_http_upstream_collapse_release(uc, rc ? NGX_ERROR : NGX_OK);
+        return;
+    }
+
+    umcf = ngx_http_get_module_main_conf(r, ngx_http_upstream_module);
+
+    ngx_rbtree_delete(&umcf->collapse, &uc->node);
+    uc->header_sent = 1;
+
+    if (ngx_queue_empty(&uc->waiters)) {
+        return;
+    }
+
+    if (rc >= NGX_HTTP_SPECIAL_RESPONSE
+        && rc != NGX_HTTP_CLIENT_CLOSED_REQUEST
+        && rc != NGX_HTTP_REQUEST_TIME_OUT)
+    {
+        /* the upstream error is returned to all waiting requests */
+
+        ngx_http_upstream_collapse_release(uc, rc);
+        return;
+    }
+
+    ngx_http_upstream_collapse_promote(uc);
+}
+
+
+static void
+ngx_http_upstream_collapse_promote(ngx_http_upstream_collapse_t *uc)
+{
+    ngx_queue_t                    *q;
+    ngx_http_request_t             *r;
+    ngx_http_upstream_collapse_t   *leader, *w;
+    ngx_http_upstream_main_conf_t  *umcf;
+
+    /* the first waiting request goes to upstream on its own */
+
+    q = ngx_queue_head(&uc->waiters);
+    ngx_queue_remove(q);
+
+    leader = ngx_queue_data(q, ngx_http_upstream_collapse_t, queue);
+
+    leader->leader = NULL;
+    leader->leading = 1;
+
+    ngx_queue_init(&leader->waiters);
+
+    if (!ngx_queue_empty(&uc->waiters)) {
+        ngx_queue_add(&leader->waiters, &uc->waiters);
+        ngx_queue_init(&uc->waiters);
+
+        for (q = ngx_queue_head(&leader->waiters);
+             q != ngx_queue_sentinel(&leader->waiters);
+             q = ngx_queue_next(q))
+        {
+            w = ngx_queue_data(q, ngx_http_upstream_collapse_t, queue);
+            w->leader = leader;
+        }
+    }
+
+    r = leader->request;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http upstream collapse promote");
+
+    umcf = ngx_http_get_module_main_conf(r, ngx_http_upstream_module);
+
+    ngx_rbtree_insert(&umcf->collapse, &leader->node);
+
+    r->write_event_handler = ngx_http_upstream_collapse_start_handler;
+    ngx_post_event(r->connection->write, &ngx_posted_events);
+}
+
+
+static void
+ngx_http_upstream_collapse_release(ngx_http_upstream_collapse_t *uc,
+    ngx_int_t rc)
+{
+    ngx_http_upstream_collapse_t  *w;
+
+    while (!ngx_queue_empty(&uc->waiters)) {
+        w = ngx_queue_data(ngx_queue_head(&uc->waiters),
+                           ngx_http_upstream_collapse_t, queue);
+
+        ngx_http_upstream_collapse_detach(w, rc);
+    }
+}
+
+
+static void
+ngx_http_upstream_collapse_restart(ngx_http_upstream_collapse_t *uc)
+{
+    ngx_http_request_t            *r;
+    ngx_http_upstream_collapse_t  *w;
+
+    /* each waiting request goes to upstream on its own */
+
+    while (!ngx_queue_empty(&uc->waiters)) {
+        w = ngx_queue_data(ngx_queue_head(&uc->waiters),
+                           ngx_http_upstream_collapse_t, queue);
+
+        ngx_queue_remove(&w->queue);
+        w->leader = NULL;
+
+        r = w->request;
+        r->upstream->collapse = NULL;
+
+        r->write_event_handler = ngx_http_upstream_collapse_start_handler;
+        ngx_post_event(r->connection->write, &ngx_posted_events);
+    }
+}
+
 
-            stats->responses++;
+static void
+ngx_http_upstream_collapse_detach(ngx_http_upstream_collapse_t *w,
+    ngx_int_t rc)
+{
+    ngx_http_request_t  *r;
 
-            if (u->state) {
-                stats->bytes += u->state->response_length;
-            }
+    /*
+     * waiting requests are finalized from posted events,
+     * as the leading request may be in the middle of its own finalization
+     */
 
-            ngx_shmtx_unlock(&cache->shpool->mutex);
-        }
+    if (w->leader) {
+        ngx_queue_remove(&w->queue);
+        w->leader = NULL;
+    }
 
-#endif
+    w->rc = rc;
 
-    }
+    r = w->request;
 
-#endif
+    r->write_event_handler = ngx_http_upstream_collapse_finalize_handler;
+    ngx_post_event(r->connection->write, &ngx_posted_events);
+}
 
-    r->read_event_handler = ngx_http_block_reading;
 
-    if (rc == NGX_DECLINED) {
-        return;
-    }
+static void
+ngx_http_upstream_collapse_start_handler(ngx_http_request_t *r)
+{
+    ngx_http_upstream_t  *u;
 
-    r->connection->log->action = "sending to client";
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http upstream collapse start");
 
-    if (!u->header_sent
-        || rc == NGX_HTTP_REQUEST_TIME_OUT
-        || rc == NGX_HTTP_CLIENT_CLOSED_REQUEST)
-    {
-        ngx_http_finalize_request(r, rc);
-        return;
-    }
+    u = r->upstream;
 
-    flush = 0;
+    if (!u->store && !r->post_action && !u->conf->ignore_client_abort) {
+        r->write_event_handler = ngx_http_upstream_wr_check_broken_connection;
 
-    if (rc >= NGX_HTTP_SPECIAL_RESPONSE) {
-        rc = NGX_ERROR;
-        flush = 1;
+    } else {
+        r->write_event_handler = ngx_http_request_empty_handler;
     }
 
-    if (r->header_only
-        || (u->pipe && u->pipe->downstream_error))
-    {
-        ngx_http_finalize_request(r, rc);
-        return;
-    }
+    ngx_http_upstream_start(r, u);
+}
 
-    if (rc == 0) {
 
-        if (ngx_http_upstream_process_trailers(r, u) != NGX_OK) {
-            ngx_http_finalize_request(r, NGX_ERROR);
-            return;
-        }
+static void
+ngx_http_upstream_collapse_finalize_handler(ngx_http_request_t *r)
+{
+    ngx_http_upstream_t  *u;
 
-        rc = ngx_http_send_special(r, NGX_HTTP_LAST);
+    u = r->upstream;
 
-    } else if (flush) {
-        r->keepalive = 0;
-        rc = ngx_http_send_special(r, NGX_HTTP_FLUSH);
-    }
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http upstream collapse finalize waiter: %i",
+                   u->collapse->rc);
 
-    ngx_http_finalize_request(r, rc);
+    ngx_http_upstream_finalize_request(r, u, u->collapse->rc);
 }
 
 
@@ -6517,6 +7991,47 @@ ngx_http_upstream_cache_etag(ngx_http_request_t *r,
     return NGX_OK;
 }
 
+
+static ngx_int_t
+ngx_http_upstream_cache_range(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data)
+{
+    u_char            *p;
+    ngx_http_cache_t  *c;
+
+    if (r->upstream == NULL || r->cache == NULL || !r->cache->partial) {
+        v->not_found = 1;
+        return NGX_OK;
+    }
+
+    c = r->cache;
+
+    p = ngx_pnalloc(r->pool, sizeof("bytes=-") - 1 + 2 * NGX_OFF_T_LEN);
+    if (p == NULL) {
+        return NGX_ERROR;
+    }
+
+    v->data = p;
+
+    if (c->partial_start == -1) {
+        p = ngx_sprintf(p, "bytes=-%O", c->partial_end);
+
+    } else if (c->partial_end == -1) {
+        p = ngx_sprintf(p, "bytes=%O-", c->partial_start);
+
+    } else {
+        p = ngx_sprintf(p, "bytes=%O-%O", c->partial_start,
+                        c->partial_end - 1);
+    }
+
+    v->len = p - v->data;
+    v->valid = 1;
+    v->no_cacheable = 0;
+    v->not_found = 0;
+
+    return NGX_OK;
+}
+
 #endif
 
 
@@ -7310,6 +8825,47 @@ ngx_http_upstream_connection_drop_set_slot(ngx_conf_t *cf, ngx_command_t *cmd,
 }
 
 
+#if (NGX_HTTP_V2)
+
+static ngx_int_t
+ngx_http_v2_upstream_init_connection(ngx_http_request_t *r,
+    ngx_http_upstream_t *u)
+{
+    ngx_connection_t          *c, *sc;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    c = u->peer.connection;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http2 upstream init connection on c:%p", c);
+
+    /* the session output is not delayed */
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+    if (clcf->tcp_nodelay && ngx_tcp_nodelay(c) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    sc = ngx_http_v2_upstream_create_session(&u->peer, u->conf);
+    if (sc == NULL) {
+        return NGX_ERROR;
+    }
+
+    sc->data = r;
+    sc->read->handler = ngx_http_upstream_handler;
+    sc->write->handler = ngx_http_upstream_handler;
+
+    u->peer.connection = sc;
+    u->writer.connection = sc;
+    u->output.sendfile = 0;
+
+    return NGX_OK;
+}
+
+#endif
+
+
 #if (NGX_HTTP_V3)
 
 static ngx_int_t
@@ -7626,6 +9182,12 @@ ngx_http_v3_upstream_connected(ngx_http_request_t *r, ngx_http_upstream_t *u,
         }
     }
 
+    if (u->conf->h3_multiplex) {
+        if (ngx_http_v3_upstream_add_session(r, u, c) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+
     if (ngx_http_v3_upstream_send_request(r, u, sc) != NGX_OK) {
         return NGX_ERROR;
     }
@@ -7683,6 +9245,201 @@ ngx_http_v3_upstream_close_request_stream(ngx_connection_t *c,
 }
 
 
+static ngx_int_t
+ngx_http_v3_upstream_connect_peer(ngx_peer_connection_t *pc, void *data)
+{
+    ngx_str_t                        name;
+    ngx_queue_t                     *q, *sessions;
+    ngx_connection_t                *c;
+    ngx_http_request_t              *r;
+    ngx_http_v3_session_t           *h3c;
+    ngx_http_upstream_conf_t        *conf;
+    ngx_http_v3_upstream_session_t  *session;
+    ngx_http_upstream_main_conf_t   *umcf;
+
+    r = pc->ctx;
+    conf = r->upstream->conf;
+
+    if (conf->ssl_server_name || conf->ssl_verify) {
+        if (ngx_http_upstream_ssl_get_name(r, r->upstream, &name) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+    } else {
+        ngx_str_null(&name);
+    }
+
+    umcf = ngx_http_get_module_main_conf(r, ngx_http_upstream_module);
+
+    sessions = &umcf->h3_sessions;
+
+    for (q = ngx_queue_head(sessions);
+         q != ngx_queue_sentinel(sessions);
+         q = ngx_queue_next(q))
+    {
+        session = ngx_queue_data(q, ngx_http_v3_upstream_session_t, queue);
+
+        if (session->processing >= conf->h3_multiplex_streams
+            || ngx_memn2cmp((u_char *) &session->sockaddr,
+                            (u_char *) pc->sockaddr,
+                            session->socklen, pc->socklen)
+               != 0)
+        {
+            continue;
+        }
+
+        /*
+         * a session is only used with the SSL settings it was established
+         * with, and for the server name it was verified for
+         */
+
+        if (session->ssl != conf->ssl
+            || session->ssl_name.len != name.len
+            || ngx_strncmp(session->ssl_name.data, name.data, name.len) != 0)
+        {
+            continue;
+        }
+
+        c = session->connection;
+        h3c = ngx_http_v3_get_session(c);
+
+        /* the peer limits the number of streams, see RFC 9000, 4.6 */
+
+        if (h3c->goaway || h3c->peer_goaway || !ngx_quic_can_open_stream(c, 1))
+        {
+            continue;
+        }
+
+        goto found;
+    }
+
+    return ngx_event_connect(pc, data);
+
+found:
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, pc->log, 0,
+                   "http3 upstream: using connection %p, %ui streams",
+                   c, session->processing);
+
+    session->processing++;
+
+    if (h3c->keepalive.timer_set) {
+        ngx_del_timer(&h3c->keepalive);
+    }
+
+    pc->connection = c;
+    pc->cached = 1;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_v3_upstream_add_session(ngx_http_request_t *r, ngx_http_upstream_t *u,
+    ngx_connection_t *c)
+{
+    ngx_pool_cleanup_t              *cln;
+    ngx_http_v3_upstream_session_t  *session;
+    ngx_http_upstream_main_conf_t   *umcf;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http3 upstream add session c:%p", c);
+
+    session = ngx_palloc(c->pool, sizeof(ngx_http_v3_upstream_session_t));
+    if (session == NULL) {
+        return NGX_ERROR;
+    }
+
+    cln = ngx_pool_cleanup_add(c->pool, 0);
+    if (cln == NULL) {
+        return NGX_ERROR;
+    }
+
+    cln->handler = ngx_http_v3_upstream_cleanup_session;
+    cln->data = session;
+
+    session->connection = c;
+    session->processing = 1;
+
+    session->socklen = u->peer.socklen;
+    ngx_memcpy(&session->sockaddr, u->peer.sockaddr, u->peer.socklen);
+
+    session->ssl = u->conf->ssl;
+
+    /* the name is set by ngx_http_upstream_ssl_name() */
+
+    if (u->conf->ssl_server_name || u->conf->ssl_verify) {
+        session->ssl_name.data = ngx_pstrdup(c->pool, &u->ssl_name);
+        if (session->ssl_name.data == NULL) {
+            return NGX_ERROR;
+        }
+
+        session->ssl_name.len = u->ssl_name.len;
+
+    } else {
+        ngx_str_null(&session->ssl_name);
+    }
+
+    umcf = ngx_http_get_module_main_conf(r, ngx_http_upstream_module);
+
+    ngx_queue_insert_head(&umcf->h3_sessions, &session->queue);
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_v3_upstream_keep_session(ngx_http_upstream_t *u, ngx_connection_t *c)
+{
+    ngx_pool_cleanup_t              *cln;
+    ngx_http_v3_session_t           *h3c;
+    ngx_http_v3_upstream_session_t  *session;
+
+    session = NULL;
+
+    for (cln = c->pool->cleanup; cln; cln = cln->next) {
+        if (cln->handler == ngx_http_v3_upstream_cleanup_session) {
+            session = cln->data;
+            break;
+        }
+    }
+
+    if (session == NULL) {
+        /* the connection was not established */
+        return NGX_DECLINED;
+    }
+
+    if (--session->processing) {
+        return NGX_OK;
+    }
+
+    h3c = ngx_http_v3_get_session(c);
+
+    if (ngx_terminate || ngx_exiting
+        || h3c->goaway || h3c->peer_goaway
+        || !ngx_quic_can_open_stream(c, 1))
+    {
+        return NGX_DECLINED;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http3 upstream keep session c:%p", c);
+
+    ngx_add_timer(&h3c->keepalive, u->conf->h3_multiplex_timeout);
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_v3_upstream_cleanup_session(void *data)
+{
+    ngx_http_v3_upstream_session_t  *session = data;
+
+    ngx_queue_remove(&session->queue);
+}
+
+
 static void
 ngx_http_quic_upstream_dummy_handler(ngx_event_t *ev)
 {
@@ -7958,6 +9715,22 @@ ngx_http_upstream_create_main_conf(ngx_conf_t *cf)
         return NULL;
     }
 
+    ngx_rbtree_init(&umcf->collapse, &umcf->collapse_sentinel,
+                    ngx_http_upstream_collapse_rbtree_insert_value);
+
+    /*
+     * multiplexed sessions are shared by all locations, and matched
+     * by the peer address, SSL context, and SSL server name
+     */
+
+#if (NGX_HTTP_V2)
+    ngx_queue_init(&umcf->multiplex_sessions);
+#endif
+
+#if (NGX_HTTP_V3)
+    ngx_queue_init(&umcf->h3_sessions);
+#endif
+
     return umcf;
 }
 
@@ -89,8 +89,22 @@ typedef struct {
     ngx_hash_t                       headers_in_hash;
     ngx_array_t                      upstreams;
                                              /* ngx_http_upstream_srv_conf_t */
+
+    ngx_rbtree_t                     collapse;
+    ngx_rbtree_node_t                collapse_sentinel;
+
+#if (NGX_HTTP_V2)
+    ngx_queue_t                      multiplex_sessions;
+#endif
+
+#if (NGX_HTTP_V3)
+    ngx_queue_t                      h3_sessions;
+#endif
 } ngx_http_upstream_main_conf_t;
 
+
+typedef struct ngx_http_upstream_collapse_s  ngx_http_upstream_collapse_t;
+
 typedef struct ngx_http_upstream_srv_conf_s  ngx_http_upstream_srv_conf_t;
 
 typedef ngx_int_t (*ngx_http_upstream_init_pt)(ngx_conf_t *cf,
@@ -221,6 +235,9 @@ typedef struct {
     ngx_http_upstream_local_t       *local;
     ngx_flag_t                       socket_keepalive;
 
+    ngx_flag_t                       collapse;
+    ngx_http_complex_value_t        *collapse_key;
+
 #if (NGX_HTTP_CACHE)
     ngx_shm_zone_t                  *cache_zone;
     ngx_http_complex_value_t        *cache_value;
@@ -228,12 +245,15 @@ typedef struct {
     ngx_uint_t                       cache_min_uses;
     ngx_uint_t                       cache_use_stale;
     ngx_uint_t                       cache_methods;
+    ngx_uint_t                       cache_compressed;
 
     off_t                            cache_max_range_offset;
 
     ngx_flag_t                       cache_lock;
     ngx_msec_t                       cache_lock_timeout;
     ngx_msec_t                       cache_lock_age;
+    ngx_flag_t                       cache_lock_stream;
+    size_t                           cache_partial;
 
     ngx_flag_t                       cache_revalidate;
     ngx_flag_t                       cache_convert_head;
@@ -286,9 +306,18 @@ typedef struct {
 
     ngx_str_t                        module;
 
+#if (NGX_HTTP_V2)
+    ngx_flag_t                       multiplex;
+    ngx_uint_t                       multiplex_streams;
+    ngx_msec_t                       multiplex_timeout;
+#endif
+
 #if (NGX_HTTP_V3)
     ngx_quic_conf_t                  quic;
     ngx_http_v3_settings_t           h3_settings;
+    ngx_flag_t                       h3_multiplex;
+    ngx_uint_t                       h3_multiplex_streams;
+    ngx_msec_t                       h3_multiplex_timeout;
 #endif
 
     NGX_COMPAT_BEGIN(2)
@@ -431,6 +460,8 @@ struct ngx_http_upstream_s {
 
     ngx_http_cleanup_pt             *cleanup;
 
+    ngx_http_upstream_collapse_t    *collapse;
+
     unsigned                         store:1;
     unsigned                         cacheable:1;
     unsigned                         accel:1;
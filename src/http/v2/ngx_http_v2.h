@@ -49,6 +49,9 @@
 #define NGX_HTTP_V2_MAX_WINDOW           ((1U << 31) - 1)
 #define NGX_HTTP_V2_DEFAULT_WINDOW       65535
 
+#define NGX_HTTP_V2_UPSTREAM_WINDOW         (16 * 1024 * 1024)
+#define NGX_HTTP_V2_UPSTREAM_STREAM_WINDOW  (1024 * 1024)
+
 #define NGX_HTTP_V2_DEFAULT_WEIGHT       16
 
 
@@ -57,6 +60,14 @@ typedef struct ngx_http_v2_node_s         ngx_http_v2_node_t;
 typedef struct ngx_http_v2_out_frame_s    ngx_http_v2_out_frame_t;
 
 
+typedef struct {
+    size_t                           init_window;
+    size_t                           send_window;
+    size_t                           recv_window;
+    ngx_uint_t                       last_stream_id;
+} ngx_http_v2_upstream_conn_t;
+
+
 typedef u_char *(*ngx_http_v2_handler_pt) (ngx_http_v2_connection_t *h2c,
     u_char *pos, u_char *end);
 
@@ -301,6 +312,15 @@ void ngx_http_v2_close_stream(ngx_http_v2_stream_t *stream, ngx_int_t rc);
 
 ngx_int_t ngx_http_v2_send_output_queue(ngx_http_v2_connection_t *h2c);
 
+ngx_int_t ngx_http_v2_upstream_connect_peer(ngx_peer_connection_t *pc,
+    void *data);
+ngx_connection_t *ngx_http_v2_upstream_create_session(
+    ngx_peer_connection_t *pc, ngx_http_upstream_conf_t *conf);
+ngx_http_v2_upstream_conn_t *ngx_http_v2_upstream_get_conn(
+    ngx_connection_t *c);
+void ngx_http_v2_upstream_close_stream(ngx_connection_t *c);
+ngx_connection_t *ngx_http_v2_upstream_get_ssl_data(ngx_connection_t *c);
+
 
 ngx_str_t *ngx_http_v2_get_static_name(ngx_uint_t index);
 ngx_str_t *ngx_http_v2_get_static_value(ngx_uint_t index);
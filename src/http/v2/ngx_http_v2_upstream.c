@@ -0,0 +1,1680 @@
+
+/*
+ * Copyright (C) 2026 Web Server LLC
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+/*
+ * An upstream HTTP/2 session multiplexes requests to a peer over a single
+ * connection.  Each request gets a stream, that is a fake connection which
+ * is used by the upstream module in place of the real one: the frames sent
+ * to the stream are copied to the session output, while the frames received
+ * from the peer are demultiplexed by stream identifiers and are read from
+ * the stream as is.  The frames of stream 0 are handled by the session;
+ * SETTINGS and GOAWAY are passed to all streams as well.
+ *
+ * The connection receive window is maintained by the session and is only
+ * refilled as the streams read their data.
+ */
+
+
+#define NGX_HTTP_V2_UPSTREAM_BUFFER_SIZE       16384
+#define NGX_HTTP_V2_UPSTREAM_OUTPUT_LIMIT      (4 * 16384)
+#define NGX_HTTP_V2_UPSTREAM_STREAM_POOL_SIZE  1024
+
+#define NGX_HTTP_V2_UPSTREAM_MAX_STREAM_ID     0x7fffffff
+
+/* errors */
+#define NGX_HTTP_V2_CANCEL                     0x8
+
+/* settings fields */
+#define NGX_HTTP_V2_MAX_STREAMS_SETTING        0x3
+#define NGX_HTTP_V2_INIT_WINDOW_SIZE_SETTING   0x4
+
+
+typedef enum {
+    ngx_http_v2_upstream_st_header = 0,
+    ngx_http_v2_upstream_st_stream,
+    ngx_http_v2_upstream_st_control,
+    ngx_http_v2_upstream_st_skip
+} ngx_http_v2_upstream_state_e;
+
+
+typedef struct ngx_http_v2_upstream_session_s  ngx_http_v2_upstream_session_t;
+
+
+typedef struct {
+    ngx_connection_t                   connection;
+    ngx_event_t                        read;
+    ngx_event_t                        write;
+
+    ngx_http_v2_upstream_session_t    *session;
+    ngx_pool_t                        *pool;
+    ngx_queue_t                        queue;
+
+    ngx_uint_t                         id;
+
+    ngx_chain_t                       *in;
+    ngx_chain_t                       *last;
+    ngx_chain_t                       *free;
+    size_t                             buffered;
+
+    /* parsing of the frames sent */
+    u_char                             frame[NGX_HTTP_V2_FRAME_HEADER_SIZE];
+    size_t                             frame_len;
+    size_t                             skip;
+    size_t                             rest;
+
+    unsigned                           blocked:1;
+    unsigned                           local_end:1;
+    unsigned                           remote_end:1;
+    unsigned                           reset:1;
+} ngx_http_v2_upstream_stream_t;
+
+
+struct ngx_http_v2_upstream_session_s {
+    ngx_connection_t                  *connection;
+    ngx_pool_t                        *pool;
+    ngx_queue_t                        queue;
+
+    ngx_queue_t                        streams;
+    ngx_uint_t                         processing;
+    ngx_uint_t                         max_streams;
+
+    ngx_msec_t                         timeout;
+
+    ngx_http_v2_upstream_conn_t        conn;
+
+    ngx_sockaddr_t                     sockaddr;
+    socklen_t                          socklen;
+
+    void                              *ssl;
+    ngx_str_t                          ssl_name;
+
+    u_char                            *buffer;
+
+    ngx_http_v2_upstream_state_e       state;
+    u_char                             frame[NGX_HTTP_V2_FRAME_HEADER_SIZE];
+    size_t                             frame_len;
+    size_t                             rest;
+    ngx_uint_t                         type;
+    ngx_uint_t                         flags;
+    ngx_uint_t                         sid;
+    ngx_http_v2_upstream_stream_t     *stream;
+    u_char                            *payload;
+    size_t                             payload_len;
+
+    ngx_chain_t                       *out;
+    ngx_chain_t                       *last;
+    ngx_chain_t                       *free;
+    size_t                             out_size;
+
+    size_t                             buffered;
+
+    unsigned                           listed:1;
+    unsigned                           settings:1;
+    unsigned                           goaway:1;
+};
+
+
+static ngx_int_t ngx_http_v2_upstream_ssl_name(ngx_http_request_t *r,
+    void **ssl, ngx_str_t *name);
+static ngx_http_v2_upstream_stream_t *ngx_http_v2_upstream_create_stream(
+    ngx_http_v2_upstream_session_t *session, ngx_log_t *log);
+static void ngx_http_v2_upstream_read_handler(ngx_event_t *rev);
+static void ngx_http_v2_upstream_write_handler(ngx_event_t *wev);
+static ngx_int_t ngx_http_v2_upstream_process(
+    ngx_http_v2_upstream_session_t *session, u_char *p, u_char *end);
+static ngx_int_t ngx_http_v2_upstream_frame(
+    ngx_http_v2_upstream_session_t *session);
+static ngx_int_t ngx_http_v2_upstream_control(
+    ngx_http_v2_upstream_session_t *session);
+static ngx_int_t ngx_http_v2_upstream_settings(
+    ngx_http_v2_upstream_session_t *session);
+static ngx_int_t ngx_http_v2_upstream_forward(
+    ngx_http_v2_upstream_session_t *session);
+static ngx_int_t ngx_http_v2_upstream_input(
+    ngx_http_v2_upstream_stream_t *stream, u_char *p, size_t len);
+static ngx_int_t ngx_http_v2_upstream_update_window(
+    ngx_http_v2_upstream_session_t *session);
+static ngx_int_t ngx_http_v2_upstream_send_frame(
+    ngx_http_v2_upstream_session_t *session, ngx_uint_t type,
+    ngx_uint_t flags, ngx_uint_t sid, u_char *payload, size_t len);
+static ngx_int_t ngx_http_v2_upstream_send_output(
+    ngx_http_v2_upstream_session_t *session);
+static void ngx_http_v2_upstream_post_write(
+    ngx_http_v2_upstream_session_t *session);
+static void ngx_http_v2_upstream_close_session(
+    ngx_http_v2_upstream_session_t *session);
+static void ngx_http_v2_upstream_wake_stream(
+    ngx_http_v2_upstream_stream_t *stream);
+static ngx_int_t ngx_http_v2_upstream_append(ngx_pool_t *pool,
+    ngx_chain_t **out, ngx_chain_t **last, ngx_chain_t **free, u_char *p,
+    size_t len);
+
+static ssize_t ngx_http_v2_upstream_recv(ngx_connection_t *c, u_char *buf,
+    size_t size);
+static ssize_t ngx_http_v2_upstream_recv_chain(ngx_connection_t *c,
+    ngx_chain_t *in, off_t limit);
+static ssize_t ngx_http_v2_upstream_send(ngx_connection_t *c, u_char *buf,
+    size_t size);
+static ngx_chain_t *ngx_http_v2_upstream_send_chain(ngx_connection_t *c,
+    ngx_chain_t *in, off_t limit);
+static void ngx_http_v2_upstream_parse_output(
+    ngx_http_v2_upstream_stream_t *stream, u_char *p, size_t len);
+
+
+#define ngx_http_v2_upstream_get_stream(c)                                    \
+    ((ngx_http_v2_upstream_stream_t *)                                        \
+         ((u_char *) (c) - offsetof(ngx_http_v2_upstream_stream_t, connection)))
+
+
+ngx_int_t
+ngx_http_v2_upstream_connect_peer(ngx_peer_connection_t *pc, void *data)
+{
+    void                            *ssl;
+    ngx_str_t                        name;
+    ngx_uint_t                       max;
+    ngx_queue_t                     *q, *sessions;
+    ngx_connection_t                *c;
+    ngx_http_request_t              *r;
+    ngx_http_upstream_conf_t        *conf;
+    ngx_http_v2_upstream_stream_t   *stream;
+    ngx_http_v2_upstream_session_t  *session;
+    ngx_http_upstream_main_conf_t   *umcf;
+
+    r = pc->ctx;
+    conf = r->upstream->conf;
+
+    if (ngx_http_v2_upstream_ssl_name(r, &ssl, &name) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    umcf = ngx_http_get_module_main_conf(r, ngx_http_upstream_module);
+
+    sessions = &umcf->multiplex_sessions;
+
+    for (q = ngx_queue_head(sessions);
+         q != ngx_queue_sentinel(sessions);
+         q = ngx_queue_next(q))
+    {
+        session = ngx_queue_data(q, ngx_http_v2_upstream_session_t, queue);
+
+        if (!session->settings
+            || ngx_memn2cmp((u_char *) &session->sockaddr,
+                            (u_char *) pc->sockaddr,
+                            session->socklen, pc->socklen)
+               != 0)
+        {
+            continue;
+        }
+
+        /*
+         * a session is only used with the SSL settings it was established
+         * with, and for the server name it was verified for
+         */
+
+        if (session->ssl != ssl
+            || session->ssl_name.len != name.len
+            || ngx_strncmp(session->ssl_name.data, name.data, name.len) != 0)
+        {
+            continue;
+        }
+
+        max = ngx_min(conf->multiplex_streams, session->max_streams);
+
+        if (session->processing >= max) {
+            continue;
+        }
+
+        if (session->conn.last_stream_id + 2 * (session->processing + 1)
+            > NGX_HTTP_V2_UPSTREAM_MAX_STREAM_ID)
+        {
+            continue;
+        }
+
+        goto found;
+    }
+
+    return ngx_event_connect(pc, data);
+
+found:
+
+    c = session->connection;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, pc->log, 0,
+                   "http2 upstream: using session %p, %ui streams",
+                   c, session->processing);
+
+    stream = ngx_http_v2_upstream_create_stream(session, pc->log);
+    if (stream == NULL) {
+        return NGX_ERROR;
+    }
+
+    if (c->idle) {
+        c->idle = 0;
+
+        if (c->read->timer_set) {
+            ngx_del_timer(c->read);
+        }
+    }
+
+    pc->connection = &stream->connection;
+    pc->cached = 1;
+
+    return NGX_OK;
+}
+
+
+ngx_connection_t *
+ngx_http_v2_upstream_create_session(ngx_peer_connection_t *pc,
+    ngx_http_upstream_conf_t *conf)
+{
+    ngx_str_t                        name;
+    ngx_connection_t                *c;
+    ngx_http_v2_upstream_stream_t   *stream;
+    ngx_http_v2_upstream_session_t  *session;
+    ngx_http_upstream_main_conf_t   *umcf;
+
+    c = pc->connection;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http2 upstream create session: %d", c->fd);
+
+    session = ngx_pcalloc(c->pool, sizeof(ngx_http_v2_upstream_session_t));
+    if (session == NULL) {
+        return NULL;
+    }
+
+    session->buffer = ngx_palloc(c->pool, NGX_HTTP_V2_UPSTREAM_BUFFER_SIZE);
+    if (session->buffer == NULL) {
+        return NULL;
+    }
+
+    session->payload = ngx_palloc(c->pool, NGX_HTTP_V2_DEFAULT_FRAME_SIZE);
+    if (session->payload == NULL) {
+        return NULL;
+    }
+
+    session->connection = c;
+    session->pool = c->pool;
+
+    ngx_queue_init(&session->streams);
+
+    session->max_streams = NGX_MAX_INT32_VALUE;
+    session->timeout = conf->multiplex_timeout;
+
+    session->conn.init_window = NGX_HTTP_V2_DEFAULT_WINDOW;
+    session->conn.send_window = NGX_HTTP_V2_DEFAULT_WINDOW;
+    session->conn.recv_window = NGX_HTTP_V2_UPSTREAM_WINDOW;
+
+    ngx_memcpy(&session->sockaddr, pc->sockaddr, pc->socklen);
+    session->socklen = pc->socklen;
+
+    if (ngx_http_v2_upstream_ssl_name(pc->ctx, &session->ssl, &name)
+        != NGX_OK)
+    {
+        return NULL;
+    }
+
+    if (name.len) {
+        session->ssl_name.data = ngx_pstrdup(c->pool, &name);
+        if (session->ssl_name.data == NULL) {
+            return NULL;
+        }
+
+        session->ssl_name.len = name.len;
+    }
+
+    stream = ngx_http_v2_upstream_create_stream(session, c->log);
+    if (stream == NULL) {
+        return NULL;
+    }
+
+    /* the first stream starts the connection with the preface */
+
+    stream->skip = sizeof(NGX_HTTP_V2_PREFACE) - 1;
+
+    if (c->read->timer_set) {
+        ngx_del_timer(c->read);
+    }
+
+    if (c->write->timer_set) {
+        ngx_del_timer(c->write);
+    }
+
+    c->data = session;
+    c->read->handler = ngx_http_v2_upstream_read_handler;
+    c->write->handler = ngx_http_v2_upstream_write_handler;
+
+    c->log = ngx_cycle->log;
+    c->read->log = ngx_cycle->log;
+    c->write->log = ngx_cycle->log;
+    c->pool->log = ngx_cycle->log;
+
+    umcf = ngx_http_get_module_main_conf((ngx_http_request_t *) pc->ctx,
+                                         ngx_http_upstream_module);
+
+    ngx_queue_insert_tail(&umcf->multiplex_sessions, &session->queue);
+    session->listed = 1;
+
+    if (c->read->ready) {
+        ngx_post_event(c->read, &ngx_posted_events);
+    }
+
+    return &stream->connection;
+}
+
+
+static ngx_int_t
+ngx_http_v2_upstream_ssl_name(ngx_http_request_t *r, void **ssl,
+    ngx_str_t *name)
+{
+#if (NGX_HTTP_SSL)
+    ngx_http_upstream_t  *u;
+
+    u = r->upstream;
+
+    if (u->ssl) {
+        *ssl = u->conf->ssl;
+
+        if (u->conf->ssl_name) {
+            return ngx_http_complex_value(r, u->conf->ssl_name, name);
+        }
+
+        *name = u->resolved ? u->resolved->host : u->upstream->host;
+
+        return NGX_OK;
+    }
+#endif
+
+    *ssl = NULL;
+    ngx_str_null(name);
+
+    return NGX_OK;
+}
+
+
+ngx_http_v2_upstream_conn_t *
+ngx_http_v2_upstream_get_conn(ngx_connection_t *c)
+{
+    ngx_http_v2_upstream_stream_t  *stream;
+
+    if (c->recv != ngx_http_v2_upstream_recv) {
+        return NULL;
+    }
+
+    stream = ngx_http_v2_upstream_get_stream(c);
+
+    return &stream->session->conn;
+}
+
+
+ngx_connection_t *
+ngx_http_v2_upstream_get_ssl_data(ngx_connection_t *c)
+{
+    ngx_queue_t                     *q;
+    ngx_http_v2_upstream_stream_t   *stream;
+    ngx_http_v2_upstream_session_t  *session;
+
+    if (c->read->handler != ngx_http_v2_upstream_read_handler) {
+        return c;
+    }
+
+    session = c->data;
+
+    if (ngx_queue_empty(&session->streams)) {
+        return NULL;
+    }
+
+    q = ngx_queue_head(&session->streams);
+    stream = ngx_queue_data(q, ngx_http_v2_upstream_stream_t, queue);
+
+    return &stream->connection;
+}
+
+
+void
+ngx_http_v2_upstream_close_stream(ngx_connection_t *c)
+{
+    u_char                           buf[4];
+    ngx_pool_t                      *pool;
+    ngx_connection_t                *pc;
+    ngx_http_v2_upstream_stream_t   *stream;
+    ngx_http_v2_upstream_session_t  *session;
+
+    stream = ngx_http_v2_upstream_get_stream(c);
+    session = stream->session;
+
+    ngx_log_debug3(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http2 upstream close stream %ui, %ui left, buffered:%uz",
+                   stream->id, session->processing - 1, stream->buffered);
+
+    if (session->connection
+        && stream->id
+        && !stream->reset
+        && !(stream->local_end && stream->remote_end))
+    {
+        (void) ngx_http_v2_write_uint32(buf, NGX_HTTP_V2_CANCEL);
+
+        if (ngx_http_v2_upstream_send_frame(session,
+                                            NGX_HTTP_V2_RST_STREAM_FRAME, 0,
+                                            stream->id, buf, 4)
+            != NGX_OK)
+        {
+            ngx_http_v2_upstream_close_session(session);
+        }
+    }
+
+    if (c->read->timer_set) {
+        ngx_del_timer(c->read);
+    }
+
+    if (c->write->timer_set) {
+        ngx_del_timer(c->write);
+    }
+
+    if (c->read->posted) {
+        ngx_delete_posted_event(c->read);
+    }
+
+    if (c->write->posted) {
+        ngx_delete_posted_event(c->write);
+    }
+
+    session->buffered -= stream->buffered;
+    session->processing--;
+
+    ngx_queue_remove(&stream->queue);
+
+    pool = stream->pool;
+    ngx_destroy_pool(pool);
+
+    pc = session->connection;
+
+    if (pc == NULL) {
+        if (ngx_queue_empty(&session->streams)) {
+            ngx_destroy_pool(session->pool);
+        }
+
+        return;
+    }
+
+    if (ngx_http_v2_upstream_update_window(session) != NGX_OK) {
+        ngx_http_v2_upstream_close_session(session);
+        return;
+    }
+
+    if (session->processing) {
+        return;
+    }
+
+    if (session->goaway || ngx_terminate || ngx_exiting) {
+        ngx_http_v2_upstream_close_session(session);
+        return;
+    }
+
+    pc->idle = 1;
+    ngx_add_timer(pc->read, session->timeout);
+}
+
+
+static ngx_http_v2_upstream_stream_t *
+ngx_http_v2_upstream_create_stream(ngx_http_v2_upstream_session_t *session,
+    ngx_log_t *log)
+{
+    ngx_pool_t                     *pool;
+    ngx_event_t                    *rev, *wev;
+    ngx_connection_t               *c, *sc;
+    ngx_http_v2_upstream_stream_t  *stream;
+
+    pool = ngx_create_pool(NGX_HTTP_V2_UPSTREAM_STREAM_POOL_SIZE, log);
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    stream = ngx_pcalloc(pool, sizeof(ngx_http_v2_upstream_stream_t));
+    if (stream == NULL) {
+        ngx_destroy_pool(pool);
+        return NULL;
+    }
+
+    stream->session = session;
+    stream->pool = pool;
+
+    c = session->connection;
+
+    sc = &stream->connection;
+    rev = &stream->read;
+    wev = &stream->write;
+
+    /*
+     * the events of a stream are never added to the event method,
+     * they are only posted by the session; an event is either ready
+     * or active, so ngx_handle_read_event() and ngx_handle_write_event()
+     * do nothing for them
+     */
+
+    rev->data = sc;
+    rev->log = log;
+    rev->active = 1;
+
+    wev->data = sc;
+    wev->log = log;
+    wev->write = 1;
+    wev->ready = 1;
+
+    sc->fd = c->fd;
+    sc->type = c->type;
+
+    sc->read = rev;
+    sc->write = wev;
+
+    sc->recv = ngx_http_v2_upstream_recv;
+    sc->send = ngx_http_v2_upstream_send;
+    sc->recv_chain = ngx_http_v2_upstream_recv_chain;
+    sc->send_chain = ngx_http_v2_upstream_send_chain;
+
+    sc->log = log;
+    sc->pool = pool;
+
+    sc->sockaddr = c->sockaddr;
+    sc->socklen = c->socklen;
+    sc->addr_text = c->addr_text;
+    sc->local_sockaddr = c->local_sockaddr;
+    sc->local_socklen = c->local_socklen;
+
+#if (NGX_SSL)
+    sc->ssl = c->ssl;
+#endif
+
+    sc->number = ngx_atomic_fetch_add(ngx_connection_counter, 1);
+    sc->start_time = ngx_current_msec;
+
+    sc->shared = 1;
+    sc->sndlowat = 1;
+    sc->tcp_nodelay = NGX_TCP_NODELAY_DISABLED;
+    sc->tcp_nopush = NGX_TCP_NOPUSH_DISABLED;
+
+    ngx_queue_insert_tail(&session->streams, &stream->queue);
+    session->processing++;
+
+    return stream;
+}
+
+
+static void
+ngx_http_v2_upstream_read_handler(ngx_event_t *rev)
+{
+    ssize_t                          n;
+    ngx_connection_t                *c;
+    ngx_http_v2_upstream_session_t  *session;
+
+    c = rev->data;
+    session = c->data;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http2 upstream read handler");
+
+    if (rev->timedout || c->close) {
+        ngx_http_v2_upstream_close_session(session);
+        return;
+    }
+
+    do {
+        n = c->recv(c, session->buffer, NGX_HTTP_V2_UPSTREAM_BUFFER_SIZE);
+
+        if (n == NGX_AGAIN) {
+            break;
+        }
+
+        if (n == 0 || n == NGX_ERROR) {
+            ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                           "http2 upstream session closed by peer");
+
+            ngx_http_v2_upstream_close_session(session);
+            return;
+        }
+
+        if (ngx_http_v2_upstream_process(session, session->buffer,
+                                         session->buffer + n)
+            != NGX_OK)
+        {
+            ngx_http_v2_upstream_close_session(session);
+            return;
+        }
+
+    } while (rev->ready);
+
+    if (ngx_http_v2_upstream_update_window(session) != NGX_OK) {
+        ngx_http_v2_upstream_close_session(session);
+        return;
+    }
+
+    if (ngx_handle_read_event(rev, 0) != NGX_OK) {
+        ngx_http_v2_upstream_close_session(session);
+        return;
+    }
+}
+
+
+static void
+ngx_http_v2_upstream_write_handler(ngx_event_t *wev)
+{
+    ngx_connection_t                *c;
+    ngx_http_v2_upstream_session_t  *session;
+
+    c = wev->data;
+    session = c->data;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http2 upstream write handler");
+
+    if (ngx_http_v2_upstream_send_output(session) == NGX_ERROR) {
+        ngx_http_v2_upstream_close_session(session);
+    }
+}
+
+
+static ngx_int_t
+ngx_http_v2_upstream_process(ngx_http_v2_upstream_session_t *session,
+    u_char *p, u_char *end)
+{
+    size_t  n;
+
+    while (p < end) {
+
+        switch (session->state) {
+
+        case ngx_http_v2_upstream_st_header:
+
+            n = ngx_min((size_t) (end - p),
+                        NGX_HTTP_V2_FRAME_HEADER_SIZE - session->frame_len);
+
+            ngx_memcpy(session->frame + session->frame_len, p, n);
+
+            p += n;
+            session->frame_len += n;
+
+            if (session->frame_len < NGX_HTTP_V2_FRAME_HEADER_SIZE) {
+                return NGX_OK;
+            }
+
+            session->frame_len = 0;
+
+            if (ngx_http_v2_upstream_frame(session) != NGX_OK) {
+                return NGX_ERROR;
+            }
+
+            break;
+
+        default: /* payload */
+
+            n = ngx_min((size_t) (end - p), session->rest);
+
+            if (session->state == ngx_http_v2_upstream_st_stream) {
+                if (ngx_http_v2_upstream_input(session->stream, p, n)
+                    != NGX_OK)
+                {
+                    return NGX_ERROR;
+                }
+
+            } else if (session->state == ngx_http_v2_upstream_st_control) {
+                ngx_memcpy(session->payload + session->payload_len, p, n);
+                session->payload_len += n;
+            }
+
+            p += n;
+            session->rest -= n;
+        }
+
+        if (session->state == ngx_http_v2_upstream_st_header
+            || session->rest)
+        {
+            continue;
+        }
+
+        if (session->state == ngx_http_v2_upstream_st_control
+            && ngx_http_v2_upstream_control(session) != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+        session->state = ngx_http_v2_upstream_st_header;
+        session->stream = NULL;
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_v2_upstream_frame(ngx_http_v2_upstream_session_t *session)
+{
+    u_char                         *f;
+    size_t                          length;
+    ngx_queue_t                    *q;
+    ngx_connection_t               *c;
+    ngx_http_v2_upstream_stream_t  *stream;
+
+    c = session->connection;
+    f = session->frame;
+
+    length = (f[0] << 16) + (f[1] << 8) + f[2];
+
+    session->type = f[3];
+    session->flags = f[4];
+    session->sid = ngx_http_v2_parse_sid(&f[5]);
+
+    ngx_log_debug4(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http2 upstream frame type:%ui f:%Xi l:%uz sid:%ui",
+                   session->type, session->flags, length, session->sid);
+
+    if (length > NGX_HTTP_V2_DEFAULT_FRAME_SIZE) {
+        ngx_log_error(NGX_LOG_ERR, c->log, 0,
+                      "upstream sent too large http2 frame: %uz", length);
+        return NGX_ERROR;
+    }
+
+    session->rest = length;
+
+    if (session->sid == 0) {
+        session->state = ngx_http_v2_upstream_st_control;
+        session->payload_len = 0;
+        return NGX_OK;
+    }
+
+    if (session->type == NGX_HTTP_V2_DATA_FRAME) {
+
+        if (length > session->conn.recv_window) {
+            ngx_log_error(NGX_LOG_ERR, c->log, 0,
+                          "upstream violated connection flow control, "
+                          "received %uz data frame with window %uz",
+                          length, session->conn.recv_window);
+            return NGX_ERROR;
+        }
+
+        session->conn.recv_window -= length;
+    }
+
+    for (q = ngx_queue_head(&session->streams);
+         q != ngx_queue_sentinel(&session->streams);
+         q = ngx_queue_next(q))
+    {
+        stream = ngx_queue_data(q, ngx_http_v2_upstream_stream_t, queue);
+
+        if (stream->id == session->sid) {
+            goto found;
+        }
+    }
+
+    /* a stream already closed */
+
+    session->state = ngx_http_v2_upstream_st_skip;
+
+    return NGX_OK;
+
+found:
+
+    if ((session->type == NGX_HTTP_V2_DATA_FRAME
+         || session->type == NGX_HTTP_V2_HEADERS_FRAME)
+        && (session->flags & NGX_HTTP_V2_END_STREAM_FLAG))
+    {
+        stream->remote_end = 1;
+    }
+
+    if (session->type == NGX_HTTP_V2_RST_STREAM_FRAME) {
+        stream->reset = 1;
+    }
+
+    session->state = ngx_http_v2_upstream_st_stream;
+    session->stream = stream;
+
+    return ngx_http_v2_upstream_input(stream, f, NGX_HTTP_V2_FRAME_HEADER_SIZE);
+}
+
+
+static ngx_int_t
+ngx_http_v2_upstream_control(ngx_http_v2_upstream_session_t *session)
+{
+    size_t                          window;
+    ngx_queue_t                    *q;
+    ngx_connection_t               *c;
+    ngx_http_v2_upstream_stream_t  *stream;
+
+    c = session->connection;
+
+    switch (session->type) {
+
+    case NGX_HTTP_V2_SETTINGS_FRAME:
+        return ngx_http_v2_upstream_settings(session);
+
+    case NGX_HTTP_V2_PING_FRAME:
+
+        if (session->payload_len != 8) {
+            ngx_log_error(NGX_LOG_ERR, c->log, 0,
+                          "upstream sent ping frame with invalid length: %uz",
+                          session->payload_len);
+            return NGX_ERROR;
+        }
+
+        if (session->flags & NGX_HTTP_V2_ACK_FLAG) {
+            return NGX_OK;
+        }
+
+        return ngx_http_v2_upstream_send_frame(session,
+                                               NGX_HTTP_V2_PING_FRAME,
+                                               NGX_HTTP_V2_ACK_FLAG, 0,
+                                               session->payload, 8);
+
+    case NGX_HTTP_V2_GOAWAY_FRAME:
+
+        if (session->payload_len < 8) {
+            ngx_log_error(NGX_LOG_ERR, c->log, 0,
+                          "upstream sent goaway frame with invalid length: %uz",
+                          session->payload_len);
+            return NGX_ERROR;
+        }
+
+        ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                       "http2 upstream goaway: %ui, error %ui",
+                       (ngx_uint_t) ngx_http_v2_parse_sid(session->payload),
+                       (ngx_uint_t)
+                           ngx_http_v2_parse_uint32(session->payload + 4));
+
+        /* no new streams are opened in the session */
+
+        session->goaway = 1;
+
+        if (session->listed) {
+            ngx_queue_remove(&session->queue);
+            session->listed = 0;
+        }
+
+        return ngx_http_v2_upstream_forward(session);
+
+    case NGX_HTTP_V2_WINDOW_UPDATE_FRAME:
+
+        if (session->payload_len != 4) {
+            ngx_log_error(NGX_LOG_ERR, c->log, 0,
+                          "upstream sent window update frame "
+                          "with invalid length: %uz",
+                          session->payload_len);
+            return NGX_ERROR;
+        }
+
+        window = ngx_http_v2_parse_window(session->payload);
+
+        ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                       "http2 upstream window update: %uz, window %uz",
+                       window, session->conn.send_window);
+
+        if (window == 0
+            || window > NGX_HTTP_V2_MAX_WINDOW - session->conn.send_window)
+        {
+            ngx_log_error(NGX_LOG_ERR, c->log, 0,
+                          "upstream sent invalid window update: %uz", window);
+            return NGX_ERROR;
+        }
+
+        session->conn.send_window += window;
+
+        /* the streams blocked on the connection window can proceed */
+
+        for (q = ngx_queue_head(&session->streams);
+             q != ngx_queue_sentinel(&session->streams);
+             q = ngx_queue_next(q))
+        {
+            stream = ngx_queue_data(q, ngx_http_v2_upstream_stream_t, queue);
+
+            if (!stream->blocked) {
+                ngx_post_event(&stream->write, &ngx_posted_events);
+            }
+        }
+
+        return NGX_OK;
+
+    default:
+        return NGX_OK;
+    }
+}
+
+
+static ngx_int_t
+ngx_http_v2_upstream_settings(ngx_http_v2_upstream_session_t *session)
+{
+    u_char            *p, *end;
+    ngx_uint_t         id, value;
+    ngx_connection_t  *c;
+
+    c = session->connection;
+
+    if (session->flags & NGX_HTTP_V2_ACK_FLAG) {
+
+        if (session->payload_len != 0) {
+            ngx_log_error(NGX_LOG_ERR, c->log, 0,
+                          "upstream sent settings frame "
+                          "with ack flag and non-zero length: %uz",
+                          session->payload_len);
+            return NGX_ERROR;
+        }
+
+        return NGX_OK;
+    }
+
+    if (session->payload_len % 6 != 0) {
+        ngx_log_error(NGX_LOG_ERR, c->log, 0,
+                      "upstream sent settings frame with invalid length: %uz",
+                      session->payload_len);
+        return NGX_ERROR;
+    }
+
+    end = session->payload + session->payload_len;
+
+    for (p = session->payload; p < end; p += 6) {
+        id = ngx_http_v2_parse_uint16(p);
+        value = ngx_http_v2_parse_uint32(&p[2]);
+
+        ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                       "http2 upstream setting: %ui %ui", id, value);
+
+        switch (id) {
+
+        case NGX_HTTP_V2_MAX_STREAMS_SETTING:
+            session->max_streams = value;
+            break;
+
+        case NGX_HTTP_V2_INIT_WINDOW_SIZE_SETTING:
+
+            if (value > NGX_HTTP_V2_MAX_WINDOW) {
+                ngx_log_error(NGX_LOG_ERR, c->log, 0,
+                              "upstream sent settings frame "
+                              "with too large initial window size: %ui",
+                              value);
+                return NGX_ERROR;
+            }
+
+            session->conn.init_window = value;
+            break;
+        }
+    }
+
+    session->settings = 1;
+
+    /* the streams opened update their send windows */
+
+    if (ngx_http_v2_upstream_forward(session) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    return ngx_http_v2_upstream_send_frame(session, NGX_HTTP_V2_SETTINGS_FRAME,
+                                           NGX_HTTP_V2_ACK_FLAG, 0, NULL, 0);
+}
+
+
+static ngx_int_t
+ngx_http_v2_upstream_forward(ngx_http_v2_upstream_session_t *session)
+{
+    ngx_queue_t                    *q;
+    ngx_http_v2_upstream_stream_t  *stream;
+
+    for (q = ngx_queue_head(&session->streams);
+         q != ngx_queue_sentinel(&session->streams);
+         q = ngx_queue_next(q))
+    {
+        stream = ngx_queue_data(q, ngx_http_v2_upstream_stream_t, queue);
+
+        if (ngx_http_v2_upstream_input(stream, session->frame,
+                                       NGX_HTTP_V2_FRAME_HEADER_SIZE)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+        if (ngx_http_v2_upstream_input(stream, session->payload,
+                                       session->payload_len)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_v2_upstream_input(ngx_http_v2_upstream_stream_t *stream, u_char *p,
+    size_t len)
+{
+    ngx_event_t  *rev;
+
+    if (len == 0) {
+        return NGX_OK;
+    }
+
+    if (ngx_http_v2_upstream_append(stream->pool, &stream->in, &stream->last,
+                                    &stream->free, p, len)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    stream->buffered += len;
+    stream->session->buffered += len;
+
+    rev = &stream->read;
+
+    rev->ready = 1;
+    rev->active = 0;
+
+    ngx_post_event(rev, &ngx_posted_events);
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_v2_upstream_update_window(ngx_http_v2_upstream_session_t *session)
+{
+    u_char  buf[4];
+    size_t  window;
+
+    /*
+     * the data not yet read by the streams occupy the connection window,
+     * so the session does not buffer more than NGX_HTTP_V2_UPSTREAM_WINDOW
+     */
+
+    if (session->buffered >= NGX_HTTP_V2_UPSTREAM_WINDOW) {
+        return NGX_OK;
+    }
+
+    window = NGX_HTTP_V2_UPSTREAM_WINDOW - session->buffered;
+
+    if (window < session->conn.recv_window + NGX_HTTP_V2_UPSTREAM_WINDOW / 4) {
+        return NGX_OK;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, session->connection->log, 0,
+                   "http2 upstream send window update: %uz, buffered:%uz",
+                   window - session->conn.recv_window, session->buffered);
+
+    (void) ngx_http_v2_write_uint32(buf, window - session->conn.recv_window);
+
+    session->conn.recv_window = window;
+
+    return ngx_http_v2_upstream_send_frame(session,
+                                           NGX_HTTP_V2_WINDOW_UPDATE_FRAME,
+                                           0, 0, buf, 4);
+}
+
+
+static ngx_int_t
+ngx_http_v2_upstream_send_frame(ngx_http_v2_upstream_session_t *session,
+    ngx_uint_t type, ngx_uint_t flags, ngx_uint_t sid, u_char *payload,
+    size_t len)
+{
+    u_char  *p, buf[NGX_HTTP_V2_FRAME_HEADER_SIZE + 8];
+
+    p = buf;
+
+    *p++ = 0;
+    *p++ = 0;
+    *p++ = (u_char) len;
+    *p++ = (u_char) type;
+    *p++ = (u_char) flags;
+
+    p = ngx_http_v2_write_sid(p, sid);
+    p = ngx_cpymem(p, payload, len);
+
+    if (ngx_http_v2_upstream_append(session->pool, &session->out,
+                                    &session->last, &session->free,
+                                    buf, p - buf)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    session->out_size += p - buf;
+
+    ngx_http_v2_upstream_post_write(session);
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_v2_upstream_send_output(ngx_http_v2_upstream_session_t *session)
+{
+    size_t                          size;
+    ngx_queue_t                    *q;
+    ngx_chain_t                    *cl, *ln, *next;
+    ngx_event_t                    *wev;
+    ngx_connection_t               *c;
+    ngx_http_v2_upstream_stream_t  *stream;
+
+    c = session->connection;
+
+    if (session->out && c->write->ready) {
+
+        cl = c->send_chain(c, session->out, 0);
+
+        if (cl == NGX_CHAIN_ERROR) {
+            c->error = 1;
+            return NGX_ERROR;
+        }
+
+        for (ln = session->out; ln != cl; ln = next) {
+            next = ln->next;
+
+            ln->buf->pos = ln->buf->start;
+            ln->buf->last = ln->buf->start;
+
+            ln->next = session->free;
+            session->free = ln;
+        }
+
+        session->out = cl;
+
+        size = 0;
+
+        for (ln = cl; ln; ln = ln->next) {
+            size += ngx_buf_size(ln->buf);
+        }
+
+        session->out_size = size;
+
+        if (cl == NULL) {
+            session->last = NULL;
+        }
+
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                       "http2 upstream output left:%uz", size);
+    }
+
+    if (ngx_handle_write_event(c->write, 0) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    if (session->out_size >= NGX_HTTP_V2_UPSTREAM_OUTPUT_LIMIT) {
+        return NGX_AGAIN;
+    }
+
+    for (q = ngx_queue_head(&session->streams);
+         q != ngx_queue_sentinel(&session->streams);
+         q = ngx_queue_next(q))
+    {
+        stream = ngx_queue_data(q, ngx_http_v2_upstream_stream_t, queue);
+
+        if (stream->blocked) {
+            stream->blocked = 0;
+
+            wev = &stream->write;
+
+            wev->ready = 1;
+            wev->active = 0;
+
+            ngx_post_event(wev, &ngx_posted_events);
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_v2_upstream_post_write(ngx_http_v2_upstream_session_t *session)
+{
+    ngx_event_t  *wev;
+
+    wev = session->connection->write;
+
+    if (wev->ready) {
+        ngx_post_event(wev, &ngx_posted_events);
+    }
+}
+
+
+static void
+ngx_http_v2_upstream_close_session(ngx_http_v2_upstream_session_t *session)
+{
+    ngx_queue_t                    *q;
+    ngx_connection_t               *c;
+    ngx_http_v2_upstream_stream_t  *stream;
+
+    c = session->connection;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http2 upstream close session: %d, %ui streams",
+                   c->fd, session->processing);
+
+    if (session->listed) {
+        ngx_queue_remove(&session->queue);
+        session->listed = 0;
+    }
+
+    session->connection = NULL;
+
+    /* the streams get an error or eof after the data buffered */
+
+    for (q = ngx_queue_head(&session->streams);
+         q != ngx_queue_sentinel(&session->streams);
+         q = ngx_queue_next(q))
+    {
+        stream = ngx_queue_data(q, ngx_http_v2_upstream_stream_t, queue);
+
+#if (NGX_SSL)
+        stream->connection.ssl = NULL;
+#endif
+
+        ngx_http_v2_upstream_wake_stream(stream);
+    }
+
+#if (NGX_HTTP_SSL)
+    if (c->ssl) {
+        c->ssl->no_wait_shutdown = 1;
+        c->ssl->no_send_shutdown = 1;
+
+        (void) ngx_ssl_shutdown(c);
+    }
+#endif
+
+    ngx_close_connection(c);
+
+    if (ngx_queue_empty(&session->streams)) {
+        ngx_destroy_pool(session->pool);
+    }
+}
+
+
+static void
+ngx_http_v2_upstream_wake_stream(ngx_http_v2_upstream_stream_t *stream)
+{
+    ngx_event_t  *rev, *wev;
+
+    rev = &stream->read;
+
+    rev->ready = 1;
+    rev->active = 0;
+
+    ngx_post_event(rev, &ngx_posted_events);
+
+    wev = &stream->write;
+
+    wev->ready = 1;
+    wev->active = 0;
+
+    ngx_post_event(wev, &ngx_posted_events);
+
+    stream->blocked = 0;
+}
+
+
+static ngx_int_t
+ngx_http_v2_upstream_append(ngx_pool_t *pool, ngx_chain_t **out,
+    ngx_chain_t **last, ngx_chain_t **free, u_char *p, size_t len)
+{
+    size_t        n;
+    ngx_buf_t    *b;
+    ngx_chain_t  *cl;
+
+    while (len) {
+        cl = *last;
+
+        if (cl == NULL || cl->buf->last == cl->buf->end) {
+
+            if (*free) {
+                cl = *free;
+                *free = cl->next;
+
+            } else {
+                cl = ngx_alloc_chain_link(pool);
+                if (cl == NULL) {
+                    return NGX_ERROR;
+                }
+
+                cl->buf = ngx_create_temp_buf(pool,
+                                              NGX_HTTP_V2_UPSTREAM_BUFFER_SIZE);
+                if (cl->buf == NULL) {
+                    return NGX_ERROR;
+                }
+
+                /* not to be delayed in the SSL buffer */
+                cl->buf->flush = 1;
+            }
+
+            cl->next = NULL;
+
+            if (*last) {
+                (*last)->next = cl;
+
+            } else {
+                *out = cl;
+            }
+
+            *last = cl;
+        }
+
+        b = cl->buf;
+
+        n = ngx_min(len, (size_t) (b->end - b->last));
+
+        b->last = ngx_cpymem(b->last, p, n);
+
+        p += n;
+        len -= n;
+    }
+
+    return NGX_OK;
+}
+
+
+static ssize_t
+ngx_http_v2_upstream_recv(ngx_connection_t *c, u_char *buf, size_t size)
+{
+    size_t                           n;
+    u_char                          *p, *last;
+    ngx_buf_t                       *b;
+    ngx_chain_t                     *cl;
+    ngx_event_t                     *rev;
+    ngx_http_v2_upstream_stream_t   *stream;
+    ngx_http_v2_upstream_session_t  *session;
+
+    stream = ngx_http_v2_upstream_get_stream(c);
+    session = stream->session;
+
+    rev = c->read;
+
+    p = buf;
+    last = buf + size;
+
+    while (stream->in && p < last) {
+        cl = stream->in;
+        b = cl->buf;
+
+        n = ngx_min((size_t) (b->last - b->pos), (size_t) (last - p));
+
+        p = ngx_cpymem(p, b->pos, n);
+        b->pos += n;
+
+        if (b->pos < b->last) {
+            break;
+        }
+
+        stream->in = cl->next;
+
+        if (stream->in == NULL) {
+            stream->last = NULL;
+        }
+
+        b->pos = b->start;
+        b->last = b->start;
+
+        cl->next = stream->free;
+        stream->free = cl;
+    }
+
+    n = p - buf;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http2 upstream recv: %uz of %uz", n, stream->buffered);
+
+    if (stream->in == NULL) {
+        rev->ready = 0;
+        rev->active = 1;
+    }
+
+    if (n) {
+        stream->buffered -= n;
+        session->buffered -= n;
+
+        if (session->connection
+            && ngx_http_v2_upstream_update_window(session) != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+        return n;
+    }
+
+    if (session->connection == NULL) {
+        rev->eof = 1;
+        return 0;
+    }
+
+    return NGX_AGAIN;
+}
+
+
+static ssize_t
+ngx_http_v2_upstream_recv_chain(ngx_connection_t *c, ngx_chain_t *in,
+    off_t limit)
+{
+    size_t      size;
+    ssize_t     n, total;
+    ngx_buf_t  *b;
+
+    total = 0;
+
+    for ( /* void */ ; in; in = in->next) {
+        b = in->buf;
+
+        size = b->end - b->last;
+
+        if (limit && (off_t) (total + size) > limit) {
+            size = limit - total;
+        }
+
+        if (size == 0) {
+            break;
+        }
+
+        n = ngx_http_v2_upstream_recv(c, b->last, size);
+
+        if (n <= 0) {
+            return total ? total : n;
+        }
+
+        total += n;
+
+        if ((size_t) n < size) {
+            break;
+        }
+    }
+
+    return total;
+}
+
+
+static ssize_t
+ngx_http_v2_upstream_send(ngx_connection_t *c, u_char *buf, size_t size)
+{
+    ngx_buf_t    b;
+    ngx_chain_t  cl, *rc;
+
+    ngx_memzero(&b, sizeof(ngx_buf_t));
+
+    b.pos = buf;
+    b.last = buf + size;
+    b.temporary = 1;
+
+    cl.buf = &b;
+    cl.next = NULL;
+
+    rc = ngx_http_v2_upstream_send_chain(c, &cl, 0);
+
+    if (rc == NGX_CHAIN_ERROR) {
+        return NGX_ERROR;
+    }
+
+    if (rc) {
+        return NGX_AGAIN;
+    }
+
+    return size;
+}
+
+
+static ngx_chain_t *
+ngx_http_v2_upstream_send_chain(ngx_connection_t *c, ngx_chain_t *in,
+    off_t limit)
+{
+    size_t                           size;
+    ngx_buf_t                       *b;
+    ngx_chain_t                     *cl;
+    ngx_event_t                     *wev;
+    ngx_http_v2_upstream_stream_t   *stream;
+    ngx_http_v2_upstream_session_t  *session;
+
+    stream = ngx_http_v2_upstream_get_stream(c);
+    session = stream->session;
+
+    wev = c->write;
+
+    if (session->connection == NULL) {
+        wev->error = 1;
+        return NGX_CHAIN_ERROR;
+    }
+
+    /*
+     * the frames are copied to the session output as a whole, so the
+     * frames of different streams are never mixed; new streams are not
+     * delayed to keep their identifiers in order
+     */
+
+    if (stream->id && session->out_size >= NGX_HTTP_V2_UPSTREAM_OUTPUT_LIMIT) {
+
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                       "http2 upstream stream %ui blocked", stream->id);
+
+        stream->blocked = 1;
+
+        wev->ready = 0;
+        wev->active = 1;
+
+        return in;
+    }
+
+    for (cl = in; cl; cl = cl->next) {
+        b = cl->buf;
+
+        if (ngx_buf_special(b)) {
+            continue;
+        }
+
+        if (!ngx_buf_in_memory(b)) {
+            ngx_log_error(NGX_LOG_ALERT, c->log, 0,
+                          "file buffer in http2 upstream stream");
+            return NGX_CHAIN_ERROR;
+        }
+
+        size = b->last - b->pos;
+
+        ngx_http_v2_upstream_parse_output(stream, b->pos, size);
+
+        if (ngx_http_v2_upstream_append(session->pool, &session->out,
+                                        &session->last, &session->free,
+                                        b->pos, size)
+            != NGX_OK)
+        {
+            return NGX_CHAIN_ERROR;
+        }
+
+        session->out_size += size;
+        c->sent += size;
+
+        b->pos = b->last;
+
+        if (b->in_file) {
+            b->file_pos = b->file_last;
+        }
+    }
+
+    if (stream->skip || stream->rest || stream->frame_len) {
+        ngx_log_error(NGX_LOG_ALERT, c->log, 0,
+                      "incomplete frame sent to http2 upstream stream");
+        return NGX_CHAIN_ERROR;
+    }
+
+    ngx_http_v2_upstream_post_write(session);
+
+    return NULL;
+}
+
+
+static void
+ngx_http_v2_upstream_parse_output(ngx_http_v2_upstream_stream_t *stream,
+    u_char *p, size_t len)
+{
+    size_t      n;
+    u_char     *f;
+    ngx_uint_t  sid;
+
+    while (len) {
+
+        if (stream->skip) {
+            n = ngx_min(len, stream->skip);
+
+            stream->skip -= n;
+
+            p += n;
+            len -= n;
+
+            continue;
+        }
+
+        if (stream->rest) {
+            n = ngx_min(len, stream->rest);
+
+            stream->rest -= n;
+
+            p += n;
+            len -= n;
+
+            continue;
+        }
+
+        n = ngx_min(len, NGX_HTTP_V2_FRAME_HEADER_SIZE - stream->frame_len);
+
+        ngx_memcpy(stream->frame + stream->frame_len, p, n);
+
+        p += n;
+        len -= n;
+        stream->frame_len += n;
+
+        if (stream->frame_len < NGX_HTTP_V2_FRAME_HEADER_SIZE) {
+            break;
+        }
+
+        stream->frame_len = 0;
+
+        f = stream->frame;
+
+        stream->rest = (f[0] << 16) + (f[1] << 8) + f[2];
+
+        sid = ngx_http_v2_parse_sid(&f[5]);
+
+        if (sid == 0) {
+            continue;
+        }
+
+        if (stream->id == 0) {
+            ngx_log_debug1(NGX_LOG_DEBUG_HTTP, stream->connection.log, 0,
+                           "http2 upstream stream %ui opened", sid);
+
+            stream->id = sid;
+        }
+
+        if ((f[3] == NGX_HTTP_V2_DATA_FRAME
+             || f[3] == NGX_HTTP_V2_HEADERS_FRAME)
+            && (f[4] & NGX_HTTP_V2_END_STREAM_FLAG))
+        {
+            stream->local_end = 1;
+        }
+    }
+}
@@ -167,6 +167,7 @@ struct ngx_http_v3_session_s {
     off_t                         payload_bytes;
 
     unsigned                      goaway:1;
+    unsigned                      peer_goaway:1;
     unsigned                      hq:1;
     unsigned                      client:1;
 
@@ -1247,6 +1247,11 @@ ngx_http_v3_parse_control(ngx_connection_t *c, ngx_http_v3_parse_control_t *st,
                 st->state = sw_settings;
                 break;
 
+            case NGX_HTTP_V3_FRAME_GOAWAY:
+                ngx_http_v3_recv_goaway(c);
+                st->state = sw_skip;
+                break;
+
             default:
                 ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->log, 0,
                                "http3 parse skip unknown frame");
@@ -638,3 +638,17 @@ ngx_http_v3_cancel_stream(ngx_connection_t *c, ngx_uint_t stream_id)
 
     return NGX_OK;
 }
+
+
+void
+ngx_http_v3_recv_goaway(ngx_connection_t *c)
+{
+    ngx_http_v3_session_t  *h3c;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->log, 0, "http3 recv goaway");
+
+    /* no new requests are accepted by the peer */
+
+    h3c = ngx_http_v3_get_session(c);
+    h3c->peer_goaway = 1;
+}
@@ -29,6 +29,8 @@ static char *ngx_mail_ssl_password_file(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 static char *ngx_mail_ssl_session_cache(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
+static char *ngx_mail_ssl_session_ticket_key_rotation(ngx_conf_t *cf,
+    ngx_command_t *cmd, void *conf);
 
 static char *ngx_mail_ssl_conf_command_check(ngx_conf_t *cf, void *post,
     void *data);
@@ -153,6 +155,13 @@ static ngx_command_t  ngx_mail_ssl_commands[] = {
       offsetof(ngx_mail_ssl_conf_t, session_ticket_keys),
       NULL },
 
+    { ngx_string("ssl_session_ticket_key_rotation"),
+      NGX_MAIL_MAIN_CONF|NGX_MAIL_SRV_CONF|NGX_CONF_TAKE12,
+      ngx_mail_ssl_session_ticket_key_rotation,
+      NGX_MAIL_SRV_CONF_OFFSET,
+      0,
+      NULL },
+
     { ngx_string("ssl_session_timeout"),
       NGX_MAIL_MAIN_CONF|NGX_MAIL_SRV_CONF|NGX_CONF_TAKE1,
       ngx_conf_set_sec_slot,
@@ -320,6 +329,7 @@ ngx_mail_ssl_create_conf(ngx_conf_t *cf)
     scf->session_timeout = NGX_CONF_UNSET;
     scf->session_tickets = NGX_CONF_UNSET;
     scf->session_ticket_keys = NGX_CONF_UNSET_PTR;
+    scf->session_ticket_key_rotation = NGX_CONF_UNSET;
 
     return scf;
 }
@@ -514,7 +524,16 @@ ngx_mail_ssl_merge_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_conf_merge_ptr_value(conf->session_ticket_keys,
                          prev->session_ticket_keys, NULL);
 
-    if (ngx_ssl_session_ticket_keys(cf, &conf->ssl, conf->session_ticket_keys)
+    if (conf->session_ticket_key_rotation == NGX_CONF_UNSET) {
+        conf->session_ticket_key_rotation = prev->session_ticket_key_rotation;
+        conf->session_ticket_key_keep = prev->session_ticket_key_keep;
+    }
+
+    ngx_conf_init_value(conf->session_ticket_key_rotation, 0);
+
+    if (ngx_ssl_session_ticket_keys(cf, &conf->ssl, conf->session_ticket_keys,
+                                    conf->session_ticket_key_rotation,
+                                    conf->session_ticket_key_keep)
         != NGX_OK)
     {
         return NGX_CONF_ERROR;
@@ -578,10 +597,9 @@ ngx_mail_ssl_session_cache(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
     ngx_mail_ssl_conf_t  *scf = conf;
 
-    size_t       len;
-    ngx_str_t   *value, name, size;
+    ngx_str_t   *value;
     ngx_int_t    n;
-    ngx_uint_t   i, j;
+    ngx_uint_t   i;
 
     value = cf->args->elts;
 
@@ -622,64 +640,97 @@ ngx_mail_ssl_session_cache(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             && ngx_strncmp(value[i].data, "shared:", sizeof("shared:") - 1)
                == 0)
         {
-            len = 0;
+            value[i].data += sizeof("shared:") - 1;
+            value[i].len -= sizeof("shared:") - 1;
 
-            for (j = sizeof("shared:") - 1; j < value[i].len; j++) {
-                if (value[i].data[j] == ':') {
-                    break;
-                }
-
-                len++;
+            scf->shm_zone = ngx_ssl_session_cache_zone(cf, &value[i],
+                                                       &ngx_mail_ssl_module);
+            if (scf->shm_zone == NULL) {
+                return NGX_CONF_ERROR;
             }
 
-            if (len == 0 || j == value[i].len) {
-                goto invalid;
-            }
+            continue;
+        }
 
-            name.len = len;
-            name.data = value[i].data + sizeof("shared:") - 1;
+        goto invalid;
+    }
 
-            size.len = value[i].len - j - 1;
-            size.data = name.data + len + 1;
+    if (scf->shm_zone && scf->builtin_session_cache == NGX_CONF_UNSET) {
+        scf->builtin_session_cache = NGX_SSL_NO_BUILTIN_SCACHE;
+    }
 
-            n = ngx_parse_size(&size);
+    return NGX_CONF_OK;
 
-            if (n == NGX_ERROR) {
-                goto invalid;
-            }
+invalid:
 
-            if (n < (ngx_int_t) (8 * ngx_pagesize)) {
-                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
-                                   "session cache \"%V\" is too small",
-                                   &value[i]);
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "invalid session cache \"%V\"", &value[i]);
 
-                return NGX_CONF_ERROR;
-            }
+    return NGX_CONF_ERROR;
+}
 
-            scf->shm_zone = ngx_shared_memory_add(cf, &name, n,
-                                                   &ngx_mail_ssl_module);
-            if (scf->shm_zone == NULL) {
-                return NGX_CONF_ERROR;
-            }
 
-            scf->shm_zone->init = ngx_ssl_session_cache_init;
+static char *
+ngx_mail_ssl_session_ticket_key_rotation(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf)
+{
+    ngx_mail_ssl_conf_t  *scf = conf;
+
+    ngx_int_t   n;
+    ngx_str_t  *value;
 
-            continue;
+    if (scf->session_ticket_key_rotation != NGX_CONF_UNSET) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "off") == 0) {
+
+        if (cf->args->nelts > 2) {
+            goto invalid;
         }
 
+        scf->session_ticket_key_rotation = 0;
+        return NGX_CONF_OK;
+    }
+
+    scf->session_ticket_key_rotation = ngx_parse_time(&value[1], 1);
+
+    if (scf->session_ticket_key_rotation == (time_t) NGX_ERROR
+        || scf->session_ticket_key_rotation == 0)
+    {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid rotation interval \"%V\"", &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    if (cf->args->nelts == 2) {
+        return NGX_CONF_OK;
+    }
+
+    if (ngx_strncmp(value[2].data, "keep=", 5) != 0) {
         goto invalid;
     }
 
-    if (scf->shm_zone && scf->builtin_session_cache == NGX_CONF_UNSET) {
-        scf->builtin_session_cache = NGX_SSL_NO_BUILTIN_SCACHE;
+    n = ngx_atoi(value[2].data + 5, value[2].len - 5);
+
+    if (n == NGX_ERROR || n == 0 || n >= NGX_SSL_TICKET_KEYS) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid number of previous keys \"%V\", "
+                           "it must be between 1 and %d",
+                           &value[2], NGX_SSL_TICKET_KEYS - 1);
+        return NGX_CONF_ERROR;
     }
 
+    scf->session_ticket_key_keep = n;
+
     return NGX_CONF_OK;
 
 invalid:
 
     ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
-                       "invalid session cache \"%V\"", &value[i]);
+                       "invalid parameter \"%V\"", &value[2]);
 
     return NGX_CONF_ERROR;
 }
@@ -137,6 +137,11 @@ ngx_thread_read(ngx_file_t *file, u_char *buf, size_t size, off_t offset,
 
     task->handler = ngx_thread_read_handler;
 
+    /* small reads, such as cache headers, are not queued behind large ones */
+
+    task->priority = (size <= NGX_THREAD_READ_HIGH_SIZE)
+                     ? NGX_THREAD_TASK_HIGH : NGX_THREAD_TASK_NORMAL;
+
     ctx->write = 0;
 
     ctx->fd = file->fd;
@@ -275,6 +280,66 @@ ngx_write_file(ngx_file_t *file, u_char *buf, size_t size, off_t offset)
 }
 
 
+#if (NGX_HAVE_COPY_FILE_RANGE)
+
+ssize_t
+ngx_copy_file_range(ngx_file_t *src, off_t src_offset, ngx_file_t *dst,
+    off_t dst_offset, size_t size)
+{
+    ssize_t    n, copied;
+    ngx_err_t  err;
+
+    ngx_log_debug5(NGX_LOG_DEBUG_CORE, dst->log, 0,
+                   "copy_file_range: %d, %O, %d, %O, %uz",
+                   src->fd, src_offset, dst->fd, dst_offset, size);
+
+    copied = 0;
+
+    while (size) {
+        n = copy_file_range(src->fd, &src_offset, dst->fd, &dst_offset,
+                            size, 0);
+
+        if (n == -1) {
+            err = ngx_errno;
+
+            if (err == NGX_EINTR) {
+                ngx_log_debug0(NGX_LOG_DEBUG_CORE, dst->log, err,
+                               "copy_file_range() was interrupted");
+                continue;
+            }
+
+            if (copied == 0
+                && (err == NGX_EXDEV || err == NGX_ENOSYS
+                    || err == NGX_EOPNOTSUPP || err == NGX_EINVAL))
+            {
+                /* not supported for these files, read() and write() */
+
+                ngx_log_debug1(NGX_LOG_DEBUG_CORE, dst->log, err,
+                               "copy_file_range() \"%s\" not supported",
+                               dst->name.data);
+                return NGX_DECLINED;
+            }
+
+            ngx_log_error(NGX_LOG_CRIT, dst->log, err,
+                          "copy_file_range() \"%s\" to \"%s\" failed",
+                          src->name.data, dst->name.data);
+            return NGX_ERROR;
+        }
+
+        if (n == 0) {
+            break;
+        }
+
+        copied += n;
+        size -= n;
+    }
+
+    return copied;
+}
+
+#endif
+
+
 ngx_fd_t
 ngx_open_tempfile(u_char *name, ngx_uint_t persistent, ngx_uint_t access)
 {
@@ -523,6 +588,10 @@ ngx_thread_write_chain_to_file(ngx_file_t *file, ngx_chain_t *cl, off_t offset,
 
     task->handler = ngx_thread_write_chain_to_file_handler;
 
+    /* the task may be left with a high priority by a previous read */
+
+    task->priority = NGX_THREAD_TASK_NORMAL;
+
     ctx->write = 1;
 
     ctx->fd = file->fd;
@@ -131,6 +131,12 @@ ssize_t ngx_read_file(ngx_file_t *file, u_char *buf, size_t size, off_t offset);
 ssize_t ngx_write_file(ngx_file_t *file, u_char *buf, size_t size,
     off_t offset);
 
+#if (NGX_HAVE_COPY_FILE_RANGE)
+ssize_t ngx_copy_file_range(ngx_file_t *src, off_t src_offset,
+    ngx_file_t *dst, off_t dst_offset, size_t size);
+#define ngx_copy_file_range_n    "copy_file_range()"
+#endif
+
 ssize_t ngx_write_chain_to_file(ngx_file_t *file, ngx_chain_t *ce,
     off_t offset, ngx_pool_t *pool);
 
@@ -191,6 +197,7 @@ ngx_int_t ngx_set_file_time(u_char *name, ngx_fd_t fd, time_t s);
     (((sb)->st_blocks * 512 > (sb)->st_size                                  \
      && (sb)->st_blocks * 512 < (sb)->st_size + 8 * (sb)->st_blksize)        \
      ? (sb)->st_blocks * 512 : (sb)->st_size)
+#define ngx_file_sparse_fs_size(sb)  ((sb)->st_blocks * 512)
 #define ngx_file_mtime(sb)       (sb)->st_mtime
 #define ngx_file_uniq(sb)        (sb)->st_ino
 
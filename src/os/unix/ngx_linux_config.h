@@ -107,6 +107,10 @@ typedef struct iocb  ngx_aiocb_t;
 #include <netinet/udp.h>
 #endif
 
+#if (NGX_HAVE_NUMA)
+#include <linux/mempolicy.h>
+#endif
+
 
 #define NGX_LISTEN_BACKLOG        511
 
@@ -0,0 +1,313 @@
+
+/*
+ * Copyright (C) 2026 Web Server LLC
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+#if (NGX_HAVE_NUMA)
+
+#define NGX_NUMA_SYSFS  "/sys/devices/system/node/"
+
+#define NGX_NUMA_LONG_BITS  (8 * sizeof(unsigned long))
+
+#define ngx_numa_mask_set(mask, node)                                         \
+    (mask)[(node) / NGX_NUMA_LONG_BITS] |= 1UL << ((node) % NGX_NUMA_LONG_BITS)
+
+
+static ssize_t ngx_numa_read(char *name, u_char *buf, size_t size);
+static ngx_int_t ngx_numa_next_range(u_char **pos, u_char *last,
+    ngx_uint_t *from, ngx_uint_t *to);
+
+
+ngx_uint_t  ngx_numa_nodes;
+
+static ngx_uint_t    ngx_numa_node_ids[NGX_NUMA_MAX_NODES];
+#if (NGX_HAVE_CPU_AFFINITY)
+static ngx_cpuset_t  ngx_numa_node_cpus[NGX_NUMA_MAX_NODES];
+#endif
+
+
+ngx_int_t
+ngx_numa_init(ngx_log_t *log)
+{
+    u_char      *p, *last, buf[4096];
+    ssize_t      n;
+    ngx_uint_t   i, from, to;
+#if (NGX_HAVE_CPU_AFFINITY)
+    u_char      *q, *end, list[4096];
+    ngx_uint_t   cpu;
+    char         name[sizeof(NGX_NUMA_SYSFS "node/cpulist") + NGX_INT_T_LEN];
+#endif
+
+    ngx_numa_nodes = 0;
+
+    n = ngx_numa_read(NGX_NUMA_SYSFS "online", buf, sizeof(buf));
+
+    if (n <= 0) {
+        /* no NUMA topology, e.g. sysfs is not mounted */
+        return NGX_OK;
+    }
+
+    p = buf;
+    last = buf + n;
+
+    while (ngx_numa_next_range(&p, last, &from, &to) == NGX_OK) {
+
+        for (i = from; i <= to; i++) {
+
+            if (i >= NGX_NUMA_MAX_NODES) {
+                ngx_log_error(NGX_LOG_WARN, log, 0,
+                              "NUMA nodes above %d are not supported",
+                              NGX_NUMA_MAX_NODES - 1);
+                goto nodes;
+            }
+
+            ngx_numa_node_ids[ngx_numa_nodes] = i;
+
+#if (NGX_HAVE_CPU_AFFINITY)
+
+            CPU_ZERO(&ngx_numa_node_cpus[ngx_numa_nodes]);
+
+            ngx_sprintf((u_char *) name, NGX_NUMA_SYSFS "node%ui/cpulist%Z",
+                        i);
+
+            n = ngx_numa_read(name, list, sizeof(list));
+
+            q = list;
+            end = list + (n > 0 ? n : 0);
+
+            while (ngx_numa_next_range(&q, end, &from, &to) == NGX_OK) {
+                for (cpu = from; cpu <= to && cpu < CPU_SETSIZE; cpu++) {
+                    CPU_SET(cpu, &ngx_numa_node_cpus[ngx_numa_nodes]);
+                }
+            }
+
+#endif
+
+            ngx_numa_nodes++;
+        }
+    }
+
+nodes:
+
+    ngx_log_debug1(NGX_LOG_DEBUG_CORE, log, 0,
+                   "numa nodes: %ui", ngx_numa_nodes);
+
+    return NGX_OK;
+}
+
+
+static ssize_t
+ngx_numa_read(char *name, u_char *buf, size_t size)
+{
+    ssize_t   n;
+    ngx_fd_t  fd;
+
+    fd = ngx_open_file(name, NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
+
+    if (fd == NGX_INVALID_FILE) {
+        return NGX_ERROR;
+    }
+
+    n = ngx_read_fd(fd, buf, size);
+
+    (void) ngx_close_file(fd);
+
+    return n;
+}
+
+
+static ngx_int_t
+ngx_numa_next_range(u_char **pos, u_char *last, ngx_uint_t *from,
+    ngx_uint_t *to)
+{
+    u_char      *p, *start;
+    ngx_int_t    n;
+    ngx_uint_t   i;
+
+    /* list format: "0-3,8,10-11\n" */
+
+    p = *pos;
+
+    for (i = 0; i < 2; i++) {
+
+        start = p;
+
+        while (p < last && *p >= '0' && *p <= '9') {
+            p++;
+        }
+
+        n = ngx_atoi(start, p - start);
+
+        if (n == NGX_ERROR) {
+            return NGX_DONE;
+        }
+
+        if (i == 0) {
+            *from = n;
+            *to = n;
+
+            if (p < last && *p == '-') {
+                p++;
+                continue;
+            }
+
+        } else if ((ngx_uint_t) n >= *from) {
+            *to = n;
+        }
+
+        break;
+    }
+
+    if (p < last && *p == ',') {
+        p++;
+    }
+
+    *pos = p;
+
+    return NGX_OK;
+}
+
+
+ngx_int_t
+ngx_numa_node_exists(ngx_uint_t node)
+{
+    ngx_uint_t  i;
+
+    for (i = 0; i < ngx_numa_nodes; i++) {
+        if (ngx_numa_node_ids[i] == node) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+void
+ngx_numa_set_policy(ngx_shm_t *shm)
+{
+    int            mode;
+    char          *name;
+    ngx_uint_t     i;
+    unsigned long  mask[NGX_NUMA_MAX_NODES / NGX_NUMA_LONG_BITS];
+
+    ngx_memzero(mask, sizeof(mask));
+
+    switch (shm->numa) {
+
+    case NGX_NUMA_BIND:
+        mode = MPOL_BIND;
+        name = "bind";
+        ngx_numa_mask_set(mask, shm->numa_node);
+        break;
+
+    case NGX_NUMA_INTERLEAVE:
+
+        if (ngx_numa_nodes == 0) {
+            return;
+        }
+
+        mode = MPOL_INTERLEAVE;
+        name = "interleave";
+
+        for (i = 0; i < ngx_numa_nodes; i++) {
+            ngx_numa_mask_set(mask, ngx_numa_node_ids[i]);
+        }
+
+        break;
+
+    default: /* NGX_NUMA_DEFAULT */
+        return;
+    }
+
+    if (syscall(SYS_mbind, shm->addr, shm->size, mode, mask,
+                NGX_NUMA_MAX_NODES + 1, 0)
+        == -1)
+    {
+        ngx_log_error(NGX_LOG_WARN, shm->log, ngx_errno,
+                      "mbind(%s) failed for zone \"%V\", ignored",
+                      name, &shm->name);
+        return;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_CORE, shm->log, 0,
+                   "numa zone \"%V\" policy: %s", &shm->name, name);
+}
+
+
+ngx_int_t
+ngx_numa_get_policy(void *addr, ngx_uint_t *policy, ngx_uint_t *node)
+{
+    int  mode, n;
+
+    if (syscall(SYS_get_mempolicy, &mode, NULL, 0, addr, MPOL_F_ADDR) == -1) {
+        return NGX_ERROR;
+    }
+
+    switch (mode) {
+
+    case MPOL_BIND:
+        *policy = NGX_NUMA_BIND;
+        break;
+
+    case MPOL_INTERLEAVE:
+        *policy = NGX_NUMA_INTERLEAVE;
+        break;
+
+    default:
+        *policy = NGX_NUMA_DEFAULT;
+    }
+
+    /* the node of the page backing the address */
+
+    if (syscall(SYS_get_mempolicy, &n, NULL, 0, addr, MPOL_F_NODE|MPOL_F_ADDR)
+        == -1)
+    {
+        return NGX_ERROR;
+    }
+
+    *node = n;
+
+    return NGX_OK;
+}
+
+
+#if (NGX_HAVE_CPU_AFFINITY)
+
+ngx_cpuset_t *
+ngx_numa_cpus(ngx_uint_t n)
+{
+    return &ngx_numa_node_cpus[n % ngx_numa_nodes];
+}
+
+
+ngx_int_t
+ngx_numa_cpuset_node(ngx_cpuset_t *mask)
+{
+    ngx_uint_t    i;
+    ngx_cpuset_t  set;
+
+    if (CPU_COUNT(mask) == 0) {
+        return NGX_DECLINED;
+    }
+
+    for (i = 0; i < ngx_numa_nodes; i++) {
+
+        CPU_AND(&set, mask, &ngx_numa_node_cpus[i]);
+
+        if (CPU_EQUAL(&set, mask)) {
+            return ngx_numa_node_ids[i];
+        }
+    }
+
+    return NGX_DECLINED;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,38 @@
+
+/*
+ * Copyright (C) 2026 Web Server LLC
+ */
+
+
+#ifndef _NGX_NUMA_H_INCLUDED_
+#define _NGX_NUMA_H_INCLUDED_
+
+
+#define NGX_NUMA_DEFAULT      0
+#define NGX_NUMA_BIND         1
+#define NGX_NUMA_INTERLEAVE   2
+
+
+#if (NGX_HAVE_NUMA)
+
+#define NGX_NUMA_MAX_NODES    64
+
+
+ngx_int_t ngx_numa_init(ngx_log_t *log);
+ngx_int_t ngx_numa_node_exists(ngx_uint_t node);
+void ngx_numa_set_policy(ngx_shm_t *shm);
+ngx_int_t ngx_numa_get_policy(void *addr, ngx_uint_t *policy,
+    ngx_uint_t *node);
+
+#if (NGX_HAVE_CPU_AFFINITY)
+ngx_cpuset_t *ngx_numa_cpus(ngx_uint_t n);
+ngx_int_t ngx_numa_cpuset_node(ngx_cpuset_t *mask);
+#endif
+
+
+extern ngx_uint_t  ngx_numa_nodes;
+
+#endif
+
+
+#endif /* _NGX_NUMA_H_INCLUDED_ */
@@ -64,6 +64,12 @@ ngx_os_init(ngx_log_t *log)
         ngx_ncpu = 1;
     }
 
+#if (NGX_HAVE_NUMA)
+    if (ngx_numa_init(log) != NGX_OK) {
+        return NGX_ERROR;
+    }
+#endif
+
 #if (NGX_HAVE_LEVEL1_DCACHE_LINESIZE)
     size = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
     if (size > 0) {
@@ -10,6 +10,7 @@
 
 
 #include <ngx_setaffinity.h>
+#include <ngx_numa.h>
 #include <ngx_setproctitle.h>
 
 
@@ -53,6 +53,8 @@ sig_atomic_t  ngx_noaccept;
 ngx_uint_t    ngx_noaccepting;
 ngx_uint_t    ngx_restart;
 
+void        (*ngx_process_notify)(ngx_cycle_t *cycle, void *data);
+
 
 static ngx_cache_manager_ctx_t  ngx_cache_manager_ctx = {
     ngx_cache_manager_process_handler, "cache manager process", 0
@@ -455,6 +457,45 @@ ngx_pass_open_channel(ngx_cycle_t *cycle)
 }
 
 
+void
+ngx_notify_processes(ngx_cycle_t *cycle, void *data)
+{
+    ngx_int_t      i;
+    ngx_channel_t  ch;
+
+    if (ngx_process != NGX_PROCESS_WORKER) {
+        return;
+    }
+
+    ngx_memzero(&ch, sizeof(ngx_channel_t));
+
+    ch.command = NGX_CMD_NOTIFY;
+    ch.pid = ngx_pid;
+    ch.slot = ngx_process_slot;
+    ch.fd = -1;
+    ch.data = data;
+
+    for (i = 0; i < ngx_last_process; i++) {
+
+        if (i == ngx_process_slot
+            || ngx_processes[i].pid == -1
+            || ngx_processes[i].channel[0] == -1)
+        {
+            continue;
+        }
+
+        ngx_log_debug3(NGX_LOG_DEBUG_CORE, cycle->log, 0,
+                       "notify s:%i pid:%P fd:%d",
+                       i, ngx_processes[i].pid, ngx_processes[i].channel[0]);
+
+        /* a lost notification is tolerated by the receivers */
+
+        (void) ngx_write_channel(ngx_processes[i].channel[0],
+                                 &ch, sizeof(ngx_channel_t), cycle->log);
+    }
+}
+
+
 static void
 ngx_signal_worker_processes(ngx_cycle_t *cycle, int signo)
 {
@@ -882,7 +923,7 @@ ngx_worker_process_init(ngx_cycle_t *cycle, ngx_int_t worker)
     }
 
     if (worker >= 0) {
-        cpu_affinity = ngx_get_cpu_affinity(worker);
+        cpu_affinity = ngx_get_cpu_affinity(cycle, worker);
 
         if (cpu_affinity) {
             ngx_setaffinity(cpu_affinity, cycle->log);
@@ -1087,6 +1128,12 @@ ngx_channel_handler(ngx_event_t *ev)
             ngx_reopen = 1;
             break;
 
+        case NGX_CMD_NOTIFY:
+            if (ngx_process_notify) {
+                ngx_process_notify((ngx_cycle_t *) ngx_cycle, ch.data);
+            }
+            break;
+
         case NGX_CMD_OPEN_CHANNEL:
 
             ngx_log_debug3(NGX_LOG_DEBUG_CORE, ev->log, 0,
@@ -1095,6 +1142,11 @@ ngx_channel_handler(ngx_event_t *ev)
 
             ngx_processes[ch.slot].pid = ch.pid;
             ngx_processes[ch.slot].channel[0] = ch.fd;
+
+            if (ch.slot >= ngx_last_process) {
+                ngx_last_process = ch.slot + 1;
+            }
+
             break;
 
         case NGX_CMD_CLOSE_CHANNEL:
@@ -18,6 +18,7 @@
 #define NGX_CMD_QUIT           3
 #define NGX_CMD_TERMINATE      4
 #define NGX_CMD_REOPEN         5
+#define NGX_CMD_NOTIFY         6
 
 
 #define NGX_PROCESS_SINGLE     0
@@ -38,6 +39,7 @@ void ngx_master_process_cycle(ngx_cycle_t *cycle);
 void ngx_single_process_cycle(ngx_cycle_t *cycle);
 
 void ngx_update_process_title(ngx_cycle_t *cycle, ngx_uint_t single);
+void ngx_notify_processes(ngx_cycle_t *cycle, void *data);
 
 
 extern ngx_uint_t      ngx_process;
@@ -48,6 +50,8 @@ extern ngx_uint_t      ngx_inherited;
 extern ngx_uint_t      ngx_daemonized;
 extern ngx_uint_t      ngx_exiting;
 
+extern void          (*ngx_process_notify)(ngx_cycle_t *cycle, void *data);
+
 extern sig_atomic_t    ngx_reap;
 extern sig_atomic_t    ngx_sigio;
 extern sig_atomic_t    ngx_sigalrm;
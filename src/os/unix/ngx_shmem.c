@@ -50,6 +50,10 @@ ngx_shm_alloc(ngx_shm_t *shm)
         return NGX_ERROR;
     }
 
+#if (NGX_HAVE_NUMA)
+    ngx_numa_set_policy(shm);
+#endif
+
     return NGX_OK;
 }
 
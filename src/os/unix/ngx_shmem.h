@@ -19,9 +19,21 @@ typedef struct {
     ngx_str_t    name;
     ngx_log_t   *log;
     ngx_uint_t   exists;   /* unsigned  exists:1;  */
+#if (NGX_HAVE_NUMA)
+    ngx_uint_t   numa;
+    ngx_uint_t   numa_node;
+#endif
 } ngx_shm_t;
 
 
+#if (NGX_HAVE_NUMA)
+#define ngx_shm_same_policy(shm1, shm2)                                       \
+    ((shm1)->numa == (shm2)->numa && (shm1)->numa_node == (shm2)->numa_node)
+#else
+#define ngx_shm_same_policy(shm1, shm2)  1
+#endif
+
+
 ngx_int_t ngx_shm_alloc(ngx_shm_t *shm);
 void ngx_shm_free(ngx_shm_t *shm);
 
@@ -13,6 +13,22 @@
 static ngx_chain_t *ngx_udp_output_chain_to_iovec(ngx_iovec_t *vec,
     ngx_chain_t *in, ngx_log_t *log);
 static ssize_t ngx_sendmsg_vec(ngx_connection_t *c, ngx_iovec_t *vec);
+#if (NGX_HAVE_MMSG)
+static ssize_t ngx_sendmmsg_vec(ngx_connection_t *c, ngx_iovec_t *vec,
+    ngx_chain_t *in, off_t limit);
+#if ((NGX_HAVE_UDP_SEGMENT) && (NGX_HAVE_MSGHDR_MSG_CONTROL))
+static ssize_t ngx_sendmsg_segments(ngx_connection_t *c, struct iovec *iovs,
+    ngx_uint_t count, size_t segment);
+#endif
+
+
+#define NGX_UDP_MAX_SEGMENT_BUF  65487 /* 65K - IPv6 header */
+
+
+#if ((NGX_HAVE_UDP_SEGMENT) && (NGX_HAVE_MSGHDR_MSG_CONTROL))
+static ngx_uint_t  ngx_udp_segmentation = 1;
+#endif
+#endif
 
 
 ngx_chain_t *
@@ -86,9 +102,17 @@ ngx_udp_unix_sendmsg_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
             return in;
         }
 
-        send += vec.size;
+#if (NGX_HAVE_MMSG)
+        if (cl && vec.size && send + (off_t) vec.size < limit) {
+            n = ngx_sendmmsg_vec(c, &vec, cl, limit - send);
+
+        } else
+#endif
+        {
+            n = ngx_sendmsg_vec(c, &vec);
+        }
 
-        n = ngx_sendmsg_vec(c, &vec);
+        send += vec.size;
 
         if (n == NGX_ERROR) {
             return NGX_CHAIN_ERROR;
@@ -240,6 +264,292 @@ ngx_sendmsg_vec(ngx_connection_t *c, ngx_iovec_t *vec)
 }
 
 
+#if (NGX_HAVE_MMSG)
+
+static ssize_t
+ngx_sendmmsg_vec(ngx_connection_t *c, ngx_iovec_t *vec, ngx_chain_t *in,
+    off_t limit)
+{
+    int              n;
+    size_t           total, segment, last;
+    ssize_t          sent;
+    ngx_err_t        err;
+    ngx_uint_t       i, nmsgs, used, parts, gso;
+    ngx_chain_t     *cl;
+    ngx_iovec_t      next;
+    struct mmsghdr   msgs[NGX_UDP_MAX_BATCH];
+
+#if (NGX_HAVE_ADDRINFO_CMSG)
+    size_t           clen;
+    u_char           msg_control[CMSG_SPACE(sizeof(ngx_addrinfo_t))];
+#endif
+
+    /*
+     * the first datagram is already in vec, the following complete
+     * datagrams are placed into the rest of its iovec array
+     */
+
+    ngx_memzero(&msgs[0], sizeof(struct mmsghdr));
+
+    msgs[0].msg_hdr.msg_iov = vec->iovs;
+    msgs[0].msg_hdr.msg_iovlen = vec->count;
+
+    nmsgs = 1;
+    used = vec->count;
+    total = vec->size;
+
+    segment = vec->size;
+    last = vec->size;
+    gso = 1;
+
+    while (in && nmsgs < NGX_UDP_MAX_BATCH && (off_t) total < limit) {
+
+        parts = 0;
+
+        for (cl = in; cl; cl = cl->next) {
+
+            if (!ngx_buf_special(cl->buf)) {
+                parts++;
+            }
+
+            if (cl->buf->flush || cl->buf->last_buf) {
+                break;
+            }
+        }
+
+        if (parts == 0 || parts > vec->nalloc - used) {
+            break;
+        }
+
+        next.iovs = vec->iovs + used;
+        next.nalloc = vec->nalloc - used;
+
+        cl = ngx_udp_output_chain_to_iovec(&next, in, c->log);
+
+        if (cl == NGX_CHAIN_ERROR) {
+            return NGX_ERROR;
+        }
+
+        if (cl == in || next.size == 0) {
+            break;
+        }
+
+        if (last != segment || next.size > segment) {
+            gso = 0;
+        }
+
+        ngx_memzero(&msgs[nmsgs], sizeof(struct mmsghdr));
+
+        msgs[nmsgs].msg_hdr.msg_iov = next.iovs;
+        msgs[nmsgs].msg_hdr.msg_iovlen = next.count;
+
+        nmsgs++;
+        used += next.count;
+        total += next.size;
+        last = next.size;
+
+        in = cl;
+    }
+
+    if (nmsgs == 1) {
+        return ngx_sendmsg_vec(c, vec);
+    }
+
+    vec->size = total;
+
+#if ((NGX_HAVE_UDP_SEGMENT) && (NGX_HAVE_MSGHDR_MSG_CONTROL))
+
+    if (gso && ngx_udp_segmentation && total <= NGX_UDP_MAX_SEGMENT_BUF) {
+
+        sent = ngx_sendmsg_segments(c, vec->iovs, used, segment);
+
+        if (sent != NGX_DECLINED) {
+            return sent;
+        }
+    }
+
+#endif
+
+#if (NGX_HAVE_ADDRINFO_CMSG)
+    clen = 0;
+
+    if (c->listening && c->listening->wildcard && c->local_sockaddr) {
+        ngx_memzero(msg_control, sizeof(msg_control));
+
+        msgs[0].msg_hdr.msg_control = msg_control;
+        msgs[0].msg_hdr.msg_controllen = sizeof(msg_control);
+
+        clen = ngx_set_srcaddr_cmsg(CMSG_FIRSTHDR(&msgs[0].msg_hdr),
+                                    c->local_sockaddr);
+    }
+#endif
+
+    for (i = 0; i < nmsgs; i++) {
+
+        if (c->socklen) {
+            msgs[i].msg_hdr.msg_name = c->sockaddr;
+            msgs[i].msg_hdr.msg_namelen = c->socklen;
+        }
+
+#if (NGX_HAVE_ADDRINFO_CMSG)
+        if (clen) {
+            msgs[i].msg_hdr.msg_control = msg_control;
+            msgs[i].msg_hdr.msg_controllen = clen;
+        }
+#endif
+    }
+
+eintr:
+
+    n = sendmmsg(c->fd, msgs, nmsgs, 0);
+
+    if (n == -1) {
+        err = ngx_errno;
+
+        switch (err) {
+        case NGX_EAGAIN:
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                           "sendmmsg() not ready");
+            return NGX_AGAIN;
+
+        case NGX_EINTR:
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                           "sendmmsg() was interrupted");
+            goto eintr;
+
+        default:
+            c->write->error = 1;
+            ngx_connection_error(c, err, "sendmmsg() failed");
+            return NGX_ERROR;
+        }
+    }
+
+    sent = 0;
+
+    for (i = 0; i < (ngx_uint_t) n; i++) {
+        sent += msgs[i].msg_len;
+    }
+
+    ngx_log_debug4(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "sendmmsg: fd:%d %d of %ui datagrams, %z bytes",
+                   c->fd, n, nmsgs, sent);
+
+    return n ? sent : NGX_AGAIN;
+}
+
+
+#if ((NGX_HAVE_UDP_SEGMENT) && (NGX_HAVE_MSGHDR_MSG_CONTROL))
+
+static ssize_t
+ngx_sendmsg_segments(ngx_connection_t *c, struct iovec *iovs, ngx_uint_t count,
+    size_t segment)
+{
+    size_t           clen;
+    ssize_t          n;
+    uint16_t        *valp;
+    ngx_err_t        err;
+    struct msghdr    msg;
+    struct cmsghdr  *cmsg;
+
+#if (NGX_HAVE_ADDRINFO_CMSG)
+    char             msg_control[CMSG_SPACE(sizeof(uint16_t))
+                             + CMSG_SPACE(sizeof(ngx_addrinfo_t))];
+#else
+    char             msg_control[CMSG_SPACE(sizeof(uint16_t))];
+#endif
+
+    ngx_memzero(&msg, sizeof(struct msghdr));
+    ngx_memzero(msg_control, sizeof(msg_control));
+
+    if (c->socklen) {
+        msg.msg_name = c->sockaddr;
+        msg.msg_namelen = c->socklen;
+    }
+
+    msg.msg_iov = iovs;
+    msg.msg_iovlen = count;
+
+    msg.msg_control = msg_control;
+    msg.msg_controllen = sizeof(msg_control);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+
+    clen = CMSG_SPACE(sizeof(uint16_t));
+
+    valp = (void *) CMSG_DATA(cmsg);
+    *valp = segment;
+
+#if (NGX_HAVE_ADDRINFO_CMSG)
+    if (c->listening && c->listening->wildcard && c->local_sockaddr) {
+        cmsg = CMSG_NXTHDR(&msg, cmsg);
+        clen += ngx_set_srcaddr_cmsg(cmsg, c->local_sockaddr);
+    }
+#endif
+
+    msg.msg_controllen = clen;
+
+eintr:
+
+    n = sendmsg(c->fd, &msg, 0);
+
+    if (n == -1) {
+        err = ngx_errno;
+
+        switch (err) {
+        case NGX_EAGAIN:
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                           "sendmsg() not ready");
+            return NGX_AGAIN;
+
+        case NGX_EINTR:
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                           "sendmsg() was interrupted");
+            goto eintr;
+
+        case EIO:
+
+            /* no checksum offload on the outgoing interface */
+
+            ngx_log_error(NGX_LOG_NOTICE, c->log, err,
+                          "sendmsg() with UDP_SEGMENT failed, "
+                          "segmentation disabled");
+
+            ngx_udp_segmentation = 0;
+
+            return NGX_DECLINED;
+
+        case EINVAL:
+        case EMSGSIZE:
+
+            /* segment does not fit into path MTU */
+
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                           "sendmsg() with UDP_SEGMENT failed");
+
+            return NGX_DECLINED;
+
+        default:
+            c->write->error = 1;
+            ngx_connection_error(c, err, "sendmsg() failed");
+            return NGX_ERROR;
+        }
+    }
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "sendmsg: fd:%d %z bytes, segment:%uz", c->fd, n, segment);
+
+    return n;
+}
+
+#endif
+
+#endif
+
+
 #if (NGX_HAVE_ADDRINFO_CMSG)
 
 size_t
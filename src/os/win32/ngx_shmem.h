@@ -23,6 +23,9 @@ typedef struct {
 } ngx_shm_t;
 
 
+#define ngx_shm_same_policy(shm1, shm2)  1
+
+
 ngx_int_t ngx_shm_alloc(ngx_shm_t *shm);
 ngx_int_t ngx_shm_remap(ngx_shm_t *shm, u_char *addr);
 void ngx_shm_free(ngx_shm_t *shm);
@@ -1041,6 +1041,10 @@ ngx_stream_add_listening(ngx_conf_t *cf, ngx_stream_conf_addr_t *addr)
     ls->fastopen = addr->opt.fastopen;
 #endif
 
+#if (NGX_HAVE_MMSG)
+    ls->batch = addr->opt.batch;
+#endif
+
 #if (NGX_HAVE_REUSEPORT)
     ls->reuseport = addr->opt.reuseport;
 #endif
@@ -76,6 +76,9 @@ typedef struct {
 #if (NGX_HAVE_TCP_FASTOPEN)
     int                            fastopen;
 #endif
+#if (NGX_HAVE_MMSG)
+    int                            batch;
+#endif
 #if (NGX_HAVE_KEEPALIVE_TUNABLE)
     int                            tcp_keepidle;
     int                            tcp_keepintvl;
@@ -481,4 +484,8 @@ typedef ngx_int_t (*ngx_stream_filter_pt)(ngx_stream_session_t *s,
 extern ngx_stream_filter_pt  ngx_stream_top_filter;
 
 
+ngx_int_t ngx_stream_write_filter(ngx_stream_session_t *s, ngx_chain_t *in,
+    ngx_uint_t from_upstream);
+
+
 #endif /* _NGX_STREAM_H_INCLUDED_ */
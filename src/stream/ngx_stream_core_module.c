@@ -1076,6 +1076,27 @@ ngx_stream_core_listen(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         }
 #endif
 
+        if (ngx_strncmp(value[i].data, "batch=", 6) == 0) {
+#if (NGX_HAVE_MMSG)
+            lsopt.batch = ngx_atoi(value[i].data + 6, value[i].len - 6);
+            lsopt.set = 1;
+
+            if (lsopt.batch == NGX_ERROR
+                || lsopt.batch == 0
+                || lsopt.batch > NGX_UDP_MAX_BATCH)
+            {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid batch \"%V\"", &value[i]);
+                return NGX_CONF_ERROR;
+            }
+#else
+            ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                               "batch is not supported "
+                               "on this platform, ignored");
+#endif
+            continue;
+        }
+
         if (ngx_strncmp(value[i].data, "backlog=", 8) == 0) {
             lsopt.backlog = ngx_atoi(value[i].data + 8, value[i].len - 8);
             lsopt.set = 1;
@@ -1342,6 +1363,11 @@ ngx_stream_core_listen(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         if (lsopt.proxy_protocol) {
             return "\"proxy_protocol\" parameter is incompatible with \"udp\"";
         }
+
+#if (NGX_HAVE_MMSG)
+    } else if (lsopt.batch) {
+        return "\"batch\" parameter requires \"udp\"";
+#endif
     }
 
     for (n = 0; n < u.naddrs; n++) {
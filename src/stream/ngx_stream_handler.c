@@ -61,6 +61,12 @@ static ngx_api_entry_t  ngx_api_stream_server_zone_ssl_entries[] = {
         .data.off  = offsetof(ngx_stream_server_stats_t, ssl.failed)
     },
 
+    {
+        .name      = ngx_string("ktls"),
+        .handler   = ngx_api_struct_atomic_handler,
+        .data.off  = offsetof(ngx_stream_server_stats_t, ssl.ktls)
+    },
+
     ngx_api_null_entry
 };
 
@@ -764,6 +770,10 @@ ngx_stream_add_ssl_handshake_stats(ngx_connection_t *c,
     if (SSL_session_reused(c->ssl->connection)) {
         (void) ngx_atomic_fetch_add(&stats->ssl.reuses, 1);
     }
+
+    if (c->ssl->sendfile || c->ssl->ktls_recv) {
+        (void) ngx_atomic_fetch_add(&stats->ssl.ktls, 1);
+    }
 }
 
 #endif
@@ -690,6 +690,7 @@ ngx_stream_limit_conn_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     ngx_memzero(&zp, sizeof(ngx_shm_zone_params_t));
 
     zp.min_size = 8 * ngx_pagesize;
+    zp.numa_aware = 1;
 
     for (i = 2; i < cf->args->nelts; i++) {
 
@@ -717,8 +718,9 @@ ngx_stream_limit_conn_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         return NGX_CONF_ERROR;
     }
 
-    shm_zone = ngx_shared_memory_add(cf, &zp.name, zp.size,
-                                     &ngx_stream_limit_conn_module);
+    zp.tag = &ngx_stream_limit_conn_module;
+
+    shm_zone = ngx_shared_memory_add_ext(cf, &zp);
     if (shm_zone == NULL) {
         return NGX_CONF_ERROR;
     }
@@ -11,6 +11,9 @@
 #include <ngx_stream.h>
 
 
+#define NGX_STREAM_PROXY_SPLICE_BUFFERED  0x20
+
+
 typedef struct {
     ngx_addr_t                      *addr;
     ngx_stream_complex_value_t      *value;
@@ -35,6 +38,7 @@ typedef struct {
     ngx_flag_t                       next_upstream;
     ngx_flag_t                       proxy_protocol;
     ngx_flag_t                       half_close;
+    ngx_flag_t                       splice;
     ngx_stream_upstream_local_t     *local;
     ngx_flag_t                       socket_keepalive;
 
@@ -97,6 +101,19 @@ static void ngx_stream_proxy_process(ngx_stream_session_t *s,
     ngx_uint_t from_upstream, ngx_uint_t do_write);
 static ngx_int_t ngx_stream_proxy_test_finalize(ngx_stream_session_t *s,
     ngx_uint_t from_upstream);
+static void ngx_stream_proxy_test_keepalive(ngx_stream_session_t *s,
+    ngx_uint_t from_upstream);
+#if (NGX_HAVE_MMSG)
+static ngx_uint_t ngx_stream_proxy_udp_queued(ngx_stream_session_t *s,
+    ngx_connection_t *src, ngx_buf_t *b);
+#endif
+#if (NGX_HAVE_SPLICE)
+static ngx_int_t ngx_stream_proxy_splice(ngx_stream_session_t *s,
+    ngx_uint_t from_upstream, ngx_connection_t *src, ngx_connection_t *dst,
+    size_t limit_rate, off_t *received, ngx_uint_t *packets);
+static ngx_int_t ngx_stream_proxy_splice_init(ngx_stream_session_t *s);
+static void ngx_stream_proxy_splice_cleanup(void *data);
+#endif
 static void ngx_stream_proxy_next_upstream(ngx_stream_session_t *s);
 static void ngx_stream_upstream_free_peer(ngx_stream_upstream_t *u,
     ngx_uint_t state);
@@ -115,6 +132,8 @@ static char *ngx_stream_proxy_connection_drop(ngx_conf_t *cf,
     ngx_command_t *cmd, void *conf);
 static ngx_int_t ngx_stream_proxy_need_connection_drop(ngx_stream_upstream_t *u,
     ngx_msec_t connection_drop);
+static char *ngx_stream_proxy_splice_check(ngx_conf_t *cf, void *post,
+    void *data);
 
 #if (NGX_STREAM_SSL)
 
@@ -160,6 +179,10 @@ static ngx_conf_post_t  ngx_stream_proxy_ssl_conf_command_post =
 #endif
 
 
+static ngx_conf_post_t  ngx_stream_proxy_splice_post =
+    { ngx_stream_proxy_splice_check };
+
+
 static ngx_conf_deprecated_t  ngx_conf_deprecated_proxy_downstream_buffer = {
     ngx_conf_deprecated, "proxy_downstream_buffer", "proxy_buffer_size"
 };
@@ -290,6 +313,13 @@ static ngx_command_t  ngx_stream_proxy_commands[] = {
       offsetof(ngx_stream_proxy_srv_conf_t, half_close),
       NULL },
 
+    { ngx_string("proxy_splice"),
+      NGX_STREAM_MAIN_CONF|NGX_STREAM_SRV_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_STREAM_SRV_CONF_OFFSET,
+      offsetof(ngx_stream_proxy_srv_conf_t, splice),
+      &ngx_stream_proxy_splice_post },
+
     { ngx_string("proxy_connection_drop"),
       NGX_STREAM_MAIN_CONF|NGX_STREAM_SRV_CONF|NGX_CONF_TAKE1,
       ngx_stream_proxy_connection_drop,
@@ -515,6 +545,23 @@ ngx_stream_proxy_handler(ngx_stream_session_t *s)
     u->peer.type = c->type;
     u->start_sec = ngx_time();
 
+    if (c->type == SOCK_STREAM) {
+
+        /*
+         * with proxy_responses, upstream connections can be kept alive
+         * once all responses are received, see ngx_stream_proxy_finalize()
+         */
+
+        u->requests = (c->buffer && c->buffer->last > c->buffer->pos);
+
+        u->keepalive = (pscf->responses != NGX_MAX_INT32_VALUE
+                        && !pscf->proxy_protocol
+#if (NGX_STREAM_SSL)
+                        && !pscf->ssl_enable
+#endif
+                       );
+    }
+
     c->write->handler = ngx_stream_proxy_downstream_handler;
     c->read->handler = ngx_stream_proxy_downstream_handler;
 
@@ -1021,6 +1068,29 @@ ngx_stream_proxy_init_upstream(ngx_stream_session_t *s)
     u->upload_rate = ngx_stream_complex_value_size(s, pscf->upload_rate, 0);
     u->download_rate = ngx_stream_complex_value_size(s, pscf->download_rate, 0);
 
+#if (NGX_HAVE_SPLICE)
+
+    /*
+     * data are relayed with splice() unless they have to be
+     * seen by TLS or by a filter other than the write filter
+     */
+
+    if (pscf->splice
+        && pc->type == SOCK_STREAM
+#if (NGX_STREAM_SSL)
+        && c->ssl == NULL
+        && pc->ssl == NULL
+#endif
+        && ngx_stream_top_filter == ngx_stream_write_filter)
+    {
+        ngx_log_debug0(NGX_LOG_DEBUG_STREAM, c->log, 0,
+                       "stream proxy splice");
+
+        u->splice = 1;
+    }
+
+#endif
+
     u->connected = 1;
 
     pc->read->handler = ngx_stream_proxy_upstream_handler;
@@ -1725,6 +1795,24 @@ ngx_stream_proxy_need_connection_drop(ngx_stream_upstream_t *u,
 }
 
 
+static char *
+ngx_stream_proxy_splice_check(ngx_conf_t *cf, void *post, void *data)
+{
+#if !(NGX_HAVE_SPLICE)
+    ngx_flag_t  *fp = data;
+
+    if (*fp) {
+        ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                           "\"proxy_splice\" is not supported "
+                           "on this platform, ignored");
+        *fp = 0;
+    }
+#endif
+
+    return NGX_CONF_OK;
+}
+
+
 static void
 ngx_stream_proxy_process_connection(ngx_event_t *ev, ngx_uint_t from_upstream)
 {
@@ -1995,9 +2083,20 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
 
     for ( ;; ) {
 
+#if (NGX_HAVE_MMSG)
+        if (do_write && !from_upstream
+            && ngx_stream_proxy_udp_queued(s, src, b))
+        {
+            /* read queued datagrams to send them to upstream at once */
+            do_write = 0;
+        }
+#endif
+
         if (do_write && dst) {
 
-            if (*out || *busy || dst->buffered) {
+            if (*out || *busy
+                || (dst->buffered & ~NGX_STREAM_PROXY_SPLICE_BUFFERED))
+            {
                 c->log->action = send_action;
 
                 rc = ngx_stream_top_filter(s, *out, from_upstream);
@@ -2017,6 +2116,38 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
             }
         }
 
+#if (NGX_HAVE_SPLICE)
+
+        if (u->splice && dst) {
+
+            if (*out || *busy) {
+                /* wait for buffered data to be sent first */
+                break;
+            }
+
+            rc = ngx_stream_proxy_splice(s, from_upstream, src, dst,
+                                         limit_rate, received, packets);
+
+            if (rc == NGX_ERROR) {
+                ngx_stream_proxy_finalize(s, NGX_STREAM_OK);
+                return;
+            }
+
+            if (rc == NGX_OK) {
+                break;
+            }
+
+            /* rc == NGX_DECLINED, fall back to buffered mode */
+        }
+
+#endif
+
+        if (!from_upstream && c->type == SOCK_DGRAM
+            && pscf->requests && u->requests >= pscf->requests)
+        {
+            break;
+        }
+
         size = b->end - b->last;
 
         if (size && src->read->ready && !src->read->delayed) {
@@ -2086,7 +2217,14 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
                 cl->buf->last_buf = src->read->eof;
                 cl->buf->flush = !src->read->eof;
 
-                (*packets)++;
+                if (n || c->type == SOCK_DGRAM) {
+                    (*packets)++;
+
+                    if (u->keepalive) {
+                        ngx_stream_proxy_test_keepalive(s, from_upstream);
+                    }
+                }
+
                 *received += n;
                 b->last += n;
                 do_write = 1;
@@ -2145,6 +2283,39 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
 }
 
 
+#if (NGX_HAVE_MMSG)
+
+static ngx_uint_t
+ngx_stream_proxy_udp_queued(ngx_stream_session_t *s, ngx_connection_t *src,
+    ngx_buf_t *b)
+{
+    ngx_stream_upstream_t        *u;
+    ngx_stream_proxy_srv_conf_t  *pscf;
+
+    if (src->udp == NULL || src->udp->buffer == NULL
+        || !src->read->ready || src->read->delayed)
+    {
+        return 0;
+    }
+
+    u = s->upstream;
+
+    if (u->upload_rate) {
+        return 0;
+    }
+
+    pscf = ngx_stream_get_module_srv_conf(s, ngx_stream_proxy_module);
+
+    if (pscf->requests && u->requests >= pscf->requests) {
+        return 0;
+    }
+
+    return (off_t) (b->end - b->last) >= ngx_buf_size(src->udp->buffer);
+}
+
+#endif
+
+
 static ngx_int_t
 ngx_stream_proxy_test_finalize(ngx_stream_session_t *s,
     ngx_uint_t from_upstream)
@@ -2233,6 +2404,248 @@ ngx_stream_proxy_test_finalize(ngx_stream_session_t *s,
 }
 
 
+static void
+ngx_stream_proxy_test_keepalive(ngx_stream_session_t *s,
+    ngx_uint_t from_upstream)
+{
+    ngx_stream_upstream_t        *u;
+    ngx_stream_proxy_srv_conf_t  *pscf;
+
+    /*
+     * TCP has no message boundaries, so a connection is only kept alive
+     * if reads strictly alternate: each read from the client is a request,
+     * followed by exactly proxy_responses reads from the upstream; a split
+     * or unsolicited response, or a pipelined request, disables keepalive
+     */
+
+    pscf = ngx_stream_get_module_srv_conf(s, ngx_stream_proxy_module);
+
+    u = s->upstream;
+
+    if (from_upstream) {
+        if (u->responses > pscf->responses * u->requests) {
+            u->keepalive = 0;
+        }
+
+    } else {
+        if (u->responses < pscf->responses * (u->requests - 1)) {
+            u->keepalive = 0;
+        }
+    }
+
+    if (!u->keepalive) {
+        ngx_log_debug2(NGX_LOG_DEBUG_STREAM, s->connection->log, 0,
+                       "stream proxy keepalive disabled, "
+                       "requests:%ui responses:%ui",
+                       u->requests, u->responses);
+    }
+}
+
+
+#if (NGX_HAVE_SPLICE)
+
+static ngx_int_t
+ngx_stream_proxy_splice(ngx_stream_session_t *s, ngx_uint_t from_upstream,
+    ngx_connection_t *src, ngx_connection_t *dst, size_t limit_rate,
+    off_t *received, ngx_uint_t *packets)
+{
+    off_t                        limit;
+    size_t                       size;
+    ssize_t                      n;
+    ngx_err_t                    err;
+    ngx_msec_t                   delay;
+    ngx_stream_upstream_t       *u;
+    ngx_stream_upstream_pipe_t  *p;
+
+    u = s->upstream;
+
+    if (u->pipes == NULL) {
+        if (ngx_stream_proxy_splice_init(s) != NGX_OK) {
+            u->splice = 0;
+            return NGX_DECLINED;
+        }
+    }
+
+    p = &u->pipes[from_upstream];
+
+    for ( ;; ) {
+
+        if (p->size && dst->write->ready) {
+
+            n = splice(p->fd[0], NULL, dst->fd, NULL, p->size,
+                       SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+
+            ngx_log_debug3(NGX_LOG_DEBUG_STREAM, s->connection->log, 0,
+                           "splice to %d: %z of %uz", dst->fd, n, p->size);
+
+            if (n > 0) {
+                p->size -= n;
+                dst->sent += n;
+                continue;
+            }
+
+            err = ngx_errno;
+
+            if (n == -1 && err != NGX_EAGAIN) {
+                dst->write->error = 1;
+                ngx_connection_error(dst, err, "splice() failed");
+                return NGX_ERROR;
+            }
+
+            dst->write->ready = 0;
+        }
+
+        size = p->capacity - p->size;
+
+        if (size
+            && src->read->ready && !src->read->delayed && !src->read->eof)
+        {
+            if (limit_rate) {
+                limit = (off_t) limit_rate * (ngx_time() - u->start_sec + 1)
+                        - *received;
+
+                if (limit <= 0) {
+                    src->read->delayed = 1;
+                    delay = (ngx_msec_t) (- limit * 1000 / limit_rate + 1);
+                    ngx_add_timer(src->read, delay);
+                    break;
+                }
+
+                if ((off_t) size > limit) {
+                    size = (size_t) limit;
+                }
+            }
+
+            n = splice(src->fd, NULL, p->fd[1], NULL, size,
+                       SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+
+            ngx_log_debug3(NGX_LOG_DEBUG_STREAM, s->connection->log, 0,
+                           "splice from %d: %z of %uz", src->fd, n, size);
+
+            if (n == -1) {
+                err = ngx_errno;
+
+                if (err == NGX_EAGAIN) {
+                    src->read->ready = 0;
+                    break;
+                }
+
+                src->read->error = 1;
+                ngx_connection_error(src, err, "splice() failed");
+
+                n = 0;
+            }
+
+            if (n == 0) {
+                src->read->ready = 0;
+                src->read->eof = 1;
+                continue;
+            }
+
+            if (limit_rate) {
+                delay = (ngx_msec_t) (n * 1000 / limit_rate);
+
+                if (delay > 0) {
+                    src->read->delayed = 1;
+                    ngx_add_timer(src->read, delay);
+                }
+            }
+
+            if (from_upstream
+                && u->state->first_byte_time == (ngx_msec_t) -1)
+            {
+                u->state->first_byte_time = ngx_current_msec - u->start_time;
+            }
+
+            (*packets)++;
+            *received += n;
+            p->size += n;
+
+            if (u->keepalive) {
+                ngx_stream_proxy_test_keepalive(s, from_upstream);
+            }
+
+            continue;
+        }
+
+        break;
+    }
+
+    if (p->size) {
+        dst->buffered |= NGX_STREAM_PROXY_SPLICE_BUFFERED;
+
+    } else {
+        dst->buffered &= ~NGX_STREAM_PROXY_SPLICE_BUFFERED;
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_stream_proxy_splice_init(ngx_stream_session_t *s)
+{
+    int                          size;
+    ngx_uint_t                   i;
+    ngx_connection_t            *c;
+    ngx_pool_cleanup_t          *cln;
+    ngx_stream_upstream_pipe_t  *p;
+
+    c = s->connection;
+
+    cln = ngx_pool_cleanup_add(c->pool, 2 * sizeof(ngx_stream_upstream_pipe_t));
+    if (cln == NULL) {
+        return NGX_ERROR;
+    }
+
+    p = cln->data;
+
+    p[0].fd[0] = p[0].fd[1] = -1;
+    p[1].fd[0] = p[1].fd[1] = -1;
+
+    cln->handler = ngx_stream_proxy_splice_cleanup;
+
+    for (i = 0; i < 2; i++) {
+
+        if (pipe2(p[i].fd, O_NONBLOCK|O_CLOEXEC) == -1) {
+            ngx_log_error(NGX_LOG_ERR, c->log, ngx_errno,
+                          "pipe2() failed, splice disabled");
+            return NGX_ERROR;
+        }
+
+        size = fcntl(p[i].fd[0], F_GETPIPE_SZ);
+
+        p[i].size = 0;
+        p[i].capacity = (size > 0) ? (size_t) size : 65536;
+    }
+
+    ngx_log_debug4(NGX_LOG_DEBUG_STREAM, c->log, 0,
+                   "stream proxy splice pipes: %d:%d %d:%d",
+                   p[0].fd[0], p[0].fd[1], p[1].fd[0], p[1].fd[1]);
+
+    s->upstream->pipes = p;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_stream_proxy_splice_cleanup(void *data)
+{
+    ngx_stream_upstream_pipe_t  *p = data;
+
+    ngx_uint_t  i;
+
+    for (i = 0; i < 4; i++) {
+        if (p[i / 2].fd[i % 2] != -1) {
+            (void) close(p[i / 2].fd[i % 2]);
+        }
+    }
+}
+
+#endif
+
+
 static void
 ngx_stream_proxy_next_upstream(ngx_stream_session_t *s)
 {
@@ -2331,8 +2744,9 @@ ngx_stream_upstream_free_peer(ngx_stream_upstream_t *u, ngx_uint_t state)
 static void
 ngx_stream_proxy_finalize(ngx_stream_session_t *s, ngx_uint_t rc)
 {
-    ngx_connection_t       *pc;
-    ngx_stream_upstream_t  *u;
+    ngx_connection_t             *pc;
+    ngx_stream_upstream_t        *u;
+    ngx_stream_proxy_srv_conf_t  *pscf;
 
     ngx_log_debug1(NGX_LOG_DEBUG_STREAM, s->connection->log, 0,
                    "finalize stream proxy: %i", rc);
@@ -2361,8 +2775,27 @@ ngx_stream_proxy_finalize(ngx_stream_session_t *s, ngx_uint_t rc)
         }
     }
 
+    pscf = ngx_stream_get_module_srv_conf(s, ngx_stream_proxy_module);
+
+    if (u->keepalive
+        && (rc != NGX_STREAM_OK
+            || pc == NULL
+            || !u->connected
+            || !s->connection->read->eof
+            || u->half_closed
+            || u->upstream_out
+            || u->upstream_busy
+            || pc->buffered
+            || u->responses != pscf->responses * u->requests))
+    {
+        u->keepalive = 0;
+    }
+
     if (u->peer.sockaddr) {
         ngx_stream_upstream_free_peer(u, 0);
+
+        /* the connection may be cached by the keepalive module */
+        pc = u->peer.connection;
     }
 
     if (pc) {
@@ -2455,6 +2888,7 @@ ngx_stream_proxy_create_srv_conf(ngx_conf_t *cf)
     conf->local = NGX_CONF_UNSET_PTR;
     conf->socket_keepalive = NGX_CONF_UNSET;
     conf->half_close = NGX_CONF_UNSET;
+    conf->splice = NGX_CONF_UNSET;
 
 #if (NGX_STREAM_SSL)
     conf->ssl_enable = NGX_CONF_UNSET;
@@ -2529,6 +2963,7 @@ ngx_stream_proxy_merge_srv_conf(ngx_conf_t *cf, void *parent, void *child)
                               prev->socket_keepalive, 0);
 
     ngx_conf_merge_value(conf->half_close, prev->half_close, 0);
+    ngx_conf_merge_value(conf->splice, prev->splice, 0);
 
 #if (NGX_STREAM_SSL)
 
@@ -139,6 +139,17 @@ typedef struct {
 } ngx_stream_upstream_resolved_t;
 
 
+#if (NGX_HAVE_SPLICE)
+
+typedef struct {
+    int                                fd[2];
+    size_t                             size;
+    size_t                             capacity;
+} ngx_stream_upstream_pipe_t;
+
+#endif
+
+
 typedef struct {
     ngx_peer_connection_t              peer;
 
@@ -162,12 +173,18 @@ typedef struct {
 
     ngx_str_t                          ssl_name;
 
+#if (NGX_HAVE_SPLICE)
+    ngx_stream_upstream_pipe_t        *pipes;
+#endif
+
     ngx_stream_upstream_srv_conf_t    *upstream;
     ngx_stream_upstream_resolved_t    *resolved;
     ngx_stream_upstream_state_t       *state;
     unsigned                           connected:1;
     unsigned                           proxy_protocol:1;
     unsigned                           half_closed:1;
+    unsigned                           splice:1;
+    unsigned                           keepalive:1;
 } ngx_stream_upstream_t;
 
 
@@ -0,0 +1,591 @@
+
+/*
+ * Copyright (C) 2026 Web Server LLC
+ * Copyright (C) Maxim Dounin
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_stream.h>
+
+
+typedef struct {
+    ngx_uint_t                         max_cached;
+    ngx_uint_t                         requests;
+    ngx_msec_t                         time;
+    ngx_msec_t                         timeout;
+
+    ngx_queue_t                        cache;
+    ngx_queue_t                        free;
+
+    ngx_pool_t                        *pool;
+
+    ngx_stream_upstream_init_pt        original_init_upstream;
+    ngx_stream_upstream_init_peer_pt   original_init_peer;
+
+} ngx_stream_upstream_keepalive_srv_conf_t;
+
+
+typedef struct {
+    ngx_stream_upstream_keepalive_srv_conf_t  *conf;
+
+    ngx_queue_t                        queue;
+    ngx_connection_t                  *connection;
+
+    socklen_t                          socklen;
+    ngx_sockaddr_t                     sockaddr;
+
+#if (NGX_API && NGX_STREAM_UPSTREAM_ZONE)
+    ngx_stream_upstream_rr_peers_t    *rr_peers;
+#endif
+
+} ngx_stream_upstream_keepalive_cache_t;
+
+
+static ngx_int_t ngx_stream_upstream_init_keepalive_peer(
+    ngx_stream_session_t *s, ngx_stream_upstream_srv_conf_t *us);
+static ngx_int_t ngx_stream_upstream_connect_keepalive_peer(
+    ngx_peer_connection_t *pc, void *data);
+static void ngx_stream_upstream_close_keepalive_peer(ngx_peer_connection_t *pc,
+    void *data, ngx_uint_t state);
+
+static ngx_int_t ngx_stream_upstream_keepalive_test(ngx_connection_t *c);
+static void ngx_stream_upstream_keepalive_dummy_handler(ngx_event_t *ev);
+static void ngx_stream_upstream_keepalive_close_handler(ngx_event_t *ev);
+static void ngx_stream_upstream_keepalive_free(
+    ngx_stream_upstream_keepalive_cache_t *item);
+
+static void *ngx_stream_upstream_keepalive_create_conf(ngx_conf_t *cf);
+static char *ngx_stream_upstream_keepalive(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+
+
+static ngx_command_t  ngx_stream_upstream_keepalive_commands[] = {
+
+    { ngx_string("keepalive"),
+      NGX_STREAM_UPS_CONF|NGX_CONF_TAKE1,
+      ngx_stream_upstream_keepalive,
+      NGX_STREAM_SRV_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("keepalive_time"),
+      NGX_STREAM_UPS_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_msec_slot,
+      NGX_STREAM_SRV_CONF_OFFSET,
+      offsetof(ngx_stream_upstream_keepalive_srv_conf_t, time),
+      NULL },
+
+    { ngx_string("keepalive_timeout"),
+      NGX_STREAM_UPS_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_msec_slot,
+      NGX_STREAM_SRV_CONF_OFFSET,
+      offsetof(ngx_stream_upstream_keepalive_srv_conf_t, timeout),
+      NULL },
+
+    { ngx_string("keepalive_requests"),
+      NGX_STREAM_UPS_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_STREAM_SRV_CONF_OFFSET,
+      offsetof(ngx_stream_upstream_keepalive_srv_conf_t, requests),
+      NULL },
+
+      ngx_null_command
+};
+
+
+static ngx_stream_module_t  ngx_stream_upstream_keepalive_module_ctx = {
+    NULL,                                  /* preconfiguration */
+    NULL,                                  /* postconfiguration */
+
+    NULL,                                  /* create main configuration */
+    NULL,                                  /* init main configuration */
+
+    ngx_stream_upstream_keepalive_create_conf, /* create server configuration */
+    NULL                                   /* merge server configuration */
+};
+
+
+ngx_module_t  ngx_stream_upstream_keepalive_module = {
+    NGX_MODULE_V1,
+    &ngx_stream_upstream_keepalive_module_ctx, /* module context */
+    ngx_stream_upstream_keepalive_commands,    /* module directives */
+    NGX_STREAM_MODULE,                     /* module type */
+    NULL,                                  /* init master */
+    NULL,                                  /* init module */
+    NULL,                                  /* init process */
+    NULL,                                  /* init thread */
+    NULL,                                  /* exit thread */
+    NULL,                                  /* exit process */
+    NULL,                                  /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+static ngx_int_t
+ngx_stream_upstream_init_keepalive(ngx_conf_t *cf,
+    ngx_stream_upstream_srv_conf_t *us)
+{
+    ngx_uint_t                                 i;
+    ngx_stream_upstream_keepalive_srv_conf_t  *kcf;
+    ngx_stream_upstream_keepalive_cache_t     *cached;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_STREAM, cf->log, 0,
+                   "init keepalive");
+
+    kcf = ngx_stream_conf_upstream_srv_conf(us,
+                                        ngx_stream_upstream_keepalive_module);
+
+    ngx_conf_init_msec_value(kcf->time, 3600000);
+    ngx_conf_init_msec_value(kcf->timeout, 60000);
+    ngx_conf_init_uint_value(kcf->requests, 1000);
+
+    if (kcf->original_init_upstream(cf, us) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    kcf->original_init_peer = us->peer.init;
+
+    us->peer.init = ngx_stream_upstream_init_keepalive_peer;
+
+    /*
+     * allocate cache items and add to free queue; the number of cached
+     * connections is limited per peer, so more items are allocated
+     * on demand if there are several peers
+     */
+
+    cached = ngx_pcalloc(cf->pool,
+              sizeof(ngx_stream_upstream_keepalive_cache_t) * kcf->max_cached);
+    if (cached == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_queue_init(&kcf->cache);
+    ngx_queue_init(&kcf->free);
+
+    for (i = 0; i < kcf->max_cached; i++) {
+        ngx_queue_insert_head(&kcf->free, &cached[i].queue);
+        cached[i].conf = kcf;
+    }
+
+    kcf->pool = cf->pool;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_stream_upstream_init_keepalive_peer(ngx_stream_session_t *s,
+    ngx_stream_upstream_srv_conf_t *us)
+{
+    ngx_stream_upstream_keepalive_srv_conf_t  *kcf;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_STREAM, s->connection->log, 0,
+                   "init keepalive peer");
+
+    kcf = ngx_stream_conf_upstream_srv_conf(us,
+                                        ngx_stream_upstream_keepalive_module);
+
+    if (kcf->original_init_peer(s, us) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    s->upstream->peer.connect = ngx_stream_upstream_connect_keepalive_peer;
+    s->upstream->peer.close = ngx_stream_upstream_close_keepalive_peer;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_stream_upstream_connect_keepalive_peer(ngx_peer_connection_t *pc,
+    void *data)
+{
+    ngx_stream_session_t                      *s;
+    ngx_stream_upstream_keepalive_cache_t     *item;
+    ngx_stream_upstream_keepalive_srv_conf_t  *kcf;
+
+    ngx_queue_t       *q, *next, *cache;
+    ngx_connection_t  *c;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_STREAM, pc->log, 0,
+                   "connect keepalive peer");
+
+    s = pc->ctx;
+
+    if (!s->upstream->keepalive) {
+        return ngx_event_connect(pc, pc->data);
+    }
+
+    kcf = ngx_stream_conf_upstream_srv_conf(s->upstream->upstream,
+                                        ngx_stream_upstream_keepalive_module);
+
+    /* search cache for suitable connection */
+
+    cache = &kcf->cache;
+
+    for (q = ngx_queue_head(cache);
+         q != ngx_queue_sentinel(cache);
+         q = next)
+    {
+        next = ngx_queue_next(q);
+
+        item = ngx_queue_data(q, ngx_stream_upstream_keepalive_cache_t, queue);
+        c = item->connection;
+
+        if (ngx_memn2cmp((u_char *) &item->sockaddr, (u_char *) pc->sockaddr,
+                         item->socklen, pc->socklen)
+            != 0)
+        {
+            continue;
+        }
+
+        ngx_queue_remove(q);
+
+        if (ngx_stream_upstream_keepalive_test(c) != NGX_OK) {
+
+            /* the connection was closed or got unexpected data */
+
+            ngx_log_debug1(NGX_LOG_DEBUG_STREAM, pc->log, 0,
+                           "connect keepalive peer: stale connection %p", c);
+
+            ngx_stream_upstream_keepalive_free(item);
+            continue;
+        }
+
+        ngx_queue_insert_head(&kcf->free, q);
+
+#if (NGX_API && NGX_STREAM_UPSTREAM_ZONE)
+        if (item->rr_peers) {
+            (void) ngx_atomic_fetch_add(&item->rr_peers->stats.keepalive, -1);
+        }
+#endif
+
+        goto found;
+    }
+
+    return ngx_event_connect(pc, pc->data);
+
+found:
+
+    ngx_log_debug1(NGX_LOG_DEBUG_STREAM, pc->log, 0,
+                   "connect keepalive peer: using connection %p", c);
+
+    c->idle = 0;
+    c->sent = 0;
+    c->data = NULL;
+    c->log = pc->log;
+    c->read->log = pc->log;
+    c->write->log = pc->log;
+
+    if (c->read->timer_set) {
+        ngx_del_timer(c->read);
+    }
+
+    pc->connection = c;
+    pc->cached = 1;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_stream_upstream_close_keepalive_peer(ngx_peer_connection_t *pc,
+    void *data, ngx_uint_t state)
+{
+    ngx_stream_session_t                      *s;
+    ngx_stream_upstream_keepalive_cache_t     *item, *last;
+    ngx_stream_upstream_keepalive_srv_conf_t  *kcf;
+
+    ngx_uint_t              n;
+    ngx_queue_t            *q;
+    ngx_connection_t       *c;
+    ngx_stream_upstream_t  *u;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_STREAM, pc->log, 0,
+                   "close keepalive peer");
+
+    /* cache valid connections */
+
+    s = pc->ctx;
+
+    u = s->upstream;
+
+    kcf = ngx_stream_conf_upstream_srv_conf(u->upstream,
+                                        ngx_stream_upstream_keepalive_module);
+    c = pc->connection;
+
+    if (state & NGX_PEER_FAILED
+        || c == NULL
+        || c->type != SOCK_STREAM
+        || c->read->eof
+        || c->read->error
+        || c->read->timedout
+        || c->write->error
+        || c->write->timedout)
+    {
+        return;
+    }
+
+    if (++c->requests >= kcf->requests) {
+        return;
+    }
+
+    if (ngx_current_msec - c->start_time > kcf->time) {
+        return;
+    }
+
+    if (!u->keepalive) {
+        return;
+    }
+
+    if (ngx_terminate || ngx_exiting) {
+        return;
+    }
+
+    if (ngx_handle_read_event(c->read, 0) != NGX_OK) {
+        return;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_STREAM, pc->log, 0,
+                   "close keepalive peer: saving connection %p", c);
+
+    /* the least recently used connection to the peer is closed if needed */
+
+    n = 0;
+    last = NULL;
+
+    for (q = ngx_queue_head(&kcf->cache);
+         q != ngx_queue_sentinel(&kcf->cache);
+         q = ngx_queue_next(q))
+    {
+        item = ngx_queue_data(q, ngx_stream_upstream_keepalive_cache_t, queue);
+
+        if (ngx_memn2cmp((u_char *) &item->sockaddr, (u_char *) pc->sockaddr,
+                         item->socklen, pc->socklen)
+            == 0)
+        {
+            n++;
+            last = item;
+        }
+    }
+
+    if (n >= kcf->max_cached) {
+        ngx_queue_remove(&last->queue);
+        ngx_stream_upstream_keepalive_free(last);
+    }
+
+    if (ngx_queue_empty(&kcf->free)) {
+
+        item = ngx_pcalloc(kcf->pool,
+                           sizeof(ngx_stream_upstream_keepalive_cache_t));
+        if (item == NULL) {
+            return;
+        }
+
+        item->conf = kcf;
+
+        q = &item->queue;
+
+    } else {
+        q = ngx_queue_head(&kcf->free);
+        ngx_queue_remove(q);
+
+        item = ngx_queue_data(q, ngx_stream_upstream_keepalive_cache_t, queue);
+    }
+
+    ngx_queue_insert_head(&kcf->cache, q);
+
+#if (NGX_API && NGX_STREAM_UPSTREAM_ZONE)
+    if (u->upstream->shm_zone != NULL) {
+        item->rr_peers = u->upstream->peer.data;
+        (void) ngx_atomic_fetch_add(&item->rr_peers->stats.keepalive, 1);
+
+    } else {
+        item->rr_peers = NULL;
+    }
+#endif
+
+    item->connection = c;
+
+    pc->connection = NULL;
+
+    c->read->delayed = 0;
+    ngx_add_timer(c->read, kcf->timeout);
+
+    if (c->write->timer_set) {
+        ngx_del_timer(c->write);
+    }
+
+    c->write->handler = ngx_stream_upstream_keepalive_dummy_handler;
+    c->read->handler = ngx_stream_upstream_keepalive_close_handler;
+
+    /* the session pool is going away */
+
+    c->pool = NULL;
+
+    c->data = item;
+    c->idle = 1;
+    c->log = ngx_cycle->log;
+    c->read->log = ngx_cycle->log;
+    c->write->log = ngx_cycle->log;
+
+    item->socklen = pc->socklen;
+    ngx_memcpy(&item->sockaddr, pc->sockaddr, pc->socklen);
+
+    if (c->read->ready) {
+        ngx_stream_upstream_keepalive_close_handler(c->read);
+    }
+}
+
+
+static ngx_int_t
+ngx_stream_upstream_keepalive_test(ngx_connection_t *c)
+{
+    int   n;
+    char  buf[1];
+
+    /*
+     * an idle connection of a request/response protocol must
+     * neither be closed by the peer nor have any data pending
+     */
+
+    n = recv(c->fd, buf, 1, MSG_PEEK);
+
+    if (n == -1 && ngx_socket_errno == NGX_EAGAIN) {
+        c->read->ready = 0;
+        return NGX_OK;
+    }
+
+    return NGX_ERROR;
+}
+
+
+static void
+ngx_stream_upstream_keepalive_dummy_handler(ngx_event_t *ev)
+{
+    ngx_log_debug0(NGX_LOG_DEBUG_STREAM, ev->log, 0,
+                   "keepalive dummy handler");
+}
+
+
+static void
+ngx_stream_upstream_keepalive_close_handler(ngx_event_t *ev)
+{
+    ngx_connection_t                       *c;
+    ngx_stream_upstream_keepalive_cache_t  *item;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_STREAM, ev->log, 0,
+                   "keepalive close handler");
+
+    c = ev->data;
+
+    if (c->close || c->read->timedout) {
+        goto close;
+    }
+
+    if (ngx_stream_upstream_keepalive_test(c) == NGX_OK) {
+
+        if (ngx_handle_read_event(c->read, 0) != NGX_OK) {
+            goto close;
+        }
+
+        return;
+    }
+
+close:
+
+    item = c->data;
+
+    ngx_queue_remove(&item->queue);
+
+    ngx_stream_upstream_keepalive_free(item);
+}
+
+
+static void
+ngx_stream_upstream_keepalive_free(ngx_stream_upstream_keepalive_cache_t *item)
+{
+    ngx_close_connection(item->connection);
+
+    item->connection = NULL;
+
+    ngx_queue_insert_head(&item->conf->free, &item->queue);
+
+#if (NGX_API && NGX_STREAM_UPSTREAM_ZONE)
+    if (item->rr_peers) {
+        (void) ngx_atomic_fetch_add(&item->rr_peers->stats.keepalive, -1);
+    }
+#endif
+}
+
+
+static void *
+ngx_stream_upstream_keepalive_create_conf(ngx_conf_t *cf)
+{
+    ngx_stream_upstream_keepalive_srv_conf_t  *conf;
+
+    conf = ngx_pcalloc(cf->pool,
+                       sizeof(ngx_stream_upstream_keepalive_srv_conf_t));
+    if (conf == NULL) {
+        return NULL;
+    }
+
+    /*
+     * set by ngx_pcalloc():
+     *
+     *     conf->original_init_upstream = NULL;
+     *     conf->original_init_peer = NULL;
+     *     conf->max_cached = 0;
+     */
+
+    conf->time = NGX_CONF_UNSET_MSEC;
+    conf->timeout = NGX_CONF_UNSET_MSEC;
+    conf->requests = NGX_CONF_UNSET_UINT;
+
+    return conf;
+}
+
+
+static char *
+ngx_stream_upstream_keepalive(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_stream_upstream_srv_conf_t            *uscf;
+    ngx_stream_upstream_keepalive_srv_conf_t  *kcf = conf;
+
+    ngx_int_t    n;
+    ngx_str_t   *value;
+
+    if (kcf->max_cached) {
+        return "is duplicate";
+    }
+
+    /* read options */
+
+    value = cf->args->elts;
+
+    n = ngx_atoi(value[1].data, value[1].len);
+
+    if (n == NGX_ERROR || n == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid value \"%V\" in \"%V\" directive",
+                           &value[1], &cmd->name);
+        return NGX_CONF_ERROR;
+    }
+
+    kcf->max_cached = n;
+
+    /* init upstream handler */
+
+    uscf = ngx_stream_conf_get_module_srv_conf(cf, ngx_stream_upstream_module);
+
+    kcf->original_init_upstream = uscf->peer.init_upstream
+                                  ? uscf->peer.init_upstream
+                                  : ngx_stream_upstream_init_round_robin;
+
+    uscf->peer.init_upstream = ngx_stream_upstream_init_keepalive;
+
+    return NGX_CONF_OK;
+}
@@ -20,6 +20,11 @@
 
 #if (NGX_API && NGX_STREAM_UPSTREAM_ZONE)
 
+typedef struct {
+    ngx_atomic_uint_t  keepalive;
+} ngx_stream_upstream_stats_t;
+
+
 typedef struct {
     uint64_t                         conns;
     uint64_t                         fails;
@@ -133,6 +138,10 @@ struct ngx_stream_upstream_rr_peers_s {
 #if (NGX_STREAM_UPSTREAM_ZONE)
     ngx_uint_t                      *generation;
     ngx_stream_upstream_rr_peer_t   *resolve;
+
+#if (NGX_API)
+    ngx_stream_upstream_stats_t      stats;
+#endif
 #endif
 
     ngx_uint_t                       zombies;
@@ -39,6 +39,8 @@ static ngx_int_t ngx_api_stream_upstream_peers_handler(
     ngx_api_entry_data_t data, ngx_api_ctx_t *actx, void *ctx);
 static ngx_int_t ngx_api_stream_upstream_peers_iter(ngx_api_iter_ctx_t *ictx,
     ngx_api_ctx_t *actx);
+static ngx_int_t ngx_api_stream_upstream_keepalive_handler(
+    ngx_api_entry_data_t data, ngx_api_ctx_t *actx, void *ctx);
 #if (NGX_DEBUG)
 static ngx_int_t ngx_api_stream_upstream_zombies_handler(
     ngx_api_entry_data_t data, ngx_api_ctx_t *actx, void *ctx);
@@ -79,6 +81,11 @@ static ngx_api_entry_t  ngx_api_stream_upstream_entries[] = {
         .handler   = ngx_api_stream_upstream_peers_handler,
     },
 
+    {
+        .name      = ngx_string("keepalive"),
+        .handler   = ngx_api_stream_upstream_keepalive_handler,
+    },
+
 #if (NGX_DEBUG)
     {
         .name      = ngx_string("zombies"),
@@ -305,6 +312,7 @@ ngx_stream_upstream_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     ngx_memzero(&zp, sizeof(ngx_shm_zone_params_t));
 
     zp.min_size = 8 * ngx_pagesize;
+    zp.numa_aware = 1;
 
     if (cf->args->nelts == 3) {
         if (ngx_conf_parse_zone_size(cf, &zp, &value[2]) != NGX_OK) {
@@ -316,8 +324,9 @@ ngx_stream_upstream_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         return NGX_CONF_ERROR;
     }
 
-    uscf->shm_zone = ngx_shared_memory_add(cf, &zp.name, zp.size,
-                                           &ngx_stream_upstream_module);
+    zp.tag = &ngx_stream_upstream_module;
+
+    uscf->shm_zone = ngx_shared_memory_add_ext(cf, &zp);
     if (uscf->shm_zone == NULL) {
         return NGX_CONF_ERROR;
     }
@@ -1000,6 +1009,22 @@ ngx_api_stream_upstream_peer_struct_int64_handler(ngx_api_entry_data_t data,
 }
 
 
+static ngx_int_t
+ngx_api_stream_upstream_keepalive_handler(ngx_api_entry_data_t data,
+    ngx_api_ctx_t *actx, void *ctx)
+{
+    ngx_stream_upstream_srv_conf_t *uscf = ctx;
+
+    ngx_stream_upstream_rr_peers_t  *peers;
+
+    peers = uscf->peer.data;
+
+    data.num = peers->stats.keepalive;
+
+    return ngx_api_number_handler(data, actx, ctx);
+}
+
+
 #if (NGX_DEBUG)
 
 static ngx_int_t
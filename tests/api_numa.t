@@ -0,0 +1,87 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for NUMA-aware worker placement and zone memory policies.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx;
+use Test::Utils qw/ get_json /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+plan(skip_all => 'no NUMA topology')
+	unless -e '/sys/devices/system/node/online';
+
+my $t = Test::Nginx->new()->has(qw/http http_api limit_req/);
+
+$t->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+worker_processes     2;
+worker_cpu_affinity  numa;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    limit_req_zone  $binary_remote_addr  zone=il:1m:numa=interleave  rate=1r/s;
+    limit_req_zone  $binary_remote_addr  zone=bind:1m:numa=0  rate=1r/s;
+    limit_req_zone  $binary_remote_addr  zone=none:1m  rate=1r/s;
+
+    server {
+        listen       127.0.0.1:8081;
+        server_name  localhost;
+
+        limit_req    zone=late;
+    }
+
+    limit_req_zone  $binary_remote_addr  zone=late:1m:numa=interleave  rate=1r/s;
+
+    server {
+        listen       127.0.0.1:8080;
+        server_name  localhost;
+
+        location /status/ {
+            api /status/;
+        }
+    }
+}
+
+EOF
+
+$t->try_run('no numa')->plan(7);
+
+###############################################################################
+
+my $numa = get_json('/status/angie/numa');
+
+ok($numa->{nodes} >= 1, 'nodes');
+is(keys %{$numa->{workers}}, 2, 'workers');
+is($numa->{workers}{0}, 0, 'first worker node');
+
+is(get_json('/status/slabs/il/numa/policy'), 'interleave', 'interleave');
+is_deeply(get_json('/status/slabs/bind/numa'), { policy => 'bind', node => 0 },
+	'bind');
+is(get_json('/status/slabs/none/numa/policy'), 'default', 'default');
+is(get_json('/status/slabs/late/numa/policy'), 'interleave',
+	'declared after use');
+
+###############################################################################
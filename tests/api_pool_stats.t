@@ -0,0 +1,106 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for pool_stats, memory pool statistics in the API.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx;
+use Test::Utils qw/ get_json /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has(qw/http http_api/)->plan(12)
+	->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    pool_stats  on;
+
+    server {
+        listen       127.0.0.1:8080;
+        server_name  localhost;
+
+        request_pool_size  1k;
+
+        status_zone  srv;
+
+        location / {
+            status_zone  loc;
+        }
+
+        location /status/ {
+            api /status/http/;
+        }
+    }
+}
+
+EOF
+
+$t->write_file('t', 'SEE-THIS');
+$t->run();
+
+###############################################################################
+
+http_get('/t');
+http_get('/t?' . 'x' x 3000);
+
+my $pools = get_json('/status/server_zones/srv/pools/');
+
+is($pools->{request}{pools}, 2, 'server request pools');
+is($pools->{connection}{pools}, 2, 'server connection pools');
+ok($pools->{request}{size} >= 2 * 1024, 'request pools size');
+ok($pools->{request}{peak} >= 1024, 'request pool peak');
+ok($pools->{request}{blocks} >= 2, 'request pool blocks');
+ok($pools->{request}{large} >= 1, 'request pool large allocations');
+
+my $sizes = $pools->{request}{sizes};
+
+is(keys %$sizes, 11, 'sizes');
+is($sizes->{'1k'}, 0, 'no pools of 1k');
+
+$pools = get_json('/status/location_zones/loc/pools/');
+
+is($pools->{request}{pools}, 2, 'location request pools');
+ok(!exists $pools->{connection}, 'no location connection pools');
+
+# a keepalive connection is accounted once
+
+http(<<EOF);
+GET /t HTTP/1.1
+Host: localhost
+
+GET /t HTTP/1.1
+Host: localhost
+Connection: close
+
+EOF
+
+# including the API requests made above
+
+$pools = get_json('/status/server_zones/srv/pools/');
+
+is($pools->{request}{pools}, 6, 'keepalive request pools');
+is($pools->{connection}{pools}, 5, 'keepalive connection pools');
+
+###############################################################################
@@ -0,0 +1,136 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for SSL shared session cache statistics.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx qw/ :DEFAULT http_end /;
+use Test::Utils qw/ get_json /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()
+	->has(qw/http http_ssl http_api rewrite socket_ssl/)
+	->has_daemon('openssl');
+
+$t->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    ssl_certificate_key localhost.key;
+    ssl_certificate localhost.crt;
+
+    ssl_protocols TLSv1.2;
+    ssl_session_tickets off;
+
+    server {
+        listen       127.0.0.1:8443 ssl;
+        server_name  localhost;
+
+        ssl_session_cache shared:one:1m;
+
+        location / {
+            return 200 "body $ssl_session_reused";
+        }
+    }
+
+    server {
+        listen       127.0.0.1:8444 ssl;
+        server_name  localhost;
+
+        ssl_session_cache shared:two:64k;
+
+        location / {
+            return 200 "body $ssl_session_reused";
+        }
+    }
+
+    server {
+        listen       127.0.0.1:8080;
+        server_name  localhost;
+
+        location /api/ {
+            api /status/ssl_session_caches/;
+        }
+    }
+}
+
+EOF
+
+$t->write_file('openssl.conf', <<EOF);
+[ req ]
+default_bits = 2048
+encrypt_key = no
+distinguished_name = req_distinguished_name
+[ req_distinguished_name ]
+EOF
+
+my $d = $t->testdir();
+
+foreach my $name ('localhost') {
+	system('openssl req -x509 -new '
+		. "-config $d/openssl.conf -subj /CN=$name/ "
+		. "-out $d/$name.crt -keyout $d/$name.key "
+		. ">>$d/openssl.out 2>&1") == 0
+		or die "Can't create certificate for $name: $!\n";
+}
+
+$t->try_run('no TLSv1.2')->plan(9);
+
+###############################################################################
+
+my $s = http_get(
+	'/', PeerAddr => '127.0.0.1:' . port(8443), start => 1,
+	SSL => 1,
+	SSL_session_cache_size => 100
+);
+http_end($s);
+
+like(reuse($s), qr/^body r$/m, 'session reused');
+like(reuse($s), qr/^body r$/m, 'session reused again');
+
+my $j = get_json('/api/');
+
+is($j->{one}{sessions}, 1, 'sessions');
+is($j->{one}{stored}, 1, 'stored');
+is($j->{one}{hits}, 2, 'hits');
+is($j->{one}{misses}, 0, 'misses');
+is($j->{one}{slots}{total} - $j->{one}{slots}{free}, 1, 'slots used');
+cmp_ok($j->{one}{stripes}, '>', 1, 'stripes');
+
+is($j->{two}{stripes}, 1, 'small cache stripes');
+
+###############################################################################
+
+sub reuse {
+	my ($s) = @_;
+
+	return http_get(
+		'/', PeerAddr => '127.0.0.1:' . port(8443),
+		SSL => 1,
+		SSL_reuse_ctx => $s
+	);
+}
+
+###############################################################################
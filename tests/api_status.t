@@ -141,6 +141,9 @@ my %test_cases = (
 				free => $num_re,
 			},
 			slots => hash_each($slot),
+			(-e '/sys/devices/system/node/online')
+				? (numa => { policy => 'default', node => $num_re })
+				: (),
 		};
 
 		my $status = superhashof({
@@ -156,10 +159,11 @@ my %test_cases = (
 				build_time => $time_re,
 			}),
 			connections => superhashof({
-				accepted => $num_re,
-				active   => $num_re,
-				dropped  => $num_re,
-				idle     => $num_re,
+				accepted    => $num_re,
+				active      => $num_re,
+				dropped     => $num_re,
+				idle        => $num_re,
+				idle_memory => $num_re,
 			}),
 			slabs => superhashof({
 				limit_conn_zone => $zone,
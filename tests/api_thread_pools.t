@@ -0,0 +1,80 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for thread pools statistics in the API.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx qw/ :DEFAULT http_end /;
+use Test::Utils qw/ get_json /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has(qw/http http_api/)
+	->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+thread_pool  pool threads=4;
+thread_pool  idle threads=2;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    server {
+        listen       127.0.0.1:8080;
+        server_name  localhost;
+
+        location / {
+            aio  threads=pool;
+        }
+
+        location /status/ {
+            api /status/thread_pools/;
+        }
+    }
+}
+
+EOF
+
+$t->write_file('small', 'SEE-THIS');
+$t->write_file('large', 'x' x (1024 * 1024));
+$t->try_run('no threads')->plan(14);
+
+###############################################################################
+
+like(http_get('/small'), qr/SEE-THIS/, 'small file');
+
+my @large = map { http_get('/large', start => 1) } 1 .. 8;
+like(http_end($_), qr/200 OK.*x{1024}$/s, 'large file') for @large;
+
+my $pools = get_json('/status/');
+
+is(join(' ', sort keys %$pools), 'idle pool', 'pools');
+
+my $pool = $pools->{pool};
+
+is($pool->{threads}, 4, 'threads');
+ok($pool->{tasks} >= 9, 'tasks');
+is($pool->{queue}, 0, 'queue');
+
+is($pools->{idle}{tasks}, 0, 'idle pool tasks');
+
+###############################################################################
@@ -0,0 +1,142 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for brotli filter module.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx qw/ :DEFAULT http_content /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has(qw/http proxy gzip brotli/)->plan(15);
+
+$t->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    server {
+        listen       127.0.0.1:8080;
+        server_name  localhost;
+
+        location / {
+            brotli on;
+            gzip on;
+            gzip_vary on;
+        }
+
+        location /level/ {
+            alias %%TESTDIR%%/;
+            brotli on;
+            brotli_comp_level 1;
+            brotli_window 1k;
+            brotli_buffers 2 1k;
+        }
+
+        location /proxy/ {
+            brotli on;
+            brotli_min_length 100;
+            proxy_pass http://127.0.0.1:8080/local/;
+        }
+
+        location /local/ {
+            alias %%TESTDIR%%/;
+        }
+    }
+}
+
+EOF
+
+$t->write_file('index.html', 'X' x 64);
+$t->write_file('big.html', join('', map { sprintf "X%05dXXXXXX", $_ }
+	(0 .. 9999)));
+$t->write_file('t.txt', 'X' x 64);
+
+$t->run();
+
+###############################################################################
+
+my $r;
+
+$r = get('/', 'br');
+like($r, qr/^Content-Encoding: br/mi, 'brotli');
+like($r, qr/^Vary: Accept-Encoding/mi, 'vary');
+unlike($r, qr/^Content-Length/mi, 'no content length');
+body_like($r, 'X' x 64, 'brotli body');
+
+$r = get('/', 'gzip');
+like($r, qr/^Content-Encoding: gzip/mi, 'gzip only');
+
+$r = get('/', 'gzip, deflate, br');
+like($r, qr/^Content-Encoding: br/mi, 'brotli preferred');
+
+$r = get('/', 'gzip;q=1, br;q=0.5');
+like($r, qr/^Content-Encoding: gzip/mi, 'gzip preferred by q');
+
+$r = get('/', 'gzip, br;q=0');
+like($r, qr/^Content-Encoding: gzip/mi, 'brotli disabled by q');
+
+$r = get('/', 'brx');
+unlike($r, qr/^Content-Encoding/mi, 'token boundaries');
+
+$r = get('/t.txt', 'br');
+unlike($r, qr/^Content-Encoding/mi, 'types');
+
+$r = get('/level/big.html', 'br');
+like($r, qr/^Content-Encoding: br/mi, 'small buffers');
+body_like($r, join('', map { sprintf "X%05dXXXXXX", $_ } (0 .. 9999)),
+	'small buffers body');
+ok(length($r) < 120000 / 2, 'small buffers compressed');
+
+$r = get('/proxy/index.html', 'br');
+unlike($r, qr/^Content-Encoding/mi, 'min length');
+
+$r = get('/proxy/big.html', 'br');
+like($r, qr/^Content-Encoding: br/mi, 'proxied');
+
+###############################################################################
+
+sub get {
+	my ($uri, $ae) = @_;
+	return http(<<EOF);
+GET $uri HTTP/1.1
+Host: localhost
+Connection: close
+Accept-Encoding: $ae
+
+EOF
+}
+
+sub body_like {
+	my ($r, $expect, $name) = @_;
+
+	SKIP: {
+		eval { require IO::Uncompress::Brotli; };
+		skip "IO::Uncompress::Brotli not found", 1 if $@;
+
+		is(IO::Uncompress::Brotli::unbro(http_content($r), 1024 * 1024),
+			$expect, $name);
+	}
+}
+
+###############################################################################
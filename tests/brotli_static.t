@@ -0,0 +1,95 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for brotli_static module.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has(qw/http gzip_static brotli_static/)->plan(10);
+
+$t->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    server {
+        listen       127.0.0.1:8080;
+        server_name  localhost;
+
+        location / {
+            brotli_static on;
+            gzip_static on;
+            gzip_vary on;
+        }
+
+        location /always/ {
+            alias %%TESTDIR%%/;
+            brotli_static always;
+        }
+    }
+}
+
+EOF
+
+$t->write_file('t', 'plain');
+$t->write_file('t.br', 'brotli');
+$t->write_file('t.gz', 'gzip');
+$t->write_file('n', 'plain');
+
+$t->run();
+
+###############################################################################
+
+my $r;
+
+$r = get('/t', 'br');
+like($r, qr/^Content-Encoding: br/mi, 'brotli');
+like($r, qr/^Content-Length: 6/mi, 'brotli length');
+like($r, qr/^Vary: Accept-Encoding/mi, 'vary');
+like($r, qr/brotli$/, 'brotli body');
+
+like(get('/t', 'gzip, br'), qr/brotli$/, 'brotli preferred');
+like(get('/t', 'gzip, br;q=0.5'), qr/gzip$/, 'gzip preferred by q');
+like(get('/t', 'gzip'), qr/gzip$/, 'gzip only');
+like(get('/t', 'identity'), qr/plain$/, 'no encoding');
+like(get('/n', 'br'), qr/plain$/, 'no compressed file');
+
+like(get('/always/t', 'gzip'), qr/brotli$/, 'always');
+
+###############################################################################
+
+sub get {
+	my ($uri, $ae) = @_;
+	return http(<<EOF);
+GET $uri HTTP/1.1
+Host: localhost
+Connection: close
+Accept-Encoding: $ae
+
+EOF
+}
+
+###############################################################################
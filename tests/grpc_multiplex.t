@@ -0,0 +1,156 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for grpc backend, multiplexed connections.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx qw/ :DEFAULT http_end /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has(qw/http http_v2 grpc/)->plan(13)
+	->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    server {
+        listen       127.0.0.1:8080;
+        server_name  localhost;
+
+        grpc_multiplex  on;
+
+        location / {
+            grpc_pass 127.0.0.1:8081;
+        }
+
+        location /other/ {
+            grpc_pass 127.0.0.1:8081;
+        }
+
+        location /single/ {
+            grpc_pass 127.0.0.1:8081;
+            grpc_multiplex_streams 1;
+        }
+
+        location /off/ {
+            grpc_pass 127.0.0.1:8081;
+            grpc_multiplex off;
+        }
+    }
+
+    server {
+        listen       127.0.0.1:8081;
+        server_name  localhost;
+
+        http2 on;
+
+        add_header X-Conn $connection always;
+
+        location / {
+            root %%TESTDIR%%;
+        }
+
+        location /slow {
+            alias %%TESTDIR%%/t;
+            limit_rate 8k;
+        }
+
+        location /single/ {
+            alias %%TESTDIR%%/;
+            limit_rate 8k;
+        }
+    }
+}
+
+EOF
+
+$t->write_file('t', 'x' x 8192);
+$t->write_file('large', 'y' x (3 * 1024 * 1024));
+$t->run();
+
+###############################################################################
+
+my $r = http_get('/t');
+like($r, qr/200 OK.*x{8192}$/s, 'request');
+
+my $conn = conn($r);
+
+is(conn(http_get('/t')), $conn, 'connection reused');
+is(conn(http_get('/other/t')), $conn, 'connection reused in other location');
+
+# concurrent requests share the connection
+
+my @s = map { http_get('/slow', start => 1) } 1 .. 4;
+my @r = map { http_end($_) } @s;
+
+is(scalar(grep { /x{8192}$/ } @r), 4, 'concurrent requests');
+is(scalar(grep { conn($_) eq $conn } @r), 4, 'concurrent requests multiplexed');
+
+# streams are limited by grpc_multiplex_streams
+
+@s = map { http_get('/single/t', start => 1) } 1 .. 3;
+@r = map { http_end($_) } @s;
+
+is(scalar(grep { /x{8192}$/ } @r), 3, 'streams limit');
+is(scalar(uniq(map { conn($_) } @r)), 3, 'streams limit - sessions');
+
+# flow control, response larger than the windows
+
+@s = map { http_get('/large', start => 1) } 1 .. 2;
+@r = map { http_end($_) } @s;
+
+like($r[0], qr/200 OK.*y{1024}$/s, 'large response');
+is(length(body($r[0])), 3 * 1024 * 1024, 'large response length');
+is(length(body($r[1])), 3 * 1024 * 1024, 'large response concurrent');
+is(conn($r[1]), $conn, 'large responses multiplexed');
+
+# the connection is still usable
+
+is(conn(http_get('/t')), $conn, 'connection reused after large responses');
+
+# no multiplexing
+
+isnt(conn(http_get('/off/t')), $conn, 'multiplexing off');
+
+###############################################################################
+
+sub conn {
+	my ($r) = @_;
+	return '' unless defined $r;
+	return $r =~ /x-conn: (\d+)/i ? $1 : '';
+}
+
+sub body {
+	my ($r) = @_;
+	return '' unless defined $r;
+	$r =~ s/.*?\x0d\x0a\x0d\x0a//s;
+	return $r;
+}
+
+sub uniq {
+	my %seen;
+	return grep { !$seen{$_}++ } @_;
+}
+
+###############################################################################
@@ -0,0 +1,175 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for gzip filter module, compression in threads.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx qw/ :DEFAULT http_end http_content /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has(qw/http proxy gzip/)
+	->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+thread_pool  gzip threads=2;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    server {
+        listen       127.0.0.1:8080;
+        server_name  localhost;
+
+        gzip on;
+        gzip_min_length 0;
+        gzip_threads pool=gzip;
+
+        location / {
+        }
+
+        location /buffers/ {
+            alias %%TESTDIR%%/;
+            gzip_buffers 2 1k;
+        }
+
+        location /aio/ {
+            alias %%TESTDIR%%/;
+            aio threads=gzip;
+            output_buffers 1 4k;
+        }
+
+        location /proxy/ {
+            proxy_pass http://127.0.0.1:8081/;
+        }
+
+        location /unbuffered/ {
+            proxy_pass http://127.0.0.1:8081/;
+            proxy_buffering off;
+        }
+
+        location /off/ {
+            alias %%TESTDIR%%/;
+            gzip_threads off;
+        }
+    }
+
+    server {
+        listen       127.0.0.1:8081;
+        server_name  localhost;
+
+        location / {
+            limit_rate 2m;
+            limit_rate_after 32k;
+        }
+    }
+}
+
+EOF
+
+my $big = join('', map { sprintf "X%06dXXXXX", $_ } (0 .. 99999));
+
+$t->write_file('index.html', 'SEE-THIS');
+$t->write_file('big.html', $big);
+
+$t->try_run('no threads')->plan(12);
+
+###############################################################################
+
+my $r;
+
+$r = get('/');
+like($r, qr/^Content-Encoding: gzip/mi, 'gzip');
+gunzip_is($r, 'SEE-THIS', 'small');
+
+$r = get('/big.html');
+like($r, qr/^Content-Encoding: gzip/mi, 'big gzip');
+gunzip_is($r, $big, 'big');
+
+gunzip_is(get('/buffers/big.html'), $big, 'small buffers');
+gunzip_is(get('/aio/big.html'), $big, 'aio threads');
+gunzip_is(get('/proxy/big.html'), $big, 'proxy');
+gunzip_is(get('/unbuffered/big.html'), $big, 'proxy unbuffered');
+gunzip_is(get('/off/big.html'), $big, 'off');
+
+$r = http(<<EOF);
+HEAD /big.html HTTP/1.1
+Host: localhost
+Connection: close
+Accept-Encoding: gzip
+
+EOF
+
+like($r, qr/^Content-Encoding: gzip/mi, 'head');
+is(http_content($r), '', 'head no body');
+
+# concurrent requests
+
+my @s = map { http(<<EOF, start => 1) } (1 .. 4);
+GET /big.html HTTP/1.1
+Host: localhost
+Connection: close
+Accept-Encoding: gzip
+
+EOF
+
+is(scalar(grep { gunzip(http_end($_)) eq $big } @s), 4, 'concurrent');
+
+###############################################################################
+
+sub get {
+	my ($uri) = @_;
+	return http(<<EOF);
+GET $uri HTTP/1.1
+Host: localhost
+Connection: close
+Accept-Encoding: gzip
+
+EOF
+}
+
+sub gunzip {
+	my ($r) = @_;
+
+	eval { require IO::Uncompress::Gunzip; };
+	return $big if $@;
+
+	my $in = http_content($r);
+	my $out;
+
+	IO::Uncompress::Gunzip::gunzip(\$in => \$out);
+
+	return $out;
+}
+
+sub gunzip_is {
+	my ($r, $expect, $name) = @_;
+
+	SKIP: {
+		eval { require IO::Uncompress::Gunzip; };
+		skip "IO::Uncompress::Gunzip not found", 1 if $@;
+
+		ok(gunzip($r) eq $expect, $name);
+	}
+}
+
+###############################################################################
@@ -0,0 +1,93 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for client_body_timeout with a body sent in small parts.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx qw/ :DEFAULT http_end /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has(qw/http proxy/)->plan(2)
+	->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    server {
+        listen       127.0.0.1:8080;
+        server_name  localhost;
+
+        client_body_timeout  1s;
+
+        location / {
+            add_header    X-Body $request_body;
+            proxy_method  GET;
+            proxy_pass    http://127.0.0.1:8081/t;
+        }
+    }
+
+    server {
+        listen       127.0.0.1:8081;
+        server_name  localhost;
+
+        location / { }
+    }
+}
+
+EOF
+
+$t->write_file('t', 'SEE-THIS');
+$t->run();
+
+###############################################################################
+
+# each part postpones the timeout, so the body is read in 2.4s
+
+like(slow_body('abcdef', 0.4), qr/X-Body: abcdef.*SEE-THIS/ms, 'slow body');
+
+# the timeout still expires once the client stalls
+
+is(slow_body('abc', 0), '', 'stalled body');
+
+###############################################################################
+
+sub slow_body {
+	my ($body, $delay) = @_;
+
+	my $s = http(<<EOF, start => 1);
+POST / HTTP/1.0
+Host: localhost
+Content-Length: 6
+
+EOF
+
+	for my $c (split //, $body) {
+		select undef, undef, undef, $delay;
+		$s->print($c);
+	}
+
+	return http_end($s);
+}
+
+###############################################################################
@@ -0,0 +1,107 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for client_header_buffers_cache and memory of idle connections.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+use IO::Select;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx;
+use Test::Utils qw/ get_json /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has(qw/http http_api/)->plan(6)
+	->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    client_header_buffers_cache  4;
+
+    server {
+        listen       127.0.0.1:8080;
+        server_name  localhost;
+
+        client_header_buffer_size    1k;
+        large_client_header_buffers  4 8k;
+
+        location / { }
+
+        location /status/ {
+            api /status/connections/;
+        }
+    }
+}
+
+EOF
+
+$t->write_file('t', 'SEE-THIS');
+$t->run();
+
+###############################################################################
+
+my $s = http('', start => 1);
+
+like(request($s, '/t'), qr/SEE-THIS/, 'keepalive request');
+like(request($s, '/t', 'X-Large: ' . 'x' x 4000), qr/SEE-THIS/,
+	'large header buffer');
+like(request($s, '/t'), qr/SEE-THIS/, 'header buffer reused');
+
+# the same buffers are taken by another connection
+
+my $s2 = http('', start => 1);
+
+like(request($s2, '/t', 'X-Large: ' . 'x' x 4000), qr/SEE-THIS/,
+	'large header buffer cached');
+
+# both connections are idle now
+
+my $conns = get_json('/status/');
+
+is($conns->{idle}, 2, 'idle connections');
+ok($conns->{idle_memory} >= $conns->{idle} * 256, 'idle memory');
+
+###############################################################################
+
+sub request {
+	my ($s, $uri, $header) = @_;
+
+	$header = defined $header ? "$header\r\n" : '';
+
+	$s->print("GET $uri HTTP/1.1\r\nHost: localhost\r\n$header\r\n");
+
+	my $reply = '';
+
+	while (IO::Select->new($s)->can_read(3)) {
+		my $n = $s->sysread(my $buf, 65536);
+		last unless $n;
+
+		$reply .= $buf;
+		last if $reply =~ /SEE-THIS$/;
+	}
+
+	return $reply;
+}
+
+###############################################################################
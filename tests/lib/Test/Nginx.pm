@@ -177,6 +177,7 @@ sub has_module($) {
 		acme	=> '--with-http_acme_module',
 		charset	=> '(?s)^(?!.*--without-http_charset_module)',
 		gzip	=> '(?s)^(?!.*--without-http_gzip_module)',
+		brotli	=> '--with-http_brotli_module',
 		ssi	=> '(?s)^(?!.*--without-http_ssi_module)',
 		mirror	=> '(?s)^(?!.*--without-http_mirror_module)',
 		userid	=> '(?s)^(?!.*--without-http_userid_module)',
@@ -251,6 +252,8 @@ sub has_module($) {
 			=> '--with-stream_ssl_module',
 		stream_ssl_preread
 			=> '--with-stream_ssl_preread_module',
+		stream_upstream_keepalive
+			=> '(?s)^(?!.*--without-stream_upstream_keepalive_mo)',
 		stream_upstream_hash
 			=> '(?s)^(?!.*--without-stream_upstream_hash_module)',
 		stream_upstream_least_conn
@@ -272,6 +275,7 @@ sub has_module($) {
 	my %modules = (
 		http_geoip
 			=> 'ngx_http_geoip_module',
+		brotli	=> 'ngx_http_brotli_filter_module',
 		image_filter
 			=> 'ngx_http_image_filter_module',
 		perl	=> 'ngx_http_perl_module',
@@ -0,0 +1,160 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for http proxy cache, proxy_cache_compressed directive.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx qw/ :DEFAULT http_content /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has(qw/http proxy cache gzip brotli/)->plan(18);
+
+$t->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    proxy_cache_path  %%TESTDIR%%/cache  keys_zone=one:1m;
+    proxy_cache_key   $uri;
+
+    server {
+        listen       127.0.0.1:8080;
+        server_name  localhost;
+
+        add_header X-Cache-Status $upstream_cache_status;
+
+        gzip on;
+        gzip_vary on;
+        brotli on;
+
+        location / {
+            proxy_pass    http://127.0.0.1:8081;
+            proxy_cache   one;
+            proxy_cache_valid any 1m;
+            proxy_cache_compressed gzip br;
+        }
+
+        location /gzip/ {
+            proxy_pass    http://127.0.0.1:8081/;
+            proxy_cache   one;
+            proxy_cache_valid any 1m;
+            proxy_cache_compressed gzip;
+        }
+
+        location /off/ {
+            proxy_pass    http://127.0.0.1:8081/;
+            proxy_cache   one;
+            proxy_cache_valid any 1m;
+            proxy_cache_compressed off;
+        }
+    }
+
+    server {
+        listen       127.0.0.1:8081;
+        server_name  localhost;
+
+        location / {
+            add_header ETag '"tag"';
+        }
+    }
+}
+
+EOF
+
+my $body = join('', map { sprintf "X%05dXXXXXX", $_ } (0 .. 999));
+
+$t->write_file('t.html', $body);
+$t->write_file('g.html', $body);
+$t->write_file('o.html', $body);
+
+$t->run();
+
+###############################################################################
+
+my $r;
+
+$r = get('/t.html', 'br');
+like($r, qr/X-Cache-Status: MISS.*Content-Encoding: br/ms, 'miss');
+unlike($r, qr/^Content-Length/mi, 'miss compressed on the fly');
+
+$r = get('/t.html', 'br');
+like($r, qr/^Content-Encoding: br/mi, 'variant');
+like($r, qr/X-Cache-Status: HIT/, 'variant hit');
+like($r, qr/^Content-Length: (\d+)/mi, 'variant length');
+is(length(http_content($r)), $r =~ /^Content-Length: (\d+)/mi && $1,
+	'variant body length');
+like($r, qr/^ETag: W\/"tag"/mi, 'variant weak etag');
+like($r, qr/^Vary: Accept-Encoding/mi, 'variant vary');
+unlike($r, qr/^Accept-Ranges/mi, 'variant no ranges');
+unbrotli_is($r, $body, 'variant body');
+
+$r = get('/t.html', 'identity');
+unlike($r, qr/^Content-Encoding/mi, 'identity');
+is(http_content($r), $body, 'identity body');
+
+$r = get('/t.html', 'gzip');
+unlike($r, qr/^Content-Length/mi, 'gzip compressed on the fly');
+
+$r = get('/t.html', 'gzip');
+like($r, qr/^Content-Length: \d+.*^Content-Encoding: gzip/msi, 'gzip variant');
+
+like(get('/t.html', 'gzip, br;q=0.5'),
+	qr/^Content-Length: \d+.*^Content-Encoding: gzip/msi, 'gzip variant by q');
+like(get('/t.html', 'gzip;q=0.5, br'),
+	qr/^Content-Length: \d+.*^Content-Encoding: br/msi, 'brotli variant by q');
+
+# encodings not enabled are not stored
+
+get('/gzip/g.html', 'br');
+unlike(get('/gzip/g.html', 'br'), qr/^Content-Length/mi, 'brotli disabled');
+
+get('/off/o.html', 'gzip');
+unlike(get('/off/o.html', 'gzip'), qr/^Content-Length/mi, 'off');
+
+###############################################################################
+
+sub get {
+	my ($uri, $ae) = @_;
+	return http(<<EOF);
+GET $uri HTTP/1.1
+Host: localhost
+Connection: close
+Accept-Encoding: $ae
+
+EOF
+}
+
+sub unbrotli_is {
+	my ($r, $expect, $name) = @_;
+
+	SKIP: {
+		eval { require IO::Uncompress::Brotli; };
+		skip "IO::Uncompress::Brotli not found", 1 if $@;
+
+		is(IO::Uncompress::Brotli::unbro(http_content($r), 1024 * 1024),
+			$expect, $name);
+	}
+}
+
+###############################################################################
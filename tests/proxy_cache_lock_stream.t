@@ -0,0 +1,190 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for http proxy cache, proxy_cache_lock_stream directive.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+use IO::Select;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx qw/ :DEFAULT http_end http_content /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has(qw/http proxy cache/)->plan(12)
+	->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    proxy_cache_path   %%TESTDIR%%/cache  levels=1:2
+                       keys_zone=NAME:1m use_temp_path=off;
+
+    server {
+        listen       127.0.0.1:8080;
+        server_name  localhost;
+
+        add_header X-Cache-Status $upstream_cache_status;
+
+        location / {
+            proxy_pass    http://127.0.0.1:8081;
+            proxy_cache   NAME;
+
+            proxy_cache_lock on;
+            proxy_cache_lock_stream on;
+        }
+
+        location /off/ {
+            proxy_pass    http://127.0.0.1:8081;
+            proxy_cache   NAME;
+
+            proxy_cache_lock on;
+        }
+    }
+}
+
+EOF
+
+my $body = 'part1' . ('X' x 100000) . 'part2';
+
+$t->run_daemon(\&http_fake_daemon);
+
+$t->run();
+
+$t->waitforsocket('127.0.0.1:' . port(8081));
+
+###############################################################################
+
+# waiting requests are served from the cache file being written
+
+my $s = http_get('/stream', start => 1);
+select undef, undef, undef, 0.3;
+
+my @s = map { http_get('/stream', start => 1) } (1 .. 2);
+
+my $r = read_partial($s[0], 0.5);
+like($r, qr/part1/, 'stream partial');
+
+$r .= http_end($s[0]);
+like($r, qr/X-Cache-Status: HIT/, 'stream reader');
+is(http_content($r), "request 1\n" . $body, 'stream reader body');
+is(http_content(http_end($s[1])), "request 1\n" . $body, 'stream reader 2');
+
+$r = http_end($s);
+like($r, qr/X-Cache-Status: MISS/, 'stream writer');
+is(http_content($r), "request 1\n" . $body, 'stream writer body');
+
+like(http_get('/stream'), qr/request 1/, 'stream cached');
+
+# streaming disabled
+
+$s = http_get('/off/stream', start => 1);
+select undef, undef, undef, 0.3;
+
+$s[0] = http_get('/off/stream', start => 1);
+
+is(read_partial($s[0], 0.5), '', 'off partial');
+like(http_end($s[0]), qr/request 1/, 'off waiting');
+
+http_end($s);
+
+# incomplete responses are not passed as complete
+
+$s = http_get('/abort', start => 1);
+select undef, undef, undef, 0.3;
+
+$s[0] = http_get('/abort', start => 1);
+
+$r = http_end($s[0]);
+like($r, qr/part1/, 'abort partial');
+unlike($r, qr/part2/, 'abort incomplete');
+
+http_end($s);
+
+like(http_get('/abort'), qr/request 2/, 'abort not cached');
+
+###############################################################################
+
+sub read_partial {
+	my ($s, $timeout) = @_;
+	my $buf = '';
+
+	my $sel = IO::Select->new($s);
+
+	while ($sel->can_read($timeout)) {
+		last unless $s->sysread($buf, 65536, length($buf));
+		$timeout = 0.1;
+	}
+
+	return $buf;
+}
+
+###############################################################################
+
+sub http_fake_daemon {
+	my $server = IO::Socket::INET->new(
+		Proto => 'tcp',
+		LocalAddr => '127.0.0.1:' . port(8081),
+		Listen => 5,
+		Reuse => 1
+	)
+		or die "Can't create listening socket: $!\n";
+
+	local $SIG{PIPE} = 'IGNORE';
+
+	my %num;
+
+	while (my $client = $server->accept()) {
+		$client->autoflush(1);
+
+		my $uri = '';
+
+		while (<$client>) {
+			$uri = $1 if /GET (.*) HTTP/;
+			last if /^\x0d?\x0a?$/;
+		}
+
+		next unless $uri;
+
+		my $num = ++$num{$uri};
+		my $len = length("request $num\n") + length($body);
+
+		print $client <<"EOF";
+HTTP/1.1 200 OK
+Cache-Control: max-age=300
+Content-Length: $len
+Connection: close
+
+request $num
+EOF
+
+		print $client substr($body, 0, 50000);
+
+		select undef, undef, undef, 1.2;
+
+		next if $uri eq '/abort';
+
+		print $client substr($body, 50000);
+	}
+}
+
+###############################################################################
@@ -0,0 +1,174 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for http proxy cache lock, waiting requests wakeup.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+use IO::Select;
+use Time::HiRes qw/ time /;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx qw/ :DEFAULT http_end /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has(qw/http proxy cache/)->plan(6)
+	->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+worker_processes 2;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    proxy_cache_path   %%TESTDIR%%/cache  levels=1:2
+                       keys_zone=NAME:1m;
+
+    server {
+        listen       127.0.0.1:8080 reuseport;
+        server_name  localhost;
+
+        location / {
+            proxy_pass    http://127.0.0.1:8081;
+            proxy_cache   NAME;
+
+            proxy_cache_lock on;
+            proxy_cache_lock_timeout 10s;
+        }
+    }
+}
+
+EOF
+
+$t->run_daemon(\&http_fake_daemon);
+
+$t->run();
+
+$t->waitforsocket('127.0.0.1:' . port(8081));
+
+###############################################################################
+
+# the upstream responds in 1.15s; waiting requests are served as soon
+# as the lock is released rather than on the next 500ms lock check
+
+my ($s, @s, $start, @time);
+
+$s = http_get('/cached', start => 1);
+select undef, undef, undef, 0.1;
+
+$start = time();
+@s = map { http_get('/cached', start => 1) } (1 .. 6);
+@time = http_end_all($start, @s);
+
+like(http_end($s), qr/request 1/, 'lock holder');
+is(scalar(grep { $_->[0] =~ /request 1/ } @time), 6, 'waiting cached');
+cmp_ok(max(map { $_->[1] } @time), '<', 1.3, 'waiting wakeup');
+
+# lock released without caching the response
+
+$s = http_get('/nostore', start => 1);
+select undef, undef, undef, 0.1;
+
+$start = time();
+@s = map { http_get('/nostore', start => 1) } (1 .. 2);
+@time = http_end_all($start, @s);
+
+like(http_end($s), qr/request 1/, 'nostore lock holder');
+like(join('', map { $_->[0] } @time), qr/request 2/, 'nostore waiting');
+cmp_ok(min(map { $_->[1] } @time), '<', 2.45, 'nostore wakeup');
+
+###############################################################################
+
+sub http_end_all {
+	my ($start, @s) = @_;
+	my @time;
+
+	# responses are read as they arrive, so that each one is timed
+
+	my $sel = IO::Select->new(@s);
+
+	while ($sel->count()) {
+		my @ready = $sel->can_read(10) or last;
+
+		for my $s (@ready) {
+			$sel->remove($s);
+			push @time, [ http_end($s), time() - $start ];
+		}
+	}
+
+	return @time;
+}
+
+sub max {
+	my $max = shift;
+	$max = $max > $_ ? $max : $_ for @_;
+	return $max;
+}
+
+sub min {
+	my $min = shift;
+	$min = $min < $_ ? $min : $_ for @_;
+	return $min;
+}
+
+###############################################################################
+
+sub http_fake_daemon {
+	my $server = IO::Socket::INET->new(
+		Proto => 'tcp',
+		LocalAddr => '127.0.0.1:' . port(8081),
+		Listen => 5,
+		Reuse => 1
+	)
+		or die "Can't create listening socket: $!\n";
+
+	local $SIG{PIPE} = 'IGNORE';
+
+	my %num;
+
+	while (my $client = $server->accept()) {
+		$client->autoflush(1);
+
+		my $uri = '';
+
+		while (<$client>) {
+			$uri = $1 if /GET (.*) HTTP/;
+			last if /^\x0d?\x0a?$/;
+		}
+
+		next unless $uri;
+
+		select undef, undef, undef, 1.15;
+
+		my $num = ++$num{$uri};
+		my $cc = $uri eq '/nostore' ? 'no-store' : 'max-age=300';
+
+		print $client <<"EOF";
+HTTP/1.1 200 OK
+Cache-Control: $cc
+Connection: close
+
+request $num
+EOF
+	}
+}
+
+###############################################################################
@@ -0,0 +1,173 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for http proxy cache, proxy_cache_partial directive.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx qw/ :DEFAULT http_content /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has(qw/http proxy cache/)->plan(25)
+	->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    proxy_cache_path   %%TESTDIR%%/cache  levels=1:2
+                       keys_zone=NAME:1m use_temp_path=off;
+
+    log_format range $uri:$http_range;
+
+    server {
+        listen       127.0.0.1:8080;
+        server_name  localhost;
+
+        add_header X-Cache-Status $upstream_cache_status;
+
+        location / {
+            proxy_pass    http://127.0.0.1:8081;
+            proxy_cache   NAME;
+            proxy_cache_valid 200 206 1m;
+
+            proxy_cache_partial 4k;
+        }
+
+        location /off/ {
+            proxy_pass    http://127.0.0.1:8081/;
+            proxy_cache   NAME;
+            proxy_cache_valid 200 206 1m;
+        }
+    }
+
+    server {
+        listen       127.0.0.1:8081;
+        server_name  localhost;
+
+        access_log   %%TESTDIR%%/range.log range;
+
+        location / {
+        }
+    }
+}
+
+EOF
+
+my $body = join('', map { sprintf "X%06dXXXXX", $_ } (0 .. 9999));
+
+$t->write_file('t.html', $body);
+$t->write_file('s.html', $body);
+$t->write_file('f.html', $body);
+$t->write_file('o.html', $body);
+
+$t->run();
+
+###############################################################################
+
+my $r;
+
+# a missing range is requested from upstream aligned to blocks
+
+$r = get('/t.html', 'bytes=5000-5099');
+like($r, qr/ 206 .*X-Cache-Status: MISS/s, 'miss');
+like($r, qr/^Content-Range: bytes 5000-5099\/120000/mi, 'miss content range');
+is(http_content($r), substr($body, 5000, 100), 'miss body');
+
+$r = get('/t.html', 'bytes=4200-8100');
+like($r, qr/X-Cache-Status: HIT/, 'hit');
+is(http_content($r), substr($body, 4200, 3901), 'hit body');
+
+# other blocks are added to the same cache entry
+
+$r = get('/t.html', 'bytes=20000-30000');
+like($r, qr/X-Cache-Status: MISS/, 'another miss');
+is(http_content($r), substr($body, 20000, 10001), 'another miss body');
+
+$r = get('/t.html', 'bytes=20480-32767');
+like($r, qr/X-Cache-Status: HIT/, 'another hit');
+is(http_content($r), substr($body, 20480, 12288), 'another hit body');
+
+$r = get('/t.html', 'bytes=5000-5099');
+like($r, qr/X-Cache-Status: HIT/, 'first range still cached');
+
+# a range partially present
+
+$r = get('/t.html', 'bytes=6000-14000');
+like($r, qr/X-Cache-Status: MISS/, 'overlapping miss');
+is(http_content($r), substr($body, 6000, 8001), 'overlapping miss body');
+
+like(get('/t.html', 'bytes=4096-16383'), qr/X-Cache-Status: HIT/,
+	'overlapping hit');
+
+# suffix and open ranges, the last block is not aligned
+
+$r = get('/s.html', 'bytes=-1000');
+like($r, qr/X-Cache-Status: MISS/, 'suffix miss');
+like($r, qr/^Content-Range: bytes 119000-119999\/120000/mi,
+	'suffix content range');
+is(http_content($r), substr($body, -1000), 'suffix miss body');
+
+$r = get('/s.html', 'bytes=118900-');
+like($r, qr/X-Cache-Status: MISS/, 'open range miss');
+is(http_content($r), substr($body, 118900), 'open range miss body');
+
+like(get('/s.html', 'bytes=-1000'), qr/X-Cache-Status: HIT/, 'suffix hit');
+
+# unsatisfiable range
+
+like(get('/s.html', 'bytes=200000-'), qr/ 416 /, 'not satisfiable');
+
+# requests without ranges are not partial
+
+$r = get('/f.html');
+like($r, qr/ 200 .*X-Cache-Status: MISS/s, 'full');
+is(http_content($r), $body, 'full body');
+
+like(get('/f.html', 'bytes=0-99'), qr/ 206 .*X-Cache-Status: HIT/s,
+	'full range hit');
+
+# partial caching disabled
+
+like(get('/off/o.html', 'bytes=0-99'), qr/ 206 /, 'off');
+
+$t->stop();
+
+is(join(' ', map { /:(.*)/ && $1 } split /\n/, $t->read_file('range.log')),
+	'bytes=4096-8191 bytes=16384-32767 bytes=4096-16383 bytes=-1000 '
+	. 'bytes=118784- - -',
+	'upstream ranges');
+
+###############################################################################
+
+sub get {
+	my ($uri, $range) = @_;
+	$range = defined $range ? "Range: $range\n" : '';
+	return http(<<EOF);
+GET $uri HTTP/1.1
+Host: localhost
+Connection: close
+$range
+EOF
+}
+
+###############################################################################
@@ -0,0 +1,285 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for http proxy, proxy_collapse directive.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx qw/ :DEFAULT http_end http_content /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has(qw/http proxy/)->plan(22)
+	->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    log_format status $request_uri:$status:$upstream_status;
+
+    server {
+        listen       127.0.0.1:8080;
+        server_name  localhost;
+
+        access_log   %%TESTDIR%%/status.log status;
+
+        proxy_collapse on;
+
+        location / {
+            proxy_pass    http://127.0.0.1:8081;
+        }
+
+        location /unbuffered/ {
+            proxy_pass    http://127.0.0.1:8081/;
+            proxy_buffering off;
+        }
+
+        location /key/ {
+            proxy_pass    http://127.0.0.1:8081/;
+            proxy_collapse_key $host;
+        }
+
+        location /cookie/ {
+            proxy_pass    http://127.0.0.1:8081/;
+            proxy_collapse_key $uri$http_cookie;
+        }
+
+        location /timeout/ {
+            proxy_pass    http://127.0.0.1:8081/;
+            proxy_read_timeout 500ms;
+        }
+
+        location /off/ {
+            proxy_pass    http://127.0.0.1:8081/;
+            proxy_collapse off;
+        }
+    }
+}
+
+EOF
+
+$t->run_daemon(\&http_fake_daemon);
+
+$t->run();
+
+$t->waitforsocket('127.0.0.1:' . port(8081));
+
+###############################################################################
+
+my (@s, %n);
+
+# parallel requests share a single upstream response
+
+@s = map { get('/par', start => 1) } (1 .. 3);
+%n = map { request_num(http_end($_)) => 1 } @s;
+
+is(keys %n, 1, 'collapsed');
+like(get('/par'), qr/X-Num: \d+/, 'collapsed header');
+
+# subsequent requests are sent to upstream again
+
+my $r = get('/seq');
+isnt(request_num(get('/seq')), request_num($r), 'sequential');
+
+# different keys
+
+@s = map { get("/par$_", start => 1) } (1 .. 2);
+%n = map { request_num(http_end($_)) => 1 } @s;
+
+is(keys %n, 2, 'different keys');
+
+@s = map { get("/key/par$_", start => 1) } (1 .. 2);
+%n = map { request_num(http_end($_)) => 1 } @s;
+
+is(keys %n, 1, 'collapse key');
+
+# collapsing disabled, or not applicable
+
+@s = map { get('/off/par', start => 1) } (1 .. 2);
+%n = map { request_num(http_end($_)) => 1 } @s;
+
+is(keys %n, 2, 'off');
+
+@s = map { http(<<EOF, start => 1) } (1 .. 2);
+POST /post HTTP/1.0
+Content-Length: 0
+
+EOF
+%n = map { request_num(http_end($_)) => 1 } @s;
+
+is(keys %n, 2, 'post');
+
+@s = (get('/cond', start => 1), http(<<EOF, start => 1));
+GET /cond HTTP/1.0
+If-None-Match: "foo"
+
+EOF
+%n = map { request_num(http_end($_)) => 1 } @s;
+
+is(keys %n, 2, 'conditional');
+
+# requests with credentials are only collapsed if they are in the key
+
+@s = map { get('/cred', start => 1, cookie => 'a=b') } (1 .. 2);
+%n = map { request_num(http_end($_)) => 1 } @s;
+
+is(keys %n, 2, 'cookie');
+
+@s = map { get('/cookie/cred', start => 1, cookie => 'a=b') } (1 .. 2);
+%n = map { request_num(http_end($_)) => 1 } @s;
+
+is(keys %n, 1, 'cookie in key');
+
+# responses with cookies or private ones are not shared
+
+@s = map { get('/setcookie', start => 1) } (1 .. 2);
+%n = map { request_num(http_end($_)) => 1 } @s;
+
+is(keys %n, 2, 'set-cookie');
+
+@s = map { get('/private', start => 1) } (1 .. 2);
+%n = map { request_num(http_end($_)) => 1 } @s;
+
+is(keys %n, 2, 'private');
+
+# response body is passed to all requests as it is received
+
+my $body = join '', map { sprintf "%05d%s\n", $_, 'X' x 1018 } (1 .. 200);
+
+@s = map { get('/stream', start => 1) } (1 .. 3);
+
+is(scalar(grep { http_content(http_end($_)) =~ /\n\Q$body\E$/ } @s), 3,
+	'stream');
+
+@s = map { get('/unbuffered/stream', start => 1) } (1 .. 3);
+
+is(scalar(grep { http_content(http_end($_)) =~ /\n\Q$body\E$/ } @s), 3,
+	'stream unbuffered');
+
+# waiting request is passed to upstream if the leading one goes away
+
+@s = (get('/abort', start => 1), get('/abort', start => 1));
+select undef, undef, undef, 0.2;
+close $s[0];
+
+like(http_end($s[1]), qr/200 OK.*request/s, 'leader closed');
+
+# ... or waiting requests go away
+
+@s = map { get('/abort2', start => 1) } (1 .. 3);
+select undef, undef, undef, 0.2;
+close $s[1];
+
+%n = map { request_num(http_end($_)) => 1 } @s[0, 2];
+
+is(keys %n, 1, 'waiter closed');
+
+# upstream errors are passed to all requests
+
+@s = map { get('/timeout/par', start => 1) } (1 .. 2);
+
+is(scalar(grep { http_end($_) =~ /^HTTP\/1.1 504/ } @s), 2, 'timeout');
+
+# upstream status in waiting requests
+
+$t->stop();
+
+my $log = $t->read_file('status.log');
+
+like($log, qr!^/par:200:200$!m, 'log waiting');
+is(() = $log =~ m!^/par:200:200$!mg, 4, 'log all');
+like($log, qr!^/abort:200:200$!m, 'log promoted');
+like($log, qr!^/timeout/par:504:504$!m, 'log timeout');
+like($log, qr!^/timeout/par:504:-$!m, 'log timeout waiting');
+
+###############################################################################
+
+sub get {
+	my ($uri, %extra) = @_;
+	my $cookie = delete $extra{cookie};
+	$cookie = defined $cookie ? "Cookie: $cookie\n" : '';
+	return http(<<EOF, %extra);
+GET $uri HTTP/1.1
+Host: localhost
+Connection: close
+$cookie
+EOF
+}
+
+sub request_num {
+	my ($r) = @_;
+	return $r =~ /request (\d+)/ ? $1 : $r;
+}
+
+###############################################################################
+
+sub http_fake_daemon {
+	my $server = IO::Socket::INET->new(
+		Proto => 'tcp',
+		LocalAddr => '127.0.0.1:' . port(8081),
+		Listen => 5,
+		Reuse => 1
+	)
+		or die "Can't create listening socket: $!\n";
+
+	local $SIG{PIPE} = 'IGNORE';
+
+	my $num = 0;
+
+	while (my $client = $server->accept()) {
+		$client->autoflush(1);
+
+		my $uri = '';
+
+		while (<$client>) {
+			$uri = $1 if /^\w+ (.*) HTTP/;
+			last if /^\x0d?\x0a?$/;
+		}
+
+		next unless $uri;
+
+		$num++;
+
+		select undef, undef, undef, 1.1;
+
+		my $extra = '';
+		$extra = "Set-Cookie: s=$num\n" if $uri eq '/setcookie';
+		$extra = "Cache-Control: private\n" if $uri eq '/private';
+
+		print $client <<"EOF";
+HTTP/1.1 200 OK
+X-Num: $num
+${extra}Connection: close
+
+request $num
+EOF
+
+		next unless $uri eq '/stream';
+
+		for my $i (1 .. 200) {
+			print $client sprintf "%05d%s\n", $i, 'X' x 1018;
+			select undef, undef, undef, 0.005 unless $i % 20;
+		}
+	}
+}
+
+###############################################################################
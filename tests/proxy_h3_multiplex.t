@@ -0,0 +1,212 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for http proxy to http3 backend, multiplexed connections.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx qw/ :DEFAULT http_end /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has(qw/http proxy http_v3/)
+	->has_daemon("openssl")->plan(15);
+
+$t->prepare_ssl();
+
+$t->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    server {
+        listen       127.0.0.1:8080;
+        server_name  localhost;
+
+        proxy_http_version     3;
+        proxy_http3_multiplex  on;
+
+        location / {
+            proxy_pass https://127.0.0.1:%%PORT_8981_UDP%%;
+        }
+
+        location /other/ {
+            proxy_pass https://127.0.0.1:%%PORT_8981_UDP%%/;
+        }
+
+        location /single/ {
+            proxy_pass https://127.0.0.1:%%PORT_8981_UDP%%;
+            proxy_http3_multiplex_streams 1;
+        }
+
+        location /timeout/ {
+            proxy_pass https://127.0.0.1:%%PORT_8981_UDP%%/;
+            proxy_http3_multiplex_timeout 1s;
+        }
+
+        location /off/ {
+            proxy_pass https://127.0.0.1:%%PORT_8981_UDP%%/;
+            proxy_http3_multiplex off;
+        }
+
+        location /limited/ {
+            proxy_pass https://127.0.0.1:%%PORT_8982_UDP%%/;
+        }
+
+        location /goaway/ {
+            proxy_pass https://127.0.0.1:%%PORT_8983_UDP%%/;
+        }
+    }
+
+    server {
+        listen       127.0.0.1:%%PORT_8981_UDP%% quic;
+        server_name  localhost;
+
+        ssl_certificate     localhost.crt;
+        ssl_certificate_key localhost.key;
+
+        add_header X-Conn $quic_connection always;
+
+        location / {
+            root %%TESTDIR%%;
+        }
+
+        location /slow {
+            alias %%TESTDIR%%/t;
+            limit_rate 8k;
+        }
+
+        location /single/ {
+            alias %%TESTDIR%%/;
+            limit_rate 8k;
+        }
+    }
+
+    server {
+        listen       127.0.0.1:%%PORT_8982_UDP%% quic;
+        server_name  localhost;
+
+        ssl_certificate     localhost.crt;
+        ssl_certificate_key localhost.key;
+
+        http3_max_concurrent_streams 1;
+
+        add_header X-Conn $quic_connection always;
+
+        location / {
+            root %%TESTDIR%%;
+            limit_rate 8k;
+        }
+    }
+
+    server {
+        listen       127.0.0.1:%%PORT_8983_UDP%% quic;
+        server_name  localhost;
+
+        ssl_certificate     localhost.crt;
+        ssl_certificate_key localhost.key;
+
+        keepalive_requests 2;
+
+        add_header X-Conn $quic_connection always;
+
+        location / {
+            root %%TESTDIR%%;
+        }
+    }
+}
+
+EOF
+
+$t->write_file('t', 'x' x 16384);
+$t->run();
+
+###############################################################################
+
+my $r = http_get('/t');
+like($r, qr/200 OK.*x{16384}$/s, 'request');
+
+my $conn = conn($r);
+
+is(conn(http_get('/t')), $conn, 'connection reused');
+is(conn(http_get('/other/t')), $conn, 'connection reused in other location');
+
+# concurrent requests share the connection
+
+my @s = map { http_get('/slow', start => 1) } 1 .. 4;
+my @r = map { http_end($_) } @s;
+
+is(scalar(grep { /x{16384}$/ } @r), 4, 'concurrent requests');
+is(scalar(grep { conn($_) eq $conn } @r), 4, 'concurrent requests multiplexed');
+
+# streams are limited by proxy_http3_multiplex_streams
+
+@s = map { http_get('/single/t', start => 1) } 1 .. 3;
+@r = map { http_end($_) } @s;
+
+is(scalar(grep { /x{16384}$/ } @r), 3, 'streams limit');
+is(scalar(uniq(map { conn($_) } @r)), 3, 'streams limit - connections');
+
+# streams are limited by the peer
+
+@s = map { http_get('/limited/t', start => 1) } 1 .. 2;
+@r = map { http_end($_) } @s;
+
+is(scalar(grep { /x{16384}$/ } @r), 2, 'peer streams limit');
+is(scalar(uniq(map { conn($_) } @r)), 2, 'peer streams limit - connections');
+
+# idle connections are closed after proxy_http3_multiplex_timeout
+
+$conn = conn(http_get('/timeout/t'));
+select undef, undef, undef, 2.1;
+isnt(conn(http_get('/timeout/t')), $conn, 'multiplex timeout');
+
+# no new streams after GOAWAY from the peer
+
+$conn = conn(http_get('/goaway/t'));
+is(conn(http_get('/goaway/t')), $conn, 'goaway - connection reused');
+
+$r = http_get('/goaway/t');
+like($r, qr/200 OK.*x{16384}$/s, 'goaway - request');
+isnt(conn($r), $conn, 'goaway - new connection');
+
+# no multiplexing
+
+$conn = conn(http_get('/off/t'));
+$r = http_get('/off/t');
+like($r, qr/200 OK.*x{16384}$/s, 'multiplexing off - request');
+isnt(conn($r), $conn, 'multiplexing off');
+
+###############################################################################
+
+sub conn {
+	my ($r) = @_;
+	return '' unless defined $r;
+	return $r =~ /x-conn: (\d+)/i ? $1 : '';
+}
+
+sub uniq {
+	my %seen;
+	return grep { !$seen{$_}++ } @_;
+}
+
+###############################################################################
@@ -0,0 +1,117 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for http proxy to http3 backend, multiplexed connections with SSL.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has(qw/http proxy http_v3/)
+	->has_daemon('openssl');
+
+$t->write_file_expand('nginx.conf', <<'EOF')->plan(5);
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    server {
+        listen       127.0.0.1:8080;
+        server_name  localhost;
+
+        location / {
+            proxy_pass https://127.0.0.1:%%PORT_8981_UDP%%;
+            proxy_http_version     3;
+            proxy_http3_multiplex  on;
+
+            proxy_ssl_name $arg_name;
+            proxy_ssl_verify on;
+            proxy_ssl_trusted_certificate localhost.crt;
+        }
+    }
+
+    server {
+        listen       127.0.0.1:%%PORT_8981_UDP%% quic;
+        server_name  localhost;
+
+        ssl_certificate_key localhost.key;
+        ssl_certificate localhost.crt;
+
+        add_header X-Conn $quic_connection always;
+
+        location / {
+            root %%TESTDIR%%;
+        }
+    }
+}
+
+EOF
+
+$t->write_file('openssl.conf', <<EOF);
+[ req ]
+default_bits = 2048
+encrypt_key = no
+distinguished_name = req_distinguished_name
+[ req_distinguished_name ]
+EOF
+
+my $d = $t->testdir();
+
+foreach my $name ('localhost') {
+	system('openssl req -x509 -new '
+		. "-config $d/openssl.conf -subj /CN=$name/ "
+		. "-out $d/$name.crt -keyout $d/$name.key "
+		. ">>$d/openssl.out 2>&1") == 0
+		or die "Can't create certificate for $name: $!\n";
+}
+
+$t->write_file('t', 'SEE-THIS');
+$t->run();
+
+###############################################################################
+
+my $r = http_get('/t?name=localhost');
+like($r, qr/200 OK.*SEE-THIS$/s, 'verified');
+
+my $conn = conn($r);
+
+is(conn(http_get('/t?name=localhost')), $conn, 'same name multiplexed');
+
+# a session verified for another name is not used
+
+like(http_get('/t?name=example.com'), qr/502 Bad/, 'other name not verified');
+
+$r = http_get('/t?name=localhost');
+like($r, qr/SEE-THIS$/, 'verified again');
+is(conn($r), $conn, 'verified again multiplexed');
+
+###############################################################################
+
+sub conn {
+	my ($r) = @_;
+	return '' unless defined $r;
+	return $r =~ /x-conn: (\d+)/i ? $1 : '';
+}
+
+###############################################################################
@@ -0,0 +1,173 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for RSA private key operations offloaded to thread pools.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx;
+use Test::Nginx::Stream qw/ stream /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()
+	->has(qw/http http_ssl rewrite stream stream_ssl stream_return/)
+	->has(qw/socket_ssl/)->has_daemon('openssl');
+
+$t->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+thread_pool keys threads=2;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    ssl_certificate_key localhost.key;
+    ssl_certificate localhost.crt;
+
+    ssl_async_keys threads=keys;
+
+    server {
+        listen       127.0.0.1:8443 ssl;
+        server_name  localhost;
+
+        ssl_protocols TLSv1.2;
+
+        location / {
+            return 200 "body $ssl_protocol $ssl_cipher";
+        }
+    }
+
+    server {
+        listen       127.0.0.1:8444 ssl;
+        server_name  localhost;
+
+        location / {
+            return 200 "body $ssl_protocol";
+        }
+    }
+
+    server {
+        listen       127.0.0.1:8445 ssl;
+        server_name  localhost;
+
+        ssl_async_keys off;
+
+        location / {
+            return 200 "body $ssl_protocol";
+        }
+    }
+}
+
+stream {
+    %%TEST_GLOBALS_STREAM%%
+
+    server {
+        listen       127.0.0.1:8446 ssl;
+
+        ssl_certificate_key localhost.key;
+        ssl_certificate localhost.crt;
+
+        ssl_async_keys threads;
+
+        return "stream $ssl_protocol";
+    }
+}
+
+EOF
+
+$t->write_file('openssl.conf', <<EOF);
+[ req ]
+default_bits = 2048
+encrypt_key = no
+distinguished_name = req_distinguished_name
+[ req_distinguished_name ]
+EOF
+
+my $d = $t->testdir();
+
+foreach my $name ('localhost') {
+	system('openssl req -x509 -new '
+		. "-config $d/openssl.conf -subj /CN=$name/ "
+		. "-out $d/$name.crt -keyout $d/$name.key "
+		. ">>$d/openssl.out 2>&1") == 0
+		or die "Can't create certificate for $name: $!\n";
+}
+
+$t->try_run('no ssl_async_keys')->plan(6);
+
+###############################################################################
+
+like(get(8443), qr/^body TLSv1.2 ECDHE/m, 'handshake TLSv1.2');
+like(get(8444), qr/^body TLS/m, 'handshake default');
+like(get(8445), qr/^body TLS/m, 'handshake async off');
+
+like(stream('127.0.0.1:' . port(8446), SSL => 1)->read(),
+	qr/^stream TLS/, 'stream handshake');
+
+# concurrent handshakes are served by the thread pool
+
+my @s = map {
+	http_get('/', PeerAddr => '127.0.0.1:' . port(8444), SSL => 1,
+		start => 1)
+} 1 .. 10;
+
+is(scalar(grep { defined $_ } @s), 10, 'concurrent handshakes');
+
+# connections closed in the middle of the handshake
+
+for (1 .. 10) {
+	my $s = IO::Socket::INET->new('127.0.0.1:' . port(8444)) or next;
+	$s->syswrite(client_hello());
+	close $s;
+}
+
+like(get(8444), qr/^body TLS/m, 'handshake after aborted');
+
+###############################################################################
+
+sub get {
+	my ($port) = @_;
+	return http_get('/', PeerAddr => '127.0.0.1:' . port($port), SSL => 1);
+}
+
+sub client_hello {
+	# TLSv1.2 ClientHello with an RSA signature algorithm
+
+	my $ciphers = pack('n*', 0xc02f, 0xc030);
+	my $sigalgs = pack('n*', 0x0401);
+	my $groups = pack('n*', 0x0017);
+
+	my $ext = pack('nnn', 0x000d, length($sigalgs) + 2, length($sigalgs))
+		. $sigalgs
+		. pack('nnn', 0x000a, length($groups) + 2, length($groups))
+		. $groups;
+
+	my $body = pack('n', 0x0303) . ("\x00" x 32) . "\x00"
+		. pack('n', length($ciphers)) . $ciphers . "\x01\x00"
+		. pack('n', length($ext)) . $ext;
+
+	my $hs = "\x01" . substr(pack('N', length($body)), 1) . $body;
+
+	return "\x16\x03\x01" . pack('n', length($hs)) . $hs;
+}
+
+###############################################################################
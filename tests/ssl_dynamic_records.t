@@ -0,0 +1,110 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for dynamic TLS record sizing and certificate compression.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has(qw/http http_ssl socket_ssl/)
+	->has_daemon('openssl');
+
+$t->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    ssl_certificate_key localhost.key;
+    ssl_certificate localhost.crt;
+
+    sendfile off;
+
+    server {
+        listen       127.0.0.1:8443 ssl;
+        server_name  localhost;
+
+        ssl_dynamic_records on threshold=16k timeout=100ms;
+        ssl_certificate_compression zlib;
+    }
+
+    server {
+        listen       127.0.0.1:8444 ssl;
+        server_name  localhost;
+
+        ssl_buffer_size 4k;
+        ssl_dynamic_records on size=1000;
+    }
+}
+
+EOF
+
+$t->write_file('openssl.conf', <<EOF);
+[ req ]
+default_bits = 2048
+encrypt_key = no
+distinguished_name = req_distinguished_name
+[ req_distinguished_name ]
+EOF
+
+my $d = $t->testdir();
+
+foreach my $name ('localhost') {
+	system('openssl req -x509 -new '
+		. "-config $d/openssl.conf -subj /CN=$name/ "
+		. "-out $d/$name.crt -keyout $d/$name.key "
+		. ">>$d/openssl.out 2>&1") == 0
+		or die "Can't create certificate for $name: $!\n";
+}
+
+$t->write_file('small.html', 'SMALL');
+$t->write_file('big.html',
+	join('', map { sprintf "X%06dXXXX", $_ } (1 .. 50000)));
+
+$t->run()->plan(3);
+
+###############################################################################
+
+like(get('/small.html', 8443), qr/^SMALL$/m, 'small response');
+is(body(get('/big.html', 8443)), $t->read_file('big.html'), 'big response');
+
+# records smaller than the buffer size
+
+is(body(get('/big.html', 8444)), $t->read_file('big.html'),
+	'big response, small buffer');
+
+###############################################################################
+
+sub get {
+	my ($uri, $port) = @_;
+	return http_get($uri, PeerAddr => '127.0.0.1:' . port($port), SSL => 1);
+}
+
+sub body {
+	my ($r) = @_;
+	return '' unless defined $r;
+	return ($r =~ /\x0d\x0a\x0d\x0a(.*)/s)[0] // '';
+}
+
+###############################################################################
@@ -0,0 +1,129 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for kernel TLS offload.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx;
+use Test::Utils qw/ get_json /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()
+	->has(qw/http http_ssl http_api rewrite socket_ssl/)
+	->has_daemon('openssl');
+
+$t->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    ssl_certificate_key localhost.key;
+    ssl_certificate localhost.crt;
+
+    sendfile on;
+
+    server {
+        listen       127.0.0.1:8443 ssl;
+        server_name  localhost;
+
+        status_zone  ktls;
+
+        ssl_ktls on;
+
+        location /ktls {
+            return 200 "ktls:$ssl_ktls";
+        }
+    }
+
+    server {
+        listen       127.0.0.1:8444 ssl;
+        server_name  localhost;
+
+        location / {
+            return 200 "ktls:$ssl_ktls";
+        }
+    }
+
+    server {
+        listen       127.0.0.1:8080;
+        server_name  localhost;
+
+        location /api/ {
+            api /status/http/server_zones/ktls/ssl/;
+        }
+    }
+}
+
+EOF
+
+$t->write_file('openssl.conf', <<EOF);
+[ req ]
+default_bits = 2048
+encrypt_key = no
+distinguished_name = req_distinguished_name
+[ req_distinguished_name ]
+EOF
+
+my $d = $t->testdir();
+
+foreach my $name ('localhost') {
+	system('openssl req -x509 -new '
+		. "-config $d/openssl.conf -subj /CN=$name/ "
+		. "-out $d/$name.crt -keyout $d/$name.key "
+		. ">>$d/openssl.out 2>&1") == 0
+		or die "Can't create certificate for $name: $!\n";
+}
+
+$t->write_file('big.html',
+	join('', map { sprintf "X%06dXXXX", $_ } (1 .. 100000)));
+
+$t->run()->plan(5);
+
+###############################################################################
+
+my $r = get('/ktls', 8443);
+my ($ktls) = $r =~ /ktls:(\S*)/;
+
+like($r, qr/ktls:(tx|rx|tx,rx)?$/m, 'ktls variable');
+like(get('/', 8444), qr/ktls:$/m, 'ktls disabled');
+
+# file body is sent with SSL_sendfile() if kernel TLS is enabled
+
+$r = get('/big.html', 8443);
+
+like($r, qr/X100000XXXX$/, 'file body');
+is(length(($r =~ /\x0d\x0a\x0d\x0a(.*)/s)[0] // ''), 1100000, 'file length');
+
+my $j = get_json('/api/');
+
+is($j->{ktls}, $ktls ? 2 : 0, 'ktls counter');
+
+###############################################################################
+
+sub get {
+	my ($uri, $port) = @_;
+	return http_get($uri, PeerAddr => '127.0.0.1:' . port($port), SSL => 1);
+}
+
+###############################################################################
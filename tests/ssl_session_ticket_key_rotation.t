@@ -0,0 +1,163 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for scheduled rotation of shared SSL session ticket keys.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx qw/ :DEFAULT http_end /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+eval { require Net::SSLeay; die if $Net::SSLeay::VERSION < 1.86; };
+plan(skip_all => 'Net::SSLeay version => 1.86 required') if $@;
+eval { require IO::Socket::SSL; die if $IO::Socket::SSL::VERSION < 2.030; };
+plan(skip_all => 'IO::Socket::SSL version => 2.030 required') if $@;
+
+my $t = Test::Nginx->new()->has(qw/http http_ssl tickets socket_ssl/)
+	->has_daemon('openssl');
+
+$t->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+worker_processes 2;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    ssl_certificate_key localhost.key;
+    ssl_certificate localhost.crt;
+
+    ssl_protocols TLSv1.2;
+
+    add_header X-SSL-Reused $ssl_session_reused;
+
+    server {
+        listen       127.0.0.1:8443 ssl;
+        server_name  localhost;
+
+        ssl_session_cache shared:SSL:1m:file=%%TESTDIR%%/ssl.zone;
+        ssl_session_ticket_key_rotation 2s keep=1;
+    }
+}
+
+EOF
+
+$t->write_file('openssl.conf', <<EOF);
+[ req ]
+default_bits = 2048
+encrypt_key = no
+distinguished_name = req_distinguished_name
+[ req_distinguished_name ]
+EOF
+
+my $d = $t->testdir();
+
+foreach my $name ('localhost') {
+	system('openssl req -x509 -new '
+		. "-config $d/openssl.conf -subj /CN=$name/ "
+		. "-out $d/$name.crt -keyout $d/$name.key "
+		. ">>$d/openssl.out 2>&1") == 0
+		or die "Can't create certificate for $name: $!\n";
+}
+
+$t->write_file('index.html', '');
+
+$t->try_run('no persistent zones')->plan(6);
+
+###############################################################################
+
+my $old = IO::Socket::SSL::Session_Cache->new(100);
+my $prev = IO::Socket::SSL::Session_Cache->new(100);
+
+my $key = get_ticket_key_name($old);
+get_ticket_key_name($prev);
+
+select undef, undef, undef, 0.5;
+is(get_ticket_key_name(), $key, 'ticket key match');
+
+select undef, undef, undef, 2.5;
+
+my $next = get_ticket_key_name();
+cmp_ok($next, 'ne', $key, 'ticket key rotated');
+like(get($prev), qr/X-SSL-Reused: r/, 'previous key decrypts');
+
+select undef, undef, undef, 2.5;
+
+cmp_ok(get_ticket_key_name(), 'ne', $next, 'ticket key rotated again');
+unlike(get($old), qr/X-SSL-Reused: r/, 'old key dropped');
+
+# ticket keys are saved with the zone and survive restart
+
+my $saved = IO::Socket::SSL::Session_Cache->new(100);
+get_ticket_key_name($saved);
+
+$t->stop();
+$t->run();
+
+like(get($saved), qr/X-SSL-Reused: r/, 'ticket key restored');
+
+###############################################################################
+
+sub get {
+	my ($cache) = @_;
+
+	return http_get(
+		'/',
+		SSL => 1,
+		SSL_session_cache => $cache,
+		SSL_session_key => 1
+	);
+}
+
+sub get_ticket_key_name {
+	my $asn = get_ssl_session(@_);
+	my $any = qr/[\x00-\xff]/;
+next:
+	# tag(10) | len{2} | OCTETSTRING(4) | len{2} | ticket(key_name|..)
+	$asn =~ /\xaa\x81($any)\x04\x81($any)($any{16})/g;
+	return '' if !defined $3;
+	goto next if unpack("C", $1) - unpack("C", $2) != 3;
+	my $key = unpack "H*", $3;
+	Test::Nginx::log_core('||', "ticket key: $key");
+	return $key;
+}
+
+sub get_ssl_session {
+	my ($cache) = @_;
+
+	$cache = IO::Socket::SSL::Session_Cache->new(100) unless $cache;
+
+	my $s = http_get(
+		'/', start => 1,
+		SSL => 1,
+		SSL_session_cache => $cache,
+		SSL_session_key => 1
+	);
+
+	return unless $s;
+	http_end($s);
+
+	my $sess = $cache->get_session(1);
+	return '' unless defined $sess;
+	return Net::SSLeay::i2d_SSL_SESSION($sess);
+}
+
+###############################################################################
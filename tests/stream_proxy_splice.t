@@ -0,0 +1,147 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for stream proxy_splice directive.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+use IO::Select;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has(qw/stream/);
+
+$t->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+events {
+}
+
+stream {
+    %%TEST_GLOBALS_STREAM%%
+
+    log_format  bytes  '$bytes_received:$bytes_sent:$upstream_bytes_sent';
+
+    proxy_splice  on;
+
+    server {
+        listen      127.0.0.1:8080;
+        proxy_pass  127.0.0.1:8081;
+
+        proxy_half_close  on;
+
+        access_log  %%TESTDIR%%/bytes.log bytes;
+    }
+
+    server {
+        listen      127.0.0.1:8082;
+        proxy_pass  127.0.0.1:8081;
+
+        proxy_download_rate  40k;
+    }
+}
+
+EOF
+
+$t->try_run('no proxy_splice')->plan(7);
+
+###############################################################################
+
+my ($s, $u) = pair(8080, 8081);
+is(proxy($s, $u, 'SEE'), 'SEE', 'to upstream');
+is(proxy($u, $s, 'SAW'), 'SAW', 'to client');
+
+my $data = join('', map { sprintf "X%06dXXXX", $_ } (1 .. 100000));
+is(proxy($u, $s, $data), $data, 'big data');
+
+shutdown($u, 1);
+is(proxy($s, $u, 'SEE'), 'SEE', 'half close upstream');
+
+close $s;
+close $u;
+
+# rate limit
+
+($s, $u) = pair(8082, 8081);
+
+my $start = time();
+is(proxy($u, $s, 'X' x 80000), 'X' x 80000, 'rate limit data');
+cmp_ok(time() - $start, '>=', 1, 'rate limit');
+
+close $s;
+close $u;
+
+$t->stop();
+
+like($t->read_file('bytes.log'), qr/^6:1100003:6$/m, 'bytes');
+
+###############################################################################
+
+sub pair {
+	my ($server, $backend) = @_;
+
+	my $listen = IO::Socket::INET->new(
+		LocalHost => '127.0.0.1:' . port($backend),
+		Listen => 5,
+		Reuse => 1,
+	)
+		or die "Can't listen on $server: $!\n";
+
+	my $connect = IO::Socket::INET->new(
+		Proto => 'tcp',
+		PeerHost => '127.0.0.1:' . port($server),
+	)
+		or die "Can't connect to $server: $!\n";
+
+	my $accept = $listen->accept() if IO::Select->new($listen)->can_read(3);
+
+	return $connect, $accept;
+}
+
+sub proxy {
+	my ($from, $to, $msg) = @_;
+	my $buf = '';
+	my $len = length $msg;
+
+	local $SIG{PIPE} = 'IGNORE';
+
+	while (length($buf) < $len) {
+		my ($r, $w) = IO::Select->select(IO::Select->new($to),
+			length $msg ? IO::Select->new($from) : undef, undef, 5);
+
+		last unless defined $r;
+
+		if ($w && @$w) {
+			my $n = $from->syswrite($msg);
+			last unless $n;
+			$msg = substr($msg, $n);
+		}
+
+		if (@$r) {
+			my $n = $to->sysread($buf, 65536, length $buf);
+			last unless $n;
+		}
+	}
+
+	log_in(length($buf) > 100 ? length($buf) . ' bytes' : $buf);
+	return $buf;
+}
+
+###############################################################################
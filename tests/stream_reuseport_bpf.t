@@ -0,0 +1,73 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for reuseport_bpf, steering connections by CPU.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx;
+use Test::Nginx::Stream qw/ stream dgram /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has(qw/stream stream_return udp/);
+
+# all CPUs are assigned to the first worker
+
+my $mask = '1' x 64;
+
+$t->write_file_expand('nginx.conf', <<"EOF");
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+worker_processes     2;
+worker_cpu_affinity  $mask $mask;
+
+reuseport_bpf        on;
+
+events {
+}
+
+stream {
+    %%TEST_GLOBALS_STREAM%%
+
+    server {
+        listen  127.0.0.1:8080 reuseport;
+        listen  127.0.0.1:%%PORT_8980_UDP%% udp reuseport;
+
+        return  \$pid;
+    }
+}
+
+EOF
+
+$t->try_run('no reuseport_bpf');
+
+plan(skip_all => 'no bpf')
+	if $t->read_file('error.log') =~ /reuseport bpf failed/;
+
+$t->plan(2);
+
+###############################################################################
+
+my %pids = map { stream('127.0.0.1:' . port(8080))->read() => 1 } 1 .. 10;
+is(keys %pids, 1, 'tcp');
+
+%pids = map { dgram('127.0.0.1:' . port(8980))->io('.') => 1 } 1 .. 10;
+is(keys %pids, 1, 'udp');
+
+###############################################################################
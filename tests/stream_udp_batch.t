@@ -0,0 +1,119 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Stream tests for batched receiving and sending of UDP datagrams.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx;
+use Test::Nginx::Stream qw/ dgram /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has(qw/stream udp/);
+
+$t->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+events {
+}
+
+stream {
+    %%TEST_GLOBALS_STREAM%%
+
+    proxy_timeout  2100ms;
+
+    server {
+        listen           127.0.0.1:%%PORT_8980_UDP%% udp batch=16;
+        proxy_pass       127.0.0.1:%%PORT_8990_UDP%%;
+    }
+
+    server {
+        listen           127.0.0.1:%%PORT_8981_UDP%% udp batch=16;
+        proxy_pass       127.0.0.1:%%PORT_8990_UDP%%;
+
+        proxy_requests   1;
+    }
+}
+
+EOF
+
+$t->run_daemon(\&udp_daemon, $t, port(8990));
+$t->try_run('no batch')->plan(5);
+
+$t->waitforfile($t->testdir . '/' . port(8990));
+
+###############################################################################
+
+my @msgs = map { sprintf("%03d", $_) . 'X' x 100 } (1 .. 40);
+
+my @r = many(8980, @msgs);
+is(scalar @r, 40, 'datagrams');
+is(join(',', map { $_->[1] } @r), join(',', @msgs), 'datagrams order');
+is(scalar keys %{{ map { $_->[0] => 1 } @r }}, 1, 'single session');
+
+# datagrams of different sizes
+
+@msgs = map { sprintf("%03d", $_) . 'X' x ($_ % 5) } (1 .. 40);
+
+@r = many(8980, @msgs);
+is(join(',', map { $_->[1] } @r), join(',', @msgs), 'different sizes');
+
+# datagrams not read by a finished session start new ones
+
+@msgs = map { sprintf("%03d", $_) } (1 .. 10);
+
+@r = many(8981, @msgs);
+is(scalar keys %{{ map { $_->[0] => 1 } @r }}, 10, 'proxy_requests');
+
+###############################################################################
+
+sub many {
+	my ($port, @msgs) = @_;
+
+	my $s = dgram('127.0.0.1:' . port($port));
+
+	$s->write($_) for @msgs;
+
+	return map { [ $s->read() =~ /^(\d+) (.*)/ ] } 1 .. @msgs;
+}
+
+###############################################################################
+
+sub udp_daemon {
+	my ($t, $port) = @_;
+
+	my $server = IO::Socket::INET->new(
+		Proto => 'udp',
+		LocalAddr => "127.0.0.1:$port",
+		Reuse => 1
+	)
+		or die "Can't create listening socket: $!\n";
+
+	# signal we are ready
+
+	open my $fh, '>', $t->testdir() . "/$port";
+	close $fh;
+
+	while (1) {
+		$server->recv(my $buffer, 65536);
+		$server->send($server->peerport() . ' ' . $buffer);
+	}
+}
+
+###############################################################################
@@ -0,0 +1,229 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Stream tests for upstream keepalive module.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+use IO::Select;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx;
+use Test::Nginx::Stream qw/ stream /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has(qw/stream stream_upstream_keepalive/)
+	->plan(10)->write_file_expand('nginx.conf', <<'EOF');
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+events {
+}
+
+stream {
+    %%TEST_GLOBALS_STREAM%%
+
+    upstream u {
+        server 127.0.0.1:8081;
+        keepalive 2;
+    }
+
+    upstream short {
+        server 127.0.0.1:8081;
+        keepalive 2;
+        keepalive_timeout 500ms;
+    }
+
+    upstream two {
+        server 127.0.0.1:8081;
+        server 127.0.0.1:8084;
+        keepalive 1;
+    }
+
+    server {
+        listen      127.0.0.1:8080;
+        proxy_pass  u;
+
+        proxy_responses  1;
+    }
+
+    server {
+        listen      127.0.0.1:8082;
+        proxy_pass  u;
+    }
+
+    server {
+        listen      127.0.0.1:8083;
+        proxy_pass  short;
+
+        proxy_responses  1;
+    }
+
+    server {
+        listen      127.0.0.1:8085;
+        proxy_pass  two;
+
+        proxy_responses  1;
+    }
+
+    server {
+        listen      127.0.0.1:8086;
+        proxy_pass  u;
+
+        proxy_responses   1;
+        proxy_half_close  on;
+    }
+}
+
+EOF
+
+$t->run_daemon(\&stream_daemon, port(8081));
+$t->run_daemon(\&stream_daemon, port(8084));
+$t->run();
+
+$t->waitforsocket('127.0.0.1:' . port(8081));
+$t->waitforsocket('127.0.0.1:' . port(8084));
+
+###############################################################################
+
+my $id = get(8080, 'X');
+
+is(get(8080, 'X'), $id, 'keepalive');
+isnt(get(8082, 'X'), $id, 'no proxy_responses');
+is(get(8080, 'X'), $id, 'keepalive after');
+
+# connection closed by upstream while idle
+
+get(8080, 'close');
+isnt(get(8080, 'X'), $id, 'closed by upstream');
+
+# keepalive timeout
+
+$id = get(8083, 'X');
+select undef, undef, undef, 1;
+isnt(get(8083, 'X'), $id, 'keepalive timeout');
+
+# responses not yet received
+
+$id = get(8080, 'X');
+
+my $s = stream('127.0.0.1:' . port(8080));
+$s->write('w');
+select undef, undef, undef, 0.1;
+undef $s;
+
+select undef, undef, undef, 0.6;
+isnt(get(8080, 'X'), $id, 'no keepalive without response');
+
+# a response split into several reads
+
+$id = get(8080, 'split', 2);
+isnt(get(8080, 'X'), $id, 'no keepalive after split response');
+
+# connections are limited per peer
+
+my $id1 = get(8085, 'X');
+my $id2 = get(8085, 'X');
+
+is(get(8085, 'X'), $id1, 'keepalive per peer');
+is(get(8085, 'X'), $id2, 'keepalive per peer - second peer');
+
+# upstream socket shut down for writing
+
+$id = get(8086, 'X');
+isnt(get(8086, 'X'), $id, 'no keepalive after half close');
+
+###############################################################################
+
+sub get {
+	my ($port, $data, $read) = @_;
+
+	my $r = stream('127.0.0.1:' . port($port))->io($data, read => $read || 1);
+
+	# let the session be finalized
+
+	select undef, undef, undef, 0.1;
+
+	return $r =~ /^(\d+):/ ? $1 : '';
+}
+
+###############################################################################
+
+sub stream_daemon {
+	my ($port) = @_;
+
+	my $server = IO::Socket::INET->new(
+		Proto => 'tcp',
+		LocalAddr => '127.0.0.1',
+		LocalPort => $port,
+		Listen => 5,
+		Reuse => 1
+	)
+		or die "Can't create listening socket: $!\n";
+
+	my $sel = IO::Select->new($server);
+
+	local $SIG{PIPE} = 'IGNORE';
+
+	while (my @ready = $sel->can_read) {
+		foreach my $fh (@ready) {
+			if ($server == $fh) {
+				my $new = $fh->accept;
+				$new->autoflush(1);
+				$sel->add($new);
+
+			} elsif (stream_handle_client($fh)) {
+				$sel->remove($fh);
+				$fh->close;
+			}
+		}
+	}
+}
+
+sub stream_handle_client {
+	my ($client) = @_;
+
+	log2c("(new connection $client)");
+
+	$client->sysread(my $buffer, 65536) or return 1;
+
+	log2i("$client $buffer");
+
+	if ($buffer =~ /w/) {
+		select undef, undef, undef, 0.5;
+	}
+
+	my $r = $client->peerport() . ":$buffer";
+
+	log2o("$client $r");
+
+	if ($buffer =~ /split/) {
+		$client->syswrite(substr($r, 0, 6));
+		select undef, undef, undef, 0.1;
+		$r = substr($r, 6);
+	}
+
+	$client->syswrite($r);
+
+	return $buffer =~ /close/ ? 1 : 0;
+}
+
+sub log2i { Test::Nginx::log_core('|| <<', @_); }
+sub log2o { Test::Nginx::log_core('|| >>', @_); }
+sub log2c { Test::Nginx::log_core('||', @_); }
+
+###############################################################################
@@ -0,0 +1,128 @@
+#!/usr/bin/perl
+
+# (C) 2026 Web Server LLC
+
+# Tests for sub_filter with many search patterns.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has(qw/http sub/)->plan(10);
+
+my $many = join "\n", map { "            sub_filter p${_}x <$_>;" } 1 .. 80;
+
+$t->write_file_expand('nginx.conf', <<"EOF");
+
+%%TEST_GLOBALS%%
+
+daemon off;
+
+events {
+}
+
+http {
+    %%TEST_GLOBALS_HTTP%%
+
+    server {
+        listen       127.0.0.1:8080;
+        server_name  localhost;
+
+        sendfile off;
+
+        sub_filter_types *;
+        sub_filter_once off;
+
+        location /many/ {
+            alias %%TESTDIR%%/;
+$many
+        }
+
+        location /small/ {
+            alias %%TESTDIR%%/;
+            output_buffers 1 3;
+$many
+        }
+
+        location /order/ {
+            alias %%TESTDIR%%/;
+            output_buffers 1 2;
+            sub_filter abcd 1;
+            sub_filter bc 2;
+            sub_filter ab 3;
+            sub_filter abcx 4;
+        }
+
+        location /once/ {
+            alias %%TESTDIR%%/;
+            output_buffers 1 2;
+            sub_filter_once on;
+            sub_filter abc 1;
+            sub_filter ab 2;
+            sub_filter b 3;
+        }
+
+        location /end/ {
+            alias %%TESTDIR%%/;
+            sub_filter abcdef 1;
+            sub_filter cd 2;
+        }
+    }
+}
+
+EOF
+
+$t->write_file('many', join ' ', map { "p${_}x P${_}X p$_" } 1 .. 80);
+$t->write_file('order', 'abcd bcx abcx abcab');
+$t->write_file('once', 'abc abc ab b');
+$t->write_file('end', 'abcd');
+$t->run();
+
+###############################################################################
+
+my $expect = join ' ', map { "<$_> <$_> p$_" } 1 .. 80;
+
+like(http_get('/many/many'), qr/\x0d\x0a\x0d\x0a\Q$expect\E$/,
+	'many patterns');
+like(http_get('/small/many'), qr/\x0d\x0a\x0d\x0a\Q$expect\E$/,
+	'many patterns, small buffers');
+
+# the leftmost match wins, then the first pattern configured
+
+like(http_get('/order/order'), qr/^1 2x 3cx 3c3$/m, 'leftmost first');
+
+# each pattern is replaced once, the rest are matched further
+
+like(http_get('/once/once'), qr/^1 2c a3 b$/m, 'once');
+
+# a match is complete at the end of data
+
+like(http_get('/end/end'), qr/^ab2$/m, 'end of data');
+
+like(http_get('/many/order'), qr/^abcd bcx abcx abcab$/m, 'no match');
+
+# matches across buffers
+
+$t->write_file('split', 'xp1' . 'y' x 5000 . 'p1xp' . 'z' x 10000 . 'p80');
+
+my $r = http_get('/small/split');
+like($r, qr/xp1y{5000}<1>pz/, 'split - match');
+like($r, qr/z{10000}p80$/, 'split - partial at end');
+unlike($r, qr/<80>/, 'split - no match');
+
+like(http_get('/many/split'), qr/y{5000}<1>pz{10000}p80$/, 'split - large');
+
+###############################################################################